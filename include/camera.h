@@ -36,6 +36,35 @@ esp_err_t camera_deinit(void);
  */
 camera_fb_t *camera_capture(void);
 
+#define CAMERA_FRESH_TIMEOUT_MS 2000    // Limit for camera_capture_fresh
+
+/**
+ * Freshness of a captured frame
+ */
+typedef struct {
+    uint32_t age_us;            // Time from the frame's VSYNC to return
+    uint32_t discarded;         // Stale frames dropped to get it
+} camera_capture_info_t;
+
+/**
+ * Start time of a frame (driver VSYNC timestamp, esp_timer microseconds)
+ */
+static inline int64_t camera_fb_time_us(const camera_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+/**
+ * Take a photo exposed after a given time
+ * Frames still queued from before not_before_us are returned to the driver
+ * until one that started later arrives, so the result is never a leftover
+ * from an idle period or a previous mode.
+ * @param not_before_us Earliest accepted frame start (esp_timer time, 0 = now)
+ * @param info Receives the frame age and discard count (may be NULL)
+ * @return Pointer to frame buffer (NULL on error or after CAMERA_FRESH_TIMEOUT_MS)
+ */
+camera_fb_t *camera_capture_fresh(int64_t not_before_us, camera_capture_info_t *info);
+
 /**
  * Free a frame buffer
  * @param fb Frame buffer to free
@@ -44,6 +73,8 @@ void camera_free_fb(camera_fb_t *fb);
 
 /**
  * Get a preview frame (lower resolution)
+ * Reprograms the sensor to QVGA and back; prefer preview_get_jpeg(),
+ * which leaves the sensor alone.
  * @return Pointer to frame buffer
  */
 camera_fb_t *camera_get_preview(void);
@@ -68,6 +99,58 @@ esp_err_t camera_set_framesize(framesize_t size);
  */
 esp_err_t camera_set_quality(uint8_t quality);
 
+// Auto exposure/gain/white balance settle detection
+#define CAMERA_SETTLE_TOLERANCE_PCT  5      // Max frame-to-frame change counted as stable
+#define CAMERA_SETTLE_STABLE_FRAMES  1      // Consecutive stable frame pairs required
+#define CAMERA_SETTLE_FALLBACK_FRAMES 3     // Frames dropped when 3A state is not readable
+#define CAMERA_SETTLE_TIMEOUT_MS     3000   // Per-shot limit (long dark exposures)
+#define CAMERA_WARMUP_TIMEOUT_MS     4000   // Limit at camera_init
+
+// Persisted 3A state (restored and written to the sensor at init)
+#define CAMERA_3A_MAX_AGE_SEC        (24 * 3600) // Older records are ignored
+#define CAMERA_3A_LUMA_TOLERANCE_PCT 15     // Luminance change treated as a new scene
+#define CAMERA_SEED_LATENCY_FRAMES   1      // Frames before seeded exposure applies
+
+/**
+ * Settle statistics since camera_init
+ */
+typedef struct {
+    uint32_t last_frames;       // Frames discarded by the last camera_wait_settled
+    uint32_t wake_frames;       // Frames discarded from init to the first saved shot
+    uint32_t stale;             // Stored states rejected because the scene changed
+    bool restored;              // 3A state was restored from NVS at init
+    bool wake_done;             // First shot after init has been saved
+} camera_settle_stats_t;
+
+/**
+ * Wait for auto exposure, gain and white balance to settle
+ * Drops frames until the sensor's exposure, gain and AWB gains change by at
+ * most CAMERA_SETTLE_TOLERANCE_PCT between CAMERA_SETTLE_STABLE_FRAMES + 1
+ * consecutive frames. Only frames exposed after the call are sampled, so
+ * stale frames left in the driver queue never count. Sensors without
+ * readable 3A registers drop CAMERA_SETTLE_FALLBACK_FRAMES frames instead.
+ * If a 3A state was stored for the current frame size, exposure and gain
+ * start from it and one frame at the stored luminance completes the wait.
+ * @param timeout_ms Give up after this long
+ * @param settle_ms Receives the time spent (may be NULL)
+ * @return ESP_OK when settled, ESP_ERR_TIMEOUT on timeout
+ */
+esp_err_t camera_wait_settled(uint32_t timeout_ms, uint32_t *settle_ms);
+
+/**
+ * Persist the last settled 3A state to NVS
+ * Call after a shot has been saved; the write is skipped while the scene
+ * holds steady. The next boot or deep-sleep wake restores it.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if nothing has settled
+ */
+esp_err_t camera_save_3a(void);
+
+/**
+ * Get settle statistics
+ * @param stats Receives the statistics
+ */
+void camera_get_settle_stats(camera_settle_stats_t *stats);
+
 /**
  * Get camera sensor information
  * @return Pointer to sensor descriptor
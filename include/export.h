@@ -0,0 +1,133 @@
+/**
+ * Session Export Header
+ * Streams a stored timelapse session as a single container file
+ */
+
+#ifndef __EXPORT_H
+#define __EXPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Directory holding timelapse frames (relative to SD root)
+#define EXPORT_SESSION_DIR   "timelapse"
+
+// Directory receiving exports written to SD
+#define EXPORT_OUTPUT_DIR    "export"
+
+// Staging buffer size; sink writes are always this size except the last
+#define EXPORT_BUF_SIZE      (16 * 1024)
+
+/**
+ * Output sink write callback
+ * @param ctx Sink context
+ * @param data Data to write
+ * @param len Data length
+ * @return ESP_OK on success
+ */
+typedef esp_err_t (*export_write_fn_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Output sink (HTTP response, SD file, ...)
+ */
+typedef struct {
+    export_write_fn_t write;    // Write callback
+    void *ctx;                  // Passed to write
+} export_sink_t;
+
+/**
+ * Buffered writer shared by the exporters
+ */
+typedef struct {
+    const export_sink_t *sink;  // Destination
+    uint8_t *buf;               // EXPORT_BUF_SIZE staging buffer
+    size_t used;                // Bytes pending in buf
+    uint64_t total;             // Bytes accepted so far
+    esp_err_t err;              // First sink error (sticky)
+} export_writer_t;
+
+/**
+ * Initialize a writer (allocates the staging buffer)
+ * @param w Writer
+ * @param sink Destination sink
+ * @return ESP_OK on success
+ */
+esp_err_t export_writer_init(export_writer_t *w, const export_sink_t *sink);
+
+/**
+ * Append data to the writer
+ * @return ESP_OK, or the first sink error
+ */
+esp_err_t export_writer_put(export_writer_t *w, const void *data, size_t len);
+
+/**
+ * Copy an open file into the writer without extra buffering
+ * @param w Writer
+ * @param f Source file
+ * @param len Bytes to copy
+ * @param crc If not NULL, running CRC-32 updated with the copied bytes
+ * @return ESP_OK on success
+ */
+esp_err_t export_writer_put_file(export_writer_t *w, FILE *f, size_t len, uint32_t *crc);
+
+/**
+ * Flush pending data and release the staging buffer
+ * @return ESP_OK, or the first sink error
+ */
+esp_err_t export_writer_finish(export_writer_t *w);
+
+/**
+ * Sink writing to an open FILE (ctx is the FILE *)
+ */
+esp_err_t export_file_sink_write(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Check whether a frame file belongs to a session
+ * @param name File name inside EXPORT_SESSION_DIR
+ * @param session Session name prefix (NULL or "" matches all frames)
+ * @return true if the file is a JPEG frame of the session
+ */
+bool export_is_session_frame(const char *name, const char *session);
+
+/**
+ * Stream a session as an MJPEG AVI (RIFF with idx1 index)
+ * Frames are wrapped without re-encoding, in on-disk order. Memory use is
+ * one EXPORT_BUF_SIZE buffer regardless of the number of frames.
+ * @param session Session name prefix (e.g. "TIMELAPSE_20261018")
+ * @param fps Playback frame rate
+ * @param sink Output sink
+ * @return ESP_OK on success
+ */
+esp_err_t avi_export_stream(const char *session, uint32_t fps, const export_sink_t *sink);
+
+/**
+ * Export a session as an MJPEG AVI file on the SD card
+ * @param session Session name prefix
+ * @param fps Playback frame rate
+ * @param path Output path (relative to SD root)
+ * @return ESP_OK on success
+ */
+esp_err_t avi_export_to_file(const char *session, uint32_t fps, const char *path);
+
+/**
+ * Stream a session as a store-only (uncompressed) ZIP archive
+ * CRCs are computed while streaming and written in data descriptors, so
+ * no temp file is used. The only per-file state is a 4-byte CRC kept for
+ * the central directory; ZIP64 records are emitted past 4 GB/65535 files.
+ * @param session Session name prefix (NULL or "" for all frames)
+ * @param sink Output sink
+ * @return ESP_OK on success
+ */
+esp_err_t zip_export_stream(const char *session, const export_sink_t *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __EXPORT_H
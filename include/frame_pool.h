@@ -0,0 +1,111 @@
+/**
+ * Shared Frame Pool Header
+ * Reference-counted frame handles on top of the camera driver, so one
+ * capture can be read by several consumers (SD writer, web, OLED, ...)
+ */
+
+#ifndef __FRAME_POOL_H
+#define __FRAME_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum number of live frames (DMA-backed plus detached copies)
+#define FRAME_POOL_SIZE      6
+
+/**
+ * Shared frame handle
+ * fb is read-only for consumers; the data stays valid until the holder
+ * releases its reference.
+ */
+typedef struct frame_ref {
+    camera_fb_t fb;             // Frame descriptor (buf is DMA or PSRAM)
+    camera_fb_t *dma_fb;        // Driver buffer, NULL once detached
+    uint32_t refs;              // Outstanding references
+    uint32_t seq;               // Capture sequence number
+    int64_t captured_us;        // esp_timer time of capture
+} frame_ref_t;
+
+/**
+ * Initialize the pool (called by camera_init)
+ * @param dma_slots Number of driver frame buffers (fb_count)
+ * @return ESP_OK on success
+ */
+esp_err_t frame_pool_init(size_t dma_slots);
+
+/**
+ * Capture a new frame
+ * @return Frame with one reference held by the caller (NULL on error)
+ */
+frame_ref_t *frame_pool_capture(void);
+
+/**
+ * Capture a frame exposed after a given time (see camera_capture_fresh)
+ * @param not_before_us Earliest accepted frame start (esp_timer time, 0 = now)
+ * @param info Receives the frame age and discard count (may be NULL)
+ * @return Frame with one reference held by the caller (NULL on error)
+ */
+frame_ref_t *frame_pool_capture_fresh(int64_t not_before_us, camera_capture_info_t *info);
+
+/**
+ * Get a recent frame, capturing only if none is young enough
+ * Concurrent callers share the same capture.
+ * @param max_age_ms Maximum accepted frame age (0 always captures)
+ * @return Frame with one reference held by the caller (NULL on error)
+ */
+frame_ref_t *frame_pool_get(uint32_t max_age_ms);
+
+/**
+ * Get the most recent frame without capturing
+ * @return Frame with one reference held by the caller, NULL if none
+ */
+frame_ref_t *frame_pool_latest(void);
+
+/**
+ * Keep the most recent frame alive after its last consumer releases it
+ * The retained frame is copied to PSRAM so its DMA slot is returned.
+ * @param keep true to retain the latest frame
+ */
+void frame_pool_keep_latest(bool keep);
+
+/**
+ * Take an additional reference
+ * @param frame Frame handle
+ * @return frame
+ */
+frame_ref_t *frame_ref_acquire(frame_ref_t *frame);
+
+/**
+ * Drop a reference; the DMA slot (or PSRAM copy) is freed with the last one
+ * @param frame Frame handle (NULL is ignored)
+ */
+void frame_ref_release(frame_ref_t *frame);
+
+/**
+ * Trade a shared reference for a private PSRAM copy
+ * For slow consumers: the caller's reference on frame is released, so the
+ * DMA slot is no longer held on its behalf.
+ * @param frame Frame handle (reference is consumed)
+ * @return Detached frame with one reference, NULL on error (the original
+ *         reference is still released)
+ */
+frame_ref_t *frame_ref_detach(frame_ref_t *frame);
+
+/**
+ * Age of a frame
+ * @return Milliseconds since capture
+ */
+uint32_t frame_ref_age_ms(const frame_ref_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FRAME_POOL_H
@@ -0,0 +1,80 @@
+/**
+ * Runtime Metrics Header
+ * Fixed-memory latency histograms and counters, exported in Prometheus
+ * text format
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAX_SERIES   32
+
+/**
+ * Metric families (one Prometheus metric name prefix each)
+ */
+typedef enum {
+    METRICS_FAMILY_HTTP,     // Per-URI handler metrics
+    METRICS_FAMILY_STAGE,    // Internal pipeline stages
+    METRICS_FAMILY_MAX
+} metrics_family_t;
+
+/**
+ * Built-in pipeline stages (always registered, ids are fixed)
+ */
+typedef enum {
+    METRICS_STAGE_CAPTURE = 0,   // camera_capture()
+    METRICS_STAGE_SD_WRITE,      // sdcard_write_file()
+    METRICS_STAGE_ENCODE,        // Software JPEG encode
+    METRICS_STAGE_SETTLE,        // camera_wait_settled() (error = timed out)
+    METRICS_STAGE_MAX
+} metrics_stage_t;
+
+typedef int metrics_id_t;
+
+/**
+ * Output callback for metrics_render
+ */
+typedef esp_err_t (*metrics_write_fn_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * Register a series
+ * Must be called before the series is recorded from other tasks.
+ * @param family Metric family
+ * @param labels Prometheus label list without braces, e.g. uri="/status"
+ *               (string must stay valid)
+ * @return Series id, or -1 when METRICS_MAX_SERIES is reached
+ */
+metrics_id_t metrics_register(metrics_family_t family, const char *labels);
+
+/**
+ * Record one observation
+ * Lock-free: each core updates its own cell with local interrupts masked.
+ * @param id Series id (ignored if invalid)
+ * @param elapsed_us Latency in microseconds
+ * @param bytes Payload bytes
+ * @param error true to count an error
+ */
+void metrics_record(metrics_id_t id, uint32_t elapsed_us, uint32_t bytes, bool error);
+
+/**
+ * Render all series in Prometheus text exposition format
+ * @param write Output callback
+ * @param ctx Callback context
+ * @return ESP_OK, or the first callback error
+ */
+esp_err_t metrics_render(metrics_write_fn_t write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __METRICS_H
@@ -243,6 +243,15 @@ void oled_show_message(const char *line1, const char *line2, const char *line3);
  */
 esp_err_t oled_show_preview(const uint8_t *jpeg_data, size_t jpeg_len);
 
+/**
+ * Display a JPEG stored on the SD card (grayscale thumbnail)
+ * Streams the file through the decoder and samples each band straight into
+ * the OLED frame, so memory use does not depend on the image resolution
+ * @param path File path (relative to SD root)
+ * @return ESP_OK on success
+ */
+esp_err_t oled_show_file(const char *path);
+
 /**
  * Display a grayscale buffer as dithered monochrome
  * @param gray_data Grayscale image data (8-bit per pixel)
@@ -6,6 +6,8 @@
 #define __SDCARD_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -56,6 +58,17 @@ bool sdcard_is_ready(void);
  */
 esp_err_t sdcard_write_file(const char *path, const uint8_t *data, size_t len);
 
+/**
+ * Write a captured frame to a file, tagging the SD trace points
+ * @param path File path (relative to SD root)
+ * @param data Data to write
+ * @param len Data length
+ * @param trace_frame Frame id for tracing (trace_frame_id)
+ * @return ESP_OK on success
+ */
+esp_err_t sdcard_write_frame(const char *path, const uint8_t *data, size_t len,
+                             uint32_t trace_frame);
+
 /**
  * Append data to a file
  * @param path File path
@@ -107,6 +120,33 @@ bool sdcard_exists(const char *path);
  */
 int sdcard_list_files(const char *path, char *buffer, size_t buffer_size);
 
+/**
+ * Directory iteration callback
+ * @param name Entry name (without directory)
+ * @param is_dir true for sub-directories
+ * @param ctx User context
+ * @return false to stop iterating
+ */
+typedef bool (*sdcard_dir_cb_t)(const char *name, bool is_dir, void *ctx);
+
+/**
+ * Iterate over a directory without buffering the listing
+ * Entries are visited in on-disk (creation) order.
+ * @param path Directory path (NULL or "" for root)
+ * @param cb Callback invoked per entry
+ * @param ctx User context
+ * @return ESP_OK on success
+ */
+esp_err_t sdcard_foreach_file(const char *path, sdcard_dir_cb_t cb, void *ctx);
+
+/**
+ * Open a file for streaming access
+ * @param path File path (relative to SD root)
+ * @param mode fopen() mode string
+ * @return FILE handle (NULL on error), close with fclose()
+ */
+FILE *sdcard_fopen(const char *path, const char *mode);
+
 /**
  * Get file size
  * @param path File path
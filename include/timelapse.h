@@ -79,6 +79,8 @@ typedef struct {
     float battery_voltage;      // Battery voltage (if monitoring)
     uint64_t start_time_sec;    // Session start epoch (seconds)
     uint64_t end_time_sec;      // Session end epoch (seconds, 0 if running)
+    uint32_t settle_ms;         // Exposure settle time of the last shot
+    uint32_t wake_frames;       // Frames discarded from boot/wake to the first shot
 } timelapse_status_t;
 
 /**
@@ -147,6 +149,14 @@ uint32_t timelapse_get_progress(void);
  */
 void timelapse_get_status(timelapse_status_t *status);
 
+/**
+ * Get status revision counter
+ * Incremented on every shot and state transition; cheap to poll, so callers
+ * can skip building a full status snapshot when nothing has changed.
+ * @return Current revision
+ */
+uint32_t timelapse_get_revision(void);
+
 /**
  * Save configuration to NVS
  * @return ESP_OK on success
@@ -0,0 +1,104 @@
+/**
+ * Frame Trace Header
+ * Per-frame timestamps from VSYNC to SD commit, kept in a fixed ring and
+ * exported as Chrome trace-event JSON
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tracing follows the camera driver's CONFIG_CAMERA_TRACE switch
+#if defined(CONFIG_CAMERA_TRACE) && CONFIG_CAMERA_TRACE
+#define TRACE_ENABLED 1
+#else
+#define TRACE_ENABLED 0
+#endif
+
+#define TRACE_RING_SIZE 256     // Records kept, power of two
+
+/**
+ * Trace points; instants mark a moment, spans cover an operation
+ */
+typedef enum {
+    TRACE_VSYNC = 0,    // Instant: frame started (driver)
+    TRACE_QUEUED,       // Instant: frame complete and queued (driver)
+    TRACE_TAKEN,        // Instant: frame handed to the application (driver)
+    TRACE_COPY,         // Span: frame copied out of its DMA buffer
+    TRACE_ENCODE,       // Span: software JPEG encode
+    TRACE_SD_OPEN,      // Span: fopen on the SD card
+    TRACE_SD_WRITE,     // Span: fwrite + fflush
+    TRACE_SD_CLOSE,     // Span: fclose
+    TRACE_COMMIT,       // Instant: shot counted in the timelapse status
+    TRACE_POINT_MAX
+} trace_point_t;
+
+/**
+ * Frame id used by all trace points: the driver's VSYNC timestamp (us since
+ * boot, low 32 bits), which every copy of the camera_fb_t carries along
+ */
+static inline uint32_t trace_frame_id(const camera_fb_t *fb)
+{
+    return (uint32_t)((uint64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec);
+}
+
+/**
+ * Install the camera driver trace callback
+ * Call after esp_camera_init(). No-op when tracing is disabled.
+ */
+void trace_init(void);
+
+/**
+ * Record one trace point
+ * Lock-free, safe from any task. Prefer the TRACE_* macros, which compile
+ * to nothing when tracing is disabled.
+ * @param point Trace point
+ * @param frame Frame id (trace_frame_id)
+ * @param start_us Start time (esp_timer_get_time)
+ * @param dur_us Duration for spans, 0 for instants
+ */
+void trace_record(trace_point_t point, uint32_t frame, int64_t start_us, uint32_t dur_us);
+
+/**
+ * Output callback for trace_render_chrome
+ */
+typedef esp_err_t (*trace_write_fn_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * Render the ring as Chrome trace-event JSON (chrome://tracing, Perfetto)
+ * Each frame gets its own track.
+ * @param write Output callback
+ * @param ctx Callback context
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED when tracing is disabled, or the
+ *         first callback error
+ */
+esp_err_t trace_render_chrome(trace_write_fn_t write, void *ctx);
+
+#if TRACE_ENABLED
+#define TRACE_POINT(point, frame) \
+    trace_record((point), (frame), esp_timer_get_time(), 0)
+#define TRACE_SPAN_BEGIN(var) \
+    int64_t var = esp_timer_get_time()
+#define TRACE_SPAN_END(point, frame, var) \
+    trace_record((point), (frame), (var), (uint32_t)(esp_timer_get_time() - (var)))
+#else
+#define TRACE_POINT(point, frame)           do { } while (0)
+#define TRACE_SPAN_BEGIN(var)               do { } while (0)
+#define TRACE_SPAN_END(point, frame, var)   do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TRACE_H
@@ -21,11 +21,40 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "esp_camera.h"
 #include "jpeg_decoder.h"
 
 typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t len);
 
+/**
+ * @brief Software JPEG encoder options
+ */
+typedef struct {
+    uint8_t quality;            /*!< JPEG quality of the resulting image (1-100) */
+    bool optimize_huffman;      /*!< Build Huffman tables for this image in a second pass: smaller file, more CPU
+                                     and memory for the quantized image until the end of the encode */
+    size_t target_size;         /*!< Size budget of the JPEG in bytes, 0 = off. The highest quality up to .quality
+                                     whose file fits is used; if none does, not even quality 1, the encode fails
+                                     and nothing is output. Needs 128 bytes per 8x8 block (PSRAM when available,
+                                     else internal RAM) until the end of the encode */
+} jpg_encode_config_t;
+
+#define JPG_ENCODE_CONFIG_DEFAULT() { \
+    .quality = 80, \
+    .optimize_huffman = false, \
+    .target_size = 0, \
+}
+
+/**
+ * @brief One segment of a JPEG kept in several buffers, see fmt2jpg_chunked()
+ */
+typedef struct jpg_chunk_t {
+    struct jpg_chunk_t *next;   /*!< Next segment, NULL for the last one */
+    uint8_t *buf;               /*!< JPEG bytes of this segment */
+    size_t len;                 /*!< Number of JPEG bytes in buf */
+} jpg_chunk_t;
+
 /**
  * @brief Convert image buffer to JPEG
  *
@@ -35,7 +64,8 @@ typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t
  * @param height    Height in pixels of the source image
  * @param format    Format of the source image
  * @param quality   JPEG quality of the resulting image
- * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param cp        Callback to be called to write the bytes of the output JPEG.
+ *                  It returns the number of bytes it took; fewer than len aborts the encode.
  * @param arg       Pointer to be passed to the callback
  *
  * @return true on success
@@ -67,7 +97,7 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
  *                  You MUST free the pointer once you are done with it.
  * @param out_len   Pointer to be populated with the length of the output buffer
  *
- * @return true on success
+ * @return true on success, false if the encode failed or the output did not fit in memory
  */
 bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len);
 
@@ -83,6 +113,128 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
  */
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to JPEG buffer with encoder options
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param config    Encoder options
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_config(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer with encoder options
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder options
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_config(camera_fb_t * fb, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Predict the size of the JPEG of an image at several qualities
+ *
+ * The image is converted and transformed once; each quality then only requantizes and
+ * entropy-codes the kept DCT coefficients (128 bytes per 8x8 block, in PSRAM when available,
+ * else internal RAM). The sizes are exact: fmt2jpg_config() with the same options and that quality
+ * produces a JPEG of that length.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param config    Encoder options; quality and target_size are ignored
+ * @param qualities Qualities (1-100) to predict the size for
+ * @param count     Number of qualities
+ * @param sizes     Array of count entries populated with the size in bytes at each quality
+ *
+ * @return true on success
+ */
+bool fmt2jpg_predict_size(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const uint8_t *qualities, size_t count, size_t *sizes);
+
+/**
+ * @brief Convert image buffer to JPEG kept in a list of buffers
+ *
+ * The output grows in segments of CONFIG_CAMERA_JPEG_CHUNK_SIZE bytes (PSRAM if
+ * internal RAM runs out), so large images need no single big allocation.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param config    Encoder options
+ * @param out       Pointer to be populated with the first segment.
+ *                  You MUST release the list with jpg_chunks_free() once you are done with it.
+ * @param out_len   Pointer to be populated with the total length of the JPEG
+ *
+ * @return true on success, false if the encode failed or a segment could not be allocated
+ */
+bool fmt2jpg_chunked(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_chunk_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG kept in a list of buffers
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder options
+ * @param out       Pointer to be populated with the first segment, release with jpg_chunks_free()
+ * @param out_len   Pointer to be populated with the total length of the JPEG
+ *
+ * @return true on success
+ */
+bool frame2jpg_chunked(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_chunk_t ** out, size_t * out_len);
+
+/**
+ * @brief Free a segment list returned by fmt2jpg_chunked() or frame2jpg_chunked()
+ *
+ * @param chunks    First segment, may be NULL
+ */
+void jpg_chunks_free(jpg_chunk_t *chunks);
+
+/**
+ * @brief Convert image buffer to JPEG written to a file while encoding
+ *
+ * The data is staged in a CONFIG_CAMERA_JPEG_FILE_CHUNK_SIZE buffer in DMA-capable
+ * RAM and written in whole chunks, so on a freshly opened SD card file every write
+ * but the last one covers whole sectors. The file is left open at its end.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param config    Encoder options
+ * @param file      File opened for writing
+ * @param out_len   Pointer to be populated with the number of bytes written, may be NULL
+ *
+ * @return true on success, false if the encode or a write failed (the file then holds a partial JPEG)
+ */
+bool fmt2jpg_file(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, FILE *file, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG written to a file while encoding
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder options
+ * @param file      File opened for writing
+ * @param out_len   Pointer to be populated with the number of bytes written, may be NULL
+ *
+ * @return true on success
+ */
+bool frame2jpg_file(camera_fb_t * fb, const jpg_encode_config_t *config, FILE *file, size_t * out_len);
+
 /**
  * @brief Convert image buffer to BMP buffer
  *
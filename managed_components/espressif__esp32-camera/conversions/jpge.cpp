@@ -9,6 +9,7 @@
 //                       Code review revealed method load_block_16_8_8() (used for the non-default H2V1 sampling mode to downsample chroma) somehow didn't get the rounding factor fix from v1.02.
 
 #include "jpge.h"
+#include "jpge_kernels.h"
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -36,13 +37,22 @@ namespace jpge {
         return NULL;
 #endif
     }
+    // Large buffers that are only streamed through: SPIRAM first, internal RAM stays for the MCU lines
+    static inline void *jpge_malloc_ext(size_t nSize) {
+#if ((CONFIG_SPIRAM || CONFIG_SPIRAM_SUPPORT) && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+        void * b = heap_caps_malloc(nSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if(b){
+            return b;
+        }
+#endif
+        return malloc(nSize);
+    }
     static inline void jpge_free(void *p) { free(p); }
 
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_RST0 = 0xD0, M_APP0 = 0xE0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
-    static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
     static const int16 s_std_lum_quant[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
     static const int16 s_std_croma_quant[64] = { 17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
     static const uint8 s_dc_lum_bits[17] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
@@ -70,14 +80,94 @@ namespace jpge {
 
     const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
 
-    static int32 m_last_quality = 0;
-    static int32 m_quantization_tables[2][64];
+    // Quantization tables in zigzag order and their reciprocals for the kernels, indexed luma, chroma
+    struct quant_tables {
+        int32 q[2][64];
+#if JPGE_KERNELS_VECTOR
+        quant_recip recip[2];
+#endif
+    };
+
+
+    // Huffman tables, indexed DC luma, DC chroma, AC luma, AC chroma
+    struct huffman_tables {
+        uint codes[4][256];
+        uint8 code_sizes[4][256];
+        uint8 bits[4][17];
+        uint8 val[4][256];
+    };
+
+    static huffman_tables m_std_huff;
+
+    // Two-pass state: symbol statistics, the tables built from them, and the
+    // quantized blocks of pass one kept for pass two
+    enum { COEF_CHUNK_SIZE = 32768 - 16 };
+    struct coef_chunk {
+        coef_chunk *next;
+        uint used;
+        uint8 data[COEF_CHUNK_SIZE];
+    };
+    struct two_pass_state {
+        uint32 counts[4][256];
+        huffman_tables tables;
+        coef_chunk *first, *last;
+        uint8 huff_size[257];
+        uint huff_code[257];
+    };
+
+    // Rate control state: the DCT coefficients of every block (natural order), kept to be
+    // requantized and coded at each trial quality, and the tables of the last one
+    enum { DCT_BLOCK_SIZE = 64 * sizeof(int16) };
+    struct rate_state {
+        quant_tables quant;
+        int quality;
+        coef_chunk *first, *last;
+    };
+
+    // Blocks of an MCU in coding order and their component, per subsampling mode
+    static const uint8 s_mcu_components[4][6] = { { 0 }, { 0, 1, 2 }, { 0, 0, 1, 2 }, { 0, 0, 0, 0, 1, 2 } };
+    static const uint8 s_mcu_blocks[4] = { 1, 3, 4, 6 };
+
+    // Room for size more bytes at the end of a chunk list, NULL when out of memory
+    static uint8 *chunk_reserve(coef_chunk **first, coef_chunk **last, uint size)
+    {
+        coef_chunk *chunk = *last;
+        if (!chunk || chunk->used + size > COEF_CHUNK_SIZE) {
+            coef_chunk *next = static_cast<coef_chunk*>(jpge_malloc_ext(sizeof(coef_chunk)));
+            if (!next) {
+                return NULL;
+            }
+            next->next = NULL;
+            next->used = 0;
+            if (chunk) {
+                chunk->next = next;
+            } else {
+                *first = next;
+            }
+            *last = chunk = next;
+        }
+        uint8 *p = chunk->data + chunk->used;
+        chunk->used += size;
+        return p;
+    }
 
-    static bool m_huff_initialized = false;
-    static uint m_huff_codes[4][256];
-    static uint8 m_huff_code_sizes[4][256];
-    static uint8 m_huff_bits[4][17];
-    static uint8 m_huff_val[4][256];
+    static void free_chunks(coef_chunk *chunk)
+    {
+        while (chunk) {
+            coef_chunk *next = chunk->next;
+            jpge_free(chunk);
+            chunk = next;
+        }
+    }
+
+    // Output stream that only counts the bytes, for trial encodes
+    class count_stream : public output_stream {
+        public:
+            uint m_size;
+            count_stream() : m_size(0) { }
+            virtual bool put_buf(const void *buf, int len) { m_size += len; return true; }
+            virtual uint get_size() const { return m_size; }
+    };
 
     static inline uint8 clamp(int i) {
         if (i < 0) {
@@ -88,12 +178,19 @@ namespace jpge {
         return static_cast<uint8>(i);
     }
 
+    static inline uint8 rgb_to_y(int r, int g, int b) {
+        return static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+    }
+
+    static inline void rgb_to_ycc(uint8* pDst, int r, int g, int b) {
+        pDst[0] = rgb_to_y(r, g, b);
+        pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+        pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+    }
+
     static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
         for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
-            const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+            rgb_to_ycc(pDst, pSrc[0], pSrc[1], pSrc[2]);
         }
     }
 
@@ -111,48 +208,69 @@ namespace jpge {
         }
     }
 
-    // Forward DCT - DCT derived from jfdctint.
-    enum { CONST_BITS = 13, ROW_BITS = 2 };
-#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
-#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
-#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
-    int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
-    int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
-    int32 u1 = DCT_MUL(t12 + t13, 4433); \
-    s2 = u1 + DCT_MUL(t13, 6270); \
-    s6 = u1 + DCT_MUL(t12, -15137); \
-    u1 = t4 + t7; \
-    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
-    int32 z5 = DCT_MUL(u3 + u4, 9633); \
-    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
-    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
-    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
-    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
-    u3 += z5; u4 += z5; \
-    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
-
-    static void DCT2D(int32 *p) {
-        int32 c, *q = p;
-        for (c = 7; c >= 0; c--, q += 8) {
-            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
-            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
-        }
-        for (q = p, c = 7; c >= 0; c--, q++) {
-            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
-            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+    // Camera pixel formats, converted straight into the YCbCr sample lines
+
+    static void BGR_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
+            rgb_to_ycc(pDst, pSrc[2], pSrc[1], pSrc[0]);
+        }
+    }
+
+    static void BGR_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
+            pDst[0] = rgb_to_y(pSrc[2], pSrc[1], pSrc[0]);
+        }
+    }
+
+    // Big-endian RGB565, expanded like the RGB888 conversion in to_bmp/to_jpg (low bits zero)
+    static void RGB565_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 2, num_pixels--) {
+            const int hi = pSrc[0], lo = pSrc[1];
+            rgb_to_ycc(pDst, hi & 0xF8, ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3), (lo & 0x1F) << 3);
+        }
+    }
+
+    static void RGB565_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            const int hi = pSrc[0], lo = pSrc[1];
+            pDst[0] = rgb_to_y(hi & 0xF8, ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3), (lo & 0x1F) << 3);
+        }
+    }
+
+    // BT.601 limited range (Y 16-235, CbCr 16-240) to the full range of JFIF
+    static uint8 m_y_full[256], m_c_full[256];
+
+    static void init_range_tables() {
+        for (int i = 0; i < 256; i++) {
+            int c = (i - 128) * 255;
+            m_y_full[i] = clamp(((i - 16) * 255 * 2 + 219) / (219 * 2));
+            m_c_full[i] = clamp(128 + (c >= 0 ? c + 112 : c - 112) / 224);
+        }
+    }
+
+    // Y0,U,Y1,V: each pixel pair shares its chroma, which the H2V1/H2V2 block loaders then
+    // average as they would for RGB input
+    static void YUV422_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels >= 2; pDst += 6, pSrc += 4, num_pixels -= 2) {
+            const uint8 u = m_c_full[pSrc[1]], v = m_c_full[pSrc[3]];
+            pDst[0] = m_y_full[pSrc[0]]; pDst[1] = u; pDst[2] = v;
+            pDst[3] = m_y_full[pSrc[2]]; pDst[4] = u; pDst[5] = v;
+        }
+        if (num_pixels) {
+            pDst[0] = m_y_full[pSrc[0]]; pDst[1] = m_c_full[pSrc[1]]; pDst[2] = 128;
+        }
+    }
+
+    static void YUV422_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = m_y_full[pSrc[0]];
         }
     }
 
     // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
-    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val)
+    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val, uint8 *huff_size, uint *huff_code)
     {
         int i, l, last_p, si;
-        static uint8 huff_size[257];
-        static uint huff_code[257];
         uint code;
 
         int p = 0;
@@ -183,6 +301,112 @@ namespace jpge {
         }
     }
 
+    // Standard Huffman tables and the YUV range tables, built once
+    static bool init_std_tables() {
+        init_range_tables();
+
+        static uint8 huff_size[257];
+        static uint huff_code[257];
+        huffman_tables *t = &m_std_huff;
+
+        memcpy(t->bits[0+0], s_dc_lum_bits, 17);    memcpy(t->val[0+0], s_dc_lum_val, DC_LUM_CODES);
+        memcpy(t->bits[2+0], s_ac_lum_bits, 17);    memcpy(t->val[2+0], s_ac_lum_val, AC_LUM_CODES);
+        memcpy(t->bits[0+1], s_dc_chroma_bits, 17); memcpy(t->val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
+        memcpy(t->bits[2+1], s_ac_chroma_bits, 17); memcpy(t->val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
+
+        compute_huffman_table(&t->codes[0+0][0], &t->code_sizes[0+0][0], t->bits[0+0], t->val[0+0], huff_size, huff_code);
+        compute_huffman_table(&t->codes[2+0][0], &t->code_sizes[2+0][0], t->bits[2+0], t->val[2+0], huff_size, huff_code);
+        compute_huffman_table(&t->codes[0+1][0], &t->code_sizes[0+1][0], t->bits[0+1], t->val[0+1], huff_size, huff_code);
+        compute_huffman_table(&t->codes[2+1][0], &t->code_sizes[2+1][0], t->bits[2+1], t->val[2+1], huff_size, huff_code);
+        return true;
+    }
+
+    // Code lengths (limited to 16 bits) and symbol order for the given symbol counts,
+    // per JPEG Annex K.2. Symbols that never occur get no code.
+    static void compute_optimal_table(uint8 *bits, uint8 *val, const uint32 *counts)
+    {
+        uint32 freq[257];
+        uint8 code_size[257];
+        int others[257];
+        uint8 len_count[MAX_HUFF_CODESIZE + 1];
+
+        memcpy(freq, counts, 256 * sizeof(freq[0]));
+        freq[256] = 1; // reserved, so no real code is all ones
+        memset(code_size, 0, sizeof(code_size));
+        memset(len_count, 0, sizeof(len_count));
+        for (int i = 0; i < 257; i++) {
+            others[i] = -1;
+        }
+
+        for (;;) {
+            // The two least frequent subtrees, ties going to the larger symbol
+            int c1 = -1, c2 = -1;
+            uint32 v1 = 0xFFFFFFFF, v2 = 0xFFFFFFFF;
+            for (int i = 0; i < 257; i++) {
+                if (freq[i] && freq[i] <= v1) {
+                    v1 = freq[i]; c1 = i;
+                }
+            }
+            for (int i = 0; i < 257; i++) {
+                if (freq[i] && freq[i] <= v2 && i != c1) {
+                    v2 = freq[i]; c2 = i;
+                }
+            }
+            if (c2 < 0) {
+                break;
+            }
+            freq[c1] += freq[c2];
+            freq[c2] = 0;
+            code_size[c1]++;
+            while (others[c1] >= 0) {
+                c1 = others[c1];
+                code_size[c1]++;
+            }
+            others[c1] = c2;
+            code_size[c2]++;
+            while (others[c2] >= 0) {
+                c2 = others[c2];
+                code_size[c2]++;
+            }
+        }
+
+        for (int i = 0; i < 257; i++) {
+            if (code_size[i]) {
+                len_count[JPGE_MIN((int)code_size[i], (int)MAX_HUFF_CODESIZE)]++;
+            }
+        }
+        // Shorten codes longer than 16 bits: move a pair of them up to a prefix one level shorter
+        for (int i = MAX_HUFF_CODESIZE; i > 16; i--) {
+            while (len_count[i] > 0) {
+                int j = i - 2;
+                while (len_count[j] == 0) {
+                    j--;
+                }
+                len_count[i] -= 2;
+                len_count[i - 1]++;
+                len_count[j + 1] += 2;
+                len_count[j]--;
+            }
+        }
+        // Drop the reserved symbol, it holds one of the longest codes
+        int longest = 16;
+        while (len_count[longest] == 0) {
+            longest--;
+        }
+        len_count[longest]--;
+
+        bits[0] = 0;
+        memcpy(bits + 1, len_count + 1, 16);
+        int p = 0;
+        for (int l = 1; l <= MAX_HUFF_CODESIZE; l++) {
+            for (int sym = 0; sym < 256; sym++) {
+                if (code_size[sym] == l) {
+                    val[p++] = static_cast<uint8>(sym);
+                }
+            }
+        }
+    }
+
     void jpeg_encoder::flush_output_buffer()
     {
         if (m_out_buf_left != JPGE_OUT_BUF_SIZE) {
@@ -215,6 +439,14 @@ namespace jpge {
         }
     }
 
+    // Pad the entropy-coded data to a byte boundary with 1 bits
+    void jpeg_encoder::pad_bits()
+    {
+        put_bits(0x7F, 7);
+        m_bit_buffer = 0;
+        m_bits_in = 0;
+    }
+
     void jpeg_encoder::emit_word(uint i)
     {
         emit_byte(uint8(i >> 8)); emit_byte(uint8(i & 0xFF));
@@ -251,7 +483,7 @@ namespace jpge {
             emit_word(64 + 1 + 2);
             emit_byte(static_cast<uint8>(i));
             for (int j = 0; j < 64; j++)
-                emit_byte(static_cast<uint8>(m_quantization_tables[i][j]));
+                emit_byte(static_cast<uint8>(m_quant->q[i][j]));
         }
     }
 
@@ -273,7 +505,7 @@ namespace jpge {
     }
 
     // Emit Huffman table.
-    void jpeg_encoder::emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag)
+    void jpeg_encoder::emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag)
     {
         emit_marker(M_DHT);
 
@@ -294,11 +526,11 @@ namespace jpge {
     // Emit all Huffman tables.
     void jpeg_encoder::emit_dhts()
     {
-        emit_dht(m_huff_bits[0+0], m_huff_val[0+0], 0, false);
-        emit_dht(m_huff_bits[2+0], m_huff_val[2+0], 0, true);
+        emit_dht(m_huff->bits[0+0], m_huff->val[0+0], 0, false);
+        emit_dht(m_huff->bits[2+0], m_huff->val[2+0], 0, true);
         if (m_num_components == 3) {
-            emit_dht(m_huff_bits[0+1], m_huff_val[0+1], 1, false);
-            emit_dht(m_huff_bits[2+1], m_huff_val[2+1], 1, true);
+            emit_dht(m_huff->bits[0+1], m_huff->val[0+1], 1, false);
+            emit_dht(m_huff->bits[2+1], m_huff->val[2+1], 1, true);
         }
     }
 
@@ -321,6 +553,31 @@ namespace jpge {
         emit_byte(0);
     }
 
+    // emit restart interval
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_interval);
+    }
+
+    // Called before each MCU: ends the current restart interval when it is full
+    void jpeg_encoder::restart_check()
+    {
+        if (!m_params.m_restart_interval) {
+            return;
+        }
+        if (m_mcus_to_restart == 0) {
+            if (m_pass_num == 2) {
+                pad_bits();
+                emit_marker(M_RST0 + (m_restart_num++ & 7));
+            }
+            memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+            m_mcus_to_restart = m_params.m_restart_interval;
+        }
+        m_mcus_to_restart--;
+    }
+
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
         uint8 *pSrc;
@@ -383,45 +640,29 @@ namespace jpge {
 
     void jpeg_encoder::load_quantized_coefficients(int component_num)
     {
-        int32 *q = m_quantization_tables[component_num > 0];
-        int16 *pDst = m_coefficient_array;
-        for (int i = 0; i < 64; i++)
-        {
-            sample_array_t j = m_sample_array[s_zag[i]];
-            if (j < 0)
-            {
-                if ((j = -j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>(-(j / *q));
-            }
-            else
-            {
-                if ((j = j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>((j / *q));
-            }
-            q++;
-        }
+#if JPGE_KERNELS_VECTOR
+        quantize_8x8(m_coefficient_array, m_sample_array, m_quant->q[component_num > 0], &m_quant->recip[component_num > 0]);
+#else
+        quantize_8x8(m_coefficient_array, m_sample_array, m_quant->q[component_num > 0], NULL);
+#endif
     }
 
     void jpeg_encoder::code_coefficients_pass_two(int component_num)
     {
         int i, j, run_len, nbits, temp1, temp2;
         int16 *pSrc = m_coefficient_array;
-        uint *codes[2];
-        uint8 *code_sizes[2];
+        const uint *codes[2];
+        const uint8 *code_sizes[2];
 
         if (component_num == 0)
         {
-            codes[0] = m_huff_codes[0 + 0]; codes[1] = m_huff_codes[2 + 0];
-            code_sizes[0] = m_huff_code_sizes[0 + 0]; code_sizes[1] = m_huff_code_sizes[2 + 0];
+            codes[0] = m_huff->codes[0 + 0]; codes[1] = m_huff->codes[2 + 0];
+            code_sizes[0] = m_huff->code_sizes[0 + 0]; code_sizes[1] = m_huff->code_sizes[2 + 0];
         }
         else
         {
-            codes[0] = m_huff_codes[0 + 1]; codes[1] = m_huff_codes[2 + 1];
-            code_sizes[0] = m_huff_code_sizes[0 + 1]; code_sizes[1] = m_huff_code_sizes[2 + 1];
+            codes[0] = m_huff->codes[0 + 1]; codes[1] = m_huff->codes[2 + 1];
+            code_sizes[0] = m_huff->code_sizes[0 + 1]; code_sizes[1] = m_huff->code_sizes[2 + 1];
         }
 
         temp1 = temp2 = pSrc[0] - m_last_dc_val[component_num];
@@ -470,11 +711,253 @@ namespace jpge {
             put_bits(codes[1][0], code_sizes[1][0]);
     }
 
+    // Count the symbols code_coefficients_pass_two() would code for the block, return the
+    // zigzag index of its last non-zero coefficient (0 if only DC)
+    int jpeg_encoder::count_coefficients(int component_num)
+    {
+        int i, run_len, nbits, temp1, last = 0;
+        const int16 *pSrc = m_coefficient_array;
+        uint32 *dc_count = m_two_pass->counts[0 + (component_num > 0)];
+        uint32 *ac_count = m_two_pass->counts[2 + (component_num > 0)];
+
+        temp1 = pSrc[0] - m_last_dc_val[component_num];
+        m_last_dc_val[component_num] = pSrc[0];
+        if (temp1 < 0) temp1 = -temp1;
+
+        nbits = 0;
+        while (temp1)
+        {
+            nbits++; temp1 >>= 1;
+        }
+        dc_count[nbits]++;
+
+        for (run_len = 0, i = 1; i < 64; i++)
+        {
+            if ((temp1 = pSrc[i]) == 0)
+                run_len++;
+            else
+            {
+                while (run_len >= 16)
+                {
+                    ac_count[0xF0]++;
+                    run_len -= 16;
+                }
+                if (temp1 < 0) temp1 = -temp1;
+                nbits = 1;
+                while (temp1 >>= 1)
+                    nbits++;
+                ac_count[(run_len << 4) + nbits]++;
+                run_len = 0;
+                last = i;
+            }
+        }
+        if (run_len)
+            ac_count[0]++;
+        return last;
+    }
+
+    // Pass one of a two-pass encode: count the symbols pass two will code and keep the block
+    void jpeg_encoder::code_coefficients_pass_one(int component_num)
+    {
+        int last = count_coefficients(component_num);
+
+        // Stored as the coefficient count up to the last non-zero one, then the coefficients
+        uint size = 1 + (last + 1) * sizeof(int16);
+        uint8 *pDst = chunk_reserve(&m_two_pass->first, &m_two_pass->last, size);
+        if (!pDst)
+        {
+            m_all_stream_writes_succeeded = false;
+            return;
+        }
+        pDst[0] = static_cast<uint8>(last + 1);
+        memcpy(pDst + 1, m_coefficient_array, (last + 1) * sizeof(int16));
+    }
+
+    // Rate control: keep the DCT coefficients of the block, quantization waits for the quality
+    void jpeg_encoder::store_dct_block()
+    {
+        int16 *pDst = reinterpret_cast<int16*>(chunk_reserve(&m_rate->first, &m_rate->last, DCT_BLOCK_SIZE));
+        if (!pDst)
+        {
+            m_all_stream_writes_succeeded = false;
+            return;
+        }
+        for (int i = 0; i < 64; i++)
+            pDst[i] = static_cast<int16>(m_sample_array[i]);
+    }
+
+    // Rate control: quantize a kept DCT block into m_coefficient_array
+    void jpeg_encoder::load_dct_block(const int16 *pSrc, int component_num)
+    {
+        for (int i = 0; i < 64; i++)
+            m_sample_array[i] = pSrc[i];
+        load_quantized_coefficients(component_num);
+    }
+
     void jpeg_encoder::code_block(int component_num)
     {
-        DCT2D(m_sample_array);
+        fdct_8x8(m_sample_array);
+        if (m_rate)
+        {
+            store_dct_block();
+            return;
+        }
         load_quantized_coefficients(component_num);
-        code_coefficients_pass_two(component_num);
+        if (m_pass_num == 1)
+            code_coefficients_pass_one(component_num);
+        else
+            code_coefficients_pass_two(component_num);
+    }
+
+    // End of pass one: build the tables, write the headers and code the kept blocks with them
+    bool jpeg_encoder::code_stored_blocks()
+    {
+        const uint8 *components = s_mcu_components[m_params.m_subsampling];
+        const int blocks_per_mcu = s_mcu_blocks[m_params.m_subsampling];
+
+        build_optimal_tables();
+
+        m_pass_num = 2;
+        m_mcus_to_restart = m_params.m_restart_interval;
+        m_restart_num = 0;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+        emit_headers();
+
+        int block = 0;
+        for (coef_chunk *chunk = m_two_pass->first; chunk && m_all_stream_writes_succeeded; chunk = chunk->next)
+        {
+            for (uint ofs = 0; ofs < chunk->used; block++)
+            {
+                const uint8 *pSrc = chunk->data + ofs;
+                int count = pSrc[0];
+                if (block % blocks_per_mcu == 0)
+                    restart_check();
+                memcpy(m_coefficient_array, pSrc + 1, count * sizeof(int16));
+                memset(m_coefficient_array + count, 0, (64 - count) * sizeof(int16));
+                code_coefficients_pass_two(components[block % blocks_per_mcu]);
+                ofs += 1 + count * sizeof(int16);
+            }
+        }
+        return m_all_stream_writes_succeeded;
+    }
+
+    // Huffman tables from the symbol counts of pass one
+    void jpeg_encoder::build_optimal_tables()
+    {
+        huffman_tables *tables = &m_two_pass->tables;
+        for (int i = 0; i < 4; i++)
+        {
+            if (i & 1 && m_num_components == 1)
+                continue;
+            compute_optimal_table(tables->bits[i], tables->val[i], m_two_pass->counts[i]);
+            compute_huffman_table(tables->codes[i], tables->code_sizes[i], tables->bits[i], tables->val[i],
+                                  m_two_pass->huff_size, m_two_pass->huff_code);
+        }
+        m_huff = tables;
+    }
+
+    // Rate control: quantize the kept DCT blocks at quality and code the complete file into pStream
+    bool jpeg_encoder::code_dct_blocks(int quality, output_stream *pStream)
+    {
+        const uint8 *components = s_mcu_components[m_params.m_subsampling];
+        const int blocks_per_mcu = s_mcu_blocks[m_params.m_subsampling];
+
+        if (m_rate->quality != quality)
+        {
+            compute_quant_tables(&m_rate->quant, quality);
+            m_rate->quality = quality;
+        }
+        m_quant = &m_rate->quant;
+
+        if (m_two_pass)
+        {
+            // Optimized tables need this quality's statistics first
+            memset(m_two_pass->counts, 0, sizeof(m_two_pass->counts));
+            memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+            int block = 0;
+            for (coef_chunk *chunk = m_rate->first; chunk; chunk = chunk->next)
+            {
+                for (uint ofs = 0; ofs < chunk->used; ofs += DCT_BLOCK_SIZE, block++)
+                {
+                    int component_num = components[block % blocks_per_mcu];
+                    if (m_params.m_restart_interval && block % (blocks_per_mcu * m_params.m_restart_interval) == 0)
+                        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+                    load_dct_block(reinterpret_cast<const int16*>(chunk->data + ofs), component_num);
+                    count_coefficients(component_num);
+                }
+            }
+            build_optimal_tables();
+        }
+
+        m_pStream = pStream;
+        m_all_stream_writes_succeeded = true;
+        m_pOut_buf = m_out_buf;
+        m_out_buf_left = JPGE_OUT_BUF_SIZE;
+        m_bit_buffer = 0;
+        m_bits_in = 0;
+        m_pass_num = 2;
+        m_mcus_to_restart = m_params.m_restart_interval;
+        m_restart_num = 0;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+        emit_headers();
+
+        int block = 0;
+        for (coef_chunk *chunk = m_rate->first; chunk && m_all_stream_writes_succeeded; chunk = chunk->next)
+        {
+            for (uint ofs = 0; ofs < chunk->used; ofs += DCT_BLOCK_SIZE, block++)
+            {
+                int component_num = components[block % blocks_per_mcu];
+                if (block % blocks_per_mcu == 0)
+                    restart_check();
+                load_dct_block(reinterpret_cast<const int16*>(chunk->data + ofs), component_num);
+                code_coefficients_pass_two(component_num);
+            }
+        }
+
+        pad_bits();
+        emit_marker(M_EOI);
+        flush_output_buffer();
+        m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
+        return m_all_stream_writes_succeeded;
+    }
+
+    // Rate control: size of the complete file at quality, 0 on error
+    uint jpeg_encoder::coded_size(int quality)
+    {
+        count_stream counter;
+        output_stream *pStream = m_pStream;
+        bool ok = code_dct_blocks(quality, &counter);
+        m_pStream = pStream;
+        return ok ? counter.m_size : 0;
+    }
+
+    // Rate control: the highest quality up to m_quality whose file fits in m_target_size,
+    // 0 if none does (m_over_budget set) or on error. The budget usually holds at the top,
+    // so that is tried first.
+    int jpeg_encoder::select_quality()
+    {
+        const uint target = static_cast<uint>(m_params.m_target_size);
+        int lo = 1, hi = m_params.m_quality, best = 0;
+        uint size = coded_size(hi);
+        if (size && size <= target)
+            return hi;
+        hi--;
+        while (lo <= hi)
+        {
+            int mid = (lo + hi) / 2;
+            size = coded_size(mid);
+            if (!size)
+                return 0;
+            if (size <= target)
+            {
+                best = mid;
+                lo = mid + 1;
+            }
+            else
+                hi = mid - 1;
+        }
+        m_over_budget = !best;
+        return best;
     }
 
     void jpeg_encoder::process_mcu_row()
@@ -483,6 +966,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                restart_check();
                 load_block_8_8_grey(i); code_block(0);
             }
         }
@@ -490,6 +974,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                restart_check();
                 load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
@@ -497,6 +982,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                restart_check();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
             }
@@ -505,6 +991,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                restart_check();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
                 load_block_16_8(i, 1); code_block(1); load_block_16_8(i, 2); code_block(2);
@@ -518,16 +1005,28 @@ namespace jpge {
 
         uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
 
-        if (m_num_components == 1) {
-            if (m_image_bpp == 3)
-                RGB_to_Y(pDst, Psrc, m_image_x);
-            else
-                memcpy(pDst, Psrc, m_image_x);
-        } else {
-            if (m_image_bpp == 3)
-                RGB_to_YCC(pDst, Psrc, m_image_x);
-            else
-                Y_to_YCC(pDst, Psrc, m_image_x);
+        switch (m_params.m_source_format) {
+            case SRC_BGR888:
+                (m_num_components == 1 ? BGR_to_Y : BGR_to_YCC)(pDst, Psrc, m_image_x);
+                break;
+            case SRC_RGB565:
+                (m_num_components == 1 ? RGB565_to_Y : RGB565_to_YCC)(pDst, Psrc, m_image_x);
+                break;
+            case SRC_YUV422:
+                (m_num_components == 1 ? YUV422_to_Y : YUV422_to_YCC)(pDst, Psrc, m_image_x);
+                break;
+            default:
+                if (m_num_components == 1) {
+                    if (m_image_bpp == 3)
+                        RGB_to_Y(pDst, Psrc, m_image_x);
+                    else
+                        memcpy(pDst, Psrc, m_image_x);
+                } else {
+                    if (m_image_bpp == 3)
+                        RGB_to_YCC(pDst, Psrc, m_image_x);
+                    else
+                        Y_to_YCC(pDst, Psrc, m_image_x);
+                }
         }
 
         // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
@@ -551,13 +1050,13 @@ namespace jpge {
     }
 
     // Quantization table generation.
-    void jpeg_encoder::compute_quant_table(int32 *pDst, const int16 *pSrc)
+    void jpeg_encoder::compute_quant_table(int32 *pDst, const int16 *pSrc, int quality)
     {
         int32 q;
-        if (m_params.m_quality < 50)
-            q = 5000 / m_params.m_quality;
+        if (quality < 50)
+            q = 5000 / quality;
         else
-            q = 200 - m_params.m_quality * 2;
+            q = 200 - quality * 2;
         for (int i = 0; i < 64; i++)
         {
             int32 j = *pSrc++; j = (j * q + 50L) / 100L;
@@ -565,6 +1064,16 @@ namespace jpge {
         }
     }
 
+    void jpeg_encoder::compute_quant_tables(quant_tables *t, int quality)
+    {
+        compute_quant_table(t->q[0], s_std_lum_quant, quality);
+        compute_quant_table(t->q[1], s_std_croma_quant, quality);
+#if JPGE_KERNELS_VECTOR
+        quant_recip_init(&t->recip[0], t->q[0]);
+        quant_recip_init(&t->recip[1], t->q[1]);
+#endif
+    }
+
     // Higher-level methods.
     bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
     {
@@ -612,31 +1121,28 @@ namespace jpge {
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
-            return false;
+        if (m_open_mode != OPEN_HEADERS) {
+            if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+                return false;
+            }
+            for (int i = 1; i < m_mcu_y; i++)
+                m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
         }
-        for (int i = 1; i < m_mcu_y; i++)
-            m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
 
-        if(m_last_quality != m_params.m_quality){
-            m_last_quality = m_params.m_quality;
-            compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
-            compute_quant_table(m_quantization_tables[1], s_std_croma_quant);
+        if (!m_params.m_target_size && m_open_mode != OPEN_ANALYSIS) {
+            // Each encoder owns its tables: concurrent encoders may use different qualities
+            if ((m_fixed_quant = static_cast<quant_tables*>(jpge_malloc(sizeof(quant_tables)))) == NULL) {
+                return false;
+            }
+            compute_quant_tables(m_fixed_quant, m_params.m_quality);
+            m_quant = m_fixed_quant;
         }
 
-        if(!m_huff_initialized){
-            m_huff_initialized = true;
-
-            memcpy(m_huff_bits[0+0], s_dc_lum_bits, 17);    memcpy(m_huff_val[0+0], s_dc_lum_val, DC_LUM_CODES);
-            memcpy(m_huff_bits[2+0], s_ac_lum_bits, 17);    memcpy(m_huff_val[2+0], s_ac_lum_val, AC_LUM_CODES);
-            memcpy(m_huff_bits[0+1], s_dc_chroma_bits, 17); memcpy(m_huff_val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
-            memcpy(m_huff_bits[2+1], s_ac_chroma_bits, 17); memcpy(m_huff_val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
-
-            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
-        }
+        // The standard Huffman and range tables do not depend on the parameters; the
+        // function-local static makes the one-time build safe for concurrent encoders
+        static const bool std_tables_ready = init_std_tables();
+        (void)std_tables_ready;
+        m_huff = &m_std_huff;
 
         m_out_buf_left = JPGE_OUT_BUF_SIZE;
         m_pOut_buf = m_out_buf;
@@ -644,17 +1150,63 @@ namespace jpge {
         m_bits_in = 0;
         m_mcu_y_ofs = 0;
         m_pass_num = 2;
+        m_mcus_to_restart = m_params.m_restart_interval;
+        m_restart_num = 0;
         memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
 
-        // Emit all markers at beginning of image file.
+        if (m_open_mode == OPEN_BAND) {
+            return true;
+        }
+
+        if (m_params.m_target_size || m_open_mode == OPEN_ANALYSIS) {
+            // Nothing is written before the quality is known; the two-pass state only holds statistics
+            if ((m_rate = static_cast<rate_state*>(jpge_malloc_ext(sizeof(rate_state)))) == NULL) {
+                return false;
+            }
+            m_rate->quality = 0;
+            m_rate->first = m_rate->last = NULL;
+            if (m_params.m_two_pass_flag) {
+                if ((m_two_pass = static_cast<two_pass_state*>(jpge_malloc_ext(sizeof(two_pass_state)))) == NULL) {
+                    return false;
+                }
+                m_two_pass->first = m_two_pass->last = NULL;
+            }
+            m_pass_num = 1;
+            return true;
+        }
+
+        if (m_params.m_two_pass_flag) {
+            // The headers carry the tables, so they wait for the end of pass one
+            if ((m_two_pass = static_cast<two_pass_state*>(jpge_malloc_ext(sizeof(two_pass_state)))) == NULL) {
+                return false;
+            }
+            memset(m_two_pass->counts, 0, sizeof(m_two_pass->counts));
+            m_two_pass->first = m_two_pass->last = NULL;
+            m_pass_num = 1;
+            return true;
+        }
+
+        emit_headers();
+
+        if (m_open_mode == OPEN_HEADERS) {
+            flush_output_buffer();
+            m_pass_num = 3; // no scanlines follow
+        }
+        return m_all_stream_writes_succeeded;
+    }
+
+    // Emit all markers at beginning of image file.
+    void jpeg_encoder::emit_headers()
+    {
         emit_marker(M_SOI);
         emit_jfif_app0();
         emit_dqt();
         emit_sof();
         emit_dhts();
+        if (m_params.m_restart_interval) {
+            emit_dri();
+        }
         emit_sos();
-
-        return m_all_stream_writes_succeeded;
     }
 
     bool jpeg_encoder::process_end_of_image()
@@ -666,9 +1218,31 @@ namespace jpge {
                 }
             }
             process_mcu_row();
+            m_mcu_y_ofs = 0;
         }
 
-        put_bits(0x7F, 7);
+        if (m_rate) {
+            if (m_open_mode == OPEN_IMAGE) {
+                int quality = select_quality();
+                if (!quality || !code_dct_blocks(quality, m_pStream)) {
+                    return false;
+                }
+                m_params.m_quality = quality;
+            }
+            m_pass_num = 3; // analysis: predict_size() from here on
+            return m_all_stream_writes_succeeded;
+        }
+
+        if (m_pass_num == 1 && !code_stored_blocks()) {
+            return false;
+        }
+
+        pad_bits();
+        if (m_open_mode == OPEN_BAND) {
+            flush_output_buffer();
+            m_pass_num++;
+            return true;
+        }
         emit_marker(M_EOI);
         flush_output_buffer();
         m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
@@ -679,8 +1253,15 @@ namespace jpge {
     void jpeg_encoder::clear()
     {
         m_mcu_lines[0] = NULL;
+        m_two_pass = NULL;
+        m_rate = NULL;
+        m_quant = NULL;
+        m_fixed_quant = NULL;
+        m_huff = NULL;
         m_pass_num = 0;
+        m_open_mode = OPEN_IMAGE;
         m_all_stream_writes_succeeded = true;
+        m_over_budget = false;
     }
 
     jpeg_encoder::jpeg_encoder()
@@ -693,18 +1274,71 @@ namespace jpge {
         deinit();
     }
 
-    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    bool jpeg_encoder::open(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, open_mode_t mode)
     {
         deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if (((!pStream && mode != OPEN_ANALYSIS) || (width < 1) || (height < 1)) || (!comp_params.check())) return false;
+        switch (comp_params.m_source_format) {
+            case SRC_BGR888: if (src_channels != 3) return false; break;
+            case SRC_RGB565:
+            case SRC_YUV422: if (src_channels != 2) return false; break;
+            default: if ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) return false;
+        }
         m_pStream = pStream;
         m_params = comp_params;
+        m_open_mode = mode;
+        if (mode == OPEN_BAND) {
+            m_params.m_restart_interval = 0;
+        }
+        if (mode == OPEN_BAND || mode == OPEN_HEADERS) {
+            m_params.m_two_pass_flag = false;
+            m_params.m_target_size = 0;
+        }
         return jpg_open(width, height, src_channels);
     }
 
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open(pStream, width, height, src_channels, comp_params, OPEN_IMAGE);
+    }
+
+    bool jpeg_encoder::init_band(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open(pStream, width, height, src_channels, comp_params, OPEN_BAND);
+    }
+
+    bool jpeg_encoder::write_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open(pStream, width, height, src_channels, comp_params, OPEN_HEADERS);
+    }
+
+    bool jpeg_encoder::init_analysis(int width, int height, int src_channels, const params &comp_params)
+    {
+        return open(NULL, width, height, src_channels, comp_params, OPEN_ANALYSIS);
+    }
+
+    uint jpeg_encoder::predict_size(int quality)
+    {
+        if (!m_rate || m_open_mode != OPEN_ANALYSIS || m_pass_num != 3 || quality < 1 || quality > 100) {
+            return 0;
+        }
+        uint size = coded_size(quality);
+        m_pass_num = 3;
+        return size;
+    }
+
     void jpeg_encoder::deinit()
     {
         jpge_free(m_mcu_lines[0]);
+        jpge_free(m_fixed_quant);
+        if (m_two_pass) {
+            free_chunks(m_two_pass->first);
+            jpge_free(m_two_pass);
+        }
+        if (m_rate) {
+            free_chunks(m_rate->first);
+            jpge_free(m_rate);
+        }
         clear();
     }
 
@@ -0,0 +1,241 @@
+// jpge_kernels.cpp - Forward DCT and quantization kernels for jpge.
+//
+// The vector DCTs run the jfdctint butterflies on four rows or columns per
+// register in 32-bit lanes. jfdctint multiplies the low 16 bits of each
+// intermediate by a 16-bit constant (DCT_MUL); a 16x16->32 multiply of the
+// lane's low half reproduces that exactly.
+//
+// The vector quantizers replace the division by a float multiply with the
+// reciprocal. For a = |c| + (q >> 1) the scalar result is floor(a / q);
+// (a + 0.5) / q lies at least 0.5 / q away from the next integer, which is
+// far more than the float rounding error for |c| <= 2048 (the DCT range of
+// 8-bit samples), so truncating the product gives the same integer.
+//
+// The ESP32-S3 is not accelerated: it runs the scalar kernels. PIE's
+// saturating 32-bit adds (EE.VADDS.S32) would match here, since jfdctint
+// intermediates stay far below 2^31. The multiply is what does not map.
+// EE.VMUL.S16 returns only a shifted, saturated 16-bit product. The full
+// 32-bit products are only reachable through the 40-bit QACC accumulators,
+// which have to be unpacked through memory, and that costs more per block
+// than the core's single-cycle MUL16S in the scalar DCT.
+
+#include "jpge_kernels.h"
+
+#if JPGE_KERNELS_SSE2
+#include <emmintrin.h>
+#elif JPGE_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace jpge {
+
+    const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+
+    // Forward DCT - DCT derived from jfdctint.
+    enum { CONST_BITS = 13, ROW_BITS = 2 };
+#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
+#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
+#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+    int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
+    int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
+    int32 u1 = DCT_MUL(t12 + t13, 4433); \
+    s2 = u1 + DCT_MUL(t13, 6270); \
+    s6 = u1 + DCT_MUL(t12, -15137); \
+    u1 = t4 + t7; \
+    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
+    int32 z5 = DCT_MUL(u3 + u4, 9633); \
+    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
+    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
+    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
+    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
+    u3 += z5; u4 += z5; \
+    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
+
+    void fdct_8x8_scalar(int32 *p) {
+        int32 c, *q = p;
+        for (c = 7; c >= 0; c--, q += 8) {
+            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
+            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
+        }
+        for (q = p, c = 7; c >= 0; c--, q++) {
+            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
+            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+        }
+    }
+
+    void quantize_8x8_scalar(int16 *pDst, const int32 *block, const int32 *q)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            int32 j = block[s_zag[i]];
+            if (j < 0)
+            {
+                if ((j = -j + (*q >> 1)) < *q)
+                    *pDst++ = 0;
+                else
+                    *pDst++ = static_cast<int16>(-(j / *q));
+            }
+            else
+            {
+                if ((j = j + (*q >> 1)) < *q)
+                    *pDst++ = 0;
+                else
+                    *pDst++ = static_cast<int16>((j / *q));
+            }
+            q++;
+        }
+    }
+
+    void quant_recip_init(quant_recip *r, const int32 *q_zag)
+    {
+        for (int i = 0; i < 64; i++) {
+            r->bias[s_zag[i]] = (float)(q_zag[i] >> 1) + 0.5f;
+            r->recip[s_zag[i]] = 1.0f / (float)q_zag[i];
+        }
+    }
+
+#if JPGE_KERNELS_VECTOR
+
+#if JPGE_KERNELS_SSE2
+    typedef __m128i vec_t;
+#define V_LOAD(p)           _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))
+#define V_STORE(p, v)       _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v)
+#define V_ADD(a, b)         _mm_add_epi32(a, b)
+#define V_SUB(a, b)         _mm_sub_epi32(a, b)
+// Low 16 bits of each lane times c; the zero high half of the constant drops the lane's high half
+#define V_MUL(a, c)         _mm_madd_epi16(a, _mm_set1_epi32((c) & 0xFFFF))
+#define V_SHL(a, n)         _mm_slli_epi32(a, n)
+#define V_DESCALE(a, n)     _mm_srai_epi32(_mm_add_epi32(a, _mm_set1_epi32(1 << ((n) - 1))), n)
+
+    static inline void transpose4(vec_t &a, vec_t &b, vec_t &c, vec_t &d)
+    {
+        vec_t ab_lo = _mm_unpacklo_epi32(a, b), ab_hi = _mm_unpackhi_epi32(a, b);
+        vec_t cd_lo = _mm_unpacklo_epi32(c, d), cd_hi = _mm_unpackhi_epi32(c, d);
+        a = _mm_unpacklo_epi64(ab_lo, cd_lo);
+        b = _mm_unpackhi_epi64(ab_lo, cd_lo);
+        c = _mm_unpacklo_epi64(ab_hi, cd_hi);
+        d = _mm_unpackhi_epi64(ab_hi, cd_hi);
+    }
+#else
+    typedef int32x4_t vec_t;
+#define V_LOAD(p)           vld1q_s32(p)
+#define V_STORE(p, v)       vst1q_s32(p, v)
+#define V_ADD(a, b)         vaddq_s32(a, b)
+#define V_SUB(a, b)         vsubq_s32(a, b)
+// vmovn keeps the low 16 bits of each lane, as the scalar int16 cast does
+#define V_MUL(a, c)         vmull_s16(vmovn_s32(a), vdup_n_s16(c))
+#define V_SHL(a, n)         vshlq_n_s32(a, n)
+#define V_DESCALE(a, n)     vshrq_n_s32(vaddq_s32(a, vdupq_n_s32(1 << ((n) - 1))), n)
+
+    static inline void transpose4(vec_t &a, vec_t &b, vec_t &c, vec_t &d)
+    {
+        int32x4x2_t ab = vtrnq_s32(a, b), cd = vtrnq_s32(c, d);
+        a = vcombine_s32(vget_low_s32(ab.val[0]), vget_low_s32(cd.val[0]));
+        b = vcombine_s32(vget_low_s32(ab.val[1]), vget_low_s32(cd.val[1]));
+        c = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+        d = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+    }
+#endif
+
+    // DCT1D on four lanes at once, same operation order as the scalar macro
+    static inline void dct1d(vec_t &s0, vec_t &s1, vec_t &s2, vec_t &s3, vec_t &s4, vec_t &s5, vec_t &s6, vec_t &s7)
+    {
+        vec_t t0 = V_ADD(s0, s7), t7 = V_SUB(s0, s7), t1 = V_ADD(s1, s6), t6 = V_SUB(s1, s6);
+        vec_t t2 = V_ADD(s2, s5), t5 = V_SUB(s2, s5), t3 = V_ADD(s3, s4), t4 = V_SUB(s3, s4);
+        vec_t t10 = V_ADD(t0, t3), t13 = V_SUB(t0, t3), t11 = V_ADD(t1, t2), t12 = V_SUB(t1, t2);
+        vec_t u1 = V_MUL(V_ADD(t12, t13), 4433);
+        s2 = V_ADD(u1, V_MUL(t13, 6270));
+        s6 = V_ADD(u1, V_MUL(t12, -15137));
+        u1 = V_ADD(t4, t7);
+        vec_t u2 = V_ADD(t5, t6), u3 = V_ADD(t4, t6), u4 = V_ADD(t5, t7);
+        vec_t z5 = V_MUL(V_ADD(u3, u4), 9633);
+        t4 = V_MUL(t4, 2446); t5 = V_MUL(t5, 16819);
+        t6 = V_MUL(t6, 25172); t7 = V_MUL(t7, 12299);
+        u1 = V_MUL(u1, -7373); u2 = V_MUL(u2, -20995);
+        u3 = V_MUL(u3, -16069); u4 = V_MUL(u4, -3196);
+        u3 = V_ADD(u3, z5); u4 = V_ADD(u4, z5);
+        s0 = V_ADD(t10, t11); s1 = V_ADD(V_ADD(t7, u1), u4); s3 = V_ADD(V_ADD(t6, u2), u3);
+        s4 = V_SUB(t10, t11); s5 = V_ADD(V_ADD(t5, u2), u4); s7 = V_ADD(V_ADD(t4, u1), u3);
+    }
+
+    void fdct_8x8(int32 *p)
+    {
+        // Rows: transpose four rows so each register holds one column position
+        for (int r = 0; r < 8; r += 4) {
+            int32 *q = p + r * 8;
+            vec_t s0 = V_LOAD(q + 0),  s4 = V_LOAD(q + 4);
+            vec_t s1 = V_LOAD(q + 8),  s5 = V_LOAD(q + 12);
+            vec_t s2 = V_LOAD(q + 16), s6 = V_LOAD(q + 20);
+            vec_t s3 = V_LOAD(q + 24), s7 = V_LOAD(q + 28);
+            transpose4(s0, s1, s2, s3);
+            transpose4(s4, s5, s6, s7);
+            dct1d(s0, s1, s2, s3, s4, s5, s6, s7);
+            s0 = V_SHL(s0, ROW_BITS); s1 = V_DESCALE(s1, CONST_BITS-ROW_BITS);
+            s2 = V_DESCALE(s2, CONST_BITS-ROW_BITS); s3 = V_DESCALE(s3, CONST_BITS-ROW_BITS);
+            s4 = V_SHL(s4, ROW_BITS); s5 = V_DESCALE(s5, CONST_BITS-ROW_BITS);
+            s6 = V_DESCALE(s6, CONST_BITS-ROW_BITS); s7 = V_DESCALE(s7, CONST_BITS-ROW_BITS);
+            transpose4(s0, s1, s2, s3);
+            transpose4(s4, s5, s6, s7);
+            V_STORE(q + 0, s0);  V_STORE(q + 4, s4);
+            V_STORE(q + 8, s1);  V_STORE(q + 12, s5);
+            V_STORE(q + 16, s2); V_STORE(q + 20, s6);
+            V_STORE(q + 24, s3); V_STORE(q + 28, s7);
+        }
+        // Columns: rows are already laid out one per register
+        for (int c = 0; c < 8; c += 4) {
+            int32 *q = p + c;
+            vec_t s0 = V_LOAD(q + 0*8), s1 = V_LOAD(q + 1*8), s2 = V_LOAD(q + 2*8), s3 = V_LOAD(q + 3*8);
+            vec_t s4 = V_LOAD(q + 4*8), s5 = V_LOAD(q + 5*8), s6 = V_LOAD(q + 6*8), s7 = V_LOAD(q + 7*8);
+            dct1d(s0, s1, s2, s3, s4, s5, s6, s7);
+            V_STORE(q + 0*8, V_DESCALE(s0, ROW_BITS+3)); V_STORE(q + 1*8, V_DESCALE(s1, CONST_BITS+ROW_BITS+3));
+            V_STORE(q + 2*8, V_DESCALE(s2, CONST_BITS+ROW_BITS+3)); V_STORE(q + 3*8, V_DESCALE(s3, CONST_BITS+ROW_BITS+3));
+            V_STORE(q + 4*8, V_DESCALE(s4, ROW_BITS+3)); V_STORE(q + 5*8, V_DESCALE(s5, CONST_BITS+ROW_BITS+3));
+            V_STORE(q + 6*8, V_DESCALE(s6, CONST_BITS+ROW_BITS+3)); V_STORE(q + 7*8, V_DESCALE(s7, CONST_BITS+ROW_BITS+3));
+        }
+    }
+
+    void quantize_8x8(int16 *dst, const int32 *block, const int32 *, const quant_recip *r)
+    {
+        int16 natural[64];
+        for (int i = 0; i < 64; i += 4) {
+#if JPGE_KERNELS_SSE2
+            __m128i c = V_LOAD(block + i);
+            __m128i sign = _mm_srai_epi32(c, 31);
+            __m128i mag = _mm_sub_epi32(_mm_xor_si128(c, sign), sign);
+            __m128 a = _mm_add_ps(_mm_cvtepi32_ps(mag), _mm_loadu_ps(r->bias + i));
+            __m128i k = _mm_cvttps_epi32(_mm_mul_ps(a, _mm_loadu_ps(r->recip + i)));
+            k = _mm_sub_epi32(_mm_xor_si128(k, sign), sign);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(natural + i), _mm_packs_epi32(k, k));
+#else
+            int32x4_t c = vld1q_s32(block + i);
+            int32x4_t sign = vshrq_n_s32(c, 31);
+            float32x4_t a = vaddq_f32(vcvtq_f32_s32(vabsq_s32(c)), vld1q_f32(r->bias + i));
+            int32x4_t k = vcvtq_s32_f32(vmulq_f32(a, vld1q_f32(r->recip + i)));
+            k = vsubq_s32(veorq_s32(k, sign), sign);
+            vst1_s16(natural + i, vmovn_s32(k));
+#endif
+        }
+        for (int i = 0; i < 64; i++) {
+            dst[i] = natural[s_zag[i]];
+        }
+    }
+
+#else // scalar
+
+    void fdct_8x8(int32 *block)
+    {
+        fdct_8x8_scalar(block);
+    }
+
+    void quantize_8x8(int16 *dst, const int32 *block, const int32 *q_zag, const quant_recip *)
+    {
+        quantize_8x8_scalar(dst, block, q_zag);
+    }
+
+#endif
+
+} // namespace jpge
@@ -0,0 +1,285 @@
+// jpge_parallel.cpp - Multi-threaded encoding on top of jpge, see jpge_parallel.h.
+
+#include "jpge_parallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <pthread.h>
+#include "esp_heap_caps.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_pthread.h"
+#endif
+
+#define JPGE_PARALLEL_MAX(a,b) (((a)>(b))?(a):(b))
+#define JPGE_PARALLEL_MIN(a,b) (((a)<(b))?(a):(b))
+
+namespace jpge {
+
+    enum {
+        MAX_WORKERS = 8,
+        MAX_RESTART_INTERVAL = 0xFFFF,
+        WORKER_STACK_SIZE = 3072 + sizeof(jpeg_encoder),
+    };
+
+    static void *band_malloc(size_t size)
+    {
+        void *b = malloc(size);
+        if (b) {
+            return b;
+        }
+#if ((CONFIG_SPIRAM || CONFIG_SPIRAM_SUPPORT) && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+        return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+        return NULL;
+#endif
+    }
+
+    // Growable memory stream holding the entropy-coded data of one band
+    class band_stream : public output_stream {
+        public:
+            uint8 *m_buf;
+            uint m_size, m_cap;
+
+            band_stream() : m_buf(NULL), m_size(0), m_cap(0) { }
+            ~band_stream() { free(m_buf); }
+
+            bool reserve(uint cap)
+            {
+                uint8 *b = (uint8 *)band_malloc(cap);
+                if (!b) {
+                    return false;
+                }
+                if (m_buf) {
+                    memcpy(b, m_buf, m_size);
+                    free(m_buf);
+                }
+                m_buf = b;
+                m_cap = cap;
+                return true;
+            }
+
+            virtual bool put_buf(const void *buf, int len)
+            {
+                if (!buf) {
+                    return true;
+                }
+                if (m_size + len > m_cap && !reserve((m_size + len) * 2)) {
+                    return false;
+                }
+                memcpy(m_buf + m_size, buf, len);
+                m_size += len;
+                return true;
+            }
+
+            virtual uint get_size() const
+            {
+                return m_size;
+            }
+    };
+
+    struct band_layout {
+        int mcu_y;          // pixel rows per MCU row
+        int mcus_per_row;
+        int band_rows;      // pixel rows per band (whole MCU rows)
+        int bands;
+    };
+
+    static void plan_bands(band_layout *l, int width, int height, const params &comp_params, int workers)
+    {
+        int mcu_x = (comp_params.m_subsampling == H2V1 || comp_params.m_subsampling == H2V2) ? 16 : 8;
+        l->mcu_y = comp_params.m_subsampling == H2V2 ? 16 : 8;
+        l->mcus_per_row = (width + mcu_x - 1) / mcu_x;
+        int mcu_rows = (height + l->mcu_y - 1) / l->mcu_y;
+        int bands = JPGE_PARALLEL_MIN(workers, mcu_rows);
+        int band_mcu_rows = (mcu_rows + bands - 1) / bands;
+        // A band is one restart interval; cut it smaller if it would not fit in DRI
+        int max_mcu_rows = JPGE_PARALLEL_MAX(MAX_RESTART_INTERVAL / l->mcus_per_row, 1);
+        band_mcu_rows = JPGE_PARALLEL_MIN(band_mcu_rows, max_mcu_rows);
+        l->band_rows = band_mcu_rows * l->mcu_y;
+        l->bands = (mcu_rows + band_mcu_rows - 1) / band_mcu_rows;
+    }
+
+    struct parallel_job {
+        int width, height, src_channels;
+        params comp_params;
+        band_layout layout;
+        int workers;
+        scanline_reader read;
+        void *ctx;
+        band_stream *streams;
+        volatile bool failed;
+    };
+
+    struct worker_arg {
+        parallel_job *job;
+        int index;
+    };
+
+    static bool encode_band(parallel_job *job, int band)
+    {
+        int y0 = band * job->layout.band_rows;
+        int rows = JPGE_PARALLEL_MIN(job->layout.band_rows, job->height - y0);
+        band_stream *out = &job->streams[band];
+        if (!out->reserve(job->width * rows / 4 + 1024)) {
+            return false;
+        }
+        jpeg_encoder enc;
+        if (!enc.init_band(out, job->width, rows, job->src_channels, job->comp_params)) {
+            return false;
+        }
+        for (int y = y0; y < y0 + rows; y++) {
+            const uint8 *line = job->read(job->ctx, y);
+            if (job->failed || !line || !enc.process_scanline(line)) {
+                return false;
+            }
+        }
+        return enc.process_scanline(NULL);
+    }
+
+    // Worker k encodes bands k, k + workers, ...
+    static void *band_worker(void *arg)
+    {
+        worker_arg *w = (worker_arg *)arg;
+        parallel_job *job = w->job;
+        for (int band = w->index; band < job->layout.bands && !job->failed; band += job->workers) {
+            if (!encode_band(job, band)) {
+                job->failed = true;
+            }
+        }
+        return NULL;
+    }
+
+    static bool compress_serial(output_stream *pStream, int width, int height, int src_channels,
+                                const params &comp_params, scanline_reader read, void *ctx)
+    {
+        jpeg_encoder enc;
+        bool ok = enc.init(pStream, width, height, src_channels, comp_params);
+        for (int y = 0; ok && y < height; y++) {
+            const uint8 *line = read(ctx, y);
+            ok = line && enc.process_scanline(line);
+        }
+        return ok && enc.process_scanline(NULL);
+    }
+
+    int parallel_band_count(int width, int height, const params &comp_params, int workers)
+    {
+        // Two-pass tables and rate control need the whole image
+        if (workers < 2 || width < 1 || height < 1 || comp_params.m_two_pass_flag || comp_params.m_target_size) {
+            return 1;
+        }
+        band_layout layout;
+        plan_bands(&layout, width, height, comp_params, JPGE_PARALLEL_MIN(workers, (int)MAX_WORKERS));
+        return layout.bands;
+    }
+
+    int parallel_restart_interval(int width, int height, const params &comp_params, int workers)
+    {
+        if (parallel_band_count(width, height, comp_params, workers) < 2) {
+            return 0;
+        }
+        band_layout layout;
+        plan_bands(&layout, width, height, comp_params, JPGE_PARALLEL_MIN(workers, (int)MAX_WORKERS));
+        return layout.mcus_per_row * (layout.band_rows / layout.mcu_y);
+    }
+
+    bool compress_parallel(output_stream *pStream, int width, int height, int src_channels,
+                           const params &comp_params, int workers, scanline_reader read, void *ctx)
+    {
+        if (!pStream || !read || !comp_params.check()) {
+            return false;
+        }
+        if (parallel_band_count(width, height, comp_params, workers) < 2) {
+            params serial = comp_params;
+            serial.m_restart_interval = 0;
+            return compress_serial(pStream, width, height, src_channels, serial, read, ctx);
+        }
+
+        parallel_job job;
+        job.width = width;
+        job.height = height;
+        job.src_channels = src_channels;
+        job.comp_params = comp_params;
+        job.workers = JPGE_PARALLEL_MIN(workers, (int)MAX_WORKERS);
+        plan_bands(&job.layout, width, height, comp_params, job.workers);
+        job.workers = JPGE_PARALLEL_MIN(job.workers, job.layout.bands);
+        job.comp_params.m_restart_interval = job.layout.mcus_per_row * (job.layout.band_rows / job.layout.mcu_y);
+        job.read = read;
+        job.ctx = ctx;
+        job.failed = false;
+
+        // The headers go first; each band encoder then builds the same
+        // quantization tables from job.comp_params.
+        {
+            jpeg_encoder hdr;
+            if (!hdr.write_headers(pStream, width, height, src_channels, job.comp_params)) {
+                return false;
+            }
+        }
+
+        job.streams = new (std::nothrow) band_stream[job.layout.bands];
+        if (!job.streams) {
+            return false;
+        }
+
+        worker_arg args[MAX_WORKERS];
+        pthread_t threads[MAX_WORKERS];
+        bool started[MAX_WORKERS] = { false };
+#ifdef ESP_PLATFORM
+        esp_pthread_cfg_t prev_cfg;
+        bool had_cfg = esp_pthread_get_cfg(&prev_cfg) == ESP_OK;
+        esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+        cfg.stack_size = WORKER_STACK_SIZE;
+        cfg.prio = uxTaskPriorityGet(NULL);
+        cfg.thread_name = "jpge";
+#endif
+        for (int i = 1; i < job.workers; i++) {
+            args[i].job = &job;
+            args[i].index = i;
+#ifdef ESP_PLATFORM
+            // Spread the workers over the cores, starting with the one we are not on
+            cfg.pin_to_core = (xPortGetCoreID() + i) % portNUM_PROCESSORS;
+            esp_pthread_set_cfg(&cfg);
+#endif
+            started[i] = pthread_create(&threads[i], NULL, band_worker, &args[i]) == 0;
+            if (!started[i]) {
+                job.failed = true;
+                break;
+            }
+        }
+#ifdef ESP_PLATFORM
+        if (had_cfg) {
+            esp_pthread_set_cfg(&prev_cfg);
+        } else {
+            esp_pthread_cfg_t def = esp_pthread_get_default_config();
+            esp_pthread_set_cfg(&def);
+        }
+#endif
+
+        args[0].job = &job;
+        args[0].index = 0;
+        band_worker(&args[0]);
+        for (int i = 1; i < job.workers; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+
+        bool ok = !job.failed;
+        for (int band = 0; ok && band < job.layout.bands; band++) {
+            ok = pStream->put_buf(job.streams[band].m_buf, job.streams[band].m_size);
+            if (ok) {
+                // RSTn between bands, EOI after the last one
+                uint8 marker[2] = { 0xFF, (uint8)(band + 1 < job.layout.bands ? 0xD0 + (band & 7) : 0xD9) };
+                ok = pStream->put_buf(marker, 2);
+            }
+        }
+        ok = ok && pStream->put_buf(NULL, 0);
+        delete[] job.streams;
+        return ok;
+    }
+
+} // namespace jpge
@@ -13,12 +13,23 @@ namespace jpge
     typedef unsigned int   uint32;
     typedef unsigned int   uint;
 
+    struct huffman_tables;
+    struct two_pass_state;
+    struct quant_tables;
+    struct rate_state;
+
     // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
     enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
 
+    // Layout of the scanlines passed to process_scanline(). SRC_AUTO takes gray, RGB or RGBA from
+    // src_channels. The others are converted straight into the encoder's YCbCr sample lines:
+    // SRC_BGR888 is B,G,R bytes, SRC_RGB565 big-endian RGB565, SRC_YUV422 Y0,U,Y1,V in BT.601
+    // limited range (16-235), expanded to the full range JFIF expects.
+    enum source_format_t { SRC_AUTO = 0, SRC_BGR888 = 1, SRC_RGB565 = 2, SRC_YUV422 = 3 };
+
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_restart_interval(0), m_source_format(SRC_AUTO), m_two_pass_flag(false), m_target_size(0) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +38,15 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if ((m_restart_interval < 0) || (m_restart_interval > 0xFFFF)) {
+                    return false;
+                }
+                if ((uint)m_source_format > (uint)SRC_YUV422) {
+                    return false;
+                }
+                if (m_target_size < 0) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,6 +59,25 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // MCUs between restart markers (DRI/RSTn), 0 = none.
+            int m_restart_interval;
+
+            // Scanline layout; src_channels must be its bytes per pixel (3 for BGR888, 2 for RGB565/YUV422).
+            source_format_t m_source_format;
+
+            // Two-pass encode with Huffman tables built for this image: the quantized blocks are kept
+            // (compactly, in SPIRAM when available) until the last scanline, then coded. Smaller output,
+            // nothing reaches the stream before process_scanline(NULL). Single-band encodes only.
+            bool m_two_pass_flag;
+
+            // Rate control: size budget of the file in bytes, 0 = off. The encoder then picks the highest
+            // quality up to m_quality whose file fits. If none does, not even quality 1, over_budget()
+            // is set and the encode fails without writing anything. The DCT coefficients of the whole
+            // image are kept (128 bytes per 8x8 block, in SPIRAM when available), and each trial quality
+            // only requantizes and entropy-codes them. Nothing reaches the stream before
+            // process_scanline(NULL). Single-band encodes only.
+            int m_target_size;
     };
     
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
@@ -73,6 +112,30 @@ namespace jpge
             // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
             void deinit();
 
+            // Band encoding (see compress_parallel): like init(), but the stream receives only the
+            // entropy-coded data of these scanlines - fresh DC predictors, byte aligned at the end,
+            // no markers. comp_params.m_restart_interval is ignored.
+            bool init_band(output_stream *pStream, int width, int height, int src_channels, const params &comp_params);
+
+            // Writes and flushes the headers (SOI through SOS, with DRI if a restart interval is set)
+            // of an image; no scanlines can follow. The caller appends the scan data and EOI.
+            bool write_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params);
+
+            // Size analysis: like init() without a stream. Feed the scanlines and NULL as usual, then
+            // predict_size() gives the exact size of the file init() with these params would write at
+            // any quality. m_quality and m_target_size are ignored.
+            bool init_analysis(int width, int height, int src_channels, const params &comp_params);
+
+            // Size in bytes of the complete file at quality (1-100), 0 on error. Analysis mode only.
+            uint predict_size(int quality);
+
+            // Quality of the file: comp_params.m_quality, or the one rate control chose.
+            int get_quality() const { return m_params.m_quality; }
+
+            // Rate control: true if the file did not fit m_target_size even at quality 1. The encode
+            // then fails without writing anything.
+            bool over_budget() const { return m_over_budget; }
+
         private:
             jpeg_encoder(const jpeg_encoder &);
             jpeg_encoder &operator =(const jpeg_encoder &);
@@ -102,7 +165,18 @@ namespace jpge
             uint m_bits_in;
             uint8 m_pass_num;
             bool m_all_stream_writes_succeeded;
-
+            bool m_over_budget;
+            enum open_mode_t { OPEN_IMAGE, OPEN_HEADERS, OPEN_BAND, OPEN_ANALYSIS };
+            open_mode_t m_open_mode;
+            uint m_mcus_to_restart;
+            uint8 m_restart_num;
+            const huffman_tables *m_huff;
+            two_pass_state *m_two_pass;
+            const quant_tables *m_quant;
+            quant_tables *m_fixed_quant;    // Tables at m_params.m_quality, owned by this encoder
+            rate_state *m_rate;
+
+            bool open(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, open_mode_t mode);
             bool jpg_open(int p_x_res, int p_y_res, int src_channels);
 
             void flush_output_buffer();
@@ -111,15 +185,20 @@ namespace jpge
             void emit_byte(uint8 i);
             void emit_word(uint i);
             void emit_marker(int marker);
+            void pad_bits();
 
             void emit_jfif_app0();
             void emit_dqt();
             void emit_sof();
-            void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
+            void emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_dri();
+            void emit_headers();
+            void restart_check();
 
-            void compute_quant_table(int32 *dst, const int16 *src);
+            void compute_quant_table(int32 *dst, const int16 *src, int quality);
+            void compute_quant_tables(quant_tables *t, int quality);
             void load_quantized_coefficients(int component_num);
 
             void load_block_8_8_grey(int x);
@@ -127,7 +206,16 @@ namespace jpge
             void load_block_16_8(int x, int c);
             void load_block_16_8_8(int x, int c);
 
+            int count_coefficients(int component_num);
+            void code_coefficients_pass_one(int component_num);
             void code_coefficients_pass_two(int component_num);
+            void build_optimal_tables();
+            bool code_stored_blocks();
+            void store_dct_block();
+            void load_dct_block(const int16 *pSrc, int component_num);
+            bool code_dct_blocks(int quality, output_stream *pStream);
+            uint coded_size(int quality);
+            int select_quality();
             void code_block(int component_num);
 
             void process_mcu_row();
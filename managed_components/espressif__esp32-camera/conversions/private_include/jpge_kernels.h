@@ -0,0 +1,54 @@
+// jpge_kernels.h - Per-block kernels of the jpge encoder: forward DCT and quantization.
+//
+// One implementation is picked at compile time: SSE2 or NEON when the compiler
+// targets them, the portable scalar code otherwise (or when JPGE_KERNELS_SCALAR
+// is defined). Every implementation produces bit-identical coefficients, so
+// the choice never changes the encoded file. ESP32-S3 builds use the scalar
+// code; see jpge_kernels.cpp.
+#ifndef JPGE_KERNELS_H
+#define JPGE_KERNELS_H
+
+#include "jpge.h"
+
+#if !defined(JPGE_KERNELS_SCALAR) && defined(__SSE2__)
+#define JPGE_KERNELS_SSE2 1
+#define JPGE_KERNELS_VECTOR 1
+#define JPGE_KERNELS_NAME "sse2"
+#elif !defined(JPGE_KERNELS_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define JPGE_KERNELS_NEON 1
+#define JPGE_KERNELS_VECTOR 1
+#define JPGE_KERNELS_NAME "neon"
+#else
+#define JPGE_KERNELS_VECTOR 0
+#define JPGE_KERNELS_NAME "scalar"
+#endif
+
+namespace jpge
+{
+    // Zigzag scan order (natural index of the i-th coefficient)
+    extern const uint8 s_zag[64];
+
+    // Quantizer constants in natural (row-major) order for the vector kernels;
+    // quantize_8x8 ignores them (and accepts NULL) in scalar builds
+    struct quant_recip {
+        float bias[64];     // (q >> 1) + 0.5
+        float recip[64];    // 1 / q
+    };
+
+    // Fill r from a quantization table in zigzag order.
+    void quant_recip_init(quant_recip *r, const int32 *q_zag);
+
+    // Forward DCT (jfdctint) of one 8x8 block of level-shifted samples, in place.
+    void fdct_8x8(int32 *block);
+
+    // Quantize one DCT block into zigzag order: round(|c| / q) with halves
+    // rounded up, sign restored. q_zag is the table in zigzag order.
+    void quantize_8x8(int16 *dst, const int32 *block, const int32 *q_zag, const quant_recip *r);
+
+    // Portable reference implementations, always built
+    void fdct_8x8_scalar(int32 *block);
+    void quantize_8x8_scalar(int16 *dst, const int32 *block, const int32 *q_zag);
+
+} // namespace jpge
+
+#endif // JPGE_KERNELS_H
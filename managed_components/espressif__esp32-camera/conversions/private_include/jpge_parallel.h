@@ -0,0 +1,36 @@
+// jpge_parallel.h - Multi-threaded encoding on top of jpge.
+//
+// The image is cut into bands of whole MCU rows. The restart interval is set
+// to exactly one band, so every band starts with fresh DC predictors at a byte
+// boundary and can be entropy-coded on its own thread. The bands are then
+// written in order, separated by RST0..RST7 markers, after a single set of
+// headers carrying the DRI marker. The result is byte-identical to a serial
+// encode with the same restart interval.
+#ifndef JPGE_PARALLEL_H
+#define JPGE_PARALLEL_H
+
+#include "jpge.h"
+
+namespace jpge
+{
+    // Return source line y in the layout given by params::m_source_format, or
+    // NULL on error. The line must stay valid until the next call from the same
+    // thread. Called concurrently from several threads with different y.
+    typedef const uint8 *(*scanline_reader)(void *ctx, int y);
+
+    // Number of bands compress_parallel() uses for an image, 1 if it would encode serially.
+    int parallel_band_count(int width, int height, const params &comp_params, int workers);
+
+    // Restart interval of the bands compress_parallel() uses, 0 if it would encode serially. A serial
+    // encode with this interval gives the same file.
+    int parallel_restart_interval(int width, int height, const params &comp_params, int workers);
+
+    // Compress width x height pixels read through read(ctx, y) into pStream
+    // using up to workers threads (the calling thread is one of them). Any
+    // m_restart_interval in comp_params is replaced by the band size.
+    bool compress_parallel(output_stream *pStream, int width, int height, int src_channels,
+                           const params &comp_params, int workers, scanline_reader read, void *ctx);
+
+} // namespace jpge
+
+#endif // JPGE_PARALLEL_H
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
@@ -19,7 +20,7 @@
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
+#include "jpge_parallel.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -43,102 +44,158 @@ static void *_malloc(size_t size)
     return NULL;
 }
 
-static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
+// Encoder input layout of a camera pixel format, false if the format cannot be encoded
+static bool source_format(pixformat_t format, jpge::source_format_t *src_format, int *bytes_per_pixel)
 {
-    int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
-        l = width * 3;
-        src += l * line;
-        for(i=0; i<l; i+=3) {
-            dst[o++] = src[i+2];
-            dst[o++] = src[i+1];
-            dst[o++] = src[i];
-        }
-    } else if(format == PIXFORMAT_RGB565) {
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=2) {
-            dst[o++] = src[i] & 0xF8;
-            dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
-            dst[o++] = (src[i+1] & 0x1F) << 3;
-        }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
+    switch (format) {
+    case PIXFORMAT_GRAYSCALE:
+        *src_format = jpge::SRC_AUTO;
+        *bytes_per_pixel = 1;
+        return true;
+    case PIXFORMAT_RGB888:
+        *src_format = jpge::SRC_BGR888;
+        *bytes_per_pixel = 3;
+        return true;
+    case PIXFORMAT_RGB565:
+        *src_format = jpge::SRC_RGB565;
+        *bytes_per_pixel = 2;
+        return true;
+    case PIXFORMAT_YUV422:
+        *src_format = jpge::SRC_YUV422;
+        *bytes_per_pixel = 2;
+        return true;
+    default:
+        return false;
     }
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+#if CONFIG_CAMERA_JPEG_ENCODE_WORKERS > 1
+typedef struct {
+    const uint8_t *src;
+    size_t stride;
+} line_reader_t;
+
+static const uint8_t *read_line(void *ctx, int y)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    line_reader_t *r = (line_reader_t *)ctx;
+    return r->src + y * r->stride;
+}
+#endif
 
-    if(format == PIXFORMAT_GRAYSCALE) {
-        num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+// Encoder parameters for a camera pixel format and encoder options, false if the format cannot be encoded
+static bool encode_params(pixformat_t format, const jpg_encode_config_t *config, jpge::params *comp_params, int *bytes_per_pixel)
+{
+    jpge::source_format_t src_format;
+    if (!source_format(format, &src_format, bytes_per_pixel)) {
+        ESP_LOGE(TAG, "Format %d can not be encoded", format);
+        return false;
     }
 
+    uint8_t quality = config->quality;
     if(!quality) {
         quality = 1;
     } else if(quality > 100) {
         quality = 100;
     }
 
-    jpge::params comp_params = jpge::params();
-    comp_params.m_subsampling = subsampling;
-    comp_params.m_quality = quality;
-
-    jpge::jpeg_encoder dst_image;
+    *comp_params = jpge::params();
+    comp_params->m_subsampling = format == PIXFORMAT_GRAYSCALE ? jpge::Y_ONLY : jpge::H2V2;
+    comp_params->m_quality = quality;
+    comp_params->m_source_format = src_format;
+    comp_params->m_two_pass_flag = config->optimize_huffman;
+    comp_params->m_target_size = config->target_size > INT_MAX ? INT_MAX : (int)config->target_size;
+    return true;
+}
 
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
-        ESP_LOGE(TAG, "JPG encoder init failed");
+static bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpge::output_stream *dst_stream)
+{
+    jpge::params comp_params;
+    int bytes_per_pixel;
+    if (!encode_params(format, config, &comp_params, &bytes_per_pixel)) {
         return false;
     }
+    size_t stride = (size_t)width * bytes_per_pixel;
+
+#if CONFIG_CAMERA_JPEG_ENCODE_WORKERS > 1
+    if (jpge::parallel_band_count(width, height, comp_params, CONFIG_CAMERA_JPEG_ENCODE_WORKERS) > 1) {
+        line_reader_t reader = { src, stride };
+        if (!jpge::compress_parallel(dst_stream, width, height, bytes_per_pixel, comp_params,
+                                     CONFIG_CAMERA_JPEG_ENCODE_WORKERS, read_line, &reader)) {
+            ESP_LOGE(TAG, "JPG parallel encode failed");
+            return false;
+        }
+        return true;
+    }
+#endif
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
+    jpge::jpeg_encoder dst_image;
+
+    if (!dst_image.init(dst_stream, width, height, bytes_per_pixel, comp_params)) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
         return false;
     }
 
+    // Scanlines go straight from the frame into the encoder's YCbCr sample lines
     for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
+        if (!dst_image.process_scanline(src + i * stride)) {
             ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
             return false;
         }
     }
-    free(line);
 
     if (!dst_image.process_scanline(NULL)) {
-        ESP_LOGE(TAG, "JPG image finish failed");
+        if (dst_image.over_budget()) {
+            ESP_LOGW(TAG, "JPG rate control: no quality fits %d bytes", comp_params.m_target_size);
+        } else {
+            ESP_LOGE(TAG, "JPG image finish failed");
+        }
         return false;
     }
+    if (comp_params.m_target_size) {
+        ESP_LOGD(TAG, "JPG rate control: quality %d, %u of %d bytes", dst_image.get_quality(),
+                 (unsigned)dst_stream->get_size(), comp_params.m_target_size);
+    }
     dst_image.deinit();
     return true;
 }
 
+bool fmt2jpg_predict_size(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const uint8_t *qualities, size_t count, size_t *sizes)
+{
+    jpge::params comp_params;
+    int bytes_per_pixel;
+    if (!encode_params(format, config, &comp_params, &bytes_per_pixel)) {
+        return false;
+    }
+    size_t stride = (size_t)width * bytes_per_pixel;
+#if CONFIG_CAMERA_JPEG_ENCODE_WORKERS > 1
+    // Band-parallel encodes equal a serial one with restart markers between the bands
+    comp_params.m_restart_interval = jpge::parallel_restart_interval(width, height, comp_params, CONFIG_CAMERA_JPEG_ENCODE_WORKERS);
+#endif
+
+    jpge::jpeg_encoder analysis;
+    if (!analysis.init_analysis(width, height, bytes_per_pixel, comp_params)) {
+        ESP_LOGE(TAG, "JPG analysis init failed");
+        return false;
+    }
+    for (int i = 0; i < height; i++) {
+        if (!analysis.process_scanline(src + i * stride)) {
+            ESP_LOGE(TAG, "JPG analysis line %u failed", i);
+            return false;
+        }
+    }
+    if (!analysis.process_scanline(NULL)) {
+        ESP_LOGE(TAG, "JPG analysis finish failed");
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint8_t quality = qualities[i] ? (qualities[i] > 100 ? 100 : qualities[i]) : 1;
+        if ((sizes[i] = analysis.predict_size(quality)) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 class callback_stream : public jpge::output_stream {
 protected:
     jpg_out_cb ocb;
@@ -150,10 +207,19 @@ public:
     virtual ~callback_stream() { }
     virtual bool put_buf(const void* data, int len)
     {
-        index += ocb(oarg, index, data, len);
+        size_t written = ocb(oarg, index, data, len);
+        if (!data) {
+            //end of image, passed on so the callback can finish its output
+            return true;
+        }
+        index += written;
+        if (written != (size_t)len) {
+            ESP_LOGE(TAG, "JPG output callback took %u of %d bytes", (unsigned)written, len);
+            return false;
+        }
         return true;
     }
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
@@ -162,7 +228,9 @@ public:
 bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
     callback_stream dst_stream(cb, arg);
-    return convert_image(src, width, height, format, quality, &dst_stream);
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+    return convert_image(src, width, height, format, &config, &dst_stream);
 }
 
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
@@ -172,15 +240,52 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
 
 
 
-class memory_stream : public jpge::output_stream {
+void jpg_chunks_free(jpg_chunk_t *chunks)
+{
+    while (chunks) {
+        jpg_chunk_t *next = chunks->next;
+        free(chunks->buf);
+        free(chunks);
+        chunks = next;
+    }
+}
+
+// Output kept in a list of segments allocated as the encoder fills them
+class chunk_stream : public jpge::output_stream {
 protected:
-    uint8_t *out_buf;
-    size_t max_len, index;
+    jpg_chunk_t *first, *last;
+    size_t first_size, last_cap, total;
+
+    bool add_chunk()
+    {
+        size_t size = first ? CONFIG_CAMERA_JPEG_CHUNK_SIZE : first_size;
+        jpg_chunk_t *chunk = (jpg_chunk_t *)malloc(sizeof(jpg_chunk_t));
+        uint8_t *buf = chunk ? (uint8_t *)_malloc(size) : NULL;
+        if (!buf) {
+            free(chunk);
+            ESP_LOGE(TAG, "JPG output overflow: no memory for %u more bytes after %u", (unsigned)size, (unsigned)total);
+            return false;
+        }
+        chunk->next = NULL;
+        chunk->buf = buf;
+        chunk->len = 0;
+        if (last) {
+            last->next = chunk;
+        } else {
+            first = chunk;
+        }
+        last = chunk;
+        last_cap = size;
+        return true;
+    }
 
 public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
+    chunk_stream(size_t first_chunk_size) : first(NULL), last(NULL), first_size(first_chunk_size), last_cap(0), total(0) { }
 
-    virtual ~memory_stream() { }
+    virtual ~chunk_stream()
+    {
+        jpg_chunks_free(first);
+    }
 
     virtual bool put_buf(const void* pBuf, int len)
     {
@@ -188,48 +293,211 @@ public:
             //end of image
             return true;
         }
-        if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
+        const uint8_t *p = static_cast<const uint8_t*>(pBuf);
+        while (len > 0) {
+            if ((!last || last->len == last_cap) && !add_chunk()) {
+                return false;
+            }
+            size_t n = last_cap - last->len;
+            if (n > (size_t)len) {
+                n = len;
+            }
+            memcpy(last->buf + last->len, p, n);
+            last->len += n;
+            total += n;
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    virtual jpge::uint get_size() const
+    {
+        return total;
+    }
+
+    // Hand the segment list over to the caller
+    jpg_chunk_t *release()
+    {
+        jpg_chunk_t *chunks = first;
+        first = last = NULL;
+        return chunks;
+    }
+
+    // Hand the output over as one buffer; no copy if it fit in the first segment
+    uint8_t *release_contiguous()
+    {
+        uint8_t *out;
+        if (first && !first->next) {
+            out = first->buf;
+            uint8_t *shrunk = (uint8_t *)realloc(out, total);
+            if (shrunk) {
+                out = shrunk;
+            }
+            first->buf = NULL;
+        } else {
+            out = (uint8_t *)_malloc(total);
+            if (!out) {
+                ESP_LOGE(TAG, "JPG output malloc failed: %u bytes", (unsigned)total);
+                return NULL;
+            }
+            size_t index = 0;
+            for (jpg_chunk_t *c = first; c; c = c->next) {
+                memcpy(out + index, c->buf, c->len);
+                index += c->len;
+            }
+        }
+        jpg_chunks_free(release());
+        return out;
+    }
+};
+
+// Output written to a file in whole staging buffers
+class file_stream : public jpge::output_stream {
+protected:
+    FILE *file;
+    uint8_t *stage;
+    size_t stage_size, staged, index;
+
+    bool write_stage()
+    {
+        if (staged && fwrite(stage, 1, staged, file) != staged) {
+            ESP_LOGE(TAG, "JPG file write failed at %u bytes", (unsigned)(index - staged));
+            return false;
         }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
-            index += len;
+        staged = 0;
+        return true;
+    }
+
+public:
+    file_stream(FILE *f) : file(f), stage(NULL), stage_size(0), staged(0), index(0)
+    {
+        size_t size = CONFIG_CAMERA_JPEG_FILE_CHUNK_SIZE & ~(size_t)511;
+        // Internal DMA-capable memory lets the SD driver transfer straight from the buffer
+        stage = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+        if (!stage) {
+            stage = (uint8_t *)_malloc(size);
+        }
+        if (stage) {
+            stage_size = size;
+        }
+    }
+
+    virtual ~file_stream()
+    {
+        free(stage);
+    }
+
+    bool ok() const
+    {
+        return stage != NULL;
+    }
+
+    virtual bool put_buf(const void* pBuf, int len)
+    {
+        if (!pBuf) {
+            //end of image
+            return write_stage() && fflush(file) == 0;
+        }
+        const uint8_t *p = static_cast<const uint8_t*>(pBuf);
+        while (len > 0) {
+            size_t n = stage_size - staged;
+            if (n > (size_t)len) {
+                n = len;
+            }
+            memcpy(stage + staged, p, n);
+            staged += n;
+            index += n;
+            p += n;
+            len -= n;
+            if (staged == stage_size && !write_stage()) {
+                return false;
+            }
         }
         return true;
     }
 
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
 };
 
-bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+// First segment for a contiguous result: room for about 2 bits per pixel
+static size_t contiguous_estimate(uint16_t width, uint16_t height)
 {
-    //todo: allocate proper buffer for holding JPEG data
-    //this should be enough for CIF frame size
-    int jpg_buf_len = 128*1024;
+    return (size_t)width * height / 4 + 1024;
+}
 
+bool fmt2jpg_config(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len)
+{
+    chunk_stream dst_stream(contiguous_estimate(width, height));
 
-    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg_buf_len);
-    if(jpg_buf == NULL) {
-        ESP_LOGE(TAG, "JPG buffer malloc failed");
+    if(!convert_image(src, width, height, format, config, &dst_stream)) {
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
 
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
-        free(jpg_buf);
+    size_t len = dst_stream.get_size();
+    uint8_t *jpg_buf = dst_stream.release_contiguous();
+    if (!jpg_buf) {
         return false;
     }
-
     *out = jpg_buf;
+    *out_len = len;
+    return true;
+}
+
+bool fmt2jpg_chunked(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_chunk_t ** out, size_t * out_len)
+{
+    chunk_stream dst_stream(CONFIG_CAMERA_JPEG_CHUNK_SIZE);
+
+    if(!convert_image(src, width, height, format, config, &dst_stream)) {
+        return false;
+    }
+
     *out_len = dst_stream.get_size();
+    *out = dst_stream.release();
     return true;
 }
 
+bool fmt2jpg_file(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, FILE *file, size_t * out_len)
+{
+    file_stream dst_stream(file);
+    if (!dst_stream.ok()) {
+        ESP_LOGE(TAG, "JPG file buffer malloc failed");
+        return false;
+    }
+
+    bool ok = convert_image(src, width, height, format, config, &dst_stream);
+    if (out_len) {
+        *out_len = dst_stream.get_size();
+    }
+    return ok;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+    return fmt2jpg_config(src, src_len, width, height, format, &config, out, out_len);
+}
+
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
 {
     return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
 }
+
+bool frame2jpg_config(camera_fb_t * fb, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_config(fb->buf, fb->len, fb->width, fb->height, fb->format, config, out, out_len);
+}
+
+bool frame2jpg_chunked(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_chunk_t ** out, size_t * out_len)
+{
+    return fmt2jpg_chunked(fb->buf, fb->len, fb->width, fb->height, fb->format, config, out, out_len);
+}
+
+bool frame2jpg_file(camera_fb_t * fb, const jpg_encode_config_t *config, FILE *file, size_t * out_len)
+{
+    return fmt2jpg_file(fb->buf, fb->len, fb->width, fb->height, fb->format, config, file, out_len);
+}
@@ -20,6 +20,7 @@
 #include "freertos/task.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "cam_jpeg.h"
 
 #if (ESP_IDF_VERSION_MAJOR == 3) && (ESP_IDF_VERSION_MINOR == 3)
 #include "rom/ets_sys.h"
@@ -69,6 +70,19 @@ static portMUX_TYPE g_psram_dma_lock = portMUX_INITIALIZER_UNLOCKED;
 #define CAM_LOG_SPAM_EVERY_FRAME 0   /* set to 1 to restore old behaviour */
 #endif
 
+#if CONFIG_CAMERA_TRACE
+static volatile camera_trace_cb_t s_trace_cb = NULL;
+#define CAM_TRACE(point, fb)                  \
+    do {                                      \
+        camera_trace_cb_t cb = s_trace_cb;    \
+        if (cb) {                             \
+            cb((point), (fb));                \
+        }                                     \
+    } while (0)
+#else
+#define CAM_TRACE(point, fb) do { } while (0)
+#endif
+
 /* Number of bytes copied to SRAM for SOI validation when capturing
  * directly to PSRAM. Tunable to probe more of the frame start if needed. */
 #ifndef CAM_SOI_PROBE_BYTES
@@ -151,11 +165,9 @@ static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
         return -1;
     }
 
-    for (uint32_t i = 0; i <= length - JPEG_SOI_MARKER_LEN; i++) {
-        if (memcmp(&inbuf[i], JPEG_SOI_MARKER, JPEG_SOI_MARKER_LEN) == 0) {
-            //ESP_LOGW(TAG, "SOI: %d", (int) i);
-            return i;
-        }
+    int soi_off = cam_jpeg_find_marker(inbuf, length, JPEG_SOI_MARKER, JPEG_SOI_MARKER_LEN);
+    if (soi_off >= 0) {
+        return soi_off;
     }
 
     CAM_WARN_THROTTLE(warn_soi_miss_cnt,
@@ -172,36 +184,8 @@ static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length, bool searc
     if (search_forward) {
         /* Scan forward to honor the earliest marker in the buffer. This avoids
          * returning an EOI that belongs to a larger previous frame when the tail
-         * of that frame still resides in PSRAM. JPEG data is pseudo random, so
-         * the first marker byte appears rarely; test four positions per load to
-         * reduce memory traffic. */
-        const uint8_t *pat = JPEG_EOI_BYTES;
-        const uint32_t A = pat[0] * 0x01010101u;
-        const uint32_t ONE = 0x01010101u;
-        const uint32_t HIGH = 0x80808080u;
-        uint32_t i = 0;
-        while (i + 4 <= length) {
-            uint32_t w;
-            memcpy(&w, inbuf + i, 4); /* unaligned load is allowed */
-            uint32_t x = w ^ A; /* identify bytes equal to first marker byte */
-            uint32_t m = (~x & (x - ONE)) & HIGH; /* mask has high bit set for candidate bytes */
-            while (m) { /* handle only candidates to avoid unnecessary memcmp calls */
-                unsigned off = __builtin_ctz(m) >> 3;
-                uint32_t pos = i + off;
-                if (pos + JPEG_EOI_MARKER_LEN <= length &&
-                    memcmp(inbuf + pos, pat, JPEG_EOI_MARKER_LEN) == 0) {
-                    return pos;
-                }
-                m &= m - 1; /* clear processed candidate */
-            }
-            i += 4;
-        }
-        for (; i + JPEG_EOI_MARKER_LEN <= length; i++) {
-            if (memcmp(inbuf + i, pat, JPEG_EOI_MARKER_LEN) == 0) {
-                return i;
-            }
-        }
-        return -1;
+         * of that frame still resides in PSRAM. */
+        return cam_jpeg_find_marker(inbuf, length, JPEG_EOI_BYTES, JPEG_EOI_MARKER_LEN);
     }
 
     const uint8_t *dptr = inbuf + length - JPEG_EOI_MARKER_LEN;
@@ -217,6 +201,39 @@ static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length, bool searc
     return -1;
 }
 
+#if CONFIG_CAMERA_JPEG_VALIDATE
+/* Framesize the sensor is currently programmed for; the driver's own width
+ * and height only reflect the size given to cam_config(). */
+static const framesize_t *s_tracked_framesize = NULL;
+
+static bool cam_jpeg_frame_ok(const camera_fb_t *fb)
+{
+    static uint16_t warn_jpeg_bad_cnt = 0;
+    uint16_t width = cam_obj->width;
+    uint16_t height = cam_obj->height;
+    if (s_tracked_framesize) {
+        width = resolution[*s_tracked_framesize].width;
+        height = resolution[*s_tracked_framesize].height;
+    }
+
+    switch (cam_jpeg_validate(fb->buf, fb->len, width, height)) {
+    case CAM_JPEG_OK:
+        return true;
+    case CAM_JPEG_SIZE_MISMATCH:
+        CAM_WARN_THROTTLE(warn_jpeg_bad_cnt, "BAD-JPEG - SOF size differs from framesize");
+        break;
+    case CAM_JPEG_NO_SOS:
+    case CAM_JPEG_NO_SCAN_DATA:
+        CAM_WARN_THROTTLE(warn_jpeg_bad_cnt, "BAD-JPEG - frame truncated before scan data");
+        break;
+    default:
+        CAM_WARN_THROTTLE(warn_jpeg_bad_cnt, "BAD-JPEG - corrupt header");
+        break;
+    }
+    return false;
+}
+#endif
+
 static bool cam_get_next_frame(int * frame_pos)
 {
     if(!cam_obj->frames[*frame_pos].en){
@@ -241,6 +258,7 @@ static bool cam_start_frame(int * frame_pos)
             uint64_t us = (uint64_t)esp_timer_get_time();
             cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
+            CAM_TRACE(CAMERA_TRACE_VSYNC, &cam_obj->frames[*frame_pos].fb);
             return true;
         }
     }
@@ -401,6 +419,9 @@ static void cam_task(void *arg)
                             }
                         }
                         //send frame
+                        if (!cam_obj->frames[frame_pos].en) {
+                            CAM_TRACE(CAMERA_TRACE_QUEUED, frame_buffer_event);
+                        }
                         if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
                             //pop frame buffer from the queue
                             camera_fb_t * fb2 = NULL;
@@ -761,6 +782,13 @@ camera_fb_t *cam_take(TickType_t timeout)
                     /* DMA may bypass cache, ensure full frame is visible */
                     cam_drop_psram_cache(dma_buffer->buf, dma_buffer->len);
                 }
+#if CONFIG_CAMERA_JPEG_VALIDATE
+                if (!cam_jpeg_frame_ok(dma_buffer)) {
+                    cam_give(dma_buffer);
+                    continue; /* wait for another frame */
+                }
+#endif
+                CAM_TRACE(CAMERA_TRACE_TAKEN, dma_buffer);
                 return dma_buffer;
             }
 
@@ -781,6 +809,7 @@ skip_eoi_check:
             cam_drop_psram_cache(dma_buffer->buf, dma_buffer->len);
         }
 
+        CAM_TRACE(CAMERA_TRACE_TAKEN, dma_buffer);
         return dma_buffer;
     }
 }
@@ -817,3 +846,19 @@ bool cam_get_psram_mode(void)
 {
     return g_psram_dma_mode;
 }
+
+#if CONFIG_CAMERA_TRACE
+void cam_set_trace_cb(camera_trace_cb_t cb)
+{
+    s_trace_cb = cb;
+}
+#endif
+
+void cam_track_framesize(const framesize_t *framesize)
+{
+#if CONFIG_CAMERA_JPEG_VALIDATE
+    s_tracked_framesize = framesize;
+#else
+    (void)framesize;
+#endif
+}
@@ -0,0 +1,118 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "cam_jpeg.h"
+
+/* JPEG marker codes used by the structural check */
+#define JPEG_M_SOI  0xD8
+#define JPEG_M_EOI  0xD9
+#define JPEG_M_SOS  0xDA
+#define JPEG_M_DHT  0xC4
+#define JPEG_M_JPG  0xC8
+#define JPEG_M_DAC  0xCC
+
+int cam_jpeg_find_marker(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len)
+{
+    if (pat_len == 0 || len < pat_len) {
+        return -1;
+    }
+
+    const uint32_t A = pat[0] * 0x01010101u;
+    const uint32_t ONE = 0x01010101u;
+    const uint32_t HIGH = 0x80808080u;
+    size_t i = 0;
+    while (i + 4 <= len) {
+        uint32_t w;
+        memcpy(&w, buf + i, 4); /* unaligned load is allowed */
+        uint32_t x = w ^ A; /* identify bytes equal to first marker byte */
+        uint32_t m = (~x & (x - ONE)) & HIGH; /* mask has high bit set for candidate bytes */
+        while (m) { /* handle only candidates to avoid unnecessary memcmp calls */
+            unsigned off = __builtin_ctz(m) >> 3;
+            size_t pos = i + off;
+            if (pos + pat_len <= len && memcmp(buf + pos, pat, pat_len) == 0) {
+                return pos;
+            }
+            m &= m - 1; /* clear processed candidate */
+        }
+        i += 4;
+    }
+    for (; i + pat_len <= len; i++) {
+        if (memcmp(buf + i, pat, pat_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline int is_sof_marker(uint8_t m)
+{
+    return m >= 0xC0 && m <= 0xCF && m != JPEG_M_DHT && m != JPEG_M_JPG && m != JPEG_M_DAC;
+}
+
+cam_jpeg_check_t cam_jpeg_validate(const uint8_t *buf, size_t len, uint16_t width, uint16_t height)
+{
+    if (len < 4 || buf[0] != 0xFF || buf[1] != JPEG_M_SOI) {
+        return CAM_JPEG_NO_SOI;
+    }
+
+    size_t pos = 2;
+    int have_sof = 0;
+    while (pos + 4 <= len) {
+        if (buf[pos] != 0xFF) {
+            return CAM_JPEG_BAD_SEGMENT;
+        }
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF) { /* fill byte */
+            pos++;
+            continue;
+        }
+        if (marker == JPEG_M_SOI || marker == JPEG_M_EOI) {
+            return have_sof ? CAM_JPEG_NO_SOS : CAM_JPEG_BAD_SEGMENT;
+        }
+
+        size_t seg_len = read_be16(buf + pos + 2);
+        if (seg_len < 2 || pos + 2 + seg_len > len) {
+            return CAM_JPEG_BAD_SEGMENT;
+        }
+
+        if (is_sof_marker(marker)) {
+            /* length(2) precision(1) height(2) width(2) components(1) */
+            if (seg_len < 8) {
+                return CAM_JPEG_BAD_SEGMENT;
+            }
+            if (width && (read_be16(buf + pos + 7) != width ||
+                          read_be16(buf + pos + 5) != height)) {
+                return CAM_JPEG_SIZE_MISMATCH;
+            }
+            have_sof = 1;
+        } else if (marker == JPEG_M_SOS) {
+            if (!have_sof) {
+                return CAM_JPEG_NO_SOF;
+            }
+            /* entropy data must sit between the scan header and EOI */
+            if (pos + 2 + seg_len + 2 >= len) {
+                return CAM_JPEG_NO_SCAN_DATA;
+            }
+            return CAM_JPEG_OK;
+        }
+        pos += 2 + seg_len;
+    }
+    return CAM_JPEG_NO_SOS;
+}
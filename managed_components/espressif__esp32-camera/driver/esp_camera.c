@@ -335,6 +335,7 @@ esp_err_t esp_camera_init(const camera_config_t *config)
 
     s_state->sensor.status.framesize = frame_size;
     s_state->sensor.pixformat = pix_format;
+    cam_track_framesize(&s_state->sensor.status.framesize);
 
     ESP_LOGD(TAG, "Setting frame size to %dx%d", resolution[frame_size].width, resolution[frame_size].height);
     if (s_state->sensor.set_framesize(&s_state->sensor, frame_size) != 0) {
@@ -372,6 +373,7 @@ fail:
 
 esp_err_t esp_camera_deinit()
 {
+    cam_track_framesize(NULL);
     esp_err_t ret = cam_deinit();
     CAMERA_DISABLE_OUT_CLOCK();
     if (s_state) {
@@ -535,6 +537,13 @@ esp_err_t esp_camera_reconfigure(const camera_config_t *config)
     return esp_camera_init(&s_saved_config);
 }
 
+#if CONFIG_CAMERA_TRACE
+void esp_camera_set_trace_cb(camera_trace_cb_t cb)
+{
+    cam_set_trace_cb(cb);
+}
+#endif
+
 esp_err_t esp_camera_set_psram_mode(bool enable)
 {
     cam_set_psram_mode(enable);
@@ -0,0 +1,665 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * esp_camera API on Linux: a producer thread plays the role of the camera
+ * task and writes the next JPEG of the replay set into a free frame buffer
+ * slot once per frame period. Slots are FREE, QUEUED or HELD (returned by
+ * esp_camera_fb_get() and not yet given back). With no FREE slot the frame
+ * is dropped, or in CAMERA_GRAB_LATEST mode the oldest queued frame is
+ * replaced, which is what the driver does when the application holds on
+ * to its buffers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+
+#define SIM_FB_GET_TIMEOUT_MS 4000   /* same as esp_camera_fb_get() */
+#define SIM_MAX_FILES         256
+
+#define SIM_LOGE(fmt, ...) fprintf(stderr, "E camera_sim: " fmt "\n", ##__VA_ARGS__)
+#define SIM_LOGI(fmt, ...) fprintf(stderr, "I camera_sim: " fmt "\n", ##__VA_ARGS__)
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_HELD,
+} sim_slot_state_t;
+
+typedef struct {
+    camera_fb_t fb;
+    sim_slot_state_t state;
+    uint32_t seq;               /* production order, oldest queued is delivered first */
+} sim_slot_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+} sim_file_t;
+
+typedef struct {
+    camera_sim_config_t cfg;
+    camera_config_t config;
+    sensor_t sensor;
+
+    sim_file_t files[SIM_MAX_FILES];
+    size_t file_count;
+    size_t next_file;
+
+    sim_slot_t *slots;
+    size_t slot_count;
+    size_t slot_size;
+    uint32_t next_seq;
+
+    pthread_t producer;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;      /* signalled when a frame is queued */
+    pthread_cond_t wake;        /* wakes the producer for shutdown */
+    bool running;
+
+    unsigned int rand_state;
+    uint32_t get_calls;
+    camera_sim_stats_t stats;
+} sim_state_t;
+
+static camera_sim_config_t s_sim_config = CAMERA_SIM_CONFIG_DEFAULT();
+static sim_state_t *s_state = NULL;
+#if CONFIG_CAMERA_TRACE
+static camera_trace_cb_t s_trace_cb = NULL;
+#define SIM_TRACE(point, fb) do { if (s_trace_cb) s_trace_cb((point), (fb)); } while (0)
+#else
+#define SIM_TRACE(point, fb) do { } while (0)
+#endif
+
+static int64_t sim_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sim_deadline(struct timespec *ts, uint32_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void sim_sleep_us(int64_t us)
+{
+    if (us <= 0) {
+        return;
+    }
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/* Read width and height from the first SOF segment, 0 if there is none */
+static void sim_jpeg_size(const uint8_t *buf, size_t len, uint16_t *width, uint16_t *height)
+{
+    *width = 0;
+    *height = 0;
+    size_t pos = 2;
+    while (pos + 9 <= len && buf[pos] == 0xFF) {
+        uint8_t m = buf[pos + 1];
+        size_t seg_len = (buf[pos + 2] << 8) | buf[pos + 3];
+        if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+            *height = (buf[pos + 5] << 8) | buf[pos + 6];
+            *width = (buf[pos + 7] << 8) | buf[pos + 8];
+            return;
+        }
+        if (m == 0xDA) {
+            return;
+        }
+        pos += 2 + seg_len;
+    }
+}
+
+static int sim_name_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static bool sim_is_jpeg(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+static esp_err_t sim_load_files(sim_state_t *st, const char *dir_path)
+{
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        SIM_LOGE("Cannot open frame directory %s", dir_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char *names[SIM_MAX_FILES];
+    size_t count = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && count < SIM_MAX_FILES) {
+        if (sim_is_jpeg(ent->d_name)) {
+            names[count++] = strdup(ent->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, count, sizeof(names[0]), sim_name_cmp);
+
+    for (size_t i = 0; i < count; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        free(names[i]);
+
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8_t *data = len > 0 ? malloc(len) : NULL;
+        if (data && fread(data, 1, len, f) == (size_t)len) {
+            sim_file_t *file = &st->files[st->file_count++];
+            file->data = data;
+            file->len = len;
+            sim_jpeg_size(data, len, &file->width, &file->height);
+        } else {
+            free(data);
+        }
+        fclose(f);
+    }
+
+    if (st->file_count == 0) {
+        SIM_LOGE("No JPEG files in %s", dir_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+/* Pick the slot for a new frame (lock held), NULL if the frame is dropped */
+static sim_slot_t *sim_claim_slot(sim_state_t *st)
+{
+    sim_slot_t *oldest = NULL;
+    for (size_t i = 0; i < st->slot_count; i++) {
+        sim_slot_t *slot = &st->slots[i];
+        if (slot->state == SLOT_FREE) {
+            return slot;
+        }
+        if (slot->state == SLOT_QUEUED && (!oldest || slot->seq < oldest->seq)) {
+            oldest = slot;
+        }
+    }
+    if (oldest && st->config.grab_mode == CAMERA_GRAB_LATEST) {
+        st->stats.overwritten++;
+        return oldest;
+    }
+    st->stats.dropped++;
+    return NULL;
+}
+
+static void sim_produce(sim_state_t *st)
+{
+    sim_slot_t *slot = sim_claim_slot(st);
+    if (!slot) {
+        return;
+    }
+
+    const sim_file_t *file = &st->files[st->next_file];
+    st->next_file = (st->next_file + 1) % st->file_count;
+
+    int64_t us = sim_now_us();
+    slot->fb.timestamp.tv_sec = us / 1000000;
+    slot->fb.timestamp.tv_usec = us % 1000000;
+    SIM_TRACE(CAMERA_TRACE_VSYNC, &slot->fb);
+
+    size_t len = file->len < st->slot_size ? file->len : st->slot_size;
+    memcpy(slot->fb.buf, file->data, len);
+    slot->fb.len = len;
+    slot->fb.width = file->width;
+    slot->fb.height = file->height;
+    slot->fb.format = st->sensor.pixformat;
+
+    st->stats.produced++;
+    if (st->cfg.corrupt_every && st->stats.produced % st->cfg.corrupt_every == 0) {
+        /* cut somewhere in the middle half; the tail and its EOI are lost */
+        size_t cut = len / 4 + (size_t)rand_r(&st->rand_state) % (len / 2 + 1);
+        slot->fb.len = cut;
+        st->stats.corrupted++;
+    }
+
+    slot->state = SLOT_QUEUED;
+    slot->seq = st->next_seq++;
+    SIM_TRACE(CAMERA_TRACE_QUEUED, &slot->fb);
+    pthread_cond_broadcast(&st->queued);
+}
+
+static void *sim_producer_task(void *arg)
+{
+    sim_state_t *st = (sim_state_t *)arg;
+    uint32_t fps = st->cfg.fps ? st->cfg.fps : 1;
+    int64_t period_us = 1000000 / fps;
+    int64_t next_us = sim_now_us();
+
+    pthread_mutex_lock(&st->lock);
+    while (st->running) {
+        sim_produce(st);
+
+        next_us += period_us;
+        int64_t wait_us = next_us - sim_now_us();
+        if (wait_us > 0) {
+            struct timespec ts;
+            sim_deadline(&ts, 0);
+            ts.tv_sec += wait_us / 1000000;
+            ts.tv_nsec += (wait_us % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            while (st->running &&
+                   pthread_cond_timedwait(&st->wake, &st->lock, &ts) != ETIMEDOUT) {
+            }
+        } else {
+            next_us = sim_now_us(); /* fell behind, do not burst */
+        }
+    }
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+/* Sensor stand-in: setters only record the value in status */
+#define SIM_SETTER(name, field)                                \
+    static int sim_##name(sensor_t *sensor, int value)         \
+    {                                                          \
+        sensor->status.field = value;                          \
+        return 0;                                              \
+    }
+
+SIM_SETTER(set_contrast, contrast)
+SIM_SETTER(set_brightness, brightness)
+SIM_SETTER(set_saturation, saturation)
+SIM_SETTER(set_sharpness, sharpness)
+SIM_SETTER(set_denoise, denoise)
+SIM_SETTER(set_quality, quality)
+SIM_SETTER(set_colorbar, colorbar)
+SIM_SETTER(set_whitebal, awb)
+SIM_SETTER(set_gain_ctrl, agc)
+SIM_SETTER(set_exposure_ctrl, aec)
+SIM_SETTER(set_hmirror, hmirror)
+SIM_SETTER(set_vflip, vflip)
+SIM_SETTER(set_aec2, aec2)
+SIM_SETTER(set_awb_gain, awb_gain)
+SIM_SETTER(set_agc_gain, agc_gain)
+SIM_SETTER(set_aec_value, aec_value)
+SIM_SETTER(set_special_effect, special_effect)
+SIM_SETTER(set_wb_mode, wb_mode)
+SIM_SETTER(set_ae_level, ae_level)
+SIM_SETTER(set_dcw, dcw)
+SIM_SETTER(set_bpc, bpc)
+SIM_SETTER(set_wpc, wpc)
+SIM_SETTER(set_raw_gma, raw_gma)
+SIM_SETTER(set_lenc, lenc)
+
+static int sim_init_status(sensor_t *sensor)
+{
+    return 0;
+}
+
+static int sim_reset(sensor_t *sensor)
+{
+    return 0;
+}
+
+static int sim_set_pixformat(sensor_t *sensor, pixformat_t pixformat)
+{
+    if (pixformat != PIXFORMAT_JPEG) {
+        return -1; /* replay set is JPEG only */
+    }
+    sensor->pixformat = pixformat;
+    return 0;
+}
+
+static int sim_set_framesize(sensor_t *sensor, framesize_t framesize)
+{
+    if (framesize >= FRAMESIZE_INVALID) {
+        return -1;
+    }
+    sensor->status.framesize = framesize;
+    return 0;
+}
+
+static int sim_set_gainceiling(sensor_t *sensor, gainceiling_t gainceiling)
+{
+    sensor->status.gainceiling = gainceiling;
+    return 0;
+}
+
+static int sim_get_reg(sensor_t *sensor, int reg, int mask)
+{
+    return 0;
+}
+
+static int sim_set_reg(sensor_t *sensor, int reg, int mask, int value)
+{
+    return 0;
+}
+
+static void sim_sensor_init(sensor_t *sensor, const camera_config_t *config)
+{
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->id.PID = OV3660_PID;
+    sensor->slv_addr = OV3660_SCCB_ADDR;
+    sensor->xclk_freq_hz = config->xclk_freq_hz;
+    sensor->pixformat = PIXFORMAT_JPEG;
+    sensor->status.framesize = config->frame_size;
+    sensor->status.quality = config->jpeg_quality;
+
+    sensor->init_status = sim_init_status;
+    sensor->reset = sim_reset;
+    sensor->set_pixformat = sim_set_pixformat;
+    sensor->set_framesize = sim_set_framesize;
+    sensor->set_contrast = sim_set_contrast;
+    sensor->set_brightness = sim_set_brightness;
+    sensor->set_saturation = sim_set_saturation;
+    sensor->set_sharpness = sim_set_sharpness;
+    sensor->set_denoise = sim_set_denoise;
+    sensor->set_gainceiling = sim_set_gainceiling;
+    sensor->set_quality = sim_set_quality;
+    sensor->set_colorbar = sim_set_colorbar;
+    sensor->set_whitebal = sim_set_whitebal;
+    sensor->set_gain_ctrl = sim_set_gain_ctrl;
+    sensor->set_exposure_ctrl = sim_set_exposure_ctrl;
+    sensor->set_hmirror = sim_set_hmirror;
+    sensor->set_vflip = sim_set_vflip;
+    sensor->set_aec2 = sim_set_aec2;
+    sensor->set_awb_gain = sim_set_awb_gain;
+    sensor->set_agc_gain = sim_set_agc_gain;
+    sensor->set_aec_value = sim_set_aec_value;
+    sensor->set_special_effect = sim_set_special_effect;
+    sensor->set_wb_mode = sim_set_wb_mode;
+    sensor->set_ae_level = sim_set_ae_level;
+    sensor->set_dcw = sim_set_dcw;
+    sensor->set_bpc = sim_set_bpc;
+    sensor->set_wpc = sim_set_wpc;
+    sensor->set_raw_gma = sim_set_raw_gma;
+    sensor->set_lenc = sim_set_lenc;
+    sensor->get_reg = sim_get_reg;
+    sensor->set_reg = sim_set_reg;
+}
+
+static void sim_free(sim_state_t *st)
+{
+    if (st->slots) {
+        for (size_t i = 0; i < st->slot_count; i++) {
+            free(st->slots[i].fb.buf);
+        }
+        free(st->slots);
+    }
+    for (size_t i = 0; i < st->file_count; i++) {
+        free(st->files[i].data);
+    }
+    pthread_mutex_destroy(&st->lock);
+    pthread_cond_destroy(&st->queued);
+    pthread_cond_destroy(&st->wake);
+    free(st);
+}
+
+void esp_camera_sim_configure(const camera_sim_config_t *config)
+{
+    s_sim_config = *config;
+}
+
+void esp_camera_sim_get_stats(camera_sim_stats_t *stats)
+{
+    if (!s_state) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pthread_mutex_lock(&s_state->lock);
+    *stats = s_state->stats;
+    pthread_mutex_unlock(&s_state->lock);
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    if (s_state) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pixel_format != PIXFORMAT_JPEG) {
+        SIM_LOGE("Only PIXFORMAT_JPEG can be replayed");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    sim_state_t *st = calloc(1, sizeof(sim_state_t));
+    if (!st) {
+        return ESP_ERR_NO_MEM;
+    }
+    st->cfg = s_sim_config;
+    st->config = *config;
+    st->rand_state = st->cfg.seed;
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&st->queued, &attr);
+    pthread_cond_init(&st->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    const char *dir = getenv("ESP_CAMERA_SIM_DIR");
+    esp_err_t err = sim_load_files(st, dir ? dir : st->cfg.frame_dir);
+    if (err != ESP_OK) {
+        sim_free(st);
+        return err;
+    }
+
+    /* One slot per fb_count, sized for the largest file like the JPEG fb_size */
+    st->slot_count = config->fb_count ? config->fb_count : 1;
+    for (size_t i = 0; i < st->file_count; i++) {
+        if (st->files[i].len > st->slot_size) {
+            st->slot_size = st->files[i].len;
+        }
+    }
+    st->slots = calloc(st->slot_count, sizeof(sim_slot_t));
+    if (!st->slots) {
+        sim_free(st);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < st->slot_count; i++) {
+        st->slots[i].fb.buf = malloc(st->slot_size);
+        if (!st->slots[i].fb.buf) {
+            sim_free(st);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    sim_sensor_init(&st->sensor, config);
+
+    st->running = true;
+    if (pthread_create(&st->producer, NULL, sim_producer_task, st) != 0) {
+        sim_free(st);
+        return ESP_FAIL;
+    }
+    s_state = st;
+    SIM_LOGI("Replaying %u frames at %u fps into %u slots",
+             (unsigned)st->file_count, (unsigned)st->cfg.fps, (unsigned)st->slot_count);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void)
+{
+    sim_state_t *st = s_state;
+    if (!st) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&st->lock);
+    st->running = false;
+    pthread_cond_broadcast(&st->wake);
+    pthread_cond_broadcast(&st->queued);
+    pthread_mutex_unlock(&st->lock);
+    pthread_join(st->producer, NULL);
+
+    s_state = NULL;
+    sim_free(st);
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void)
+{
+    sim_state_t *st = s_state;
+    if (!st) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->get_calls++;
+    if (st->cfg.null_every && st->get_calls % st->cfg.null_every == 0) {
+        st->stats.null_frames++;
+        pthread_mutex_unlock(&st->lock);
+        return NULL;
+    }
+
+    struct timespec deadline;
+    sim_deadline(&deadline, SIM_FB_GET_TIMEOUT_MS);
+    sim_slot_t *slot = NULL;
+    while (st->running) {
+        for (size_t i = 0; i < st->slot_count; i++) {
+            sim_slot_t *s = &st->slots[i];
+            if (s->state == SLOT_QUEUED && (!slot || s->seq < slot->seq)) {
+                slot = s;
+            }
+        }
+        if (slot || pthread_cond_timedwait(&st->queued, &st->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (!slot) {
+        st->stats.timeouts++;
+        pthread_mutex_unlock(&st->lock);
+        SIM_LOGE("Failed to get frame: timeout");
+        return NULL;
+    }
+
+    slot->state = SLOT_HELD;
+    st->stats.delivered++;
+    int64_t delay_us = (int64_t)st->cfg.latency_ms * 1000;
+    if (st->cfg.jitter_ms) {
+        int64_t span = (int64_t)st->cfg.jitter_ms * 2000 + 1;
+        delay_us += rand_r(&st->rand_state) % span - (int64_t)st->cfg.jitter_ms * 1000;
+    }
+    pthread_mutex_unlock(&st->lock);
+
+    sim_sleep_us(delay_us);
+    SIM_TRACE(CAMERA_TRACE_TAKEN, &slot->fb);
+    return &slot->fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    sim_state_t *st = s_state;
+    if (!st || !fb) {
+        return;
+    }
+    pthread_mutex_lock(&st->lock);
+    for (size_t i = 0; i < st->slot_count; i++) {
+        if (&st->slots[i].fb == fb) {
+            st->slots[i].state = SLOT_FREE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+sensor_t *esp_camera_sensor_get(void)
+{
+    return s_state ? &s_state->sensor : NULL;
+}
+
+esp_err_t esp_camera_save_to_nvs(const char *key)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_camera_load_from_nvs(const char *key)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void esp_camera_return_all(void)
+{
+    sim_state_t *st = s_state;
+    if (!st) {
+        return;
+    }
+    pthread_mutex_lock(&st->lock);
+    for (size_t i = 0; i < st->slot_count; i++) {
+        st->slots[i].state = SLOT_FREE;
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+bool esp_camera_available_frames(void)
+{
+    sim_state_t *st = s_state;
+    bool available = false;
+    if (!st) {
+        return false;
+    }
+    pthread_mutex_lock(&st->lock);
+    for (size_t i = 0; i < st->slot_count; i++) {
+        available |= st->slots[i].state == SLOT_QUEUED;
+    }
+    pthread_mutex_unlock(&st->lock);
+    return available;
+}
+
+esp_err_t esp_camera_set_psram_mode(bool enable)
+{
+    return s_state ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+bool esp_camera_get_psram_mode(void)
+{
+    return false;
+}
+
+esp_err_t esp_camera_reconfigure(const camera_config_t *config)
+{
+    if (!config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    camera_config_t copy = *config;
+    esp_camera_deinit();
+    return esp_camera_init(&copy);
+}
+
+#if CONFIG_CAMERA_TRACE
+void esp_camera_set_trace_cb(camera_trace_cb_t cb)
+{
+    s_trace_cb = cb;
+}
+#endif
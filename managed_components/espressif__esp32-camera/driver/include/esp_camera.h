@@ -67,10 +67,16 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+/* Host simulator (esp_camera_sim.h): no LEDC, keep the config layout */
+typedef int ledc_timer_t;
+typedef int ledc_channel_t;
+#else
 #include "driver/ledc.h"
+#endif
 #include "sensor.h"
 #include "sys/time.h"
-#include "sdkconfig.h"
 
 /**
  * @brief define for if chip supports camera
@@ -274,6 +280,34 @@ esp_err_t esp_camera_reconfigure(const camera_config_t *config);
  */
 bool esp_camera_get_psram_mode(void);
 
+#if CONFIG_CAMERA_TRACE
+/**
+ * @brief Driver stages reported to the trace callback
+ */
+typedef enum {
+    CAMERA_TRACE_VSYNC,     /*!< Frame started, fb->timestamp was just set */
+    CAMERA_TRACE_QUEUED,    /*!< Complete frame handed to the frame buffer queue */
+    CAMERA_TRACE_TAKEN,     /*!< Frame returned from esp_camera_fb_get() */
+} camera_trace_point_t;
+
+/**
+ * @brief Trace callback, runs in the camera task or the caller of esp_camera_fb_get()
+ *
+ * fb->timestamp identifies the frame across all points. Must not block.
+ */
+typedef void (*camera_trace_cb_t)(camera_trace_point_t point, const camera_fb_t *fb);
+
+/**
+ * @brief Install a callback for driver trace points.
+ *
+ * Only available with CONFIG_CAMERA_TRACE; otherwise the trace points are
+ * compiled out.
+ *
+ * @param cb  Callback, or NULL to stop tracing
+ */
+void esp_camera_set_trace_cb(camera_trace_cb_t cb);
+#endif
+
 
 #ifdef __cplusplus
 }
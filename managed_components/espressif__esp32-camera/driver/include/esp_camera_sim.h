@@ -0,0 +1,94 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*
+ * Host camera simulator
+ *
+ * On the linux target, esp_camera_init()/esp_camera_fb_get()/... are served
+ * by a simulator that replays a directory of JPEG files at a fixed frame
+ * rate. It models the driver's fb_count frame buffer slots, so holding
+ * frames starves capture the same way it does on the chip, and it can
+ * inject latency, jitter, corrupt frames and NULL frames.
+ *
+ * Example:
+ *
+ *      camera_sim_config_t sim = CAMERA_SIM_CONFIG_DEFAULT();
+ *      sim.frame_dir = "test/pictures";
+ *      sim.fps = 25;
+ *      sim.corrupt_every = 10;
+ *      esp_camera_sim_configure(&sim);
+ *      esp_camera_init(&camera_config);
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Simulator settings, applied by the next esp_camera_init()
+ */
+typedef struct {
+    const char *frame_dir;      /*!< Directory of .jpg/.jpeg files replayed in name order. The ESP_CAMERA_SIM_DIR environment variable overrides it */
+    uint32_t fps;               /*!< Frames produced per second */
+    uint32_t latency_ms;        /*!< Delay added to every esp_camera_fb_get() */
+    uint32_t jitter_ms;         /*!< Uniform +/- jitter applied to latency_ms */
+    uint32_t corrupt_every;     /*!< Truncate every Nth produced frame and drop its EOI, 0 = never */
+    uint32_t null_every;        /*!< Return NULL from every Nth esp_camera_fb_get(), 0 = never */
+    unsigned int seed;          /*!< Seed for jitter and corruption offsets */
+} camera_sim_config_t;
+
+#define CAMERA_SIM_CONFIG_DEFAULT() { \
+    .frame_dir = "test/pictures",     \
+    .fps = 10,                        \
+    .latency_ms = 0,                  \
+    .jitter_ms = 0,                   \
+    .corrupt_every = 0,               \
+    .null_every = 0,                  \
+    .seed = 1,                        \
+}
+
+/**
+ * @brief Simulator counters since esp_camera_init()
+ */
+typedef struct {
+    uint32_t produced;          /*!< Frames written into a slot */
+    uint32_t delivered;         /*!< Frames returned by esp_camera_fb_get() */
+    uint32_t dropped;           /*!< Frames lost because every slot was queued or held */
+    uint32_t overwritten;       /*!< Queued frames replaced by newer ones (CAMERA_GRAB_LATEST) */
+    uint32_t corrupted;         /*!< Frames truncated on purpose */
+    uint32_t null_frames;       /*!< NULL returns injected into esp_camera_fb_get() */
+    uint32_t timeouts;          /*!< esp_camera_fb_get() calls that found no frame in time */
+} camera_sim_stats_t;
+
+/**
+ * @brief Set the simulator configuration used by the next esp_camera_init()
+ *
+ * @param config  Settings; frame_dir must stay valid until esp_camera_init() returns
+ */
+void esp_camera_sim_configure(const camera_sim_config_t *config);
+
+/**
+ * @brief Read the simulator counters
+ *
+ * @param stats  Receives the counters
+ */
+void esp_camera_sim_get_stats(camera_sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
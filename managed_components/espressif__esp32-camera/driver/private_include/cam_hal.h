@@ -62,6 +62,21 @@ bool cam_get_available_frames(void);
 void cam_set_psram_mode(bool enable);
 bool cam_get_psram_mode(void);
 
+/**
+ * @brief Follow runtime framesize changes for JPEG frame validation
+ *
+ * With CONFIG_CAMERA_JPEG_VALIDATE, cam_take() drops JPEG frames whose SOF
+ * dimensions differ from the framesize read through this pointer.
+ *
+ * @param framesize Sensor's current framesize, or NULL to use the size
+ *                  passed to cam_config()
+ */
+void cam_track_framesize(const framesize_t *framesize);
+
+#if CONFIG_CAMERA_TRACE
+void cam_set_trace_cb(camera_trace_cb_t cb);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
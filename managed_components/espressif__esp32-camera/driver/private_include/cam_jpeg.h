@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Result of a structural JPEG frame check
+ */
+typedef enum {
+    CAM_JPEG_OK = 0,
+    CAM_JPEG_NO_SOI,          /*!< Frame does not start with FF D8 */
+    CAM_JPEG_BAD_SEGMENT,     /*!< Marker or segment length runs off the frame */
+    CAM_JPEG_NO_SOF,          /*!< Scan header before any frame header */
+    CAM_JPEG_SIZE_MISMATCH,   /*!< Frame header dimensions differ from the expected size */
+    CAM_JPEG_NO_SOS,          /*!< Headers end without a scan */
+    CAM_JPEG_NO_SCAN_DATA,    /*!< Nothing between the scan header and EOI */
+} cam_jpeg_check_t;
+
+/**
+ * @brief Find the first occurrence of a marker pattern
+ *
+ * Tests four positions per 32-bit load for the first pattern byte and only
+ * compares the full pattern at candidates. JPEG entropy data rarely contains
+ * 0xFF, so most words are rejected without a byte compare.
+ *
+ * @param buf     Data to search
+ * @param len     Length of buf
+ * @param pat     Pattern to find
+ * @param pat_len Pattern length (at least 1)
+ *
+ * @return Offset of the first match, or -1 if not found
+ */
+int cam_jpeg_find_marker(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len);
+
+/**
+ * @brief Check the header structure of a complete JPEG frame
+ *
+ * Walks the marker segments from SOI up to the first SOS without touching
+ * the entropy-coded data. The frame must already be trimmed to end at EOI.
+ *
+ * @param buf    Frame data starting at SOI
+ * @param len    Frame length including EOI
+ * @param width  Expected SOF width, or 0 to skip the size check
+ * @param height Expected SOF height
+ *
+ * @return CAM_JPEG_OK if the frame looks complete
+ */
+cam_jpeg_check_t cam_jpeg_validate(const uint8_t *buf, size_t len, uint16_t width, uint16_t height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,7 @@
 #ifndef __SCCB_H__
 #define __SCCB_H__
 #include <stdint.h>
+#include <stddef.h>
 int SCCB_Init(int pin_sda, int pin_scl);
 int SCCB_Use_Port(int sccb_i2c_port);
 int SCCB_Deinit(void);
@@ -19,4 +20,41 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg);
 int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data);
 uint16_t SCCB_Read_Addr16_Val16(uint8_t slv_addr, uint16_t reg);
 int SCCB_Write_Addr16_Val16(uint8_t slv_addr, uint16_t reg, uint16_t data);
+
+#define SCCB_BURST_MAX 32   /*!< Longest register run sent in one transaction */
+
+/**
+ * @brief Write consecutive 8-bit registers starting at a 16-bit address
+ *
+ * Sent as one transaction relying on the sensor's address auto-increment.
+ * Falls back to one SCCB_Write16() per register when CONFIG_SCCB_BURST_WRITE
+ * is disabled.
+ *
+ * @param slv_addr Sensor address
+ * @param reg First register
+ * @param data Register values
+ * @param len Number of registers (at most SCCB_BURST_MAX)
+ * @return 0 on success, -1 on failure
+ */
+int SCCB_Write16_Burst(uint8_t slv_addr, uint16_t reg, const uint8_t *data, size_t len);
+
+/**
+ * @brief Alternative transport for 16-bit register access
+ *
+ * When installed with SCCB_Set_Backend(), SCCB_Read16(), SCCB_Write16()
+ * and SCCB_Write16_Burst() are routed to these callbacks instead of the I2C peripheral. Used by tests
+ * to run sensor drivers against a simulated register file.
+ */
+typedef struct {
+    uint8_t (*read16)(uint8_t slv_addr, uint16_t reg);
+    int (*write16)(uint8_t slv_addr, uint16_t reg, uint8_t data);
+    int (*write16_burst)(uint8_t slv_addr, uint16_t reg, const uint8_t *data, size_t len);
+} sccb_backend_t;
+
+/**
+ * @brief Install or remove an SCCB backend
+ *
+ * @param backend Backend callbacks, NULL to restore the I2C transport
+ */
+void SCCB_Set_Backend(const sccb_backend_t *backend);
 #endif // __SCCB_H__
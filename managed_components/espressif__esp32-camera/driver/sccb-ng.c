@@ -59,6 +59,7 @@ static device_t devices[MAX_DEVICES];
 static uint8_t device_count = 0;
 static int sccb_i2c_port;
 static bool sccb_owns_i2c_port;
+static const sccb_backend_t *sccb_backend = NULL;
 
 i2c_master_dev_handle_t *get_handle_from_address(uint8_t slv_addr)
 {
@@ -257,8 +258,18 @@ int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+void SCCB_Set_Backend(const sccb_backend_t *backend)
+{
+    sccb_backend = backend;
+}
+
 uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 {
+    if (sccb_backend)
+    {
+        return sccb_backend->read16(slv_addr, reg);
+    }
+
     i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
 
     uint8_t rx_buffer[1];
@@ -278,6 +289,11 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 
 int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
 {
+    if (sccb_backend)
+    {
+        return sccb_backend->write16(slv_addr, reg, data);
+    }
+
     i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
 
     uint8_t tx_buffer[3];
@@ -294,6 +310,44 @@ int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+int SCCB_Write16_Burst(uint8_t slv_addr, uint16_t reg, const uint8_t *data, size_t len)
+{
+#if CONFIG_SCCB_BURST_WRITE
+    if (len > SCCB_BURST_MAX)
+    {
+        return -1;
+    }
+    if (sccb_backend)
+    {
+        return sccb_backend->write16_burst(slv_addr, reg, data, len);
+    }
+
+    i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
+
+    uint8_t tx_buffer[2 + SCCB_BURST_MAX];
+    tx_buffer[0] = reg >> 8;
+    tx_buffer[1] = reg & 0x00ff;
+    memcpy(&tx_buffer[2], data, len);
+
+    esp_err_t ret = i2c_master_transmit(dev_handle, tx_buffer, 2 + len, TIMEOUT_MS);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "W [%04x..%04x] fail\n", reg, (unsigned)(reg + len - 1));
+    }
+    return ret == ESP_OK ? 0 : -1;
+#else
+    for (size_t i = 0; i < len; i++)
+    {
+        if (SCCB_Write16(slv_addr, reg + i, data[i]))
+        {
+            return -1;
+        }
+    }
+    return 0;
+#endif
+}
+
 uint16_t SCCB_Read_Addr16_Val16(uint8_t slv_addr, uint16_t reg)
 {
     i2c_master_dev_handle_t dev_handle = *(get_handle_from_address(slv_addr));
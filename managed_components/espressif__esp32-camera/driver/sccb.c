@@ -46,6 +46,7 @@ const int SCCB_I2C_PORT_DEFAULT = 0;
 
 static int sccb_i2c_port;
 static bool sccb_owns_i2c_port;
+static const sccb_backend_t *sccb_backend = NULL;
 
 int SCCB_Init(int pin_sda, int pin_scl)
 {
@@ -146,8 +147,16 @@ int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+void SCCB_Set_Backend(const sccb_backend_t *backend)
+{
+    sccb_backend = backend;
+}
+
 uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 {
+    if (sccb_backend) {
+        return sccb_backend->read16(slv_addr, reg);
+    }
     uint8_t data=0;
     esp_err_t ret = ESP_FAIL;
     uint16_t reg_htons = LITTLETOBIG(reg);
@@ -176,6 +185,9 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 
 int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
 {
+    if (sccb_backend) {
+        return sccb_backend->write16(slv_addr, reg, data);
+    }
     static uint16_t i = 0;
     esp_err_t ret = ESP_FAIL;
     uint16_t reg_htons = LITTLETOBIG(reg);
@@ -195,6 +207,39 @@ int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
     return ret == ESP_OK ? 0 : -1;
 }
 
+int SCCB_Write16_Burst(uint8_t slv_addr, uint16_t reg, const uint8_t *data, size_t len)
+{
+#if CONFIG_SCCB_BURST_WRITE
+    if (len > SCCB_BURST_MAX) {
+        return -1;
+    }
+    if (sccb_backend) {
+        return sccb_backend->write16_burst(slv_addr, reg, data, len);
+    }
+    esp_err_t ret = ESP_FAIL;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, reg >> 8, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, reg & 0xff, ACK_CHECK_EN);
+    i2c_master_write(cmd, data, len, ACK_CHECK_EN);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(sccb_i2c_port, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "W [%04x..%04x] fail\n", reg, (unsigned)(reg + len - 1));
+    }
+    return ret == ESP_OK ? 0 : -1;
+#else
+    for (size_t i = 0; i < len; i++) {
+        if (SCCB_Write16(slv_addr, reg + i, data[i])) {
+            return -1;
+        }
+    }
+    return 0;
+#endif
+}
+
 uint16_t SCCB_Read_Addr16_Val16(uint8_t slv_addr, uint16_t reg)
 {
     uint16_t data = 0;
@@ -26,7 +26,63 @@ static const char *TAG = "ov3660";
 
 //#define REG_DEBUG_ON
 
+/*
+ * Shadow copy of the registers written by this driver.
+ * Writes that would not change a register are skipped and reads of a
+ * register we wrote are served from RAM, so read-modify-write and repeated
+ * mode switches cost no redundant SCCB transactions. Registers the sensor
+ * updates on its own are never shadowed. The shadow is dropped on software
+ * reset and on driver init (the sensor may have been power cycled).
+ */
+#define SHADOW_SIZE 512 // power of two, ~280 registers are touched
+
+typedef struct {
+    uint16_t reg;       // 0 marks an unused slot (never a real register)
+    uint8_t value;
+    uint8_t valid;
+} shadow_entry_t;
+
+static shadow_entry_t shadow[SHADOW_SIZE];
+
+static void shadow_invalidate(void)
+{
+    memset(shadow, 0, sizeof(shadow));
+}
+
+static bool shadow_is_volatile(uint16_t reg)
+{
+    return reg == SYSTEM_CTROL0                 // self-clearing reset bit
+        || (reg >= 0x3400 && reg <= 0x3405)     // AWB gains
+        || (reg >= 0x3500 && reg <= 0x350b);    // AEC/AGC results
+}
+
+static shadow_entry_t *shadow_find(uint16_t reg, bool insert)
+{
+    if (shadow_is_volatile(reg)) {
+        return NULL;
+    }
+    for (int n = 0; n < SHADOW_SIZE; n++) {
+        shadow_entry_t *e = &shadow[(reg + n) & (SHADOW_SIZE - 1)];
+        if (e->reg == reg) {
+            return e;
+        }
+        if (e->reg == 0) {
+            if (!insert) {
+                return NULL;
+            }
+            e->reg = reg;
+            e->valid = 0;
+            return e;
+        }
+    }
+    return NULL;
+}
+
 static int read_reg(uint8_t slv_addr, const uint16_t reg){
+    shadow_entry_t *e = shadow_find(reg, false);
+    if (e != NULL && e->valid) {
+        return e->value;
+    }
     int ret = SCCB_Read16(slv_addr, reg);
 #ifdef REG_DEBUG_ON
     if (ret < 0) {
@@ -58,6 +114,10 @@ static int read_reg16(uint8_t slv_addr, const uint16_t reg){
 
 static int write_reg(uint8_t slv_addr, const uint16_t reg, uint8_t value){
     int ret = 0;
+    shadow_entry_t *e = shadow_find(reg, true);
+    if (e != NULL && e->valid && e->value == value) {
+        return 0;
+    }
 #ifndef REG_DEBUG_ON
     ret = SCCB_Write16(slv_addr, reg, value);
 #else
@@ -76,6 +136,13 @@ static int write_reg(uint8_t slv_addr, const uint16_t reg, uint8_t value){
         ESP_LOGE(TAG, "WRITE REG 0x%04x FAILED: %d", reg, ret);
     }
 #endif
+    if (e != NULL) {
+        e->value = value;
+        e->valid = (ret == 0);
+    }
+    if (ret == 0 && reg == SYSTEM_CTROL0 && (value & 0x80)) {
+        shadow_invalidate();
+    }
     return ret;
 }
 
@@ -93,23 +160,97 @@ static int set_reg_bits(uint8_t slv_addr, uint16_t reg, uint8_t offset, uint8_t
     return ret;
 }
 
+static bool shadow_matches(uint16_t reg, uint8_t value)
+{
+    shadow_entry_t *e = shadow_find(reg, false);
+    return e != NULL && e->valid && e->value == value;
+}
+
+// Unchanged registers tolerated inside one burst before it is split; each
+// costs one data byte, a new transaction costs about three bytes plus start/stop
+#define RUN_MAX_GAP 3
+
+/*
+ * Write consecutive registers using burst transactions.
+ * Registers already holding their value are skipped; short gaps of them
+ * are rewritten so a run does not split into several transactions.
+ */
+static int write_run(uint8_t slv_addr, uint16_t reg, const uint8_t *values, size_t len)
+{
+    int ret = 0;
+#ifdef REG_DEBUG_ON
+    for (size_t i = 0; i < len && ret == 0; i++) {
+        ret = write_reg(slv_addr, reg + i, values[i]);
+    }
+#else
+    size_t i = 0;
+    while (i < len && ret == 0) {
+        if (shadow_matches(reg + i, values[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i, end = i + 1, gap = 0;
+        for (size_t j = i + 1; j < len && gap < RUN_MAX_GAP; j++) {
+            if (shadow_matches(reg + j, values[j])) {
+                gap++;
+            } else {
+                end = j + 1;
+                gap = 0;
+            }
+        }
+
+        if (end - start == 1) {
+            ret = write_reg(slv_addr, reg + start, values[start]);
+        } else {
+            ret = SCCB_Write16_Burst(slv_addr, reg + start, values + start, end - start);
+            for (size_t k = start; k < end; k++) {
+                shadow_entry_t *e = shadow_find(reg + k, true);
+                if (e != NULL) {
+                    e->value = values[k];
+                    e->valid = (ret == 0);
+                }
+            }
+        }
+        i = end;
+    }
+#endif
+    return ret;
+}
+
+/*
+ * Write a register table; runs of consecutive addresses are grouped into
+ * bursts of up to SCCB_BURST_MAX registers while walking the table.
+ */
 static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
 {
     int i = 0, ret = 0;
+    uint8_t values[SCCB_BURST_MAX];
     while (!ret && regs[i][0] != REGLIST_TAIL) {
-        if (regs[i][0] == REG_DLY) {
+        uint16_t reg = regs[i][0];
+        if (reg == REG_DLY) {
             vTaskDelay(regs[i][1] / portTICK_PERIOD_MS);
+            i++;
+        } else if (reg == SYSTEM_CTROL0) {
+            // Software reset must be its own transaction
+            ret = write_reg(slv_addr, reg, regs[i][1]);
+            i++;
         } else {
-            ret = write_reg(slv_addr, regs[i][0], regs[i][1]);
+            size_t n = 0;
+            do {
+                values[n] = regs[i + n][1];
+                n++;
+            } while (n < SCCB_BURST_MAX && regs[i + n][0] == reg + n && regs[i + n][0] != SYSTEM_CTROL0);
+            ret = write_run(slv_addr, reg, values, n);
+            i += n;
         }
-        i++;
     }
     return ret;
 }
 
 static int write_reg16(uint8_t slv_addr, const uint16_t reg, uint16_t value)
 {
-    if (write_reg(slv_addr, reg, value >> 8) || write_reg(slv_addr, reg + 1, value)) {
+    uint8_t values[2] = { value >> 8, value & 0xFF };
+    if (write_run(slv_addr, reg, values, 2)) {
         return -1;
     }
     return 0;
@@ -117,7 +258,8 @@ static int write_reg16(uint8_t slv_addr, const uint16_t reg, uint16_t value)
 
 static int write_addr_reg(uint8_t slv_addr, const uint16_t reg, uint16_t x_value, uint16_t y_value)
 {
-    if (write_reg16(slv_addr, reg, x_value) || write_reg16(slv_addr, reg + 2, y_value)) {
+    uint8_t values[4] = { x_value >> 8, x_value & 0xFF, y_value >> 8, y_value & 0xFF };
+    if (write_run(slv_addr, reg, values, 4)) {
         return -1;
     }
     return 0;
@@ -125,6 +267,48 @@ static int write_addr_reg(uint8_t slv_addr, const uint16_t reg, uint16_t x_value
 
 #define write_reg_bits(slv_addr, reg, mask, enable) set_reg_bits(slv_addr, reg, 0, mask, enable?mask:0)
 
+/*
+ * Window/timing register values for every framesize, generated once from
+ * ratio_table. set_framesize() applies them through write_regs(), so with
+ * the shadow only the registers that differ from the current mode are sent.
+ */
+#define FRAMESIZE_PROFILE_LEN 21 // 5 x/y register quads + tail
+
+static uint16_t framesize_profiles[FRAMESIZE_QXGA + 1][FRAMESIZE_PROFILE_LEN][2];
+
+static uint16_t (*profile_put_addr(uint16_t (*p)[2], uint16_t reg, uint16_t x, uint16_t y))[2]
+{
+    p[0][0] = reg;     p[0][1] = x >> 8;
+    p[1][0] = reg + 1; p[1][1] = x & 0xFF;
+    p[2][0] = reg + 2; p[2][1] = y >> 8;
+    p[3][0] = reg + 3; p[3][1] = y & 0xFF;
+    return p + 4;
+}
+
+static void build_framesize_profiles(void)
+{
+    for (int fs = 0; fs <= FRAMESIZE_QXGA; fs++) {
+        uint16_t w = resolution[fs].width;
+        uint16_t h = resolution[fs].height;
+        ratio_settings_t settings = ratio_table[resolution[fs].aspect_ratio];
+        bool binning = (w <= (settings.max_width / 2) && h <= (settings.max_height / 2));
+
+        uint16_t (*p)[2] = framesize_profiles[fs];
+        p = profile_put_addr(p, X_ADDR_ST_H, settings.start_x, settings.start_y);
+        p = profile_put_addr(p, X_ADDR_END_H, settings.end_x, settings.end_y);
+        p = profile_put_addr(p, X_OUTPUT_SIZE_H, w, h);
+        if (binning) {
+            p = profile_put_addr(p, X_TOTAL_SIZE_H, settings.total_x, (settings.total_y / 2) + 1);
+            p = profile_put_addr(p, X_OFFSET_H, 8, 2);
+        } else {
+            p = profile_put_addr(p, X_TOTAL_SIZE_H, settings.total_x, settings.total_y);
+            p = profile_put_addr(p, X_OFFSET_H, 16, 6);
+        }
+        p[0][0] = REGLIST_TAIL;
+        p[0][1] = 0;
+    }
+}
+
 static int calc_sysclk(int xclk, bool pll_bypass, int pll_multiplier, int pll_sys_div, int pll_pre_div, bool pll_root_2x, int pll_seld5, bool pclk_manual, int pclk_div)
 {
     const int pll_pre_div2x_map[] = { 2, 3, 4, 6 };//values are multiplied by two to avoid floats
@@ -156,16 +340,14 @@ static int set_pll(sensor_t *sensor, bool bypass, uint8_t multiplier, uint8_t sy
 
     calc_sysclk(sensor->xclk_freq_hz, bypass, multiplier, sys_div, pre_div, root_2x, seld5, pclk_manual, pclk_div);
 
-    ret = write_reg(sensor->slv_addr, SC_PLLS_CTRL0, bypass?0x80:0x00);
-    if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, SC_PLLS_CTRL1, multiplier & 0x1f);
-    }
-    if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, SC_PLLS_CTRL2, 0x10 | (sys_div & 0x0f));
-    }
-    if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, SC_PLLS_CTRL3, (pre_div & 0x3) << 4 | seld5 | (root_2x?0x40:0x00));
-    }
+    // SC_PLLS_CTRL0..3 are consecutive
+    uint8_t plls[4] = {
+        bypass?0x80:0x00,
+        multiplier & 0x1f,
+        0x10 | (sys_div & 0x0f),
+        (pre_div & 0x3) << 4 | seld5 | (root_2x?0x40:0x00)
+    };
+    ret = write_run(sensor->slv_addr, SC_PLLS_CTRL0, plls, sizeof(plls));
     if (ret == 0) {
         ret = write_reg(sensor->slv_addr, PCLK_RATIO, pclk_div & 0x1f);
     }
@@ -327,21 +509,7 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     sensor->status.scale = !((w == settings.max_width && h == settings.max_height)
         || (w == (settings.max_width / 2) && h == (settings.max_height / 2)));
 
-    ret  = write_addr_reg(sensor->slv_addr, X_ADDR_ST_H, settings.start_x, settings.start_y)
-        || write_addr_reg(sensor->slv_addr, X_ADDR_END_H, settings.end_x, settings.end_y)
-        || write_addr_reg(sensor->slv_addr, X_OUTPUT_SIZE_H, w, h);
-
-    if (ret) {
-        goto fail;
-    }
-
-    if (sensor->status.binning) {
-        ret  = write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, settings.total_x, (settings.total_y / 2) + 1)
-            || write_addr_reg(sensor->slv_addr, X_OFFSET_H, 8, 2);
-    } else {
-        ret  = write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, settings.total_x, settings.total_y)
-            || write_addr_reg(sensor->slv_addr, X_OFFSET_H, 16, 6);
-    }
+    ret = write_regs(sensor->slv_addr, framesize_profiles[framesize]);
 
     if (ret == 0) {
         ret = write_reg_bits(sensor->slv_addr, ISP_CONTROL_01, 0x20, sensor->status.scale);
@@ -1014,6 +1182,9 @@ int esp32_camera_ov3660_detect(int slv_addr, sensor_id_t *id)
 
 int esp32_camera_ov3660_init(sensor_t *sensor)
 {
+    shadow_invalidate();
+    build_framesize_profiles();
+
     sensor->reset = reset;
     sensor->set_pixformat = set_pixformat;
     sensor->set_framesize = set_framesize;
@@ -0,0 +1,124 @@
+/*
+ * Host benchmark for the JPEG marker scan and header check in cam_jpeg.c.
+ *
+ * Build and run from the component root:
+ *   cc -O2 -Idriver/private_include test/host/bench_cam_jpeg.c driver/cam_jpeg.c -o bench_cam_jpeg
+ *   ./bench_cam_jpeg test/pictures/testimg.jpeg test/pictures/test_inside.jpeg test/pictures/test_outside.jpeg
+ *
+ * For each frame it times the SOI search over the entropy-coded data (the
+ * miss path taken when DMA starts mid-frame) against the previous
+ * byte-by-byte memcmp scan, times the header check, and confirms that frames
+ * cut before their scan data are rejected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cam_jpeg.h"
+
+static const uint8_t SOI[] = {0xFF, 0xD8, 0xFF};
+static const uint8_t SOS[] = {0xFF, 0xDA};
+
+/* Scan used by cam_verify_jpeg_soi() before the word-parallel search */
+static int bytewise_find(const uint8_t *buf, size_t len, const uint8_t *pat, size_t pat_len)
+{
+    for (size_t i = 0; i + pat_len <= len; i++) {
+        if (memcmp(&buf[i], pat, pat_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint8_t *load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len + 2);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    volatile int sink = 0;
+
+    for (int a = 1; a < argc; a++) {
+        size_t len;
+        uint8_t *frame = load(argv[a], &len);
+        if (!frame) {
+            fprintf(stderr, "%s: cannot read\n", argv[a]);
+            return 1;
+        }
+
+        int sos = cam_jpeg_find_marker(frame, len, SOS, sizeof(SOS));
+        if (sos < 0 || cam_jpeg_validate(frame, len, 0, 0) != CAM_JPEG_OK) {
+            fprintf(stderr, "%s: not a baseline frame\n", argv[a]);
+            failures++;
+            free(frame);
+            continue;
+        }
+
+        /* SOI search across entropy data, where no SOI exists */
+        const uint8_t *data = frame + sos;
+        size_t data_len = len - sos;
+        int iters = 2000;
+        double t0 = now_ns();
+        for (int i = 0; i < iters; i++) {
+            sink += bytewise_find(data, data_len, SOI, sizeof(SOI));
+        }
+        double t1 = now_ns();
+        for (int i = 0; i < iters; i++) {
+            sink += cam_jpeg_find_marker(data, data_len, SOI, sizeof(SOI));
+        }
+        double t2 = now_ns();
+        for (int i = 0; i < iters; i++) {
+            sink += cam_jpeg_validate(frame, len, 0, 0);
+        }
+        double t3 = now_ns();
+
+        double byte_ns = (t1 - t0) / iters;
+        double swar_ns = (t2 - t1) / iters;
+        printf("%-28s %7zu B  SOI miss scan: bytewise %8.0f ns, word %8.0f ns (%.1fx)  header check %5.0f ns\n",
+               argv[a], len, byte_ns, swar_ns, byte_ns / swar_ns, (t3 - t2) / iters);
+
+        /* Every cut that leaves no scan data must be rejected */
+        uint8_t *cut = malloc(len + 2);
+        int accepted = 0;
+        size_t sos_end = sos + 2 + ((frame[sos + 2] << 8) | frame[sos + 3]);
+        for (size_t n = 0; n <= sos_end; n++) {
+            memcpy(cut, frame, n);
+            cut[n] = 0xFF;
+            cut[n + 1] = 0xD9;
+            if (cam_jpeg_validate(cut, n + 2, 0, 0) == CAM_JPEG_OK) {
+                accepted++;
+            }
+        }
+        if (accepted) {
+            printf("  %d truncated headers accepted\n", accepted);
+            failures++;
+        }
+        free(cut);
+        free(frame);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Host check for the fmt2jpg output streams (conversions/to_jpg.cpp).
+ *
+ * Build and run from the component root:
+ *   c++ -O2 -pthread -Itest/host/include -Idriver/include -Iconversions/include -Iconversions/private_include \
+ *       -I../espressif__esp_jpeg/include test/host/bench_jpg_output.cpp conversions/to_jpg.cpp \
+ *       conversions/jpge.cpp conversions/jpge_kernels.cpp conversions/jpge_parallel.cpp -o bench_jpg_output
+ *   ./bench_jpg_output
+ *
+ * Encodes a small and a 2 MP noisy frame through fmt2jpg(), fmt2jpg_chunked(),
+ * fmt2jpg_file() and fmt2jpg_cb() and checks that all four produce the same
+ * bytes, including output far beyond the former fixed 128 KB buffer. Then
+ * checks that a short callback write and a failing file write are reported
+ * as errors instead of producing a truncated image, and that
+ * fmt2jpg_predict_size() and target_size agree with real encodes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "img_converters.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                    \
+    do {                                    \
+        if (!(cond)) {                      \
+            printf("FAIL: " __VA_ARGS__);   \
+            printf("\n");                   \
+            failures++;                     \
+        }                                   \
+    } while (0)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t rng_state = 12345;
+static uint32_t rng(void)
+{
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+/* Gradient with noise of the given amplitude, in the camera's RGB888 order */
+static uint8_t *make_frame(int w, int h, int noise)
+{
+    uint8_t *rgb = (uint8_t *)malloc((size_t)w * h * 3);
+    rng_state = 12345;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = rgb + ((size_t)y * w + x) * 3;
+            p[0] = (uint8_t)(x * 255 / w + (rng() % noise));
+            p[1] = (uint8_t)(y * 255 / h + (rng() % noise));
+            p[2] = (uint8_t)((((x / 40 + y / 40) & 1) ? 200 : 40) + (rng() % noise));
+        }
+    }
+    return rgb;
+}
+
+struct grow_buf {
+    uint8_t *buf;
+    size_t len, cap, limit;
+};
+
+static size_t grow_cb(void *arg, size_t index, const void *data, size_t len)
+{
+    grow_buf *g = (grow_buf *)arg;
+    if (!data) {
+        return 0;
+    }
+    if (g->limit && index + len > g->limit) {
+        len = g->limit - index;
+    }
+    if (index + len > g->cap) {
+        g->cap = (index + len) * 2;
+        g->buf = (uint8_t *)realloc(g->buf, g->cap);
+    }
+    memcpy(g->buf + index, data, len);
+    g->len = index + len;
+    return len;
+}
+
+static void check_outputs(const char *name, int w, int h, uint8_t quality, int noise)
+{
+    uint8_t *rgb = make_frame(w, h, noise);
+    size_t src_len = (size_t)w * h * 3;
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+
+    double t0 = now_s();
+    grow_buf ref = { NULL, 0, 0, 0 };
+    CHECK(fmt2jpg_cb(rgb, src_len, w, h, PIXFORMAT_RGB888, quality, grow_cb, &ref), "%s: fmt2jpg_cb", name);
+    double t1 = now_s();
+
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    CHECK(fmt2jpg_config(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, &jpg, &jpg_len), "%s: fmt2jpg_config", name);
+    CHECK(jpg && jpg_len == ref.len && memcmp(jpg, ref.buf, ref.len) == 0, "%s: contiguous output differs", name);
+    double t2 = now_s();
+
+    jpg_chunk_t *chunks = NULL;
+    size_t chunked_len = 0;
+    CHECK(fmt2jpg_chunked(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, &chunks, &chunked_len), "%s: fmt2jpg_chunked", name);
+    double t3 = now_s();
+    size_t index = 0;
+    int segments = 0;
+    bool same = chunked_len == ref.len;
+    for (jpg_chunk_t *c = chunks; c && same; c = c->next, segments++) {
+        same = index + c->len <= ref.len && memcmp(c->buf, ref.buf + index, c->len) == 0;
+        index += c->len;
+    }
+    CHECK(same && index == ref.len, "%s: chunked output differs", name);
+    jpg_chunks_free(chunks);
+
+    FILE *f = tmpfile();
+    size_t file_len = 0;
+    CHECK(fmt2jpg_file(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, f, &file_len), "%s: fmt2jpg_file", name);
+    double t4 = now_s();
+    uint8_t *file_buf = (uint8_t *)malloc(ref.len + 1);
+    rewind(f);
+    size_t read_len = fread(file_buf, 1, ref.len + 1, f);
+    CHECK(file_len == ref.len && read_len == ref.len && memcmp(file_buf, ref.buf, ref.len) == 0,
+          "%s: file output differs", name);
+    fclose(f);
+    free(file_buf);
+
+    CHECK(ref.len > 4 && ref.buf[ref.len - 2] == 0xFF && ref.buf[ref.len - 1] == 0xD9, "%s: no EOI", name);
+    printf("%s %dx%d q%d: %u bytes (%.1fx the old 128 KB buffer), %d segment(s); "
+           "cb %.1f ms, contiguous %.1f ms, chunked %.1f ms, file %.1f ms\n",
+           name, w, h, quality, (unsigned)ref.len, ref.len / 131072.0, segments,
+           (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t3 - t2) * 1e3, (t4 - t3) * 1e3);
+    free(jpg);
+    free(ref.buf);
+    free(rgb);
+}
+
+static void check_errors(void)
+{
+    const int w = 640, h = 480;
+    uint8_t *rgb = make_frame(w, h, 64);
+    size_t src_len = (size_t)w * h * 3;
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+
+    grow_buf limited = { NULL, 0, 0, 4096 };
+    CHECK(!fmt2jpg_cb(rgb, src_len, w, h, PIXFORMAT_RGB888, 80, grow_cb, &limited),
+          "short callback write not reported");
+    free(limited.buf);
+
+    FILE *f = fopen("/dev/null", "rb");
+    size_t file_len = 0;
+    CHECK(f && !fmt2jpg_file(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, f, &file_len),
+          "failing file write not reported");
+    if (f) {
+        fclose(f);
+    }
+    free(rgb);
+    printf("errors: short callback write and failing file write reported\n");
+}
+
+static void check_rate(void)
+{
+    const int w = 320, h = 240;
+    uint8_t *rgb = make_frame(w, h, 32);
+    size_t src_len = (size_t)w * h * 3;
+    static const uint8_t qualities[] = { 30, 60, 90 };
+    size_t sizes[3];
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.optimize_huffman = true;
+
+    CHECK(fmt2jpg_predict_size(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, qualities, 3, sizes), "fmt2jpg_predict_size");
+    for (int i = 0; i < 3; i++) {
+        uint8_t *jpg = NULL;
+        size_t jpg_len = 0;
+        config.quality = qualities[i];
+        CHECK(fmt2jpg_config(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, &jpg, &jpg_len) && jpg_len == sizes[i],
+              "q%d: predicted %u bytes, encoded %u", qualities[i], (unsigned)sizes[i], (unsigned)jpg_len);
+        free(jpg);
+    }
+
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    config.quality = 90;
+    config.target_size = sizes[1];
+    CHECK(fmt2jpg_config(rgb, src_len, w, h, PIXFORMAT_RGB888, &config, &jpg, &jpg_len) && jpg_len <= sizes[1] && jpg_len >= sizes[0],
+          "target %u bytes: encoded %u", (unsigned)sizes[1], (unsigned)jpg_len);
+    free(jpg);
+    free(rgb);
+    printf("rate: predicted q30/q60/q90 %u/%u/%u bytes exact, budget %u -> %u bytes\n",
+           (unsigned)sizes[0], (unsigned)sizes[1], (unsigned)sizes[2], (unsigned)sizes[1], (unsigned)jpg_len);
+}
+
+int main(void)
+{
+    check_outputs("preview", 320, 240, 60, 16);
+    check_outputs("noisy", 1600, 1200, 95, 64);
+    check_errors();
+    check_rate();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
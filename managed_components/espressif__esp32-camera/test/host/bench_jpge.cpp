@@ -0,0 +1,206 @@
+/*
+ * Host check and benchmark for the jpge DCT/quantization kernels (conversions/jpge_kernels.cpp).
+ *
+ * Build and run from the component root:
+ *   c++ -O2 -Itest/host/include -Iconversions/private_include -I../espressif__esp_jpeg/tjpgd \
+ *       test/host/bench_jpge.cpp conversions/jpge.cpp conversions/jpge_kernels.cpp -o bench_jpge
+ *   ./bench_jpge
+ * Add -DJPGE_KERNELS_SCALAR to build the scalar encoder for comparison; both
+ * builds print the same output size and hash.
+ *
+ * Checks the selected kernels against the scalar reference on random and
+ * extreme blocks for every quality, proves the float quantizer exact over the
+ * whole coefficient range, then times the kernels per block and a full
+ * 2 MP RGB encode.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpge.h"
+#include "bench_jpge_common.h"
+#include "jpge_kernels.h"
+
+using namespace jpge;
+
+static int failures = 0;
+
+/* Same table scaling as jpeg_encoder::compute_quant_table */
+static void quant_table(int32 *dst, int quality, bool chroma)
+{
+    static const int16 lum[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
+    int32 q = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        int32 j = chroma ? (i < 16 ? 24 : 99) : lum[i];
+        j = (j * q + 50) / 100;
+        dst[i] = j < 1 ? 1 : (j > 255 ? 255 : j);
+    }
+}
+
+static void fill_block(int32 *b, int kind)
+{
+    for (int i = 0; i < 64; i++) {
+        switch (kind) {
+        case 0: b[i] = (int32)(rng() & 0xFF) - 128; break;                         /* noise */
+        case 1: b[i] = ((i ^ (i >> 3)) & 1) ? 127 : -128; break;                   /* checkerboard */
+        case 2: b[i] = (i & 7) < 4 ? -128 : 127; break;                            /* vertical edge */
+        case 3: b[i] = (rng() & 1) ? 127 : -128; break;                            /* extreme noise */
+        default: b[i] = ((i & 7) * 16 + (i >> 3) * 8 + (int32)(rng() & 7)) - 128;  /* gradient */
+        }
+    }
+}
+
+static void check_quantizer_exact(void)
+{
+    /* |c| <= 2048 for 8-bit samples; a = |c| + (q >> 1) */
+    for (int q = 1; q <= 255; q++) {
+        float bias = (float)(q >> 1) + 0.5f, recip = 1.0f / (float)q;
+        for (int c = 0; c <= 4096; c++) {
+            int expect = (c + (q >> 1)) / q;
+            int got = (int)(((float)c + bias) * recip);
+            if (got != expect) {
+                printf("FAIL: quantizer q=%d c=%d: %d != %d\n", q, c, got, expect);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+static void check_kernels(void)
+{
+    int32 q[64];
+    quant_recip r;
+    int32 a[64], b[64];
+    int16 qa[64], qb[64];
+    int32 max_coef = 0;
+
+    for (int quality = 1; quality <= 100; quality++) {
+        for (int chroma = 0; chroma < 2; chroma++) {
+            quant_table(q, quality, chroma);
+            quant_recip_init(&r, q);
+            for (int n = 0; n < 500; n++) {
+                fill_block(a, n % 5);
+                memcpy(b, a, sizeof(a));
+                fdct_8x8(a);
+                fdct_8x8_scalar(b);
+                if (memcmp(a, b, sizeof(a)) != 0) {
+                    printf("FAIL: DCT mismatch (quality %d, block %d)\n", quality, n);
+                    failures++;
+                    return;
+                }
+                for (int i = 0; i < 64; i++) {
+                    int32 m = a[i] < 0 ? -a[i] : a[i];
+                    max_coef = m > max_coef ? m : max_coef;
+                }
+                quantize_8x8(qa, a, q, &r);
+                quantize_8x8_scalar(qb, b, q);
+                if (memcmp(qa, qb, sizeof(qa)) != 0) {
+                    printf("FAIL: quantizer mismatch (quality %d, block %d)\n", quality, n);
+                    failures++;
+                    return;
+                }
+            }
+        }
+    }
+    printf("kernels (%s): bit-exact with scalar on 100k blocks, max |coef| %d\n",
+           JPGE_KERNELS_NAME, (int)max_coef);
+}
+
+static void bench_kernels(void)
+{
+    enum { BLOCKS = 4096, ROUNDS = 100 };
+    static int32 src[BLOCKS][64], work[64];
+    int16 out[64];
+    int32 q[64];
+    quant_recip r;
+    quant_table(q, 85, false);
+    quant_recip_init(&r, q);
+    for (int i = 0; i < BLOCKS; i++) {
+        fill_block(src[i], i % 5);
+    }
+
+    volatile int sink = 0;
+    double t0 = now_s();
+    for (int n = 0; n < ROUNDS; n++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            memcpy(work, src[i], sizeof(work));
+            fdct_8x8_scalar(work);
+            quantize_8x8_scalar(out, work, q);
+            sink += out[0];
+        }
+    }
+    double t1 = now_s();
+    for (int n = 0; n < ROUNDS; n++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            memcpy(work, src[i], sizeof(work));
+            fdct_8x8(work);
+            quantize_8x8(out, work, q, &r);
+            sink += out[0];
+        }
+    }
+    double t2 = now_s();
+    double scalar_ns = (t1 - t0) * 1e9 / (BLOCKS * ROUNDS);
+    double simd_ns = (t2 - t1) * 1e9 / (BLOCKS * ROUNDS);
+    printf("DCT+quantize per block: scalar %.1f ns, %s %.1f ns (%.2fx)\n",
+           scalar_ns, JPGE_KERNELS_NAME, simd_ns, scalar_ns / simd_ns);
+}
+
+static void bench_encode(void)
+{
+    const int w = 1600, h = 1200, rounds = 5;
+    uint8 *rgb = (uint8 *)malloc(w * h * 3);
+    rng_state = 12345;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8 *p = rgb + (y * w + x) * 3;
+            p[0] = (uint8)(x * 255 / w + (rng() & 15));
+            p[1] = (uint8)(y * 255 / h + (rng() & 15));
+            p[2] = (uint8)(((x / 40 + y / 40) & 1) ? 200 : 40);
+        }
+    }
+
+    double best = 1e9;
+    uint size = 0;
+    uint32_t hash = 0;
+    for (int n = 0; n < rounds; n++) {
+        mem_stream out(w * h * 3);
+        jpeg_encoder enc;
+        params comp;
+        comp.m_quality = 85;
+        double t0 = now_s();
+        if (!enc.init(&out, w, h, 3, comp)) {
+            printf("FAIL: encoder init\n");
+            failures++;
+            break;
+        }
+        for (int y = 0; y < h; y++) {
+            enc.process_scanline(rgb + y * w * 3);
+        }
+        enc.process_scanline(NULL);
+        double dt = now_s() - t0;
+        best = dt < best ? dt : best;
+        size = out.size;
+        hash = 2166136261u;
+        for (uint i = 0; i < out.size; i++) {
+            hash = (hash ^ out.buf[i]) * 16777619u;
+        }
+    }
+    double mp = w * h / 1e6;
+    printf("encode %dx%d q85 H2V2 (%s): %.1f ms/MP, %.1f MP/s, %u bytes, hash %08x\n",
+           w, h, JPGE_KERNELS_NAME, best * 1e3 / mp, mp / best, size, hash);
+    free(rgb);
+}
+
+int main(void)
+{
+    check_quantizer_exact();
+    check_kernels();
+    bench_kernels();
+    bench_encode();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Shared fixture for the jpge host benches: timer, deterministic RNG, an
+ * in-memory output stream and a tjpgd decode to RGB888.
+ *
+ * Header-only; benches that decode also need -I../espressif__esp_jpeg/tjpgd
+ * and tjpgd.o on their build line.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpge.h"
+extern "C" {
+#include "tjpgd.h"
+}
+
+static inline double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t rng_state = 12345;
+static inline uint32_t rng(void)
+{
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+class mem_stream : public jpge::output_stream {
+public:
+    jpge::uint8 *buf;
+    jpge::uint size, cap;
+    mem_stream(jpge::uint c) : buf((jpge::uint8 *)malloc(c)), size(0), cap(c) { }
+    ~mem_stream() { free(buf); }
+    bool put_buf(const void *p, int len) override
+    {
+        if (!p) {
+            return true;
+        }
+        if (size + len > cap) {
+            return false;
+        }
+        memcpy(buf + size, p, len);
+        size += len;
+        return true;
+    }
+    jpge::uint get_size() const override { return size; }
+};
+
+struct decode_ctx {
+    const uint8_t *src;
+    size_t size, pos;
+    uint8_t *rgb;
+    int w;
+};
+
+static inline size_t decode_in(JDEC *jd, uint8_t *buf, size_t len)
+{
+    decode_ctx *d = (decode_ctx *)jd->device;
+    len = len < d->size - d->pos ? len : d->size - d->pos;
+    if (buf) {
+        memcpy(buf, d->src + d->pos, len);
+    }
+    d->pos += len;
+    return len;
+}
+
+static inline int decode_out(JDEC *jd, void *bitmap, JRECT *rect)
+{
+    decode_ctx *d = (decode_ctx *)jd->device;
+    const uint8_t *p = (const uint8_t *)bitmap;
+    int bw = (rect->right - rect->left + 1) * 3;
+    for (int y = rect->top; y <= rect->bottom; y++, p += bw) {
+        memcpy(d->rgb + ((size_t)y * d->w + rect->left) * 3, p, bw);
+    }
+    return 1;
+}
+
+/* Decode to RGB888 (free() the result), NULL on error */
+static inline uint8_t *decode(const uint8_t *src, size_t size, int *w, int *h)
+{
+    static uint8_t work[8192];
+    decode_ctx d = { src, size, 0, NULL, 0 };
+    JDEC jd;
+    if (jd_prepare(&jd, decode_in, work, sizeof(work), &d) != JDR_OK) {
+        return NULL;
+    }
+    d.w = *w = jd.width;
+    *h = jd.height;
+    d.rgb = (uint8_t *)calloc(jd.width * jd.height, 3);
+    if (jd_decomp(&jd, decode_out, 0) != JDR_OK) {
+        free(d.rgb);
+        return NULL;
+    }
+    return d.rgb;
+}
+
+/* Decode an encoder output of known size, NULL on error or size mismatch */
+static inline uint8_t *decode(const mem_stream &s, int w, int h)
+{
+    int dw, dh;
+    uint8_t *rgb = decode(s.buf, s.size, &dw, &dh);
+    if (rgb != NULL && (dw != w || dh != h)) {
+        free(rgb);
+        return NULL;
+    }
+    return rgb;
+}
@@ -0,0 +1,254 @@
+/*
+ * Host check and benchmark for the encoder's camera pixel format inputs
+ * (jpge params::m_source_format), against the previous to_jpg.cpp front end
+ * that converted every line to RGB888 first.
+ *
+ * Build and run from the component root:
+ *   cc -O2 -c -Itest/host/include ../espressif__esp_jpeg/tjpgd/tjpgd.c -o tjpgd.o
+ *   cc -O2 -c -Itest/host/include -Iconversions/private_include conversions/yuv.c -o yuv.o
+ *   c++ -O2 -Itest/host/include -Iconversions/private_include -I../espressif__esp_jpeg/tjpgd \
+ *       test/host/bench_jpge_front.cpp conversions/jpge.cpp conversions/jpge_kernels.cpp \
+ *       tjpgd.o yuv.o -o bench_jpge_front
+ *   ./bench_jpge_front
+ *
+ * RGB888 (stored B,G,R) and RGB565 must encode byte-identically both ways.
+ * YUV422 used to go YUV -> RGB -> YCbCr and now only has its range expanded,
+ * so the bench compares the PSNR of both decodes against the source image.
+ * Then it times 1600x1200 encodes of each format both ways, alternating which
+ * path runs first.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpge.h"
+#include "bench_jpge_common.h"
+extern "C" {
+#include "yuv.h"
+}
+
+using namespace jpge;
+
+static int failures = 0;
+
+enum format { FMT_RGB888, FMT_RGB565, FMT_YUV422 };
+static const char *format_names[] = { "RGB888", "RGB565", "YUV422" };
+
+static uint8 clamp8(double v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8)(v + 0.5));
+}
+
+/* Smooth gradients, saturated patches and some noise, as R,G,B */
+static uint8 *make_rgb(int w, int h)
+{
+    uint8 *rgb = (uint8 *)malloc(w * h * 3);
+    rng_state = 12345;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8 *p = rgb + (y * w + x) * 3;
+            int patch = ((x / 64) + (y / 64) * 3) % 7;
+            p[0] = (uint8)(x * 255 / w);
+            p[1] = (uint8)(y * 255 / h);
+            p[2] = (uint8)(128 + 100 * sin(x * 0.02 + y * 0.01));
+            if (patch == 0) {
+                p[0] = 230; p[1] = 30; p[2] = 40;
+            } else if (patch == 3) {
+                p[0] = 20; p[1] = 60; p[2] = 220;
+            }
+            for (int c = 0; c < 3; c++) {
+                p[c] = clamp8(p[c] + (int)(rng() & 7) - 4);
+            }
+        }
+    }
+    return rgb;
+}
+
+/* The frame as the camera would deliver it */
+static uint8 *make_frame(const uint8 *rgb, int w, int h, format fmt)
+{
+    uint8 *f = (uint8 *)malloc(w * h * 3);
+    for (int i = 0; i < w * h; i++) {
+        const uint8 *p = rgb + i * 3;
+        if (fmt == FMT_RGB888) {
+            f[i * 3 + 0] = p[2]; f[i * 3 + 1] = p[1]; f[i * 3 + 2] = p[0];
+        } else if (fmt == FMT_RGB565) {
+            uint16_t v = ((p[0] & 0xF8) << 8) | ((p[1] & 0xFC) << 3) | (p[2] >> 3);
+            f[i * 2 + 0] = v >> 8; f[i * 2 + 1] = v & 0xFF;
+        } else if ((i & 1) == 0) {
+            /* BT.601 limited range, chroma averaged over the pixel pair */
+            double cb = 0, cr = 0;
+            for (int k = 0; k < 2; k++) {
+                const uint8 *q = p + k * 3;
+                f[i * 2 + k * 2] = clamp8(16 + (65.481 * q[0] + 128.553 * q[1] + 24.966 * q[2]) / 255);
+                cb += 128 + (-37.797 * q[0] - 74.203 * q[1] + 112.0 * q[2]) / 255;
+                cr += 128 + (112.0 * q[0] - 93.786 * q[1] - 18.214 * q[2]) / 255;
+            }
+            f[i * 2 + 1] = clamp8(cb / 2);
+            f[i * 2 + 3] = clamp8(cr / 2);
+        }
+    }
+    return f;
+}
+
+/* The removed to_jpg.cpp convert_line_format(), producing R,G,B */
+static void convert_line_format(const uint8 *src, format fmt, uint8 *dst, int width, int line)
+{
+    int i, o = 0, l;
+    if (fmt == FMT_RGB888) {
+        l = width * 3;
+        src += l * line;
+        for (i = 0; i < l; i += 3) {
+            dst[o++] = src[i + 2];
+            dst[o++] = src[i + 1];
+            dst[o++] = src[i];
+        }
+    } else if (fmt == FMT_RGB565) {
+        l = width * 2;
+        src += l * line;
+        for (i = 0; i < l; i += 2) {
+            dst[o++] = src[i] & 0xF8;
+            dst[o++] = (src[i] & 0x07) << 5 | (src[i + 1] & 0xE0) >> 3;
+            dst[o++] = (src[i + 1] & 0x1F) << 3;
+        }
+    } else {
+        l = width * 2;
+        src += l * line;
+        for (i = 0; i < l; i += 4) {
+            uint8_t r, g, b;
+            yuv2rgb(src[i], src[i + 1], src[i + 3], &r, &g, &b);
+            dst[o++] = r; dst[o++] = g; dst[o++] = b;
+            yuv2rgb(src[i + 2], src[i + 1], src[i + 3], &r, &g, &b);
+            dst[o++] = r; dst[o++] = g; dst[o++] = b;
+        }
+    }
+}
+
+static params comp_params(void)
+{
+    params comp;
+    comp.m_quality = 85;
+    comp.m_subsampling = H2V2;
+    return comp;
+}
+
+static bool encode_via_rgb(mem_stream *out, const uint8 *frame, int w, int h, format fmt)
+{
+    jpeg_encoder enc;
+    if (!enc.init(out, w, h, 3, comp_params())) {
+        return false;
+    }
+    uint8 *line = (uint8 *)malloc(w * 3);
+    for (int y = 0; y < h; y++) {
+        convert_line_format(frame, fmt, line, w, y);
+        enc.process_scanline(line);
+    }
+    free(line);
+    return enc.process_scanline(NULL);
+}
+
+static bool encode_direct(mem_stream *out, const uint8 *frame, int w, int h, format fmt)
+{
+    static const source_format_t src[] = { SRC_BGR888, SRC_RGB565, SRC_YUV422 };
+    int bpp = fmt == FMT_RGB888 ? 3 : 2;
+    params comp = comp_params();
+    comp.m_source_format = src[fmt];
+    jpeg_encoder enc;
+    if (!enc.init(out, w, h, bpp, comp)) {
+        return false;
+    }
+    for (int y = 0; y < h; y++) {
+        enc.process_scanline(frame + (size_t)y * w * bpp);
+    }
+    return enc.process_scanline(NULL);
+}
+
+static double psnr(const mem_stream &s, const uint8 *ref, int w, int h)
+{
+    uint8 *rgb = decode(s, w, h);
+    double err = 0;
+    if (rgb == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < w * h * 3; i++) {
+        double e = (double)rgb[i] - ref[i];
+        err += e * e;
+    }
+    free(rgb);
+    return 10 * log10(255.0 * 255.0 / (err / (w * h * 3)));
+}
+
+static void check_formats(void)
+{
+    const int w = 320, h = 240;
+    uint8 *rgb = make_rgb(w, h);
+    for (int f = FMT_RGB888; f <= FMT_YUV422; f++) {
+        uint8 *frame = make_frame(rgb, w, h, (format)f);
+        mem_stream old_out(w * h * 3), new_out(w * h * 3);
+        if (!encode_via_rgb(&old_out, frame, w, h, (format)f) || !encode_direct(&new_out, frame, w, h, (format)f)) {
+            printf("FAIL: %s encode\n", format_names[f]);
+            failures++;
+        } else if (f != FMT_YUV422) {
+            if (old_out.size != new_out.size || memcmp(old_out.buf, new_out.buf, old_out.size) != 0) {
+                printf("FAIL: %s direct input differs from the RGB888 path\n", format_names[f]);
+                failures++;
+            } else {
+                printf("%s: byte-identical to the RGB888 path (%u bytes)\n", format_names[f], new_out.size);
+            }
+        } else {
+            double p_old = psnr(old_out, rgb, w, h), p_new = psnr(new_out, rgb, w, h);
+            printf("%s: PSNR vs source %.2f dB via RGB, %.2f dB direct; %u -> %u bytes\n",
+                   format_names[f], p_old, p_new, old_out.size, new_out.size);
+            if (p_new < 0 || p_new + 0.1 < p_old) {
+                printf("FAIL: direct YUV422 input loses quality\n");
+                failures++;
+            }
+        }
+        free(frame);
+    }
+    free(rgb);
+}
+
+static void bench_formats(void)
+{
+    const int w = 1600, h = 1200, rounds = 15;
+    uint8 *rgb = make_rgb(w, h);
+    double mp = w * h / 1e6;
+    printf("encode 1600x1200 q85 H2V2, best of %d:\n", rounds);
+    for (int f = FMT_RGB888; f <= FMT_YUV422; f++) {
+        uint8 *frame = make_frame(rgb, w, h, (format)f);
+        double best_old = 1e9, best_new = 1e9;
+        for (int n = 0; n < rounds; n++) {
+            // Alternate which path runs first so neither always gets the warm caches
+            for (int k = 0; k < 2; k++) {
+                mem_stream s(w * h * 3);
+                bool direct = (n + k) & 1;
+                double t0 = now_s();
+                if (direct) {
+                    encode_direct(&s, frame, w, h, (format)f);
+                } else {
+                    encode_via_rgb(&s, frame, w, h, (format)f);
+                }
+                double t = now_s() - t0;
+                double &best = direct ? best_new : best_old;
+                best = t < best ? t : best;
+            }
+        }
+        printf("  %s: via RGB888 %.1f ms/MP, direct %.1f ms/MP (%.2fx)\n", format_names[f],
+               best_old * 1e3 / mp, best_new * 1e3 / mp, best_old / best_new);
+        free(frame);
+    }
+    free(rgb);
+}
+
+int main(void)
+{
+    check_formats();
+    bench_formats();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Host check and benchmark for two-pass optimized-Huffman encoding
+ * (jpge params::m_two_pass_flag).
+ *
+ * Build and run from the component root:
+ *   cc -O2 -c -Itest/host/include ../espressif__esp_jpeg/tjpgd/tjpgd.c -o tjpgd.o
+ *   c++ -O2 -Itest/host/include -Iconversions/private_include -I../espressif__esp_jpeg/tjpgd \
+ *       test/host/bench_jpge_huffman.cpp conversions/jpge.cpp conversions/jpge_kernels.cpp \
+ *       tjpgd.o -o bench_jpge_huffman
+ *   ./bench_jpge_huffman test/pictures/test_inside.jpeg test/pictures/test_outside.jpeg test/pictures/testimg.jpeg
+ *
+ * Decodes each picture, re-encodes it with the standard tables and with
+ * optimized tables at several qualities, checks that both decode to the
+ * same pixels (only the entropy coding differs, with and without restart
+ * markers) and prints the size saving against the extra encode time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpge.h"
+#include "bench_jpge_common.h"
+
+using namespace jpge;
+
+static int failures = 0;
+
+static bool encode(mem_stream *out, const uint8 *rgb, int w, int h, int quality, bool two_pass, int restart, double *secs)
+{
+    params comp;
+    comp.m_quality = quality;
+    comp.m_two_pass_flag = two_pass;
+    comp.m_restart_interval = restart;
+    jpeg_encoder enc;
+    double t0 = now_s();
+    if (!enc.init(out, w, h, 3, comp)) {
+        return false;
+    }
+    for (int y = 0; y < h; y++) {
+        enc.process_scanline(rgb + (size_t)y * w * 3);
+    }
+    bool ok = enc.process_scanline(NULL);
+    *secs = now_s() - t0;
+    return ok;
+}
+
+static void bench_picture(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("FAIL: cannot open %s\n", path);
+        failures++;
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    uint size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8 *jpg = (uint8 *)malloc(size);
+    size = fread(jpg, 1, size, f);
+    fclose(f);
+
+    int w, h;
+    uint8 *rgb = decode(jpg, size, &w, &h);
+    free(jpg);
+    if (!rgb) {
+        printf("FAIL: cannot decode %s\n", path);
+        failures++;
+        return;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    printf("%s (%dx%d):\n", name, w, h);
+
+    static const int qualities[] = { 50, 80, 95 };
+    for (int qi = 0; qi < 3; qi++) {
+        for (int restart = 0; restart <= 8; restart += 8) {
+            double t_std = 1e9, t_opt = 1e9;
+            uint s_std = 0, s_opt = 0;
+            mem_stream a(w * h * 3 + 1024), b(w * h * 3 + 1024);
+            for (int n = 0; n < 5; n++) {
+                double t;
+                a.size = b.size = 0;
+                if (!encode(&a, rgb, w, h, qualities[qi], false, restart, &t)) {
+                    break;
+                }
+                t_std = t < t_std ? t : t_std;
+                if (!encode(&b, rgb, w, h, qualities[qi], true, restart, &t)) {
+                    break;
+                }
+                t_opt = t < t_opt ? t : t_opt;
+            }
+            s_std = a.size;
+            s_opt = b.size;
+
+            int wa, ha, wb, hb;
+            uint8 *pa = decode(a.buf, a.size, &wa, &ha);
+            uint8 *pb = decode(b.buf, b.size, &wb, &hb);
+            if (!pa || !pb || memcmp(pa, pb, (size_t)w * h * 3) != 0) {
+                printf("FAIL: q%d%s optimized tables decode differently\n", qualities[qi], restart ? " DRI" : "");
+                failures++;
+            } else if (s_opt >= s_std) {
+                printf("FAIL: q%d%s optimized tables are not smaller\n", qualities[qi], restart ? " DRI" : "");
+                failures++;
+            }
+            free(pa);
+            free(pb);
+            if (!restart) {
+                printf("  q%-3d standard %7u B %6.2f ms, optimized %7u B %6.2f ms: -%4.1f%% size, +%3.0f%% time\n",
+                       qualities[qi], s_std, t_std * 1e3, s_opt, t_opt * 1e3,
+                       100.0 * (s_std - s_opt) / s_std, 100.0 * (t_opt - t_std) / t_std);
+            }
+        }
+    }
+    free(rgb);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("usage: %s picture.jpeg...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i < argc; i++) {
+        bench_picture(argv[i]);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
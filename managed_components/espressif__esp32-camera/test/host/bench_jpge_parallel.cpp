@@ -0,0 +1,294 @@
+/*
+ * Host check and benchmark for the band-parallel encoder (conversions/jpge_parallel.cpp).
+ *
+ * Build and run from the component root:
+ *   cc -O2 -c -Itest/host/include ../espressif__esp_jpeg/tjpgd/tjpgd.c -o tjpgd.o
+ *   c++ -O2 -pthread -Itest/host/include -Iconversions/private_include -I../espressif__esp_jpeg/tjpgd \
+ *       test/host/bench_jpge_parallel.cpp conversions/jpge.cpp conversions/jpge_kernels.cpp \
+ *       conversions/jpge_parallel.cpp tjpgd.o -o bench_jpge_parallel
+ *   ./bench_jpge_parallel
+ *
+ * For 2..8 workers and every subsampling mode, checks that the parallel output
+ * is byte-identical to a serial encode with the same restart interval and that
+ * tjpgd decodes it to the same pixels as a serial encode without restart
+ * markers. Checks that serial encoders running concurrently at different
+ * qualities each match their single-threaded output. Then times a 2 MP RGB encode with 1, 2, 4, 8 and nproc workers.
+ * Next to the measured wall time it prints the critical path: the busiest
+ * worker's share of the band encode times, i.e. the time on that many free
+ * cores. On a machine with fewer cores than workers only the latter scales.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "jpge.h"
+#include "bench_jpge_common.h"
+#include "jpge_parallel.h"
+
+using namespace jpge;
+
+static int failures = 0;
+
+struct image {
+    int w, h, channels;
+    uint8 *pixels;
+};
+
+static const uint8 *read_line(void *ctx, int y)
+{
+    image *img = (image *)ctx;
+    return img->pixels + (size_t)y * img->w * img->channels;
+}
+
+static image make_image(int w, int h, int channels)
+{
+    image img = { w, h, channels, (uint8 *)malloc(w * h * channels) };
+    rng_state = 12345;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8 *p = img.pixels + (y * w + x) * channels;
+            p[0] = (uint8)(x * 255 / w + (rng() & 15));
+            if (channels == 3) {
+                p[1] = (uint8)(y * 255 / h + (rng() & 15));
+                p[2] = (uint8)(((x / 40 + y / 40) & 1) ? 200 : 40);
+            }
+        }
+    }
+    return img;
+}
+
+static bool encode_serial(mem_stream *out, const image &img, const params &comp)
+{
+    jpeg_encoder enc;
+    if (!enc.init(out, img.w, img.h, img.channels, comp)) {
+        return false;
+    }
+    for (int y = 0; y < img.h; y++) {
+        enc.process_scanline(img.pixels + (size_t)y * img.w * img.channels);
+    }
+    return enc.process_scanline(NULL);
+}
+
+/* Restart interval from the DRI segment, 0 if there is none */
+static int restart_interval(const mem_stream &s)
+{
+    for (uint i = 2; i + 5 < s.size; i++) {
+        if (s.buf[i] == 0xFF && s.buf[i + 1] == 0xDD) {
+            return (s.buf[i + 4] << 8) | s.buf[i + 5];
+        }
+        if (s.buf[i] == 0xFF && s.buf[i + 1] == 0xDA) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static void check_equivalence(void)
+{
+    static const struct {
+        int w, h, channels;
+        subsampling_t sub;
+        const char *name;
+    } cases[] = {
+        { 320, 240, 3, H2V2, "H2V2" },
+        { 330, 247, 3, H2V2, "H2V2 odd size" },
+        { 320, 240, 3, H2V1, "H2V1" },
+        { 320, 240, 3, H1V1, "H1V1" },
+        { 321, 203, 1, Y_ONLY, "Y_ONLY" },
+        { 4000, 40, 1, Y_ONLY, "Y_ONLY wide" },
+    };
+    int checked = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        image img = make_image(cases[c].w, cases[c].h, cases[c].channels);
+        params comp;
+        comp.m_quality = 80;
+        comp.m_subsampling = cases[c].sub;
+
+        mem_stream plain(img.w * img.h * 3 + 1024);
+        encode_serial(&plain, img, comp);
+        uint8 *ref = decode(plain, img.w, img.h);
+        if (!ref) {
+            printf("FAIL: %s: reference does not decode\n", cases[c].name);
+            failures++;
+            continue;
+        }
+
+        for (int workers = 2; workers <= 8; workers++) {
+            mem_stream par(img.w * img.h * 3 + 1024);
+            if (!compress_parallel(&par, img.w, img.h, img.channels, comp, workers, read_line, &img)) {
+                printf("FAIL: %s: parallel encode with %d workers\n", cases[c].name, workers);
+                failures++;
+                continue;
+            }
+            params serial_comp = comp;
+            serial_comp.m_restart_interval = restart_interval(par);
+            mem_stream serial(img.w * img.h * 3 + 1024);
+            encode_serial(&serial, img, serial_comp);
+            if (!serial_comp.m_restart_interval || serial.size != par.size ||
+                memcmp(serial.buf, par.buf, par.size) != 0) {
+                printf("FAIL: %s: %d workers differ from serial encode with restart interval %d\n",
+                       cases[c].name, workers, serial_comp.m_restart_interval);
+                failures++;
+                continue;
+            }
+            uint8 *rgb = decode(par, img.w, img.h);
+            if (!rgb || memcmp(rgb, ref, (size_t)img.w * img.h * 3) != 0) {
+                printf("FAIL: %s: %d workers decode to different pixels\n", cases[c].name, workers);
+                failures++;
+            }
+            free(rgb);
+            checked++;
+        }
+        free(ref);
+        free(img.pixels);
+    }
+    printf("equivalence: %d encodes byte-identical to serial with DRI, pixel-identical without\n", checked);
+}
+
+struct quality_thread {
+    const image *img;
+    int quality;
+    const mem_stream *ref;
+    int mismatches;
+};
+
+static void *quality_thread_main(void *arg)
+{
+    quality_thread *t = (quality_thread *)arg;
+    params comp;
+    comp.m_quality = t->quality;
+    for (int n = 0; n < 50; n++) {
+        mem_stream out(t->img->w * t->img->h * 3 + 1024);
+        if (!encode_serial(&out, *t->img, comp) || out.size != t->ref->size ||
+            memcmp(out.buf, t->ref->buf, out.size) != 0) {
+            t->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+/* Encoders at different qualities must not share quantization tables */
+static void check_concurrent_qualities(void)
+{
+    static const int qualities[] = { 30, 60, 90 };
+    const int n = sizeof(qualities) / sizeof(qualities[0]);
+    image img = make_image(320, 240, 3);
+    mem_stream *refs[n];
+    quality_thread args[n];
+    pthread_t threads[n];
+
+    for (int i = 0; i < n; i++) {
+        params comp;
+        comp.m_quality = qualities[i];
+        refs[i] = new mem_stream(img.w * img.h * 3 + 1024);
+        encode_serial(refs[i], img, comp);
+        args[i] = { &img, qualities[i], refs[i], 0 };
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_create(&threads[i], NULL, quality_thread_main, &args[i]);
+    }
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        mismatches += args[i].mismatches;
+        delete refs[i];
+    }
+    if (mismatches) {
+        printf("FAIL: %d concurrent encodes differ from their single-threaded output\n", mismatches);
+        failures++;
+    } else {
+        printf("concurrency: %d encodes at q%d/q%d/q%d on %d threads match\n",
+               50 * n, qualities[0], qualities[1], qualities[2], n);
+    }
+    free(img.pixels);
+}
+
+/* Time of each band encoded alone, the work a worker would do for it */
+static double critical_path(const image &img, const params &comp, int workers)
+{
+    if (parallel_band_count(img.w, img.h, comp, workers) < 2) {
+        return -1;
+    }
+    mem_stream par(img.w * img.h * 3);
+    compress_parallel(&par, img.w, img.h, img.channels, comp, workers, read_line, (void *)&img);
+    int mcu_x = 16, mcu_y = 16;
+    int band_rows = restart_interval(par) / ((img.w + mcu_x - 1) / mcu_x) * mcu_y;
+    int bands = (img.h + band_rows - 1) / band_rows;
+
+    double busiest = 0;
+    for (int k = 0; k < workers; k++) {
+        double t = 0;
+        for (int b = k; b < bands; b += workers) {
+            int rows = img.h - b * band_rows < band_rows ? img.h - b * band_rows : band_rows;
+            mem_stream out(img.w * rows * 3);
+            jpeg_encoder enc;
+            double t0 = now_s();
+            enc.init_band(&out, img.w, rows, img.channels, comp);
+            for (int y = b * band_rows; y < b * band_rows + rows; y++) {
+                enc.process_scanline(img.pixels + (size_t)y * img.w * img.channels);
+            }
+            enc.process_scanline(NULL);
+            t += now_s() - t0;
+        }
+        busiest = t > busiest ? t : busiest;
+    }
+    return busiest;
+}
+
+static void bench_scaling(void)
+{
+    const int rounds = 5;
+    image img = make_image(1600, 1200, 3);
+    params comp;
+    comp.m_quality = 85;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int counts[] = { 1, 2, 4, 8, (int)cores };
+    int n_counts = (cores != 1 && cores != 2 && cores != 4 && cores != 8) ? 5 : 4;
+
+    printf("encode 1600x1200 q85 H2V2, %ld core(s) online\n", cores);
+    double base_wall = 0, base_cpu = 0;
+    uint base_size = 0;
+    for (int c = 0; c < n_counts; c++) {
+        int workers = counts[c];
+        double best = 1e9;
+        uint size = 0;
+        for (int n = 0; n < rounds; n++) {
+            mem_stream out(img.w * img.h * 3);
+            double t0 = now_s();
+            if (!compress_parallel(&out, img.w, img.h, 3, comp, workers, read_line, &img)) {
+                printf("FAIL: encode with %d workers\n", workers);
+                failures++;
+                break;
+            }
+            double dt = now_s() - t0;
+            best = dt < best ? dt : best;
+            size = out.size;
+        }
+        double path = workers > 1 ? critical_path(img, comp, workers) : best;
+        for (int n = 1; n < rounds && workers > 1; n++) {
+            double p = critical_path(img, comp, workers);
+            path = p < path ? p : path;
+        }
+        if (workers == 1) {
+            base_wall = base_cpu = best;
+            base_size = size;
+        }
+        printf("  %d worker(s): wall %6.1f ms (%.2fx), critical path %6.1f ms (%.2fx), %u bytes (+%u)\n",
+               workers, best * 1e3, base_wall / best, path * 1e3, base_cpu / path, size, size - base_size);
+    }
+    free(img.pixels);
+}
+
+int main(void)
+{
+    check_equivalence();
+    check_concurrent_qualities();
+    bench_scaling();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Host check and benchmark for rate-controlled encoding (jpge params::m_target_size)
+ * and size prediction (jpeg_encoder::init_analysis / predict_size).
+ *
+ * Build and run from the component root:
+ *   cc -O2 -c -Itest/host/include ../espressif__esp_jpeg/tjpgd/tjpgd.c -o tjpgd.o
+ *   c++ -O2 -Itest/host/include -Iconversions/private_include -I../espressif__esp_jpeg/tjpgd \
+ *       test/host/bench_jpge_rate.cpp conversions/jpge.cpp conversions/jpge_kernels.cpp \
+ *       tjpgd.o -o bench_jpge_rate
+ *   ./bench_jpge_rate test/pictures/test_inside.jpeg test/pictures/test_outside.jpeg test/pictures/testimg.jpeg
+ *
+ * Decodes each picture and checks that the predicted sizes match real
+ * encodes byte for byte (standard and optimized tables, with and without
+ * restart markers), and that rate-controlled encodes stay within their
+ * budget and equal a plain encode at the quality they chose, or fail
+ * without output when even quality 1 is over the budget. Then compares
+ * a rate-controlled encode with the same quality search done by full
+ * re-encodes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpge.h"
+#include "bench_jpge_common.h"
+
+using namespace jpge;
+
+static int failures = 0;
+
+static bool encode(mem_stream *out, const uint8 *rgb, int w, int h, const params &comp, int *quality)
+{
+    jpeg_encoder enc;
+    if (!enc.init(out, w, h, 3, comp)) {
+        return false;
+    }
+    for (int y = 0; y < h; y++) {
+        enc.process_scanline(rgb + (size_t)y * w * 3);
+    }
+    bool ok = enc.process_scanline(NULL);
+    if (quality) {
+        *quality = enc.get_quality();
+    }
+    return ok;
+}
+
+static void check_prediction(const uint8 *rgb, int w, int h)
+{
+    static const int qualities[] = { 1, 5, 20, 50, 75, 90, 100 };
+    const int n_qualities = sizeof(qualities) / sizeof(qualities[0]);
+    int checked = 0;
+    for (int mode = 0; mode < 4; mode++) {
+        params comp;
+        comp.m_two_pass_flag = mode & 1;
+        comp.m_restart_interval = mode & 2 ? 8 : 0;
+        jpeg_encoder analysis;
+        if (!analysis.init_analysis(w, h, 3, comp)) {
+            printf("FAIL: init_analysis\n");
+            failures++;
+            return;
+        }
+        for (int y = 0; y < h; y++) {
+            analysis.process_scanline(rgb + (size_t)y * w * 3);
+        }
+        analysis.process_scanline(NULL);
+        for (int i = 0; i < n_qualities; i++) {
+            comp.m_quality = qualities[i];
+            mem_stream out(w * h * 3 + 1024);
+            encode(&out, rgb, w, h, comp, NULL);
+            uint predicted = analysis.predict_size(qualities[i]);
+            if (predicted != out.size) {
+                printf("FAIL: q%d%s%s predicted %u bytes, encoded %u\n", qualities[i],
+                       comp.m_two_pass_flag ? " optimized" : "", comp.m_restart_interval ? " DRI" : "",
+                       predicted, out.size);
+                failures++;
+            }
+            checked++;
+        }
+    }
+    printf("  prediction: %d sizes exact\n", checked);
+}
+
+static void check_rate_control(const uint8 *rgb, int w, int h)
+{
+    for (int two_pass = 0; two_pass < 2; two_pass++) {
+        params comp;
+        comp.m_quality = 90;
+        comp.m_two_pass_flag = two_pass;
+        mem_stream top(w * h * 3 + 1024);
+        encode(&top, rgb, w, h, comp, NULL);
+
+        static const int percent[] = { 10, 25, 50, 75, 100, 150 };
+        printf("  %s tables, q90 = %u bytes:", two_pass ? "optimized" : "standard", top.size);
+        for (int i = 0; i < 6; i++) {
+            params rate = comp;
+            rate.m_target_size = top.size * percent[i] / 100;
+            mem_stream out(w * h * 3 + 1024), plain(w * h * 3 + 1024);
+            int quality = 0;
+            if (!encode(&out, rgb, w, h, rate, &quality)) {
+                // Only allowed when nothing fits, and then nothing may be written
+                params q1 = comp;
+                q1.m_quality = 1;
+                mem_stream low(w * h * 3 + 1024);
+                encode(&low, rgb, w, h, q1, NULL);
+                if (low.size <= (uint)rate.m_target_size || out.size != 0) {
+                    printf("\nFAIL: rate-controlled encode to %d bytes (q1 is %u bytes, %u written)\n",
+                           rate.m_target_size, low.size, out.size);
+                    failures++;
+                }
+                printf(" %d%% -> over budget (q1 %u B)", percent[i], low.size);
+                continue;
+            }
+            params at = comp;
+            at.m_quality = quality;
+            encode(&plain, rgb, w, h, at, NULL);
+            if (plain.size != out.size || memcmp(plain.buf, out.buf, out.size) != 0) {
+                printf("\nFAIL: budget %d: output differs from a q%d encode\n", rate.m_target_size, quality);
+                failures++;
+            }
+            if (out.size > (uint)rate.m_target_size) {
+                printf("\nFAIL: budget %d: %u bytes at q%d\n", rate.m_target_size, out.size, quality);
+                failures++;
+            }
+            printf(" %d%% -> q%d %u B", percent[i], quality, out.size);
+        }
+        printf("\n");
+    }
+}
+
+/* Quality search by full re-encodes, the way a caller would do it without rate control */
+static int search_by_reencode(const uint8 *rgb, int w, int h, params comp, int target)
+{
+    int lo = 1, hi = comp.m_quality, best = 1;
+    mem_stream out(w * h * 3 + 1024);
+    encode(&out, rgb, w, h, comp, NULL);
+    if (out.size <= (uint)target) {
+        return hi;
+    }
+    hi--;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        comp.m_quality = mid;
+        out.size = 0;
+        encode(&out, rgb, w, h, comp, NULL);
+        if (out.size <= (uint)target) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    comp.m_quality = best;
+    out.size = 0;
+    encode(&out, rgb, w, h, comp, NULL);
+    return best;
+}
+
+static void bench_rate_control(const uint8 *rgb, int w, int h)
+{
+    params comp;
+    comp.m_quality = 90;
+    mem_stream top(w * h * 3 + 1024);
+    encode(&top, rgb, w, h, comp, NULL);
+    int target = top.size / 2;
+
+    double t_plain = 1e9, t_rate = 1e9, t_search = 1e9;
+    int q_rate = 0, q_search = 0;
+    for (int n = 0; n < 5; n++) {
+        mem_stream out(w * h * 3 + 1024);
+        double t0 = now_s();
+        encode(&out, rgb, w, h, comp, NULL);
+        double t1 = now_s();
+        params rate = comp;
+        rate.m_target_size = target;
+        out.size = 0;
+        encode(&out, rgb, w, h, rate, &q_rate);
+        double t2 = now_s();
+        q_search = search_by_reencode(rgb, w, h, comp, target);
+        double t3 = now_s();
+        t_plain = t1 - t0 < t_plain ? t1 - t0 : t_plain;
+        t_rate = t2 - t1 < t_rate ? t2 - t1 : t_rate;
+        t_search = t3 - t2 < t_search ? t3 - t2 : t_search;
+    }
+    if (q_rate != q_search) {
+        printf("FAIL: rate control chose q%d, re-encode search q%d\n", q_rate, q_search);
+        failures++;
+    }
+    printf("  budget %d B: single encode %.2f ms, rate-controlled %.2f ms (q%d), re-encode search %.2f ms (%.1fx)\n",
+           target, t_plain * 1e3, t_rate * 1e3, q_rate, t_search * 1e3, t_search / t_rate);
+}
+
+static void bench_picture(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("FAIL: cannot open %s\n", path);
+        failures++;
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    uint size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8 *jpg = (uint8 *)malloc(size);
+    size = fread(jpg, 1, size, f);
+    fclose(f);
+
+    int w, h;
+    uint8 *rgb = decode(jpg, size, &w, &h);
+    free(jpg);
+    if (!rgb) {
+        printf("FAIL: cannot decode %s\n", path);
+        failures++;
+        return;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    printf("%s (%dx%d):\n", name, w, h);
+
+    check_prediction(rgb, w, h);
+    check_rate_control(rgb, w, h);
+    bench_rate_control(rgb, w, h);
+    free(rgb);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("usage: %s picture.jpeg...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i < argc; i++) {
+        bench_picture(argv[i]);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,4 @@
+/* Minimal esp_attr.h for building the conversions with a plain host compiler */
+#pragma once
+
+#define IRAM_ATTR
@@ -0,0 +1,14 @@
+/* Minimal esp_heap_caps.h for building the conversions with a plain host compiler */
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+
+static inline void *heap_caps_malloc(size_t size, unsigned int caps)
+{
+    (void)caps;
+    return malloc(size);
+}
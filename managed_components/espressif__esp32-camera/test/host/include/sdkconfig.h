@@ -0,0 +1,17 @@
+/* Minimal sdkconfig for building the camera simulator with a plain host compiler */
+#pragma once
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_IDF_TARGET "linux"
+
+/* esp_jpeg Kconfig defaults, for decoding with tjpgd in the host checks */
+#define CONFIG_JD_SZBUF 512
+#define CONFIG_JD_FORMAT 0
+#define CONFIG_JD_USE_SCALE 1
+#define CONFIG_JD_TBLCLIP 1
+#define CONFIG_JD_FASTDECODE 1
+
+/* esp32-camera Kconfig defaults used by the conversions */
+#define CONFIG_CAMERA_JPEG_ENCODE_WORKERS 1
+#define CONFIG_CAMERA_JPEG_CHUNK_SIZE 32768
+#define CONFIG_CAMERA_JPEG_FILE_CHUNK_SIZE 4096
@@ -0,0 +1,2 @@
+/* Empty soc/efuse_reg.h for building the conversions with a plain host compiler */
+#pragma once
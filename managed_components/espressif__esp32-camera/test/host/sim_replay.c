@@ -0,0 +1,168 @@
+/*
+ * Host check for the camera simulator (driver/esp_camera_sim.c).
+ *
+ * Build and run from the component root:
+ *   cc -O2 -pthread -Itest/host/include -Idriver/include -Idriver/private_include \
+ *      -Iconversions/include -I../espressif__esp_jpeg/include \
+ *      test/host/sim_replay.c driver/esp_camera_sim.c driver/sensor.c driver/cam_jpeg.c -o sim_replay
+ *   ./sim_replay test/pictures
+ *
+ * Replays the pictures through the esp_camera API and checks frame delivery,
+ * fb_count slot exhaustion, injected corruption and NULL frames, and the
+ * injected latency.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_camera.h"
+#include "esp_camera_sim.h"
+#include "cam_jpeg.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                    \
+    do {                                    \
+        if (!(cond)) {                      \
+            printf("FAIL: " __VA_ARGS__);   \
+            printf("\n");                   \
+            failures++;                     \
+        }                                   \
+    } while (0)
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static camera_config_t camera_config(size_t fb_count, camera_grab_mode_t grab_mode)
+{
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_QVGA,
+        .jpeg_quality = 12,
+        .fb_count = fb_count,
+        .grab_mode = grab_mode,
+    };
+    return config;
+}
+
+static void check_replay(const char *dir)
+{
+    camera_sim_config_t sim = CAMERA_SIM_CONFIG_DEFAULT();
+    sim.frame_dir = dir;
+    sim.fps = 50;
+    esp_camera_sim_configure(&sim);
+    camera_config_t config = camera_config(2, CAMERA_GRAB_WHEN_EMPTY);
+    CHECK(esp_camera_init(&config) == ESP_OK, "init");
+
+    sensor_t *s = esp_camera_sensor_get();
+    CHECK(s && s->id.PID == OV3660_PID, "sensor id");
+    CHECK(s->set_framesize(s, FRAMESIZE_VGA) == 0 && s->status.framesize == FRAMESIZE_VGA,
+          "set_framesize");
+
+    for (int i = 0; i < 6; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        CHECK(fb != NULL, "frame %d", i);
+        if (fb) {
+            CHECK(cam_jpeg_validate(fb->buf, fb->len, fb->width, fb->height) == CAM_JPEG_OK,
+                  "frame %d is a complete JPEG", i);
+            esp_camera_fb_return(fb);
+        }
+    }
+    esp_camera_deinit();
+}
+
+static void check_slot_exhaustion(const char *dir)
+{
+    camera_sim_config_t sim = CAMERA_SIM_CONFIG_DEFAULT();
+    sim.frame_dir = dir;
+    sim.fps = 100;
+    esp_camera_sim_configure(&sim);
+    camera_config_t config = camera_config(2, CAMERA_GRAB_WHEN_EMPTY);
+    esp_camera_init(&config);
+
+    camera_fb_t *a = esp_camera_fb_get();
+    camera_fb_t *b = esp_camera_fb_get();
+    sleep_ms(200);
+    camera_sim_stats_t stats;
+    esp_camera_sim_get_stats(&stats);
+    CHECK(a && b && stats.dropped > 10, "holding both slots drops frames (%u dropped)",
+          (unsigned)stats.dropped);
+    CHECK(!esp_camera_available_frames(), "no frame queued while slots are held");
+
+    esp_camera_fb_return(a);
+    camera_fb_t *c = esp_camera_fb_get();
+    CHECK(c != NULL && c != b, "returning a slot resumes capture");
+    esp_camera_fb_return(b);
+    esp_camera_fb_return(c);
+    printf("exhaustion: produced %u, dropped %u while 2/2 slots held\n",
+           (unsigned)stats.produced, (unsigned)stats.dropped);
+    esp_camera_deinit();
+}
+
+static void check_injection(const char *dir)
+{
+    camera_sim_config_t sim = CAMERA_SIM_CONFIG_DEFAULT();
+    sim.frame_dir = dir;
+    sim.fps = 100;
+    sim.corrupt_every = 3;
+    sim.null_every = 4;
+    sim.latency_ms = 20;
+    sim.jitter_ms = 10;
+    esp_camera_sim_configure(&sim);
+    camera_config_t config = camera_config(3, CAMERA_GRAB_LATEST);
+    esp_camera_init(&config);
+
+    int nulls = 0, rejected = 0, frames = 0;
+    double latency_sum = 0, latency_min = 1e9, latency_max = 0;
+    for (int i = 0; i < 40; i++) {
+        double t = now_ms();
+        camera_fb_t *fb = esp_camera_fb_get();
+        double dt = now_ms() - t;
+        if (!fb) {
+            nulls++;
+            continue;
+        }
+        frames++;
+        latency_sum += dt;
+        latency_min = dt < latency_min ? dt : latency_min;
+        latency_max = dt > latency_max ? dt : latency_max;
+        if (cam_jpeg_find_marker(fb->buf, fb->len, (const uint8_t *)"\xFF\xD9", 2) < 0) {
+            rejected++;
+        }
+        esp_camera_fb_return(fb);
+    }
+
+    camera_sim_stats_t stats;
+    esp_camera_sim_get_stats(&stats);
+    CHECK(nulls == 10, "every 4th call is NULL (%d)", nulls);
+    CHECK(rejected > 0, "corrupt frames reach the application");
+    CHECK(latency_min >= 9 && latency_max < 60, "latency 20 +/- 10 ms (%.1f..%.1f)",
+          latency_min, latency_max);
+    printf("injection: %d frames, %d NULL, %d without EOI, latency %.1f ms avg (%.1f..%.1f), "
+           "%u corrupted, %u overwritten\n",
+           frames, nulls, rejected, latency_sum / frames, latency_min, latency_max,
+           (unsigned)stats.corrupted, (unsigned)stats.overwritten);
+    esp_camera_deinit();
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : "test/pictures";
+
+    check_replay(dir);
+    check_slot_exhaustion(dir);
+    check_injection(dir);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * SCCB mock: simulated 16-bit register file that counts bus transactions.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sccb.h"
+#include "sccb_mock.h"
+
+#define SCCB_MOCK_REGS 0x10000
+
+static uint8_t *mock_regs = NULL;
+static sccb_mock_stats_t mock_stats;
+
+static uint8_t mock_read16(uint8_t slv_addr, uint16_t reg)
+{
+    mock_stats.reads++;
+    mock_stats.bytes += 4;  // addr+W, reg[2], addr+R, data (address phase counted once)
+    return mock_regs[reg];
+}
+
+static int mock_write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
+{
+    mock_stats.writes++;
+    mock_stats.bytes += 4;  // addr+W, reg[2], data
+    mock_regs[reg] = data;
+    return 0;
+}
+
+static int mock_write16_burst(uint8_t slv_addr, uint16_t reg, const uint8_t *data, size_t len)
+{
+    mock_stats.writes++;
+    mock_stats.bytes += 3 + len;    // addr+W, reg[2], data[len]
+    for (size_t i = 0; i < len; i++) {
+        mock_regs[(uint16_t)(reg + i)] = data[i];
+    }
+    return 0;
+}
+
+static const sccb_backend_t mock_backend = {
+    .read16 = mock_read16,
+    .write16 = mock_write16,
+    .write16_burst = mock_write16_burst,
+};
+
+int sccb_mock_install(void)
+{
+    if (mock_regs == NULL) {
+        mock_regs = calloc(SCCB_MOCK_REGS, 1);
+        if (mock_regs == NULL) {
+            return -1;
+        }
+    }
+    memset(&mock_stats, 0, sizeof(mock_stats));
+    SCCB_Set_Backend(&mock_backend);
+    return 0;
+}
+
+void sccb_mock_uninstall(void)
+{
+    SCCB_Set_Backend(NULL);
+    free(mock_regs);
+    mock_regs = NULL;
+}
+
+void sccb_mock_get_stats(sccb_mock_stats_t *stats, bool clear)
+{
+    *stats = mock_stats;
+    if (clear) {
+        memset(&mock_stats, 0, sizeof(mock_stats));
+    }
+}
+
+uint8_t sccb_mock_get_reg(uint16_t reg)
+{
+    return mock_regs[reg];
+}
+
+void sccb_mock_set_reg(uint16_t reg, uint8_t value)
+{
+    mock_regs[reg] = value;
+}
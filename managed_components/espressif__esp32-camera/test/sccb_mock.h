@@ -0,0 +1,41 @@
+/*
+ * SCCB mock: simulated 16-bit register file that counts bus transactions.
+ * Installed through SCCB_Set_Backend(), so sensor drivers can be exercised
+ * without a camera attached.
+ */
+#ifndef __SCCB_MOCK_H__
+#define __SCCB_MOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint32_t reads;         // Register read transactions
+    uint32_t writes;        // Register write transactions
+    uint32_t bytes;         // Bytes on the bus (address, register and data)
+} sccb_mock_stats_t;
+
+/**
+ * @brief Allocate the register file and route SCCB 16-bit access to it
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+int sccb_mock_install(void);
+
+/**
+ * @brief Restore the I2C transport and free the register file
+ */
+void sccb_mock_uninstall(void);
+
+/**
+ * @brief Get and optionally clear the transaction counters
+ */
+void sccb_mock_get_stats(sccb_mock_stats_t *stats, bool clear);
+
+/**
+ * @brief Peek/poke the simulated registers without counting a transaction
+ */
+uint8_t sccb_mock_get_reg(uint16_t reg);
+void sccb_mock_set_reg(uint16_t reg, uint8_t value);
+
+#endif // __SCCB_MOCK_H__
@@ -1,6 +1,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "unity.h"
@@ -10,6 +11,10 @@
 #include "esp_timer.h"
 
 #include "esp_camera.h"
+#include "ov3660.h"
+#include "sccb_mock.h"
+#include "cam_jpeg.h"
+#include "ov3660_settings.h"
 
 #ifdef CONFIG_IDF_TARGET_ESP32
 #define BOARD_WROVER_KIT 1
@@ -535,3 +540,157 @@ TEST_CASE("Camera driver uses an i2c port initialized by other devices test", "[
     TEST_ESP_OK(esp_camera_deinit());
     TEST_ESP_OK(i2c_driver_delete(I2C_MASTER_NUM));
 }
+
+static void ov3660_mock_sensor(sensor_t *sensor)
+{
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->slv_addr = OV3660_SCCB_ADDR;
+    sensor->xclk_freq_hz = 20000000;
+    TEST_ASSERT_EQUAL(0, esp32_camera_ov3660_init(sensor));
+    TEST_ASSERT_EQUAL(0, sensor->reset(sensor));
+    TEST_ASSERT_EQUAL(0, sensor->set_pixformat(sensor, PIXFORMAT_JPEG));
+    TEST_ASSERT_EQUAL(0, sensor->set_framesize(sensor, FRAMESIZE_SVGA));
+}
+
+TEST_CASE("OV3660 mode switch SCCB transactions", "[camera][sccb]")
+{
+    sensor_t sensor;
+    sccb_mock_stats_t stats;
+    TEST_ASSERT_EQUAL(0, sccb_mock_install());
+    ov3660_mock_sensor(&sensor);
+
+    // Switch and back, as the timelapse does around every shot
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, sensor.set_framesize(&sensor, FRAMESIZE_UXGA));
+    sccb_mock_get_stats(&stats, true);
+    ESP_LOGI(TAG, "SVGA -> UXGA: %" PRIu32 " reads, %" PRIu32 " writes", stats.reads, stats.writes);
+    TEST_ASSERT_EQUAL(0, stats.reads);
+    TEST_ASSERT_LESS_THAN(34, stats.writes);
+    TEST_ASSERT_EQUAL_HEX8(1600 >> 8, sccb_mock_get_reg(0x3808));
+    TEST_ASSERT_EQUAL_HEX8(1600 & 0xFF, sccb_mock_get_reg(0x3809));
+
+    TEST_ASSERT_EQUAL(0, sensor.set_framesize(&sensor, FRAMESIZE_SVGA));
+    sccb_mock_get_stats(&stats, true);
+    ESP_LOGI(TAG, "UXGA -> SVGA: %" PRIu32 " reads, %" PRIu32 " writes", stats.reads, stats.writes);
+    TEST_ASSERT_EQUAL_HEX8(800 >> 8, sccb_mock_get_reg(0x3808));
+    TEST_ASSERT_EQUAL_HEX8(800 & 0xFF, sccb_mock_get_reg(0x3809));
+
+    // Re-applying the current mode or settings costs nothing
+    TEST_ASSERT_EQUAL(0, sensor.set_quality(&sensor, 12));
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, sensor.set_framesize(&sensor, FRAMESIZE_SVGA));
+    TEST_ASSERT_EQUAL(0, sensor.set_quality(&sensor, 12));
+    TEST_ASSERT_EQUAL(0, sensor.set_vflip(&sensor, sensor.status.vflip));
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, stats.reads);
+    TEST_ASSERT_EQUAL(0, stats.writes);
+
+    // Read-modify-write of a shadowed register needs no read
+    TEST_ASSERT_EQUAL(0, sensor.set_colorbar(&sensor, 1));
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, sensor.set_colorbar(&sensor, 0));
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, stats.reads);
+    TEST_ASSERT_EQUAL(1, stats.writes);
+
+    sccb_mock_uninstall();
+}
+
+TEST_CASE("OV3660 init uses burst SCCB writes", "[camera][sccb]")
+{
+    sensor_t sensor;
+    sccb_mock_stats_t stats;
+    TEST_ASSERT_EQUAL(0, sccb_mock_install());
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.slv_addr = OV3660_SCCB_ADDR;
+    sensor.xclk_freq_hz = 20000000;
+    TEST_ASSERT_EQUAL(0, esp32_camera_ov3660_init(&sensor));
+    TEST_ASSERT_EQUAL(0, sensor.reset(&sensor));
+    sccb_mock_get_stats(&stats, true);
+
+    size_t table_regs = 0;
+    for (int i = 0; sensor_default_regs[i][0] != REGLIST_TAIL; i++) {
+        if (sensor_default_regs[i][0] != REG_DLY) {
+            table_regs++;
+        }
+    }
+    // 9 bits per byte plus start/stop per transaction
+    ESP_LOGI(TAG, "Reset: %u registers in %" PRIu32 " transactions, ~%u us on the bus at %d Hz",
+             (unsigned)table_regs, stats.writes,
+             (unsigned)((stats.bytes * 9 + stats.writes * 2) * 1000000ULL / CONFIG_SCCB_CLK_FREQ),
+             CONFIG_SCCB_CLK_FREQ);
+#if CONFIG_SCCB_BURST_WRITE
+    TEST_ASSERT_LESS_THAN(table_regs / 2, stats.writes);
+#endif
+
+    // Every table register landed, except those set_ae_level() rewrites
+    for (int i = 0; sensor_default_regs[i][0] != REGLIST_TAIL; i++) {
+        uint16_t reg = sensor_default_regs[i][0];
+        if (reg == REG_DLY || reg == SYSTEM_CTROL0 || (reg >= 0x3a0f && reg <= 0x3a1f)) {
+            continue;
+        }
+        bool rewritten = false;
+        for (int j = i + 1; sensor_default_regs[j][0] != REGLIST_TAIL; j++) {
+            rewritten |= sensor_default_regs[j][0] == reg;
+        }
+        if (!rewritten) {
+            TEST_ASSERT_EQUAL_HEX8(sensor_default_regs[i][1], sccb_mock_get_reg(reg));
+        }
+    }
+
+    // Mode switch window registers go out as bursts
+    TEST_ASSERT_EQUAL(0, sensor.set_pixformat(&sensor, PIXFORMAT_JPEG));
+    TEST_ASSERT_EQUAL(0, sensor.set_framesize(&sensor, FRAMESIZE_SVGA));
+    sccb_mock_get_stats(&stats, true);
+    TEST_ASSERT_EQUAL(0, sensor.set_framesize(&sensor, FRAMESIZE_UXGA));
+    sccb_mock_get_stats(&stats, true);
+    ESP_LOGI(TAG, "SVGA -> UXGA: %" PRIu32 " transactions, %" PRIu32 " bytes", stats.writes, stats.bytes);
+
+    sccb_mock_uninstall();
+}
+
+TEST_CASE("JPEG frame structure check", "[camera][jpeg]")
+{
+    extern const uint8_t img_start[] asm("_binary_test_inside_jpeg_start");
+    extern const uint8_t img_end[]   asm("_binary_test_inside_jpeg_end");
+    size_t len = img_end - img_start - 1; /* drop the EMBED_TXTFILES terminator */
+    static const uint8_t soi[] = {0xFF, 0xD8, 0xFF};
+    static const uint8_t sos[] = {0xFF, 0xDA};
+
+    TEST_ASSERT_EQUAL(0, cam_jpeg_find_marker(img_start, len, soi, sizeof(soi)));
+    TEST_ASSERT_EQUAL(CAM_JPEG_OK, cam_jpeg_validate(img_start, len, 320, 240));
+    TEST_ASSERT_EQUAL(CAM_JPEG_OK, cam_jpeg_validate(img_start, len, 0, 0));
+    TEST_ASSERT_EQUAL(CAM_JPEG_SIZE_MISMATCH, cam_jpeg_validate(img_start, len, 640, 480));
+    TEST_ASSERT_EQUAL(CAM_JPEG_NO_SOI, cam_jpeg_validate(img_start + 1, len - 1, 320, 240));
+
+    uint8_t *buf = malloc(len);
+    TEST_ASSERT_NOT_NULL(buf);
+    int sos_off = cam_jpeg_find_marker(img_start, len, sos, sizeof(sos));
+    TEST_ASSERT_GREATER_THAN(0, sos_off);
+
+    /* frame cut before the scan, EOI from a stale buffer */
+    memcpy(buf, img_start, sos_off);
+    buf[sos_off] = 0xFF;
+    buf[sos_off + 1] = 0xD9;
+    TEST_ASSERT_EQUAL(CAM_JPEG_NO_SOS, cam_jpeg_validate(buf, sos_off + 2, 320, 240));
+
+    /* scan header directly followed by EOI */
+    size_t sos_end = sos_off + 2 + ((img_start[sos_off + 2] << 8) | img_start[sos_off + 3]);
+    memcpy(buf, img_start, sos_end);
+    buf[sos_end] = 0xFF;
+    buf[sos_end + 1] = 0xD9;
+    TEST_ASSERT_EQUAL(CAM_JPEG_NO_SCAN_DATA, cam_jpeg_validate(buf, sos_end + 2, 320, 240));
+
+    /* corrupt the first segment length so it runs off the frame */
+    memcpy(buf, img_start, len);
+    buf[4] = 0xFF;
+    TEST_ASSERT_EQUAL(CAM_JPEG_BAD_SEGMENT, cam_jpeg_validate(buf, len, 320, 240));
+
+    int64_t t = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) {
+        cam_jpeg_validate(img_start, len, 320, 240);
+    }
+    ESP_LOGI(TAG, "Header check: %lld ns per frame", (esp_timer_get_time() - t));
+    free(buf);
+}
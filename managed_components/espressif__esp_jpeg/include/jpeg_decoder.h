@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -30,6 +33,8 @@ typedef enum {
 typedef enum {
     JPEG_IMAGE_FORMAT_RGB888 = 0,   /*!< Format RGB888 */
     JPEG_IMAGE_FORMAT_RGB565,       /*!< Format RGB565 */
+    JPEG_IMAGE_FORMAT_GRAY8,        /*!< Format 8-bit luminance. Without the ROM decoder, Cb/Cr are
+                                         parsed but neither transformed nor color converted */
 } esp_jpeg_image_format_t;
 
 /**
@@ -48,11 +53,18 @@ typedef struct esp_jpeg_image_cfg_s {
         uint8_t swap_color_bytes: 1; /*!< Swap first and last color bytes */
     } flags;
 
+    struct {
+        uint16_t left;      /*!< First column of the region, in pixels of the scaled output image */
+        uint16_t top;       /*!< First row of the region, in pixels of the scaled output image */
+        uint16_t width;     /*!< Width of the region, 0 to decode the whole image */
+        uint16_t height;    /*!< Height of the region */
+    } crop;                 /*!< Region of interest: only these pixels are written, packed, to outbuf */
+
     struct {
         void *working_buffer;       /*!< If set to NULL, a working buffer will be allocated in esp_jpeg_decode().
                                          Tjpgd does not use dynamic allocation, se we pass this buffer to Tjpgd that uses it as scratchpad */
         size_t working_buffer_size; /*!< Size of the working buffer. Must be set it working_buffer != NULL.
-                                         Default size is 3.1kB or 65kB if JD_FASTDECODE == 2 */
+                                         Default size is 4kB or 65kB if JD_FASTDECODE == 2 */
     } advanced;
 
     struct {
@@ -69,18 +81,87 @@ typedef struct esp_jpeg_image_output_s {
     size_t output_len; /*!< Length of the output image in bytes */
 } esp_jpeg_image_output_t;
 
+/**
+ * @brief Input callback of a streamed decode
+ *
+ * @param[in]  read_ctx: esp_jpeg_stream_cfg_t::read_ctx
+ * @param[out] buf:      Destination of the data, or NULL to skip len bytes
+ * @param[in]  len:      Number of bytes wanted
+ *
+ * @return Number of bytes read or skipped, less than len only at the end of the data or on error
+ */
+typedef size_t (*esp_jpeg_read_cb_t)(void *read_ctx, uint8_t *buf, size_t len);
+
+/**
+ * @brief Band of decoded rows
+ */
+typedef struct {
+    const uint8_t *data;    /*!< Pixels, height rows of width pixels in the output format, no padding */
+    uint16_t top;           /*!< Output row of the first row in data */
+    uint16_t height;        /*!< Number of rows */
+    uint16_t width;         /*!< Width of the output image */
+    uint16_t image_height;  /*!< Height of the output image */
+} esp_jpeg_band_t;
+
+/**
+ * @brief Output callback of a streamed decode, called once per band from top to bottom
+ *
+ * @param[in] band_ctx: esp_jpeg_stream_cfg_t::band_ctx
+ * @param[in] band:     Decoded rows, valid only during the call
+ *
+ * @return true to continue, false to stop decoding
+ */
+typedef bool (*esp_jpeg_band_cb_t)(void *band_ctx, const esp_jpeg_band_t *band);
+
+/**
+ * @brief Streamed decode configuration
+ *
+ * The JPEG is pulled through read() into the decoder's 512 byte input buffer
+ * (CONFIG_JD_SZBUF) and the pixels leave through on_band() one row of MCUs at
+ * a time, so the memory used does not depend on the image height. The band
+ * holds width / scale * (8 or 16) / scale pixels; 1/8 scale keeps it below
+ * 1 kB even for UXGA.
+ */
+typedef struct esp_jpeg_stream_cfg_s {
+    esp_jpeg_read_cb_t read;            /*!< Input callback, see esp_jpeg_file_read() for a FILE * */
+    void *read_ctx;                     /*!< Passed to read() */
+    esp_jpeg_band_cb_t on_band;         /*!< Output callback */
+    void *band_ctx;                     /*!< Passed to on_band() */
+    esp_jpeg_image_format_t out_format; /*!< Output image format */
+    esp_jpeg_image_scale_t  out_scale;  /*!< Output scale */
+
+    struct {
+        uint8_t swap_color_bytes: 1; /*!< Swap first and last color bytes */
+    } flags;
+
+    struct {
+        void *working_buffer;       /*!< Same as esp_jpeg_image_cfg_t::advanced::working_buffer */
+        size_t working_buffer_size; /*!< Size of the working buffer. Must be set if working_buffer != NULL */
+    } advanced;
+} esp_jpeg_stream_cfg_t;
+
 /**
  * @brief Decode JPEG image
  *
  * @note This function is blocking.
  *
+ * Without advanced.working_buffer and with CONFIG_JD_TABLE_CACHE, the work
+ * buffer is kept between calls with the tables of the last image; an image
+ * with the same DQT/DHT/SOF0/DRI/SOS segments does not rebuild them.
+ *
+ * With cfg->crop set, MCUs that do not overlap the region are neither
+ * transformed nor color converted, restart intervals that do not overlap it are
+ * skipped without entropy decoding, and decoding stops below it. outbuf then
+ * only needs to hold the region.
+ *
  * @param[in]  cfg: Configuration structure
- * @param[out] img: Output image info
+ * @param[out] img: Output image info (size of the region if cropped)
  *
  * @return
- *      - ESP_OK            on success
- *      - ESP_ERR_NO_MEM    if there is no memory for allocating main structure
- *      - ESP_FAIL          if there is an error in decoding JPEG
+ *      - ESP_OK              on success
+ *      - ESP_ERR_NO_MEM      if there is no memory for allocating main structure
+ *      - ESP_ERR_INVALID_ARG if the crop region does not lie inside the output image
+ *      - ESP_FAIL            if there is an error in decoding JPEG
  */
 esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
@@ -101,6 +182,31 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
  */
 esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
+/**
+ * @brief Decode JPEG image from a read callback into row bands
+ *
+ * @note This function is blocking.
+ *
+ * @param[in]  cfg: Streamed decode configuration
+ * @param[out] img: Output image info, output_len is the total size of all bands
+ *
+ * @return
+ *      - ESP_OK                on success
+ *      - ESP_ERR_INVALID_ARG   if read or on_band is NULL
+ *      - ESP_ERR_NO_MEM        if there is no memory for the work buffer or the band
+ *      - ESP_ERR_NOT_SUPPORTED if the decoder is built for grayscale output only and out_format is not GRAY8
+ *      - ESP_FAIL              if there is an error in decoding JPEG or on_band returned false
+ */
+esp_err_t esp_jpeg_decode_stream(const esp_jpeg_stream_cfg_t *cfg, esp_jpeg_image_output_t *img);
+
+/**
+ * @brief esp_jpeg_read_cb_t for a FILE * passed as read_ctx
+ *
+ * Reads with fread() and skips with fseek(), so only the stdio buffer of the
+ * file sits between the card and the decoder's input buffer.
+ */
+size_t esp_jpeg_file_read(void *read_ctx, uint8_t *buf, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "esp_system.h"
 #include "esp_rom_caps.h"
@@ -39,7 +41,7 @@ static const char *TAG = "JPEG";
 #if defined(JD_FASTDECODE) && (JD_FASTDECODE == 2)
 #define JPEG_WORK_BUF_SIZE  65472
 #else
-#define JPEG_WORK_BUF_SIZE  3100    /* Recommended buffer size; Independent on the size of the image */
+#define JPEG_WORK_BUF_SIZE  4096    /* Enough for any baseline image: 4 DQT, full DHT and 4:2:0 MCU; independent on the size of the image */
 #endif
 
 /* If not set JD_FORMAT, it is set in ROM to RGB888, otherwise, it can be set in config */
@@ -53,10 +55,39 @@ static const char *TAG = "JPEG";
 #elif  (JD_FORMAT==1)
 #define ESP_JPEG_COLOR_BYTES    2
 #elif  (JD_FORMAT==2)
-#error Grayscale image output format is not supported
 #define ESP_JPEG_COLOR_BYTES    1
 #endif
 
+/* Only the component's TJPGD can skip the chroma; the ROM code outputs RGB888 and luminance is computed from it */
+#if CONFIG_JD_USE_ROM
+#define ESP_JPEG_NATIVE_GRAY    0
+#else
+#define ESP_JPEG_NATIVE_GRAY    1
+#endif
+
+/* Bytes per pixel TJPGD outputs for JPEG_IMAGE_FORMAT_GRAY8 */
+#define ESP_JPEG_GRAY_IN_BYTES  (ESP_JPEG_NATIVE_GRAY ? 1 : ESP_JPEG_COLOR_BYTES)
+
+#if CONFIG_JD_TABLE_CACHE
+/* Work buffer of esp_jpeg_decode(), kept with the tables of the last image for the next one */
+static struct {
+    atomic_flag busy;       /* Held by the esp_jpeg_decode() using the cache */
+    bool valid;             /* jdec is prepared and its tables are in workbuf */
+    JDEC jdec;              /* Decoder as left by jd_prepare() */
+    uint8_t *workbuf;       /* JPEG_WORK_BUF_SIZE bytes, never freed */
+} s_jpeg_cache = { .busy = ATOMIC_FLAG_INIT };
+#endif
+
+/* State of esp_jpeg_decode_stream(), the device of its JDEC */
+typedef struct {
+    const esp_jpeg_stream_cfg_t *cfg;
+    uint8_t *band;          /* One row of MCUs in the output format */
+    uint16_t band_top;      /* Output row of the first band row */
+    uint16_t band_rows;     /* Rows in the band, 0 while it is empty */
+    uint16_t width;         /* Output width */
+    uint16_t height;        /* Output height */
+} jpeg_stream_t;
+
 /*******************************************************************************
 * Function definitions
 *******************************************************************************/
@@ -65,6 +96,12 @@ static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format);
 
 static unsigned int jpeg_decode_in_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
 static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *jd, void *bitmap, JRECT *rect);
+static unsigned int jpeg_stream_in_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
+static jpeg_decode_out_t jpeg_stream_out_cb(JDEC *jd, void *bitmap, JRECT *rect);
+static bool jpeg_stream_flush(jpeg_stream_t *stream);
+static void jpeg_copy_rect(const uint8_t *in, const JRECT *rect, const JRECT *win, uint8_t *dst,
+                           esp_jpeg_image_format_t format, bool swap_color_bytes);
+static void jpeg_get_window(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, JRECT *win);
 static inline uint16_t ldb_word(const void *ptr);
 /*******************************************************************************
 * Public API functions
@@ -74,7 +111,8 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
 {
     esp_err_t ret = ESP_OK;
     uint8_t *workbuf = NULL;
-    JRESULT res;
+    bool cached = false;
+    JRESULT res = JDR_PAR;
     JDEC JDEC;
 
     assert(cfg != NULL);
@@ -83,37 +121,99 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
     const bool allocate_buffer = (cfg->advanced.working_buffer == NULL);
     const size_t workbuf_size = allocate_buffer ? JPEG_WORK_BUF_SIZE : cfg->advanced.working_buffer_size;
     if (allocate_buffer) {
-        workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
-        ESP_GOTO_ON_FALSE(workbuf, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG work buffer");
+#if CONFIG_JD_TABLE_CACHE
+        /* Use the kept work buffer unless another decode holds it */
+        cached = !atomic_flag_test_and_set(&s_jpeg_cache.busy);
+        if (cached && !s_jpeg_cache.workbuf) {
+            s_jpeg_cache.workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
+            if (!s_jpeg_cache.workbuf) {
+                atomic_flag_clear(&s_jpeg_cache.busy);
+                cached = false;
+            }
+        }
+        workbuf = cached ? s_jpeg_cache.workbuf : NULL;
+#endif
+        if (!cached) {
+            workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
+            ESP_GOTO_ON_FALSE(workbuf, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG work buffer");
+        }
     } else {
         workbuf = cfg->advanced.working_buffer;
         ESP_RETURN_ON_FALSE(workbuf_size != 0, ESP_ERR_INVALID_ARG, TAG, "Working buffer size not defined!");
     }
 
 
-    cfg->priv.read = 0;
+    ESP_GOTO_ON_FALSE(JD_FORMAT != 2 || cfg->out_format == JPEG_IMAGE_FORMAT_GRAY8, ESP_ERR_NOT_SUPPORTED, err, TAG,
+                      "Decoder is built for grayscale output only");
 
     /* Prepare image */
-    res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, workbuf_size, cfg);
+#if CONFIG_JD_TABLE_CACHE
+    if (cached && s_jpeg_cache.valid) {
+        /* Same tables as the last image: only the headers are parsed */
+        JDEC = s_jpeg_cache.jdec;
+        cfg->priv.read = 0;
+        res = jd_prepare_next(&JDEC, jpeg_decode_in_cb, cfg);
+    }
+#endif
+    if (res != JDR_OK) {
+        cfg->priv.read = 0;
+        res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, workbuf_size, cfg);
+#if CONFIG_JD_TABLE_CACHE
+        if (cached) {
+            s_jpeg_cache.valid = (res == JDR_OK);
+            s_jpeg_cache.jdec = JDEC;
+        }
+#endif
+    }
     ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image! %d", res);
+#if ESP_JPEG_NATIVE_GRAY
+    JDEC.grayout = (cfg->out_format == JPEG_IMAGE_FORMAT_GRAY8);
+#endif
 
     const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
     const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
 
+    /* Output window: the crop region or the whole image */
+    JRECT win;
+    if (cfg->crop.width) {
+        ESP_GOTO_ON_FALSE(cfg->crop.height && cfg->crop.left + cfg->crop.width <= JDEC.width / scale_div &&
+                          cfg->crop.top + cfg->crop.height <= JDEC.height / scale_div,
+                          ESP_ERR_INVALID_ARG, err, TAG, "Crop region outside the image!");
+    }
+    jpeg_get_window(cfg, JDEC.width / scale_div, JDEC.height / scale_div, &win);
+
     /* Size of output image */
-    const uint32_t outsize = (JDEC.height / scale_div) * (JDEC.width / scale_div) * out_color_bytes;
+    const uint32_t outsize = (win.bottom - win.top + 1) * (win.right - win.left + 1) * out_color_bytes;
     ESP_GOTO_ON_FALSE((outsize <= cfg->outbuf_size), ESP_ERR_NO_MEM, err, TAG, "Not enough size in output buffer!");
 
     /* Size of output image */
-    img->height = JDEC.height / scale_div;
-    img->width = JDEC.width / scale_div;
+    img->height = win.bottom - win.top + 1;
+    img->width = win.right - win.left + 1;
     img->output_len = outsize;
 
     /* Decode JPEG */
+#if CONFIG_JD_USE_ROM
+    /* The ROM code always decodes the whole image, the output callback drops what is outside the crop */
     res = jd_decomp(&JDEC, jpeg_decode_out_cb, cfg->out_scale);
+#else
+    /* Window in input pixels: MCUs outside it are only parsed, or skipped with their restart interval */
+    const JRECT roi = {
+        .left = win.left * scale_div,
+        .right = (win.right + 1) * scale_div - 1,
+        .top = win.top * scale_div,
+        .bottom = (win.bottom + 1) * scale_div - 1,
+    };
+    res = jd_decomp_roi(&JDEC, jpeg_decode_out_cb, cfg->out_scale, &roi);
+#endif
     ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in decoding JPEG image! %d", res);
 
 err:
+#if CONFIG_JD_TABLE_CACHE
+    if (cached) {
+        atomic_flag_clear(&s_jpeg_cache.busy);
+        return ret;
+    }
+#endif
     if (workbuf && allocate_buffer) {
         free(workbuf);
     }
@@ -164,6 +264,74 @@ esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_outp
     return ret;
 }
 
+esp_err_t esp_jpeg_decode_stream(const esp_jpeg_stream_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t *workbuf = NULL;
+    JRESULT res;
+    JDEC JDEC;
+    jpeg_stream_t stream = { .cfg = cfg };
+
+    assert(cfg != NULL);
+    assert(img != NULL);
+    ESP_RETURN_ON_FALSE(cfg->read && cfg->on_band, ESP_ERR_INVALID_ARG, TAG, "read and on_band are required");
+    ESP_RETURN_ON_FALSE(JD_FORMAT != 2 || cfg->out_format == JPEG_IMAGE_FORMAT_GRAY8, ESP_ERR_NOT_SUPPORTED, TAG,
+                        "Decoder is built for grayscale output only");
+
+    const bool allocate_buffer = (cfg->advanced.working_buffer == NULL);
+    const size_t workbuf_size = allocate_buffer ? JPEG_WORK_BUF_SIZE : cfg->advanced.working_buffer_size;
+    if (allocate_buffer) {
+        workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
+        ESP_GOTO_ON_FALSE(workbuf, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG work buffer");
+    } else {
+        workbuf = cfg->advanced.working_buffer;
+        ESP_RETURN_ON_FALSE(workbuf_size != 0, ESP_ERR_INVALID_ARG, TAG, "Working buffer size not defined!");
+    }
+
+    /* Prepare image */
+    res = jd_prepare(&JDEC, jpeg_stream_in_cb, workbuf, workbuf_size, &stream);
+    ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image! %d", res);
+#if ESP_JPEG_NATIVE_GRAY
+    JDEC.grayout = (cfg->out_format == JPEG_IMAGE_FORMAT_GRAY8);
+#endif
+
+    const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
+    const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
+
+    img->height = JDEC.height / scale_div;
+    img->width = JDEC.width / scale_div;
+    img->output_len = img->height * img->width * out_color_bytes;
+
+    /* One row of MCUs, at least one pixel high */
+    const uint16_t band_height = (JDEC.msy * 8 / scale_div) ? (JDEC.msy * 8 / scale_div) : 1;
+    stream.width = img->width;
+    stream.height = img->height;
+    stream.band = heap_caps_malloc(img->width * band_height * out_color_bytes, MALLOC_CAP_DEFAULT);
+    ESP_GOTO_ON_FALSE(stream.band, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG band");
+
+    /* Decode JPEG, the last band is still pending when jd_decomp() returns */
+    res = jd_decomp(&JDEC, jpeg_stream_out_cb, cfg->out_scale);
+    ESP_GOTO_ON_FALSE((res == JDR_OK && jpeg_stream_flush(&stream)), ESP_FAIL, err, TAG,
+                      "Error in decoding JPEG image! %d", res);
+
+err:
+    free(stream.band);
+    if (workbuf && allocate_buffer) {
+        free(workbuf);
+    }
+
+    return ret;
+}
+
+size_t esp_jpeg_file_read(void *read_ctx, uint8_t *buf, size_t len)
+{
+    FILE *f = (FILE *)read_ctx;
+    if (buf) {
+        return fread(buf, 1, len, f);
+    }
+    return fseek(f, (long)len, SEEK_CUR) == 0 ? len : 0;
+}
+
 /*******************************************************************************
 * Private API functions
 *******************************************************************************/
@@ -194,7 +362,6 @@ static unsigned int jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, unsigned int nby
 
 static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *dec, void *bitmap, JRECT *rect)
 {
-    uint16_t color = 0;
     assert(dec != NULL);
 
     esp_jpeg_image_cfg_t *cfg = (esp_jpeg_image_cfg_t *)dec->device;
@@ -203,47 +370,153 @@ static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *dec, void *bitmap, JRECT *rect
     assert(rect != NULL);
 
     uint8_t scale_div = jpeg_get_div_by_scale(cfg->out_scale);
-    uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
+    JRECT win;
+    jpeg_get_window(cfg, dec->width / scale_div, dec->height / scale_div, &win);
 
     /* Copy decoded image data to output buffer */
-    uint8_t *in = (uint8_t *)bitmap;
-    uint32_t line = dec->width / scale_div;
-    uint8_t *dst = (uint8_t *)cfg->outbuf;
-    for (int y = rect->top; y <= rect->bottom; y++) {
-        for (int x = rect->left; x <= rect->right; x++) {
-            if ( (JD_FORMAT == 0 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB888) ||
-                    (JD_FORMAT == 1 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB565) ) {
+    jpeg_copy_rect(bitmap, rect, &win, cfg->outbuf, cfg->out_format, cfg->flags.swap_color_bytes);
+
+    return 1;
+}
+
+static unsigned int jpeg_stream_in_cb(JDEC *dec, uint8_t *buff, unsigned int nbyte)
+{
+    assert(dec != NULL);
+
+    jpeg_stream_t *stream = (jpeg_stream_t *)dec->device;
+    assert(stream != NULL);
+
+    return stream->cfg->read(stream->cfg->read_ctx, buff, nbyte);
+}
+
+static jpeg_decode_out_t jpeg_stream_out_cb(JDEC *dec, void *bitmap, JRECT *rect)
+{
+    assert(dec != NULL);
+
+    jpeg_stream_t *stream = (jpeg_stream_t *)dec->device;
+    assert(stream != NULL);
+    assert(bitmap != NULL);
+    assert(rect != NULL);
+
+    /* MCUs arrive in raster order, so a new top row means the previous band is complete */
+    if (stream->band_rows && rect->top != stream->band_top) {
+        if (!jpeg_stream_flush(stream)) {
+            return 0;
+        }
+    }
+    stream->band_top = rect->top;
+    stream->band_rows = rect->bottom - rect->top + 1;
+
+    const JRECT win = {
+        .left = 0,
+        .right = stream->width - 1,
+        .top = stream->band_top,
+        .bottom = stream->height - 1,
+    };
+    jpeg_copy_rect(bitmap, rect, &win, stream->band, stream->cfg->out_format, stream->cfg->flags.swap_color_bytes);
+
+    return 1;
+}
+
+static bool jpeg_stream_flush(jpeg_stream_t *stream)
+{
+    if (!stream->band_rows) {
+        return true;
+    }
+    const esp_jpeg_band_t band = {
+        .data = stream->band,
+        .top = stream->band_top,
+        .height = stream->band_rows,
+        .width = stream->width,
+        .image_height = stream->height,
+    };
+    stream->band_rows = 0;
+    return stream->cfg->on_band(stream->cfg->band_ctx, &band);
+}
+
+/* Output window of esp_jpeg_decode(): the crop region or the whole width x height output image */
+static void jpeg_get_window(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, JRECT *win)
+{
+    if (cfg->crop.width) {
+        win->left = cfg->crop.left;
+        win->right = cfg->crop.left + cfg->crop.width - 1;
+        win->top = cfg->crop.top;
+        win->bottom = cfg->crop.top + cfg->crop.height - 1;
+    } else {
+        win->left = 0;
+        win->right = width - 1;
+        win->top = 0;
+        win->bottom = height - 1;
+    }
+}
+
+/* Convert the pixels of rect that lie inside win into dst, which holds the rows of win without padding */
+static void jpeg_copy_rect(const uint8_t *in, const JRECT *rect, const JRECT *win, uint8_t *dst,
+                           esp_jpeg_image_format_t format, bool swap_color_bytes)
+{
+    uint16_t color = 0;
+    const uint8_t out_color_bytes = jpeg_get_color_bytes(format);
+    const uint8_t in_color_bytes = (format == JPEG_IMAGE_FORMAT_GRAY8) ? ESP_JPEG_GRAY_IN_BYTES : ESP_JPEG_COLOR_BYTES;
+
+    /* Part of rect inside the window */
+    const int left = rect->left > win->left ? rect->left : win->left;
+    const int right = rect->right < win->right ? rect->right : win->right;
+    const int top = rect->top > win->top ? rect->top : win->top;
+    const int bottom = rect->bottom < win->bottom ? rect->bottom : win->bottom;
+    if (left > right || top > bottom) {
+        return;
+    }
+    const uint32_t in_line = (rect->right - rect->left + 1) * in_color_bytes;
+    const uint32_t line = win->right - win->left + 1;
+    in += (top - rect->top) * in_line + (left - rect->left) * in_color_bytes;
+
+    for (int y = top; y <= bottom; y++, in += in_line) {
+        const uint8_t *src = in;
+        uint8_t *row = dst + ((y - win->top) * line + left - win->left) * out_color_bytes;
+        if (format == JPEG_IMAGE_FORMAT_GRAY8) {
+            if (ESP_JPEG_NATIVE_GRAY) {
+                /* One luminance byte per pixel straight from TJPGD */
+                memcpy(row, src, right - left + 1);
+            } else {
+                /* BT.601 luminance of the RGB888 pixels from the ROM decoder */
+                for (int x = left; x <= right; x++, src += 3) {
+                    *row++ = (uint8_t)((77 * src[0] + 150 * src[1] + 29 * src[2] + 128) >> 8);
+                }
+            }
+            continue;
+        }
+        for (int x = left; x <= right; x++, row += out_color_bytes) {
+            if ( (JD_FORMAT == 0 && format == JPEG_IMAGE_FORMAT_RGB888) ||
+                    (JD_FORMAT == 1 && format == JPEG_IMAGE_FORMAT_RGB565) ) {
                 /* Output image format is same as set in TJPGD */
                 for (int b = 0; b < ESP_JPEG_COLOR_BYTES; b++) {
-                    if (cfg->flags.swap_color_bytes) {
-                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[out_color_bytes - b - 1];
+                    if (swap_color_bytes) {
+                        row[b] = src[out_color_bytes - b - 1];
                     } else {
-                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[b];
+                        row[b] = src[b];
                     }
                 }
-            } else if (JD_FORMAT == 0 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB565) {
+            } else if (JD_FORMAT == 0 && format == JPEG_IMAGE_FORMAT_RGB565) {
                 /* Output image format is not same as set in TJPGD */
-                /* We need to convert the 3 bytes in `in` to a rgb565 value */
-                color = ((in[0] & 0xF8) << 8);
-                color |= ((in[1] & 0xFC) << 3);
-                color |= (in[2] >> 3);
-
-                if (cfg->flags.swap_color_bytes) {
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = HIBYTE(color);
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = LOBYTE(color);
+                /* We need to convert the 3 bytes in `src` to a rgb565 value */
+                color = ((src[0] & 0xF8) << 8);
+                color |= ((src[1] & 0xFC) << 3);
+                color |= (src[2] >> 3);
+
+                if (swap_color_bytes) {
+                    row[0] = HIBYTE(color);
+                    row[1] = LOBYTE(color);
                 } else {
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = HIBYTE(color);
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = LOBYTE(color);
+                    row[1] = HIBYTE(color);
+                    row[0] = LOBYTE(color);
                 }
             } else {
                 ESP_LOGE(TAG, "Selected output format is not supported!");
                 assert(0);
             }
-            in += ESP_JPEG_COLOR_BYTES;
+            src += ESP_JPEG_COLOR_BYTES;
         }
     }
-
-    return 1;
 }
 
 static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale)
@@ -275,6 +548,9 @@ static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format)
     /* RGB565 (16-bit/pix) */
     case JPEG_IMAGE_FORMAT_RGB565:
         return 2;
+    /* Grayscale (8-bit/pix) */
+    case JPEG_IMAGE_FORMAT_GRAY8:
+        return 1;
     }
 
     return 1;
@@ -0,0 +1,470 @@
+/*
+ * Host check and benchmark for esp_jpeg_decode output formats (jpeg_decoder.c, tjpgd/tjpgd.c).
+ *
+ * Build and run from the component root:
+ *   cc -O2 -Itest/host/include -Iinclude -Itjpgd test/host/bench_decode.c jpeg_decoder.c \
+ *       tjpgd/tjpgd.c -o bench_decode
+ *   ./bench_decode [extra.jpg ...]
+ *
+ * Decodes the test_apps images (and any JPEG given on the command line) at
+ * every scale to RGB888, RGB565 and GRAY8. Checks that GRAY8 matches the
+ * BT.601 luminance of the RGB888 output (at 1/2 and 1/4 the mean of the full
+ * size GRAY8), that esp_jpeg_decode_stream() reading the file gives the
+ * same pixels as esp_jpeg_decode(), that cropped decodes give the same
+ * pixels as the region of a full decode and that decodes with tables from the
+ * CONFIG_JD_TABLE_CACHE cache match a private work buffer. Then prints the
+ * time per decode, the work buffer the decoder used, the time to prepare the
+ * decoder with and without cached tables, the output buffer each format
+ * needs, the band buffer of the streamed decode and the time of a centered
+ * crop.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpeg_decoder.h"
+#include "tjpgd.h"
+
+static int failures = 0;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+static size_t input_cb(JDEC *jd, uint8_t *buf, size_t len)
+{
+    esp_jpeg_image_cfg_t *cfg = jd->device;
+    if (len > cfg->indata_size - cfg->priv.read) {
+        len = cfg->indata_size - cfg->priv.read;
+    }
+    if (buf) {
+        memcpy(buf, cfg->indata + cfg->priv.read, len);
+    }
+    cfg->priv.read += len;
+    return len;
+}
+
+/* Work buffer bytes tjpgd takes from the pool for this image */
+static size_t pool_used(uint8_t *jpg, size_t len)
+{
+    static uint8_t pool[65472];
+    esp_jpeg_image_cfg_t cfg = { .indata = jpg, .indata_size = len };
+    JDEC jd;
+    if (jd_prepare(&jd, input_cb, pool, sizeof(pool), &cfg) != JDR_OK) {
+        return 0;
+    }
+    return sizeof(pool) - jd.sz_pool;
+}
+
+/* Time of jd_prepare() and of jd_prepare_next() on the tables it built */
+static void bench_prepare(uint8_t *jpg, size_t len, double *full, double *next)
+{
+    static uint8_t pool[65472];
+    esp_jpeg_image_cfg_t cfg = { .indata = jpg, .indata_size = len };
+    JDEC jd, prepared;
+    const int rounds = 2000;
+    jd_prepare(&prepared, input_cb, pool, sizeof(pool), &cfg);
+
+    double t0 = now_s();
+    for (int n = 0; n < rounds; n++) {
+        cfg.priv.read = 0;
+        jd_prepare(&jd, input_cb, pool, sizeof(pool), &cfg);
+    }
+    double t1 = now_s();
+    for (int n = 0; n < rounds; n++) {
+        cfg.priv.read = 0;
+        jd = prepared;
+        jd_prepare_next(&jd, input_cb, &cfg);
+    }
+    double t2 = now_s();
+    *full = (t1 - t0) / rounds;
+    *next = (t2 - t1) / rounds;
+}
+
+static esp_err_t decode(uint8_t *jpg, size_t len, esp_jpeg_image_format_t fmt, esp_jpeg_image_scale_t scale,
+                        uint8_t **out, esp_jpeg_image_output_t *info)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg,
+        .indata_size = len,
+        .out_format = fmt,
+        .out_scale = scale,
+    };
+    esp_err_t ret = esp_jpeg_get_image_info(&cfg, info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!*out) {
+        *out = malloc(info->output_len);
+    }
+    cfg.outbuf = *out;
+    cfg.outbuf_size = info->output_len;
+    return esp_jpeg_decode(&cfg, info);
+}
+
+static double time_decode(uint8_t *jpg, size_t len, esp_jpeg_image_format_t fmt, esp_jpeg_image_scale_t scale,
+                          size_t *out_len)
+{
+    esp_jpeg_image_output_t info;
+    uint8_t *out = NULL;
+    double best = 1e9;
+    int rounds = 0;
+    double t_end = now_s() + 0.2;
+    do {
+        double t0 = now_s();
+        if (decode(jpg, len, fmt, scale, &out, &info) != ESP_OK) {
+            free(out);
+            return -1;
+        }
+        double dt = now_s() - t0;
+        best = dt < best ? dt : best;
+        rounds++;
+    } while (now_s() < t_end || rounds < 5);
+    *out_len = info.output_len;
+    free(out);
+    return best;
+}
+
+static void check_gray(const char *name, uint8_t *jpg, size_t len, esp_jpeg_image_scale_t scale)
+{
+    esp_jpeg_image_output_t rgb_info, gray_info;
+    uint8_t *rgb = NULL, *gray = NULL;
+    if (decode(jpg, len, JPEG_IMAGE_FORMAT_RGB888, scale, &rgb, &rgb_info) != ESP_OK ||
+            decode(jpg, len, JPEG_IMAGE_FORMAT_GRAY8, scale, &gray, &gray_info) != ESP_OK) {
+        printf("FAIL: %s 1/%d: decode failed\n", name, 1 << scale);
+        failures++;
+    } else if (gray_info.output_len != (size_t)gray_info.width * gray_info.height ||
+               gray_info.width != rgb_info.width || gray_info.height != rgb_info.height) {
+        printf("FAIL: %s 1/%d: GRAY8 is %dx%d, %zu bytes\n", name, 1 << scale,
+               gray_info.width, gray_info.height, gray_info.output_len);
+        failures++;
+    } else if (scale == JPEG_IMAGE_SCALE_1_2 || scale == JPEG_IMAGE_SCALE_1_4) {
+        /* Descaled Y must be the truncated mean of the full size Y over each square */
+        esp_jpeg_image_output_t full_info;
+        uint8_t *full = NULL;
+        int n = 1 << scale, bad = 0;
+        if (decode(jpg, len, JPEG_IMAGE_FORMAT_GRAY8, JPEG_IMAGE_SCALE_0, &full, &full_info) != ESP_OK) {
+            bad = 1;
+        }
+        for (int y = 0; !bad && y < gray_info.height; y++) {
+            for (int x = 0; x < gray_info.width; x++) {
+                int sum = 0;
+                for (int i = 0; i < n * n; i++) {
+                    sum += full[(y * n + i / n) * full_info.width + x * n + i % n];
+                }
+                bad += gray[y * gray_info.width + x] != sum / (n * n);
+            }
+        }
+        if (bad) {
+            printf("FAIL: %s 1/%d: %d GRAY8 pixels are not the mean of the full size Y\n", name, n, bad);
+            failures++;
+        }
+        free(full);
+    } else {
+        /* Skip pixels with a clipped RGB888 channel: their luminance no longer matches Y */
+        int max_diff = 0;
+        for (size_t i = 0; i < gray_info.output_len; i++) {
+            const uint8_t *p = rgb + i * 3;
+            if (p[0] == 0 || p[0] == 255 || p[1] == 0 || p[1] == 255 || p[2] == 0 || p[2] == 255) {
+                continue;
+            }
+            int y = (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+            int d = abs(y - gray[i]);
+            max_diff = d > max_diff ? d : max_diff;
+        }
+        if (max_diff > 2) {
+            printf("FAIL: %s 1/%d: GRAY8 differs from RGB888 luminance by up to %d\n", name, 1 << scale, max_diff);
+            failures++;
+        }
+    }
+    free(rgb);
+    free(gray);
+}
+
+struct stream_ctx {
+    uint8_t *out;
+    size_t bpp;
+    int next_row;
+    size_t band_bytes;
+    bool ok;
+};
+
+static bool on_band(void *band_ctx, const esp_jpeg_band_t *band)
+{
+    struct stream_ctx *s = band_ctx;
+    size_t bytes = (size_t)band->width * band->height * s->bpp;
+    /* Bands must tile the image from top to bottom */
+    s->ok = s->ok && band->top == s->next_row;
+    s->next_row = band->top + band->height;
+    s->band_bytes = bytes > s->band_bytes ? bytes : s->band_bytes;
+    if (s->out) {
+        memcpy(s->out + (size_t)band->top * band->width * s->bpp, band->data, bytes);
+    }
+    return true;
+}
+
+static esp_err_t decode_stream(const char *path, esp_jpeg_image_format_t fmt, esp_jpeg_image_scale_t scale,
+                               struct stream_ctx *s, esp_jpeg_image_output_t *info)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_jpeg_stream_cfg_t cfg = {
+        .read = esp_jpeg_file_read,
+        .read_ctx = f,
+        .on_band = on_band,
+        .band_ctx = s,
+        .out_format = fmt,
+        .out_scale = scale,
+    };
+    s->next_row = 0;
+    s->band_bytes = 0;
+    s->ok = true;
+    esp_err_t ret = esp_jpeg_decode_stream(&cfg, info);
+    fclose(f);
+    return ret;
+}
+
+static void check_stream(const char *name, const char *path, uint8_t *jpg, size_t len)
+{
+    static const esp_jpeg_image_format_t formats[] = {
+        JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_FORMAT_GRAY8
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        for (int scale = JPEG_IMAGE_SCALE_0; scale <= JPEG_IMAGE_SCALE_1_8; scale++) {
+            esp_jpeg_image_output_t ref_info, info;
+            uint8_t *ref = NULL;
+            struct stream_ctx s = { .bpp = formats[i] == JPEG_IMAGE_FORMAT_RGB888 ? 3 : formats[i] == JPEG_IMAGE_FORMAT_RGB565 ? 2 : 1 };
+            if (decode(jpg, len, formats[i], scale, &ref, &ref_info) != ESP_OK) {
+                free(ref);
+                continue;   /* Reported by check_gray() */
+            }
+            s.out = calloc(1, ref_info.output_len);
+            if (decode_stream(path, formats[i], scale, &s, &info) != ESP_OK || !s.ok ||
+                    s.next_row != ref_info.height || info.output_len != ref_info.output_len ||
+                    memcmp(s.out, ref, ref_info.output_len) != 0) {
+                printf("FAIL: %s format %d 1/%d: streamed decode differs\n", name, formats[i], 1 << scale);
+                failures++;
+            }
+            free(s.out);
+            free(ref);
+        }
+    }
+}
+
+static esp_err_t decode_crop(uint8_t *jpg, size_t len, esp_jpeg_image_format_t fmt, esp_jpeg_image_scale_t scale,
+                             int left, int top, int width, int height, uint8_t *out, esp_jpeg_image_output_t *info)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg,
+        .indata_size = len,
+        .outbuf = out,
+        .outbuf_size = (uint32_t)width * height * 3,
+        .out_format = fmt,
+        .out_scale = scale,
+        .crop = { .left = left, .top = top, .width = width, .height = height },
+    };
+    return esp_jpeg_decode(&cfg, info);
+}
+
+static void check_crop(const char *name, uint8_t *jpg, size_t len)
+{
+    static const esp_jpeg_image_format_t formats[] = {
+        JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_FORMAT_GRAY8
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        size_t bpp = formats[i] == JPEG_IMAGE_FORMAT_RGB888 ? 3 : formats[i] == JPEG_IMAGE_FORMAT_RGB565 ? 2 : 1;
+        for (int scale = JPEG_IMAGE_SCALE_0; scale <= JPEG_IMAGE_SCALE_1_8; scale++) {
+            esp_jpeg_image_output_t ref_info, info;
+            uint8_t *ref = NULL;
+            if (decode(jpg, len, formats[i], scale, &ref, &ref_info) != ESP_OK) {
+                free(ref);
+                continue;   /* Reported by check_gray() */
+            }
+            int w = ref_info.width, h = ref_info.height;
+            /* Whole image, centered quarter, odd region off the MCU grid, single pixels in the corners, a column */
+            const int crops[][4] = {
+                { 0, 0, w, h }, { w / 4, h / 4, w / 2, h / 2 }, { w / 3 + 1, h / 5 + 3, w / 3, h / 7 + 1 },
+                { 0, 0, 1, 1 }, { w - 1, h - 1, 1, 1 }, { w - 3, 0, 3, h },
+            };
+            for (size_t c = 0; c < sizeof(crops) / sizeof(crops[0]); c++) {
+                const int *r = crops[c];
+                uint8_t *out = malloc((size_t)r[2] * r[3] * 3);
+                bool ok = decode_crop(jpg, len, formats[i], scale, r[0], r[1], r[2], r[3], out, &info) == ESP_OK &&
+                          info.width == r[2] && info.height == r[3] && info.output_len == (size_t)r[2] * r[3] * bpp;
+                for (int y = 0; ok && y < r[3]; y++) {
+                    ok = memcmp(out + (size_t)y * r[2] * bpp, ref + ((size_t)(r[1] + y) * w + r[0]) * bpp, r[2] * bpp) == 0;
+                }
+                if (!ok) {
+                    printf("FAIL: %s format %d 1/%d: crop %dx%d at %d,%d differs\n", name, formats[i], 1 << scale,
+                           r[2], r[3], r[0], r[1]);
+                    failures++;
+                }
+                free(out);
+            }
+            free(ref);
+        }
+    }
+
+    /* A region reaching past the image is rejected */
+    esp_jpeg_image_cfg_t cfg = { .indata = jpg, .indata_size = len };
+    esp_jpeg_image_output_t info;
+    uint8_t px[6];
+    esp_jpeg_get_image_info(&cfg, &info);
+    if (decode_crop(jpg, len, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, info.width - 1, 0, 2, 1, px, &info) !=
+            ESP_ERR_INVALID_ARG) {
+        printf("FAIL: %s: crop outside the image accepted\n", name);
+        failures++;
+    }
+}
+
+static void bench_crop(uint8_t *jpg, size_t len, double full)
+{
+    esp_jpeg_image_cfg_t cfg = { .indata = jpg, .indata_size = len };
+    esp_jpeg_image_output_t info;
+    esp_jpeg_get_image_info(&cfg, &info);
+    /* A 4x digital zoom of the center */
+    int w = info.width / 4, h = info.height / 4;
+    uint8_t *out = malloc((size_t)w * h * 2);
+    double best = 1e9;
+    for (int n = 0; n < 5; n++) {
+        double t0 = now_s();
+        decode_crop(jpg, len, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_SCALE_0, info.width * 3 / 8, info.height * 3 / 8,
+                    w, h, out, &info);
+        double dt = now_s() - t0;
+        best = dt < best ? dt : best;
+    }
+    printf("        crop RGB565 %dx%d center %7.1f us (%.2fx vs full), %d B\n", w, h, best * 1e6, full / best, w * h * 2);
+    free(out);
+}
+
+static void check_cache(const char *name, uint8_t *jpg, size_t len)
+{
+    static uint8_t work[65472];
+    size_t other_len;
+    uint8_t *other = load_file("test_apps/main/logo.jpg", &other_len);
+    esp_jpeg_image_output_t info;
+    uint8_t *ref = NULL, *miss = NULL, *hit = NULL, *tmp = NULL;
+
+    /* Reference in a private work buffer, which bypasses the cache */
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg,
+        .indata_size = len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+    };
+    esp_jpeg_get_image_info(&cfg, &info);
+    ref = malloc(info.output_len);
+    cfg.outbuf = ref;
+    cfg.outbuf_size = info.output_len;
+    bool ok = esp_jpeg_decode(&cfg, &info) == ESP_OK;
+
+    /* Another image evicts the tables, then the first decode rebuilds them and the second reuses them */
+    ok = ok && other && decode(other, other_len, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, &tmp, &info) == ESP_OK;
+    ok = ok && decode(jpg, len, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, &miss, &info) == ESP_OK;
+    ok = ok && decode(jpg, len, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, &hit, &info) == ESP_OK;
+    ok = ok && memcmp(ref, miss, info.output_len) == 0 && memcmp(ref, hit, info.output_len) == 0;
+    if (!ok) {
+        printf("FAIL: %s: decode with cached tables differs\n", name);
+        failures++;
+    }
+    free(other);
+    free(ref);
+    free(miss);
+    free(hit);
+    free(tmp);
+}
+
+static void bench_file(const char *path)
+{
+    size_t len;
+    uint8_t *jpg = load_file(path, &len);
+    if (!jpg) {
+        printf("FAIL: cannot read %s\n", path);
+        failures++;
+        return;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    esp_jpeg_image_cfg_t cfg = { .indata = jpg, .indata_size = len };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK) {
+        printf("FAIL: %s: no SOF0\n", name);
+        failures++;
+        free(jpg);
+        return;
+    }
+    double prep_full, prep_next;
+    bench_prepare(jpg, len, &prep_full, &prep_next);
+    printf("%s %dx%d, %zu bytes, work buffer %zu bytes, prepare %.2f us (%.2f us with cached tables)\n",
+           name, info.width, info.height, len, pool_used(jpg, len), prep_full * 1e6, prep_next * 1e6);
+    check_stream(name, path, jpg, len);
+    check_cache(name, jpg, len);
+    check_crop(name, jpg, len);
+    for (int scale = JPEG_IMAGE_SCALE_0; scale <= JPEG_IMAGE_SCALE_1_8; scale++) {
+        check_gray(name, jpg, len, scale);
+        size_t rgb_len, rgb565_len, gray_len;
+        double rgb = time_decode(jpg, len, JPEG_IMAGE_FORMAT_RGB888, scale, &rgb_len);
+        double rgb565 = time_decode(jpg, len, JPEG_IMAGE_FORMAT_RGB565, scale, &rgb565_len);
+        double gray = time_decode(jpg, len, JPEG_IMAGE_FORMAT_GRAY8, scale, &gray_len);
+        printf("  1/%d: RGB888 %7.1f us %6zu B | RGB565 %7.1f us %6zu B | GRAY8 %7.1f us %6zu B (%.2fx vs RGB565)\n",
+               1 << scale, rgb * 1e6, rgb_len, rgb565 * 1e6, rgb565_len, gray * 1e6, gray_len, rgb565 / gray);
+
+        /* The same RGB565 decode from the file: input and output buffers versus the band */
+        struct stream_ctx s = { .bpp = 2 };
+        esp_jpeg_image_output_t sinfo;
+        double best = 1e9;
+        for (int n = 0; n < 5; n++) {
+            double t0 = now_s();
+            decode_stream(path, JPEG_IMAGE_FORMAT_RGB565, scale, &s, &sinfo);
+            double dt = now_s() - t0;
+            best = dt < best ? dt : best;
+        }
+        printf("        stream RGB565 %7.1f us, band %zu B instead of %zu B file + %zu B frame\n",
+               best * 1e6, s.band_bytes, len, rgb565_len);
+        if (scale == JPEG_IMAGE_SCALE_0) {
+            bench_crop(jpg, len, rgb565);
+        }
+    }
+    free(jpg);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *images[] = {
+        "test_apps/main/logo.jpg",
+        "test_apps/main/usb_camera_2.jpg",
+    };
+    for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+        bench_file(images[i]);
+    }
+    for (int i = 1; i < argc; i++) {
+        bench_file(argv[i]);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+/* Minimal esp_rom_caps.h: the host build always uses the component's tjpgd */
+#pragma once
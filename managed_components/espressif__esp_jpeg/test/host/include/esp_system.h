@@ -0,0 +1,14 @@
+/* Minimal esp_system.h for building the decoder with a plain host compiler */
+#pragma once
+
+#include <assert.h>
+#include <stdlib.h>
+#include "esp_err.h"
+
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+static inline void *heap_caps_malloc(size_t size, unsigned int caps)
+{
+    (void)caps;
+    return malloc(size);
+}
@@ -0,0 +1,4 @@
+/* Minimal FreeRTOS.h: only the standard headers the decoder relies on it for */
+#pragma once
+
+#include <stdbool.h>
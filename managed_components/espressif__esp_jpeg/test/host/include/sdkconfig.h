@@ -0,0 +1,9 @@
+/* Minimal sdkconfig for building the decoder with a plain host compiler (esp_jpeg Kconfig defaults) */
+#pragma once
+
+#define CONFIG_JD_SZBUF 512
+#define CONFIG_JD_FORMAT 0
+#define CONFIG_JD_USE_SCALE 1
+#define CONFIG_JD_TBLCLIP 1
+#define CONFIG_JD_FASTDECODE 1
+#define CONFIG_JD_TABLE_CACHE 1
@@ -198,6 +198,161 @@ TEST_CASE("Test JPEG decompression library: User defined working buffer", "[esp_
     free(decoded);
 }
 
+/**
+ * @brief Grayscale output test
+ *
+ * Decodes the logo to JPEG_IMAGE_FORMAT_GRAY8 and checks the size of the
+ * output and that every pixel is the luminance of the RGB888 reference.
+ */
+TEST_CASE("Test JPEG decompression library: Grayscale output", "[esp_jpeg]")
+{
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)logo_jpg,
+        .indata_size = logo_jpg_len,
+        .out_format = JPEG_IMAGE_FORMAT_GRAY8,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_get_image_info(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    TEST_ASSERT_EQUAL(TESTW * TESTH, outimg.output_len);
+
+    unsigned char *decoded = malloc(outimg.output_len);
+    TEST_ASSERT_NOT_NULL(decoded);
+    jpeg_cfg.outbuf = decoded;
+    jpeg_cfg.outbuf_size = outimg.output_len;
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    TEST_ASSERT_EQUAL(TESTW, outimg.width);
+    TEST_ASSERT_EQUAL(TESTH, outimg.height);
+
+    const unsigned char *o = logo_rgb888;
+    for (int x = 0; x < outimg.width * outimg.height; x++, o += 3) {
+        /* The gray level can be +- 3 */
+        int y = (77 * o[0] + 150 * o[1] + 29 * o[2] + 128) >> 8;
+        TEST_ASSERT_UINT8_WITHIN(3, y, decoded[x]);
+    }
+    free(decoded);
+}
+
+/**
+ * @brief Crop output test
+ *
+ * Decodes a region of the camera image that does not start on the MCU grid
+ * and checks that it matches the same pixels of a full decode.
+ */
+TEST_CASE("Test JPEG decompression library: Crop", "[esp_jpeg]")
+{
+    const int left = 37, top = 21, w = 50, h = 30;
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)camera_2_jpg,
+        .indata_size = camera_2_jpg_len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_get_image_info(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+
+    unsigned char *full = malloc(outimg.output_len);
+    unsigned char *crop = malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(full);
+    TEST_ASSERT_NOT_NULL(crop);
+    jpeg_cfg.outbuf = full;
+    jpeg_cfg.outbuf_size = outimg.output_len;
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    const int full_w = outimg.width;
+
+    /* Only the region is written, so the output buffer holds just the region */
+    jpeg_cfg.outbuf = crop;
+    jpeg_cfg.outbuf_size = w * h * 3;
+    jpeg_cfg.crop.left = left;
+    jpeg_cfg.crop.top = top;
+    jpeg_cfg.crop.width = w;
+    jpeg_cfg.crop.height = h;
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    TEST_ASSERT_EQUAL(w, outimg.width);
+    TEST_ASSERT_EQUAL(h, outimg.height);
+    TEST_ASSERT_EQUAL(w * h * 3, outimg.output_len);
+
+    for (int y = 0; y < h; y++) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(full + ((top + y) * full_w + left) * 3, crop + y * w * 3, w * 3);
+    }
+
+    /* A region reaching past the image is rejected */
+    jpeg_cfg.crop.left = full_w - w + 1;
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, err);
+
+    free(crop);
+    free(full);
+}
+
+/**
+ * @brief Table cache test
+ *
+ * Decodes the camera image with the internal work buffer after the logo
+ * (tables rebuilt) and again (tables reused), and checks both against a
+ * decode in a user buffer, which does not touch the cache.
+ */
+TEST_CASE("Test JPEG decompression library: Table cache", "[esp_jpeg]")
+{
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)camera_2_jpg,
+        .indata_size = camera_2_jpg_len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_get_image_info(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    const size_t len = outimg.output_len;
+
+    unsigned char *ref = malloc(len);
+    unsigned char *decoded = malloc(len);
+    unsigned char *logo = malloc(TESTW * TESTH * 2);
+    unsigned char *working_buf = malloc(WORKING_BUFFER_SIZE);
+    TEST_ASSERT_NOT_NULL(ref);
+    TEST_ASSERT_NOT_NULL(decoded);
+    TEST_ASSERT_NOT_NULL(logo);
+    TEST_ASSERT_NOT_NULL(working_buf);
+
+    jpeg_cfg.outbuf = ref;
+    jpeg_cfg.outbuf_size = len;
+    jpeg_cfg.advanced.working_buffer = working_buf;
+    jpeg_cfg.advanced.working_buffer_size = WORKING_BUFFER_SIZE;
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+    jpeg_cfg.advanced.working_buffer = NULL;
+    jpeg_cfg.advanced.working_buffer_size = 0;
+
+    esp_jpeg_image_cfg_t logo_cfg = {
+        .indata = (uint8_t *)logo_jpg,
+        .indata_size = logo_jpg_len,
+        .outbuf = logo,
+        .outbuf_size = TESTW * TESTH * 2,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    err = esp_jpeg_decode(&logo_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+
+    for (int i = 0; i < 2; i++) {
+        memset(decoded, 0, len);
+        jpeg_cfg.outbuf = decoded;
+        err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+        TEST_ASSERT_EQUAL(ESP_OK, err);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(ref, decoded, len);
+    }
+
+    free(working_buf);
+    free(logo);
+    free(decoded);
+    free(ref);
+}
+
 #if CONFIG_JD_DEFAULT_HUFFMAN
 #include "test_usb_camera_jpg.h"
 #include "test_usb_camera_rgb888.h"
@@ -27,6 +27,10 @@
 #include "tjpgd.h"
 
 
+/* Luminance-only output: fixed by JD_FORMAT == 2 or selected at run time by jd->grayout */
+#define JD_GRAYOUT(jd)  (JD_FORMAT == 2 || (jd)->grayout)
+
+
 #if JD_FASTDECODE == 2
 #define HUFF_BIT    10  /* Bit length to apply fast huffman decode */
 #define HUFF_LEN    (1 << HUFF_BIT)
@@ -695,6 +699,60 @@ static JRESULT restart (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Skip a restart interval without decoding it                           */
+/*-----------------------------------------------------------------------*/
+
+static JRESULT skip_interval (
+    JDEC *jd,       /* Pointer to the decompressor object (at the top of an interval) */
+    uint16_t rstn   /* Expected restert sequense number at the end of the interval */
+)
+{
+    uint8_t *dp = jd->dptr;
+    size_t dc = jd->dctr;
+    unsigned int d = 0, flg = 0;
+
+
+#if JD_FASTDECODE >= 1
+    if (jd->marker) {   /* The marker has already been read by the bit extractor */
+        d = jd->marker;
+        jd->marker = 0;
+    } else
+#endif
+    {
+        for (;;) {      /* Scan the entropy-coded data for the next marker */
+            if (!dc) {  /* No input data is available, re-fill input buffer */
+                dp = jd->inbuf;
+                dc = jd->infunc(jd, dp, JD_SZBUF);
+                if (!dc) {
+                    return JDR_INP;
+                }
+            } else if (!JD_FASTDECODE) {
+                dp++;   /* JD_FASTDECODE == 0 points to the last byte read */
+            }
+            d = JD_FASTDECODE ? *dp++ : *dp;
+            dc--;
+            if (flg && d != 0 && d != 0xFF) {
+                break;  /* 0xFF followed by neither a stuffed zero nor a fill byte */
+            }
+            flg = (d == 0xFF);
+        }
+        jd->dptr = dp; jd->dctr = dc;
+    }
+
+    /* Check the marker */
+    if ((d & 0xF8) != 0xD0 || (d & 7) != (rstn & 7)) {
+        return JDR_FMT1;    /* Err: expected RSTn marker was not detected (may be collapted data) */
+    }
+
+    jd->dbit = 0;           /* Discard remaining bits */
+    jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;   /* Reset DC offset */
+    return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Apply Inverse-DCT in Arai Algorithm (see also aa_idct.png)            */
 /*-----------------------------------------------------------------------*/
@@ -823,12 +881,13 @@ static void block_idct (
 /*-----------------------------------------------------------------------*/
 
 static JRESULT mcu_load (
-    JDEC *jd        /* Pointer to the decompressor object */
+    JDEC *jd,       /* Pointer to the decompressor object */
+    int out         /* 0:Only parse the MCU (it is not output) */
 )
 {
     int32_t *tmp = (int32_t *)jd->workbuf;  /* Block working buffer for de-quantize and IDCT */
     int d, e;
-    unsigned int blk, nby, i, bc, z, id, cmp;
+    unsigned int blk, nby, i, bc, z, id, cmp, keep;
     jd_yuv_t *bp;
     const int32_t *dqf;
 
@@ -838,9 +897,12 @@ static JRESULT mcu_load (
 
     for (blk = 0; blk < nby + 2; blk++) {   /* Get nby Y blocks and two C blocks */
         cmp = (blk < nby) ? 0 : blk - nby + 1;  /* Component number 0:Y, 1:Cb, 2:Cr */
+        keep = out && (!JD_GRAYOUT(jd) || !cmp);    /* C blocks are only parsed, not reconstructed, in grayscale output */
 
         if (cmp && jd->ncomp != 3) {        /* Clear C blocks if not exist (monochrome image) */
-            for (i = 0; i < 64; bp[i++] = 128) ;
+            if (keep) {
+                for (i = 0; i < 64; bp[i++] = 128) ;
+            }
 
         } else {                            /* Load Y/C blocks from input stream */
             id = cmp ? 1 : 0;                       /* Huffman table ID of this component */
@@ -868,7 +930,9 @@ static JRESULT mcu_load (
             tmp[0] = d * dqf[0] >> 8;               /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
 
             /* Extract following 63 AC elements from input stream */
-            memset(&tmp[1], 0, 63 * sizeof (int32_t));  /* Initialize all AC elements */
+            if (keep) {
+                memset(&tmp[1], 0, 63 * sizeof (int32_t));  /* Initialize all AC elements */
+            }
             z = 1;      /* Top of the AC elements (in zigzag-order) */
             do {
                 d = huffext(jd, id, 1);             /* Extract a huffman coded value (zero runs and bit length) */
@@ -892,12 +956,14 @@ static JRESULT mcu_load (
                     if (!(d & bc)) {
                         d -= (bc << 1) - 1;    /* Restore negative value if needed */
                     }
-                    i = Zig[z];                     /* Get raster-order index */
-                    tmp[i] = d * dqf[i] >> 8;       /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+                    if (keep) {
+                        i = Zig[z];                 /* Get raster-order index */
+                        tmp[i] = d * dqf[i] >> 8;   /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+                    }
                 }
             } while (++z < 64);     /* Next AC element */
 
-            if (JD_FORMAT != 2 || !cmp) {   /* C components may not be processed if in grayscale output */
+            if (keep) {     /* Skipped MCUs and C components in grayscale output are not processed */
                 if (z == 1 || (JD_USE_SCALE && jd->scale == 3)) {   /* If no AC element or scale ratio is 1/8, IDCT can be ommited and the block is filled with DC value */
                     d = (jd_yuv_t)((*tmp / 256) + 128);
                     if (JD_FASTDECODE >= 1) {
@@ -956,7 +1022,7 @@ static JRESULT mcu_output (
     if (!JD_USE_SCALE || jd->scale != 3) {  /* Not for 1/8 scaling */
         pix = (uint8_t *)jd->workbuf;
 
-        if (JD_FORMAT != 2) {   /* RGB output (build an RGB MCU from Y/C component) */
+        if (!JD_GRAYOUT(jd)) {  /* RGB output (build an RGB MCU from Y/C component) */
             for (iy = 0; iy < my; iy++) {
                 pc = py = jd->mcubuf;
                 if (my == 16) {     /* Double block height? */
@@ -1002,7 +1068,7 @@ static JRESULT mcu_output (
                             py += 64 - 8;    /* Jump to next block if double block height */
                         }
                     }
-                    *pix++ = (uint8_t) * py++;          /* Get and store a Y value as grayscale */
+                    *pix++ = BYTECLIP(*py++);           /* Get and store a Y value as grayscale */
                 }
             }
         }
@@ -1015,16 +1081,16 @@ static JRESULT mcu_output (
             /* Get averaged RGB value of each square correcponds to a pixel */
             s = jd->scale * 2;  /* Number of shifts for averaging */
             w = 1 << jd->scale; /* Width of square */
-            a = (mx - w) * (JD_FORMAT != 2 ? 3 : 1);    /* Bytes to skip for next line in the square */
+            a = (mx - w) * (JD_GRAYOUT(jd) ? 1 : 3);    /* Bytes to skip for next line in the square */
             op = (uint8_t *)jd->workbuf;
             for (iy = 0; iy < my; iy += w) {
                 for (ix = 0; ix < mx; ix += w) {
-                    pix = (uint8_t *)jd->workbuf + (iy * mx + ix) * (JD_FORMAT != 2 ? 3 : 1);
+                    pix = (uint8_t *)jd->workbuf + (iy * mx + ix) * (JD_GRAYOUT(jd) ? 1 : 3);
                     r = g = b = 0;
                     for (y = 0; y < w; y++) {   /* Accumulate RGB value in the square */
                         for (x = 0; x < w; x++) {
                             r += *pix++;    /* Accumulate R or Y (monochrome output) */
-                            if (JD_FORMAT != 2) {   /* RGB output? */
+                            if (!JD_GRAYOUT(jd)) {  /* RGB output? */
                                 g += *pix++;    /* Accumulate G */
                                 b += *pix++;    /* Accumulate B */
                             }
@@ -1032,7 +1098,7 @@ static JRESULT mcu_output (
                         pix += a;
                     }                           /* Put the averaged pixel value */
                     *op++ = (uint8_t)(r >> s);  /* Put R or Y (monochrome output) */
-                    if (JD_FORMAT != 2) {   /* RGB output? */
+                    if (!JD_GRAYOUT(jd)) {  /* RGB output? */
                         *op++ = (uint8_t)(g >> s);  /* Put G */
                         *op++ = (uint8_t)(b >> s);  /* Put B */
                     }
@@ -1055,12 +1121,12 @@ static JRESULT mcu_output (
             for (ix = 0; ix < mx; ix += 8) {
                 yy = *py;   /* Get Y component */
                 py += 64;
-                if (JD_FORMAT != 2) {
+                if (!JD_GRAYOUT(jd)) {
                     *pix++ = /*R*/ BYTECLIP(yy + ((int)(1.402 * CVACC) * cr / CVACC));
                     *pix++ = /*G*/ BYTECLIP(yy - ((int)(0.344 * CVACC) * cb + (int)(0.714 * CVACC) * cr) / CVACC);
                     *pix++ = /*B*/ BYTECLIP(yy + ((int)(1.772 * CVACC) * cb / CVACC));
                 } else {
-                    *pix++ = yy;
+                    *pix++ = BYTECLIP(yy);
                 }
             }
         }
@@ -1076,17 +1142,17 @@ static JRESULT mcu_output (
         for (y = 0; y < ry; y++) {
             for (x = 0; x < rx; x++) {  /* Copy effective pixels */
                 *d++ = *s++;
-                if (JD_FORMAT != 2) {
+                if (!JD_GRAYOUT(jd)) {
                     *d++ = *s++;
                     *d++ = *s++;
                 }
             }
-            s += (mx - rx) * (JD_FORMAT != 2 ? 3 : 1);  /* Skip truncated pixels */
+            s += (mx - rx) * (JD_GRAYOUT(jd) ? 1 : 3);  /* Skip truncated pixels */
         }
     }
 
     /* Convert RGB888 to RGB565 if needed */
-    if (JD_FORMAT == 1) {
+    if (JD_FORMAT == 1 && !JD_GRAYOUT(jd)) {
         uint8_t *s = (uint8_t *)jd->workbuf;
         uint16_t w, *d = (uint16_t *)s;
         unsigned int n = rx * ry;
@@ -1106,6 +1172,29 @@ static JRESULT mcu_output (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Fold a segment into the hash of the table segments (32-bit FNV-1a)    */
+/*-----------------------------------------------------------------------*/
+
+static uint32_t hash_segment (
+    uint32_t h,             /* Hash of the preceding segments */
+    uint16_t marker,        /* Segment marker */
+    const uint8_t *seg,     /* Segment content */
+    size_t len              /* Size of the segment content */
+)
+{
+    h = (h ^ (marker & 0xFF)) * 16777619;
+    h = (h ^ (uint8_t)(len >> 8)) * 16777619;
+    h = (h ^ (uint8_t)len) * 16777619;
+    while (len--) {
+        h = (h ^ *seg++) * 16777619;
+    }
+    return h;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Analyze the JPEG image and Initialize decompressor object             */
 /*-----------------------------------------------------------------------*/
@@ -1113,31 +1202,20 @@ static JRESULT mcu_output (
 #define LDB_WORD(ptr)       (uint16_t)(((uint16_t)*((uint8_t*)(ptr))<<8)|(uint16_t)*(uint8_t*)((ptr)+1))
 
 
-JRESULT jd_prepare (
-    JDEC *jd,               /* Blank decompressor object */
-    size_t (*infunc)(JDEC *, uint8_t *, size_t), /* JPEG strem input function */
-    void *pool,             /* Working buffer for the decompression session */
-    size_t sz_pool,         /* Size of working buffer */
-    void *dev               /* I/O device identifier for the session */
+static JRESULT parse_header (
+    JDEC *jd,               /* Decompressor object with its input buffer allocated */
+    int reuse               /* 1:Tables and buffers are kept from the previous image and must match */
 )
 {
     uint8_t *seg, b;
     uint16_t marker;
     unsigned int n, i, ofs;
     size_t len;
+    uint32_t hash = 2166136261;
     JRESULT rc;
 
 
-    memset(jd, 0, sizeof (JDEC));   /* Clear decompression object (this might be a problem if machine's null pointer is not all bits zero) */
-    jd->pool = pool;        /* Work memroy */
-    jd->sz_pool = sz_pool;  /* Size of given work memory */
-    jd->infunc = infunc;    /* Stream input function */
-    jd->device = dev;       /* I/O device identifier */
-
-    jd->inbuf = seg = alloc_pool(jd, JD_SZBUF);     /* Allocate stream input buffer */
-    if (!seg) {
-        return JDR_MEM1;
-    }
+    seg = jd->inbuf;
 
     ofs = marker = 0;       /* Find SOI marker */
     do {
@@ -1188,6 +1266,7 @@ JRESULT jd_prepare (
             if (jd->infunc(jd, seg, len) != len) {
                 return JDR_INP;    /* Load segment data */
             }
+            hash = hash_segment(hash, marker, seg, len);
 
             jd->width = LDB_WORD(&seg[3]);      /* Image width in unit of pixel */
             jd->height = LDB_WORD(&seg[1]);     /* Image height in unit of pixel */
@@ -1223,6 +1302,7 @@ JRESULT jd_prepare (
             if (jd->infunc(jd, seg, len) != len) {
                 return JDR_INP;    /* Load segment data */
             }
+            hash = hash_segment(hash, marker, seg, len);
 
             jd->nrst = LDB_WORD(seg);   /* Get restart interval (MCUs) */
             break;
@@ -1234,10 +1314,13 @@ JRESULT jd_prepare (
             if (jd->infunc(jd, seg, len) != len) {
                 return JDR_INP;    /* Load segment data */
             }
+            hash = hash_segment(hash, marker, seg, len);
 
-            rc = create_huffman_tbl(jd, seg, len);  /* Create huffman tables */
-            if (rc) {
-                return rc;
+            if (!reuse) {
+                rc = create_huffman_tbl(jd, seg, len);  /* Create huffman tables */
+                if (rc) {
+                    return rc;
+                }
             }
             break;
 
@@ -1248,10 +1331,13 @@ JRESULT jd_prepare (
             if (jd->infunc(jd, seg, len) != len) {
                 return JDR_INP;    /* Load segment data */
             }
+            hash = hash_segment(hash, marker, seg, len);
 
-            rc = create_qt_tbl(jd, seg, len);   /* Create de-quantizer tables */
-            if (rc) {
-                return rc;
+            if (!reuse) {
+                rc = create_qt_tbl(jd, seg, len);   /* Create de-quantizer tables */
+                if (rc) {
+                    return rc;
+                }
             }
             break;
 
@@ -1262,49 +1348,58 @@ JRESULT jd_prepare (
             if (jd->infunc(jd, seg, len) != len) {
                 return JDR_INP;    /* Load segment data */
             }
+            hash = hash_segment(hash, marker, seg, len);
 
-            if (!jd->width || !jd->height) {
-                return JDR_FMT1;    /* Err: Invalid image size */
-            }
-            if (seg[0] != jd->ncomp) {
-                return JDR_FMT3;    /* Err: Wrong color components */
-            }
+            if (reuse) {   /* Same tables, buffers and image layout as the previous image? */
+                if (hash != jd->tblhash) {
+                    return JDR_PAR;    /* Err: Tables differ from the previous image */
+                }
+            } else {
+                jd->tblhash = hash;
 
-            /* Check if all tables corresponding to each components have been loaded */
-            for (i = 0; i < jd->ncomp; i++) {
-                b = seg[2 + 2 * i]; /* Get huffman table ID */
-                if (b != 0x00 && b != 0x11) {
-                    return JDR_FMT3;    /* Err: Different table number for DC/AC element */
+                if (!jd->width || !jd->height) {
+                    return JDR_FMT1;    /* Err: Invalid image size */
                 }
-                n = i ? 1 : 0;                          /* Component class */
-                if (!jd->huffbits[n][0] || !jd->huffbits[n][1]) {   /* Check huffman table for this component */
+                if (seg[0] != jd->ncomp) {
+                    return JDR_FMT3;    /* Err: Wrong color components */
+                }
+
+                /* Check if all tables corresponding to each components have been loaded */
+                for (i = 0; i < jd->ncomp; i++) {
+                    b = seg[2 + 2 * i]; /* Get huffman table ID */
+                    if (b != 0x00 && b != 0x11) {
+                        return JDR_FMT3;    /* Err: Different table number for DC/AC element */
+                    }
+                    n = i ? 1 : 0;                          /* Component class */
+                    if (!jd->huffbits[n][0] || !jd->huffbits[n][1]) {   /* Check huffman table for this component */
 #if JD_DEFAULT_HUFFMAN
-                    jd_load_default_huffman(jd); // Always returns OK
+                        jd_load_default_huffman(jd); // Always returns OK
 #else
-                    return JDR_FMT1;                    /* Err: Nnot loaded */
+                        return JDR_FMT1;                    /* Err: Nnot loaded */
 #endif
+                    }
+                    if (!jd->qttbl[jd->qtid[i]]) {          /* Check dequantizer table for this component */
+                        return JDR_FMT1;                    /* Err: Not loaded */
+                    }
                 }
-                if (!jd->qttbl[jd->qtid[i]]) {          /* Check dequantizer table for this component */
-                    return JDR_FMT1;                    /* Err: Not loaded */
-                }
-            }
 
-            /* Allocate working buffer for MCU and pixel output */
-            n = jd->msy * jd->msx;                      /* Number of Y blocks in the MCU */
-            if (!n) {
-                return JDR_FMT1;    /* Err: SOF0 has not been loaded */
-            }
-            len = n * 64 * 2 + 64;                      /* Allocate buffer for IDCT and RGB output */
-            if (len < 256) {
-                len = 256;    /* but at least 256 byte is required for IDCT */
-            }
-            jd->workbuf = alloc_pool(jd, len);          /* and it may occupy a part of following MCU working buffer for RGB output */
-            if (!jd->workbuf) {
-                return JDR_MEM1;    /* Err: not enough memory */
-            }
-            jd->mcubuf = alloc_pool(jd, (n + 2) * 64 * sizeof (jd_yuv_t));  /* Allocate MCU working buffer */
-            if (!jd->mcubuf) {
-                return JDR_MEM1;    /* Err: not enough memory */
+                /* Allocate working buffer for MCU and pixel output */
+                n = jd->msy * jd->msx;                      /* Number of Y blocks in the MCU */
+                if (!n) {
+                    return JDR_FMT1;    /* Err: SOF0 has not been loaded */
+                }
+                len = n * 64 * 2 + 64;                      /* Allocate buffer for IDCT and RGB output */
+                if (len < 256) {
+                    len = 256;    /* but at least 256 byte is required for IDCT */
+                }
+                jd->workbuf = alloc_pool(jd, len);          /* and it may occupy a part of following MCU working buffer for RGB output */
+                if (!jd->workbuf) {
+                    return JDR_MEM1;    /* Err: not enough memory */
+                }
+                jd->mcubuf = alloc_pool(jd, (n + 2) * 64 * sizeof (jd_yuv_t));  /* Allocate MCU working buffer */
+                if (!jd->mcubuf) {
+                    return JDR_MEM1;    /* Err: not enough memory */
+                }
             }
 
             /* Align stream read offset to JD_SZBUF */
@@ -1342,6 +1437,59 @@ JRESULT jd_prepare (
 
 
 
+JRESULT jd_prepare (
+    JDEC *jd,               /* Blank decompressor object */
+    size_t (*infunc)(JDEC *, uint8_t *, size_t), /* JPEG strem input function */
+    void *pool,             /* Working buffer for the decompression session */
+    size_t sz_pool,         /* Size of working buffer */
+    void *dev               /* I/O device identifier for the session */
+)
+{
+    memset(jd, 0, sizeof (JDEC));   /* Clear decompression object (this might be a problem if machine's null pointer is not all bits zero) */
+    jd->pool = pool;        /* Work memroy */
+    jd->sz_pool = sz_pool;  /* Size of given work memory */
+    jd->infunc = infunc;    /* Stream input function */
+    jd->device = dev;       /* I/O device identifier */
+
+    jd->inbuf = alloc_pool(jd, JD_SZBUF);   /* Allocate stream input buffer */
+    if (!jd->inbuf) {
+        return JDR_MEM1;
+    }
+
+    return parse_header(jd, 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize decompressor object for an image with the same tables      */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_prepare_next (
+    JDEC *jd,               /* Decompressor object prepared by jd_prepare() (or a copy of it) */
+    size_t (*infunc)(JDEC *, uint8_t *, size_t), /* JPEG strem input function */
+    void *dev               /* I/O device identifier for the session */
+)
+{
+    if (!jd->mcubuf) {
+        return JDR_PAR;     /* Err: Not prepared */
+    }
+    jd->infunc = infunc;
+    jd->device = dev;
+    jd->dctr = 0; jd->dbit = 0;
+    jd->grayout = 0;
+#if JD_FASTDECODE >= 1
+    jd->wreg = 0; jd->marker = 0;
+#endif
+
+    /* The DQT, DHT, SOF0, DRI and SOS segments are parsed and hashed but the tables are not rebuilt */
+    return parse_header(jd, 1);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Start to decompress the JPEG picture                                  */
 /*-----------------------------------------------------------------------*/
@@ -1352,8 +1500,26 @@ JRESULT jd_decomp (
     uint8_t scale                           /* Output de-scaling factor (0 to 3) */
 )
 {
-    unsigned int x, y, mx, my;
+    return jd_decomp_roi(jd, outfunc, scale, 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress only the MCUs that overlap a region of the JPEG picture    */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_roi (
+    JDEC *jd,                               /* Initialized decompression object */
+    int (*outfunc)(JDEC *, void *, JRECT *), /* RGB output function */
+    uint8_t scale,                          /* Output de-scaling factor (0 to 3) */
+    const JRECT *roi                        /* Region in the input image (pixel) or null pointer for the whole image */
+)
+{
+    unsigned int x, y, mx, my, nx, n, nmcu, nlast, i, ix, iy, in;
     uint16_t rst, rsc;
+    JRECT r;
     JRESULT rc;
 
 
@@ -1362,30 +1528,68 @@ JRESULT jd_decomp (
     }
     jd->scale = scale;
 
+    if (roi) {
+        if (roi->left > roi->right || roi->top > roi->bottom || roi->right >= jd->width || roi->bottom >= jd->height) {
+            return JDR_PAR;
+        }
+        r = *roi;
+    } else {
+        r.left = 0; r.right = jd->width - 1;
+        r.top = 0; r.bottom = jd->height - 1;
+    }
+
     mx = jd->msx * 8; my = jd->msy * 8;         /* Size of the MCU (pixel) */
+    nx = (jd->width + mx - 1) / mx;             /* Number of MCUs in a row */
+    nmcu = nx * ((jd->height + my - 1) / my);   /* Number of MCUs in the image */
+    nlast = nx * (r.bottom / my + 1);           /* MCUs below the region are not needed at all */
 
     jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;   /* Initialize DC values */
     rst = rsc = 0;
 
     rc = JDR_OK;
-    for (y = 0; y < jd->height; y += my) {      /* Vertical loop of MCUs */
-        for (x = 0; x < jd->width; x += mx) {   /* Horizontal loop of MCUs */
-            if (jd->nrst && rst++ == jd->nrst) {    /* Process restart interval if enabled */
-                rc = restart(jd, rsc++);
+    x = y = 0;
+    for (n = 0; n < nlast; n++) {               /* Loop of MCUs in raster order */
+        if (jd->nrst && rst++ == jd->nrst) {    /* Process restart interval if enabled */
+            rc = restart(jd, rsc++);
+            if (rc != JDR_OK) {
+                return rc;
+            }
+            rst = 1;
+        }
+        if (roi && jd->nrst && rst == 1 && n + jd->nrst < nmcu) {  /* Top of a restart interval followed by another one? */
+            in = 0;
+            ix = x; iy = y;
+            for (i = 0; i < jd->nrst && !in; i++) { /* Does any MCU in the interval overlap the region? */
+                in = ix <= r.right && ix + mx > r.left && iy <= r.bottom && iy + my > r.top;
+                if ((ix += mx) >= jd->width) {
+                    ix = 0; iy += my;
+                }
+            }
+            if (!in) {      /* Skip the interval to the next RSTn without entropy decoding */
+                rc = skip_interval(jd, rsc++);
                 if (rc != JDR_OK) {
                     return rc;
                 }
-                rst = 1;
-            }
-            rc = mcu_load(jd);                  /* Load an MCU (decompress huffman coded stream, dequantize and apply IDCT) */
-            if (rc != JDR_OK) {
-                return rc;
+                rst = 0;
+                n += jd->nrst - 1;
+                x = (n + 1) % nx * mx; y = (n + 1) / nx * my;
+                continue;
             }
+        }
+        in = x <= r.right && x + mx > r.left && y <= r.bottom && y + my > r.top;
+        rc = mcu_load(jd, in);                  /* Load an MCU (decompress huffman coded stream, dequantize and apply IDCT) */
+        if (rc != JDR_OK) {
+            return rc;
+        }
+        if (in) {
             rc = mcu_output(jd, outfunc, x, y); /* Output the MCU (YCbCr to RGB, scaling and output) */
             if (rc != JDR_OK) {
                 return rc;
             }
         }
+        if ((x += mx) >= jd->width) {           /* Next MCU */
+            x = 0; y += my;
+        }
     }
 
     return rc;
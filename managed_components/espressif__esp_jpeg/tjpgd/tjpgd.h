@@ -64,9 +64,11 @@ struct JDEC {
     uint8_t msx, msy;           /* MCU size in unit of block (width, height) */
     uint8_t qtid[3];            /* Quantization table ID of each component, Y, Cb, Cr */
     uint8_t ncomp;              /* Number of color components 1:grayscale, 3:color */
+    uint8_t grayout;            /* Output 8-bit luminance instead of JD_FORMAT (set after jd_prepare) */
     int16_t dcv[3];             /* Previous DC element of each component */
     uint16_t nrst;              /* Restart inverval */
     uint16_t width, height;     /* Size of the input image (pixel) */
+    uint32_t tblhash;           /* Hash of the DQT, DHT, SOF0, DRI and SOS segments */
     uint8_t *huffbits[2][2];    /* Huffman bit distribution tables [id][dcac] */
     uint16_t *huffcode[2][2];   /* Huffman code word tables [id][dcac] */
     uint8_t *huffdata[2][2];    /* Huffman decoded data tables [id][dcac] */
@@ -92,7 +94,9 @@ struct JDEC {
 
 /* TJpgDec API functions */
 JRESULT jd_prepare (JDEC *jd, size_t (*infunc)(JDEC *, uint8_t *, size_t), void *pool, size_t sz_pool, void *dev);
+JRESULT jd_prepare_next (JDEC *jd, size_t (*infunc)(JDEC *, uint8_t *, size_t), void *dev);
 JRESULT jd_decomp (JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale);
+JRESULT jd_decomp_roi (JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale, const JRECT *roi);
 
 
 #ifdef __cplusplus
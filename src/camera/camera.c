@@ -5,18 +5,221 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "esp_camera.h"
+#include "nvs.h"
 #include "camera.h"
+#include "metrics.h"
+#include "frame_pool.h"
+#include "trace.h"
 
 static const char *TAG = "camera";
 static bool is_init = false;
 static camera_config_t current_config;
 static framesize_t current_framesize = FRAMESIZE_UXGA;
 
+/**
+ * 3A state sampled between frames
+ */
+typedef struct {
+    uint32_t exposure;  // AEC exposure, 1/16 line
+    uint32_t gain;      // AGC gain
+    uint32_t awb_red;   // AWB red gain
+    uint32_t awb_blue;  // AWB blue gain
+    uint32_t luma;      // Average frame luminance
+} camera_3a_t;
+
+/**
+ * Converged 3A state as persisted in NVS
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t framesize;  // Frame size the values were measured at
+    camera_3a_t values;
+    int64_t saved_sec;  // Wall clock at save time (0 if the clock was unset)
+} camera_3a_record_t;
+
+#define CAMERA_3A_RECORD_VERSION 1
+#define CAMERA_3A_NVS_NAMESPACE "camera"
+#define CAMERA_3A_NVS_KEY "3a"
+#define CAMERA_CLOCK_VALID_SEC 1577836800   // 2020-01-01, earlier means unset
+
+// Last converged state; seeds the sensor when switching to its frame size
+static camera_3a_record_t scene_ref;
+static bool scene_ref_valid = false;
+static camera_3a_record_t scene_saved;      // Copy last written to NVS
+static bool scene_seeded = false;           // AEC/AGC held manual at scene_ref
+static int64_t seed_us;                     // When the seeded values were written
+static camera_settle_stats_t settle_stats;
+
+/**
+ * Read the AEC/AGC/AWB result registers (OV3660 and OV5640 share the map)
+ * The sensor drivers mark these registers volatile, so reads hit the bus.
+ * @return false if the sensor's 3A state cannot be read
+ */
+static bool camera_read_3a(sensor_t *sensor, camera_3a_t *out)
+{
+    if (sensor->get_reg == NULL ||
+        (sensor->id.PID != OV3660_PID && sensor->id.PID != OV5640_PID)) {
+        return false;
+    }
+
+    int exposure = sensor->get_reg(sensor, 0x3500, 0xFFFFF);
+    int gain = sensor->get_reg(sensor, 0x350A, 0x3FF);
+    int awb_red = sensor->get_reg(sensor, 0x3400, 0xFFF);
+    int awb_blue = sensor->get_reg(sensor, 0x3404, 0xFFF);
+    int luma = sensor->get_reg(sensor, 0x56A1, 0xFF);
+    if (exposure < 0 || gain < 0 || awb_red < 0 || awb_blue < 0 || luma < 0) {
+        return false;
+    }
+
+    out->exposure = exposure;
+    out->gain = gain;
+    out->awb_red = awb_red;
+    out->awb_blue = awb_blue;
+    out->luma = luma;
+    return true;
+}
+
+/**
+ * Check one 3A value against the previous frame
+ * A change of one step is always accepted so small values can settle.
+ */
+static bool camera_value_within(uint32_t prev, uint32_t cur, uint32_t pct)
+{
+    uint32_t diff = prev > cur ? prev - cur : cur - prev;
+    uint32_t ref = prev > cur ? prev : cur;
+    return diff <= 1 || diff * 100 <= ref * pct;
+}
+
+static bool camera_3a_stable(const camera_3a_t *prev, const camera_3a_t *cur)
+{
+    return camera_value_within(prev->exposure, cur->exposure, CAMERA_SETTLE_TOLERANCE_PCT) &&
+           camera_value_within(prev->gain, cur->gain, CAMERA_SETTLE_TOLERANCE_PCT) &&
+           camera_value_within(prev->awb_red, cur->awb_red, CAMERA_SETTLE_TOLERANCE_PCT) &&
+           camera_value_within(prev->awb_blue, cur->awb_blue, CAMERA_SETTLE_TOLERANCE_PCT);
+}
+
+/**
+ * Load the persisted 3A state into scene_ref
+ * @return true if a usable (not too old) record was found
+ */
+static bool camera_load_3a(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(CAMERA_3A_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    camera_3a_record_t rec;
+    size_t size = sizeof(rec);
+    esp_err_t ret = nvs_get_blob(nvs, CAMERA_3A_NVS_KEY, &rec, &size);
+    nvs_close(nvs);
+    if (ret != ESP_OK || size != sizeof(rec) || rec.version != CAMERA_3A_RECORD_VERSION) {
+        return false;
+    }
+
+    // Without a valid clock the age is unknown; the luminance check on the
+    // first frame still catches a changed scene
+    int64_t now = time(NULL);
+    if (rec.saved_sec >= CAMERA_CLOCK_VALID_SEC && now >= CAMERA_CLOCK_VALID_SEC &&
+        now - rec.saved_sec > CAMERA_3A_MAX_AGE_SEC) {
+        ESP_LOGI(TAG, "Stored 3A state is %lld s old, ignoring", (long long)(now - rec.saved_sec));
+        return false;
+    }
+
+    scene_ref = rec;
+    scene_saved = rec;
+    scene_ref_valid = true;
+    ESP_LOGI(TAG, "Restored 3A state (frame size %d, exp %lu gain %lu luma %lu)",
+             rec.framesize, (unsigned long)rec.values.exposure,
+             (unsigned long)rec.values.gain, (unsigned long)rec.values.luma);
+    return true;
+}
+
+esp_err_t camera_save_3a(void)
+{
+    if (!settle_stats.wake_done) {
+        settle_stats.wake_done = true;
+        ESP_LOGI(TAG, "First shot after wake: %lu frames discarded (%s)",
+                 (unsigned long)settle_stats.wake_frames,
+                 settle_stats.restored ? "3A restored" : "cold start");
+    }
+    if (!scene_ref_valid) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Skip the flash write while the scene holds steady
+    if (scene_saved.version == CAMERA_3A_RECORD_VERSION &&
+        scene_saved.framesize == scene_ref.framesize &&
+        camera_3a_stable(&scene_saved.values, &scene_ref.values) &&
+        camera_value_within(scene_saved.values.luma, scene_ref.values.luma,
+                            CAMERA_3A_LUMA_TOLERANCE_PCT)) {
+        return ESP_OK;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(CAMERA_3A_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int64_t now = time(NULL);
+    scene_ref.saved_sec = now >= CAMERA_CLOCK_VALID_SEC ? now : 0;
+    ret = nvs_set_blob(nvs, CAMERA_3A_NVS_KEY, &scene_ref, sizeof(scene_ref));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (ret == ESP_OK) {
+        scene_saved = scene_ref;
+        ESP_LOGD(TAG, "Saved 3A state (exp %lu gain %lu luma %lu)",
+                 (unsigned long)scene_ref.values.exposure, (unsigned long)scene_ref.values.gain,
+                 (unsigned long)scene_ref.values.luma);
+    } else {
+        ESP_LOGW(TAG, "Failed to save 3A state: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * Hold AEC/AGC at the stored state for the current frame size
+ * The next frames are then exposed like the last shot was; auto control is
+ * handed back (starting from these values) once one of them is checked.
+ */
+static void camera_seed_3a(sensor_t *sensor, framesize_t size)
+{
+    if (!scene_ref_valid || scene_ref.framesize != size || sensor->set_reg == NULL) {
+        return;
+    }
+    sensor->set_exposure_ctrl(sensor, 0);
+    sensor->set_gain_ctrl(sensor, 0);
+    if (sensor->set_reg(sensor, 0x3500, 0xFFFFF, scene_ref.values.exposure) < 0 ||
+        sensor->set_reg(sensor, 0x350A, 0x3FF, scene_ref.values.gain) < 0) {
+        sensor->set_exposure_ctrl(sensor, 1);
+        sensor->set_gain_ctrl(sensor, 1);
+        return;
+    }
+    scene_seeded = true;
+    seed_us = esp_timer_get_time();
+}
+
+/**
+ * Hand exposure and gain back to the sensor's auto control
+ */
+static void camera_release_seed(sensor_t *sensor)
+{
+    if (scene_seeded && sensor != NULL) {
+        sensor->set_exposure_ctrl(sensor, 1);
+        sensor->set_gain_ctrl(sensor, 1);
+        scene_seeded = false;
+    }
+}
+
 esp_err_t camera_init(const camera_config_t *config)
 {
     if (is_init) {
@@ -66,16 +269,29 @@ esp_err_t camera_init(const camera_config_t *config)
     current_framesize = config->frame_size;
     is_init = true;
 
-    // Warm up camera - discard first few frames to avoid NO-SOI errors
-    ESP_LOGI(TAG, "Warming up camera...");
-    for (int i = 0; i < 5; i++) {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (fb) {
-            esp_camera_fb_return(fb);
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));
+    // Write a stored 3A state straight away so the sensor is already
+    // exposing at it while the rest of init runs
+    if (camera_load_3a()) {
+        settle_stats.restored = true;
+        camera_seed_3a(sensor, current_framesize);
+    }
+
+    ret = frame_pool_init(config->fb_count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    trace_init();
+
+    // Warm up camera - discard frames until 3A has settled (also avoids
+    // NO-SOI errors on the first frames). When seeded this takes only the
+    // frames needed to latch and check the stored state.
+    uint32_t settle_ms = 0;
+    if (camera_wait_settled(CAMERA_WARMUP_TIMEOUT_MS, &settle_ms) == ESP_OK) {
+        ESP_LOGI(TAG, "Camera warm-up complete (%lu ms%s)", (unsigned long)settle_ms,
+                 settle_stats.restored ? ", 3A restored" : "");
+    } else {
+        ESP_LOGW(TAG, "Camera warm-up timed out after %lu ms", (unsigned long)settle_ms);
     }
-    ESP_LOGI(TAG, "Camera warm-up complete");
 
     return ESP_OK;
 }
@@ -86,6 +302,9 @@ esp_err_t camera_deinit(void)
         return ESP_OK;
     }
 
+    // Drop the retained frame so no driver buffer outlives the driver
+    frame_pool_keep_latest(false);
+
     esp_err_t ret = esp_camera_deinit();
     if (ret == ESP_OK) {
         is_init = false;
@@ -94,6 +313,112 @@ esp_err_t camera_deinit(void)
     return ret;
 }
 
+esp_err_t camera_wait_settled(uint32_t timeout_ms, uint32_t *settle_ms)
+{
+    if (!is_init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t *sensor = esp_camera_sensor_get();
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + (int64_t)timeout_ms * 1000;
+    camera_3a_t prev = {0}, cur;
+    bool have_prev = false, measured = false;
+    int stable = 0, fresh = 0, dropped = 0;
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+
+    if (sensor != NULL && !scene_seeded) {
+        camera_seed_3a(sensor, current_framesize);
+    }
+    // Seeded frames count from the register write, which camera_init may
+    // have done before this call
+    int64_t fresh_us = scene_seeded ? seed_us : start_us;
+
+    while (esp_timer_get_time() < deadline_us) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (fb == NULL) {
+            continue;
+        }
+        dropped++;
+        // Frames that started before the call (or the seed write) were
+        // exposed with old settings
+        int64_t frame_us = camera_fb_time_us(fb);
+        esp_camera_fb_return(fb);
+        if (frame_us < fresh_us) {
+            continue;
+        }
+        fresh++;
+
+        // Exposure writes latch at a frame boundary, so the first fresh
+        // frame after seeding may still use the previous values
+        if (scene_seeded && fresh <= CAMERA_SEED_LATENCY_FRAMES) {
+            continue;
+        }
+
+        if (sensor == NULL || !camera_read_3a(sensor, &cur)) {
+            camera_release_seed(sensor);
+            if (fresh >= CAMERA_SETTLE_FALLBACK_FRAMES) {
+                ret = ESP_OK;
+                break;
+            }
+            continue;
+        }
+        measured = true;
+
+        if (scene_seeded) {
+            // Exposed at the stored state: done if the scene looks the same
+            camera_release_seed(sensor);
+            if (camera_value_within(scene_ref.values.luma, cur.luma, CAMERA_3A_LUMA_TOLERANCE_PCT)) {
+                prev = cur;
+                ret = ESP_OK;
+                break;
+            }
+            ESP_LOGI(TAG, "Scene changed since stored 3A state (luma %lu -> %lu)",
+                     (unsigned long)scene_ref.values.luma, (unsigned long)cur.luma);
+            settle_stats.stale++;
+            continue;   // Auto control starts from here; prev stays empty
+        }
+
+        stable = (have_prev && camera_3a_stable(&prev, &cur)) ? stable + 1 : 0;
+        prev = cur;
+        have_prev = true;
+        if (stable >= CAMERA_SETTLE_STABLE_FRAMES) {
+            ret = ESP_OK;
+            break;
+        }
+    }
+    camera_release_seed(sensor);
+
+    if (ret == ESP_OK && measured) {
+        scene_ref.version = CAMERA_3A_RECORD_VERSION;
+        scene_ref.framesize = current_framesize;
+        scene_ref.values = prev;
+        scene_ref_valid = true;
+    }
+
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    metrics_record(METRICS_STAGE_SETTLE, elapsed_us, 0, ret != ESP_OK);
+    settle_stats.last_frames = dropped;
+    if (!settle_stats.wake_done) {
+        settle_stats.wake_frames += dropped;
+    }
+    if (settle_ms) {
+        *settle_ms = elapsed_us / 1000;
+    }
+    ESP_LOGD(TAG, "3A %s after %lu ms, %d frames (exp %lu gain %lu awb %lu/%lu luma %lu)",
+             ret == ESP_OK ? "settled" : "not settled", (unsigned long)(elapsed_us / 1000),
+             dropped, (unsigned long)prev.exposure, (unsigned long)prev.gain,
+             (unsigned long)prev.awb_red, (unsigned long)prev.awb_blue, (unsigned long)prev.luma);
+    return ret;
+}
+
+void camera_get_settle_stats(camera_settle_stats_t *stats)
+{
+    if (stats) {
+        *stats = settle_stats;
+    }
+}
+
 camera_fb_t *camera_capture(void)
 {
     if (!is_init) {
@@ -101,7 +426,10 @@ camera_fb_t *camera_capture(void)
         return NULL;
     }
 
+    int64_t start_us = esp_timer_get_time();
     camera_fb_t *fb = esp_camera_fb_get();
+    metrics_record(METRICS_STAGE_CAPTURE, (uint32_t)(esp_timer_get_time() - start_us),
+                   fb ? fb->len : 0, fb == NULL);
     if (fb == NULL) {
         ESP_LOGE(TAG, "Failed to capture frame");
         return NULL;
@@ -110,6 +438,48 @@ camera_fb_t *camera_capture(void)
     return fb;
 }
 
+camera_fb_t *camera_capture_fresh(int64_t not_before_us, camera_capture_info_t *info)
+{
+    if (!is_init) {
+        ESP_LOGE(TAG, "Camera not initialized");
+        return NULL;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    if (not_before_us == 0) {
+        not_before_us = start_us;
+    }
+    int64_t deadline_us = start_us + (int64_t)CAMERA_FRESH_TIMEOUT_MS * 1000;
+    uint32_t discarded = 0;
+    camera_fb_t *fb = NULL;
+
+    // Queued frames come back without waiting, so stale ones cost only a
+    // queue round trip; the timestamp was taken by the driver at VSYNC
+    while (esp_timer_get_time() < deadline_us) {
+        fb = esp_camera_fb_get();
+        if (fb == NULL || camera_fb_time_us(fb) >= not_before_us) {
+            break;
+        }
+        esp_camera_fb_return(fb);
+        fb = NULL;
+        discarded++;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    metrics_record(METRICS_STAGE_CAPTURE, (uint32_t)(now_us - start_us),
+                   fb ? fb->len : 0, fb == NULL);
+    if (info) {
+        info->age_us = fb ? (uint32_t)(now_us - camera_fb_time_us(fb)) : 0;
+        info->discarded = discarded;
+    }
+    if (fb == NULL) {
+        ESP_LOGE(TAG, "No fresh frame within %d ms (%lu stale discarded)",
+                 CAMERA_FRESH_TIMEOUT_MS, (unsigned long)discarded);
+        return NULL;
+    }
+    return fb;
+}
+
 void camera_free_fb(camera_fb_t *fb)
 {
     if (fb == NULL) return;
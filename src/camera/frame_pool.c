@@ -0,0 +1,363 @@
+/**
+ * Shared Frame Pool Implementation
+ *
+ * Frames are handed out by reference. The driver buffer is returned when
+ * the last reference drops, so consumers reading the same capture never
+ * compete for the driver's fb_count slots. Captures are serialized; callers
+ * that accept a recent frame wait for an in-flight capture instead of
+ * starting their own.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "camera.h"
+#include "frame_pool.h"
+#include "trace.h"
+
+static const char *TAG = "frame_pool";
+
+static frame_ref_t frames[FRAME_POOL_SIZE];
+static SemaphoreHandle_t pool_mutex = NULL;     // Guards refs and latest
+static SemaphoreHandle_t capture_mutex = NULL;  // Serializes captures
+static size_t dma_slot_count = 0;
+static frame_ref_t *latest = NULL;
+static uint32_t latest_seq = 0;
+static uint32_t next_seq = 1;
+static bool keep_latest = false;
+
+esp_err_t frame_pool_init(size_t dma_slots)
+{
+    if (pool_mutex == NULL) {
+        pool_mutex = xSemaphoreCreateMutex();
+        capture_mutex = xSemaphoreCreateMutex();
+        if (pool_mutex == NULL || capture_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create mutexes");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    dma_slot_count = dma_slots;
+    return ESP_OK;
+}
+
+/**
+ * Copy a frame's data to PSRAM
+ * @return Copy, or NULL if out of memory
+ */
+static uint8_t *frame_copy_data(const frame_ref_t *frame)
+{
+    TRACE_SPAN_BEGIN(copy_us);
+    uint8_t *buf = heap_caps_malloc(frame->fb.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buf == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for %d byte frame copy", frame->fb.len);
+        return NULL;
+    }
+    memcpy(buf, frame->fb.buf, frame->fb.len);
+    TRACE_SPAN_END(TRACE_COPY, trace_frame_id(&frame->fb), copy_us);
+    return buf;
+}
+
+/**
+ * Check for a retained, still DMA-backed latest frame (pool_mutex held)
+ * @param extra References held besides the pool's own
+ */
+static bool frame_retained_only_locked(const frame_ref_t *frame, uint32_t extra)
+{
+    return frame->refs == 1 + extra && keep_latest && frame == latest &&
+           frame->seq == latest_seq && frame->dma_fb != NULL;
+}
+
+/**
+ * Drop one reference (pool_mutex held)
+ * @return Frame to pass to frame_detach_retained once pool_mutex is given
+ *         back, NULL if there is nothing to detach
+ */
+static frame_ref_t *frame_release_locked(frame_ref_t *frame)
+{
+    if (frame->refs == 0) {
+        ESP_LOGE(TAG, "Release of free frame #%lu", (unsigned long)frame->seq);
+        return NULL;
+    }
+
+    frame->refs--;
+    if (frame->refs == 0) {
+        if (frame->dma_fb != NULL) {
+            camera_free_fb(frame->dma_fb);
+        } else {
+            heap_caps_free(frame->fb.buf);
+        }
+        frame->dma_fb = NULL;
+        frame->fb.buf = NULL;
+    } else if (frame_retained_only_locked(frame, 0)) {
+        // Only the pool's own reference is left; pin the frame for the copy
+        frame->refs++;
+        return frame;
+    }
+    return NULL;
+}
+
+/**
+ * Move a frame only the pool still references to PSRAM (pool_mutex not held)
+ * The copy runs unlocked under the pin taken by frame_release_locked. The
+ * buffer is swapped in only if no consumer picked the frame up meanwhile,
+ * since a consumer may be reading the DMA data; its release retries.
+ */
+static void frame_detach_retained(frame_ref_t *frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+
+    uint8_t *buf = frame_copy_data(frame);
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    if (frame_retained_only_locked(frame, 1)) {
+        // Without a copy the DMA slot stays held rather than lose the frame
+        if (buf != NULL) {
+            camera_free_fb(frame->dma_fb);
+            frame->dma_fb = NULL;
+            frame->fb.buf = buf;
+            buf = NULL;
+        }
+        frame->refs--;  // Drop the pin
+    } else {
+        frame_release_locked(frame);  // Not retained-only, so nothing to detach
+    }
+    xSemaphoreGive(pool_mutex);
+
+    heap_caps_free(buf);
+}
+
+/**
+ * Find an unused handle (pool_mutex held)
+ */
+static frame_ref_t *frame_alloc_locked(void)
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        if (frames[i].refs == 0) {
+            return &frames[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reference the latest frame if it is young enough (pool_mutex held)
+ */
+static frame_ref_t *frame_latest_locked(int64_t max_age_us)
+{
+    if (latest == NULL || latest->refs == 0 || latest->seq != latest_seq) {
+        return NULL;
+    }
+    if (max_age_us >= 0 && esp_timer_get_time() - latest->captured_us > max_age_us) {
+        return NULL;
+    }
+    latest->refs++;
+    return latest;
+}
+
+#define FRAME_ANY_AGE (-1)  // frame_capture_locked: accept queued frames
+
+/**
+ * Capture into a new handle (capture_mutex held)
+ * @param not_before_us Earliest accepted frame start, FRAME_ANY_AGE for any
+ * @param info Freshness details for fresh captures (may be NULL)
+ */
+static frame_ref_t *frame_capture_locked(int64_t not_before_us, camera_capture_info_t *info)
+{
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    size_t dma_held = 0;
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        if (frames[i].refs > 0 && frames[i].dma_fb != NULL) {
+            dma_held++;
+        }
+    }
+    xSemaphoreGive(pool_mutex);
+
+    if (dma_slot_count > 0 && dma_held >= dma_slot_count) {
+        ESP_LOGW(TAG, "All %d driver buffers held by consumers, capture will wait",
+                 dma_slot_count);
+    }
+
+    camera_fb_t *fb = not_before_us == FRAME_ANY_AGE ? camera_capture()
+                                                     : camera_capture_fresh(not_before_us, info);
+    if (fb == NULL) {
+        return NULL;
+    }
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame_ref_t *frame = frame_alloc_locked();
+    if (frame == NULL) {
+        xSemaphoreGive(pool_mutex);
+        ESP_LOGE(TAG, "No free frame handles");
+        camera_free_fb(fb);
+        return NULL;
+    }
+
+    frame->fb = *fb;
+    frame->dma_fb = fb;
+    frame->refs = 1;
+    frame->seq = next_seq++;
+    frame->captured_us = esp_timer_get_time();
+
+    frame_ref_t *previous = (latest != NULL && latest->seq == latest_seq) ? latest : NULL;
+    latest = frame;
+    latest_seq = frame->seq;
+    frame_ref_t *detach = NULL;
+    if (keep_latest) {
+        frame->refs++;
+        if (previous != NULL && previous->refs > 0) {
+            detach = frame_release_locked(previous);
+        }
+    }
+    xSemaphoreGive(pool_mutex);
+    frame_detach_retained(detach);
+
+    return frame;
+}
+
+frame_ref_t *frame_pool_capture(void)
+{
+    if (pool_mutex == NULL) {
+        ESP_LOGE(TAG, "Frame pool not initialized");
+        return NULL;
+    }
+
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    frame_ref_t *frame = frame_capture_locked(FRAME_ANY_AGE, NULL);
+    xSemaphoreGive(capture_mutex);
+    return frame;
+}
+
+frame_ref_t *frame_pool_capture_fresh(int64_t not_before_us, camera_capture_info_t *info)
+{
+    if (pool_mutex == NULL) {
+        ESP_LOGE(TAG, "Frame pool not initialized");
+        return NULL;
+    }
+
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    frame_ref_t *frame = frame_capture_locked(not_before_us, info);
+    xSemaphoreGive(capture_mutex);
+    return frame;
+}
+
+frame_ref_t *frame_pool_get(uint32_t max_age_ms)
+{
+    if (pool_mutex == NULL) {
+        ESP_LOGE(TAG, "Frame pool not initialized");
+        return NULL;
+    }
+    if (max_age_ms == 0) {
+        return frame_pool_capture();
+    }
+
+    int64_t max_age_us = (int64_t)max_age_ms * 1000;
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame_ref_t *frame = frame_latest_locked(max_age_us);
+    xSemaphoreGive(pool_mutex);
+    if (frame != NULL) {
+        return frame;
+    }
+
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    // Another caller may have captured while we waited
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame = frame_latest_locked(max_age_us);
+    xSemaphoreGive(pool_mutex);
+    if (frame == NULL) {
+        frame = frame_capture_locked(FRAME_ANY_AGE, NULL);
+    }
+    xSemaphoreGive(capture_mutex);
+    return frame;
+}
+
+frame_ref_t *frame_pool_latest(void)
+{
+    if (pool_mutex == NULL) return NULL;
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame_ref_t *frame = frame_latest_locked(-1);
+    xSemaphoreGive(pool_mutex);
+    return frame;
+}
+
+void frame_pool_keep_latest(bool keep)
+{
+    if (pool_mutex == NULL) return;
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    if (keep != keep_latest) {
+        bool alive = latest != NULL && latest->refs > 0 && latest->seq == latest_seq;
+        if (keep && alive) {
+            latest->refs++;
+            keep_latest = true;
+        } else if (!keep && alive) {
+            keep_latest = false;
+            frame_release_locked(latest);
+        } else {
+            keep_latest = keep;
+        }
+    }
+    xSemaphoreGive(pool_mutex);
+}
+
+frame_ref_t *frame_ref_acquire(frame_ref_t *frame)
+{
+    if (frame == NULL) return NULL;
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame->refs++;
+    xSemaphoreGive(pool_mutex);
+    return frame;
+}
+
+void frame_ref_release(frame_ref_t *frame)
+{
+    if (frame == NULL) return;
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame_ref_t *detach = frame_release_locked(frame);
+    xSemaphoreGive(pool_mutex);
+    frame_detach_retained(detach);
+}
+
+frame_ref_t *frame_ref_detach(frame_ref_t *frame)
+{
+    if (frame == NULL) return NULL;
+    if (frame->dma_fb == NULL) {
+        return frame;  // Already a private copy or detached by the pool
+    }
+
+    // Our reference keeps the DMA data valid while copying
+    uint8_t *buf = frame_copy_data(frame);
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    frame_ref_t *copy = buf ? frame_alloc_locked() : NULL;
+    if (copy != NULL) {
+        copy->fb = frame->fb;
+        copy->fb.buf = buf;
+        copy->dma_fb = NULL;
+        copy->refs = 1;
+        copy->seq = frame->seq;
+        copy->captured_us = frame->captured_us;
+    }
+    frame_ref_t *detach = frame_release_locked(frame);
+    xSemaphoreGive(pool_mutex);
+    frame_detach_retained(detach);
+
+    if (copy == NULL) {
+        heap_caps_free(buf);
+        ESP_LOGE(TAG, "Failed to detach frame #%lu", (unsigned long)frame->seq);
+    }
+    return copy;
+}
+
+uint32_t frame_ref_age_ms(const frame_ref_t *frame)
+{
+    return (uint32_t)((esp_timer_get_time() - frame->captured_us) / 1000);
+}
@@ -0,0 +1,282 @@
+/**
+ * Preview Pipeline Implementation
+ *
+ * Previews are derived from the most recent frame in the frame pool: the
+ * 4:3 center of the JPEG (narrowed by the digital zoom) is decoded as a crop
+ * at the largest tjpgd scale that still covers the preview size, resampled
+ * and re-encoded. The result is cached for the TTL so bursts of /preview
+ * requests cost one encode, and the sensor framesize is never changed.
+ * The pool retains its latest frame only while previews are being
+ * requested, so timelapse-only runs do not copy every frame to PSRAM.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "jpeg_decoder.h"
+#include "img_converters.h"
+#include "frame_pool.h"
+#include "metrics.h"
+#include "preview.h"
+#include "trace.h"
+
+static const char *TAG = "preview";
+
+static SemaphoreHandle_t preview_mutex = NULL;
+static TimerHandle_t retain_timer = NULL;
+static uint32_t preview_ttl_ms = PREVIEW_DEFAULT_TTL_MS;
+static uint8_t *cached_jpeg = NULL;
+static size_t cached_len = 0;
+static int64_t cached_us = 0;
+static uint32_t cached_seq = 0;
+static uint8_t cached_zoom = 1;
+static bool optimize_huffman = PREVIEW_OPTIMIZE_HUFFMAN;
+static size_t max_bytes = PREVIEW_MAX_BYTES;
+
+/**
+ * No preview for PREVIEW_RETAIN_IDLE_MS: stop retaining frames
+ * A preview racing with this re-enables retention on its next call.
+ */
+static void retain_timer_callback(TimerHandle_t timer)
+{
+    frame_pool_keep_latest(false);
+    ESP_LOGD(TAG, "Preview idle, frame retention off");
+}
+
+esp_err_t preview_init(void)
+{
+    if (preview_mutex == NULL) {
+        preview_mutex = xSemaphoreCreateMutex();
+        if (preview_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (retain_timer == NULL) {
+        retain_timer = xTimerCreate("preview_retain", pdMS_TO_TICKS(PREVIEW_RETAIN_IDLE_MS),
+                                    pdFALSE, NULL, retain_timer_callback);
+        if (retain_timer == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+void preview_set_ttl(uint32_t ttl_ms)
+{
+    preview_ttl_ms = ttl_ms;
+}
+
+/**
+ * Forget the cached preview so the next request encodes with new options
+ */
+static void preview_drop_cache(void)
+{
+    if (preview_mutex != NULL) {
+        xSemaphoreTake(preview_mutex, portMAX_DELAY);
+    }
+    free(cached_jpeg);
+    cached_jpeg = NULL;
+    cached_len = 0;
+    if (preview_mutex != NULL) {
+        xSemaphoreGive(preview_mutex);
+    }
+}
+
+void preview_set_optimize_huffman(bool enable)
+{
+    optimize_huffman = enable;
+    preview_drop_cache();
+}
+
+void preview_set_max_bytes(size_t bytes)
+{
+    max_bytes = bytes;
+    preview_drop_cache();
+}
+
+/**
+ * Pick the strongest decode scale that still covers the preview size
+ */
+static esp_jpeg_image_scale_t preview_pick_scale(uint16_t width, uint16_t height)
+{
+    static const esp_jpeg_image_scale_t scales[] = {
+        JPEG_IMAGE_SCALE_1_8, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_2
+    };
+    static const int divs[] = {8, 4, 2};
+
+    for (int i = 0; i < 3; i++) {
+        if (width / divs[i] >= PREVIEW_WIDTH && height / divs[i] >= PREVIEW_HEIGHT) {
+            return scales[i];
+        }
+    }
+    return JPEG_IMAGE_SCALE_0;
+}
+
+/**
+ * Nearest-neighbour resample of a 4:3 center crop, RGB888 in, BGR888 out
+ * (fmt2jpg's RGB888 input order)
+ */
+static void preview_resample(const uint8_t *src, uint16_t sw, uint16_t sh, uint8_t *dst)
+{
+    uint32_t cw = sw, ch = sh;
+    if (cw * 3 > ch * 4) {
+        cw = ch * 4 / 3;
+    } else {
+        ch = cw * 3 / 4;
+    }
+    uint32_t x0 = (sw - cw) / 2;
+    uint32_t y0 = (sh - ch) / 2;
+
+    // 16.16 fixed-point steps
+    uint32_t step_x = (cw << 16) / PREVIEW_WIDTH;
+    uint32_t step_y = (ch << 16) / PREVIEW_HEIGHT;
+
+    uint32_t fy = 0;
+    for (int y = 0; y < PREVIEW_HEIGHT; y++, fy += step_y) {
+        const uint8_t *row = src + ((y0 + (fy >> 16)) * sw + x0) * 3;
+        uint32_t fx = 0;
+        for (int x = 0; x < PREVIEW_WIDTH; x++, fx += step_x) {
+            const uint8_t *p = row + (fx >> 16) * 3;
+            *dst++ = p[2];
+            *dst++ = p[1];
+            *dst++ = p[0];
+        }
+    }
+}
+
+/**
+ * Decode, resample and encode one frame (preview_mutex held)
+ */
+static esp_err_t preview_build(const camera_fb_t *fb, uint8_t zoom, uint8_t **out, size_t *out_len)
+{
+    if (fb->format != PIXFORMAT_JPEG) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = fb->buf,
+        .indata_size = fb->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    esp_jpeg_image_output_t info;
+    esp_err_t ret = esp_jpeg_get_image_info(&jpeg_cfg, &info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // 4:3 center of the frame, 1/zoom of it in each direction
+    uint32_t cw = info.width, ch = info.height;
+    if (cw * 3 > ch * 4) {
+        cw = ch * 4 / 3;
+    } else {
+        ch = cw * 3 / 4;
+    }
+    cw /= zoom;
+    ch /= zoom;
+
+    // MCUs outside the crop are not transformed, and rows below it are not decoded
+    jpeg_cfg.out_scale = preview_pick_scale(cw, ch);
+    int div = 1 << jpeg_cfg.out_scale;
+    jpeg_cfg.crop.width = cw / div > 0 ? cw / div : 1;
+    jpeg_cfg.crop.height = ch / div > 0 ? ch / div : 1;
+    jpeg_cfg.crop.left = (info.width / div - jpeg_cfg.crop.width) / 2;
+    jpeg_cfg.crop.top = (info.height / div - jpeg_cfg.crop.height) / 2;
+    size_t decoded_size = jpeg_cfg.crop.width * jpeg_cfg.crop.height * 3;
+    uint8_t *decoded = heap_caps_malloc(decoded_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t *resampled = heap_caps_malloc(PREVIEW_WIDTH * PREVIEW_HEIGHT * 3,
+                                          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (decoded == NULL || resampled == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate preview buffers");
+        heap_caps_free(decoded);
+        heap_caps_free(resampled);
+        return ESP_ERR_NO_MEM;
+    }
+
+    jpeg_cfg.outbuf = decoded;
+    jpeg_cfg.outbuf_size = decoded_size;
+    ret = esp_jpeg_decode(&jpeg_cfg, &info);
+    if (ret == ESP_OK) {
+        preview_resample(decoded, info.width, info.height, resampled);
+        jpg_encode_config_t enc_cfg = JPG_ENCODE_CONFIG_DEFAULT();
+        enc_cfg.quality = PREVIEW_QUALITY;
+        enc_cfg.optimize_huffman = optimize_huffman;
+        enc_cfg.target_size = max_bytes;
+        if (!fmt2jpg_config(resampled, PREVIEW_WIDTH * PREVIEW_HEIGHT * 3, PREVIEW_WIDTH, PREVIEW_HEIGHT,
+                            PIXFORMAT_RGB888, &enc_cfg, out, out_len)) {
+            ESP_LOGE(TAG, "Preview encode failed");
+            ret = ESP_FAIL;
+        }
+    }
+
+    heap_caps_free(decoded);
+    heap_caps_free(resampled);
+    return ret;
+}
+
+esp_err_t preview_get_jpeg(uint8_t zoom, uint8_t **out, size_t *out_len)
+{
+    if (out == NULL || out_len == NULL) return ESP_ERR_INVALID_ARG;
+    if (zoom < 1 || zoom > PREVIEW_MAX_ZOOM) return ESP_ERR_INVALID_ARG;
+    if (preview_mutex == NULL) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(preview_mutex, portMAX_DELAY);
+
+    // Retain the latest frame while previews keep coming; the timer is
+    // restarted by every call and turns retention off once they stop
+    frame_pool_keep_latest(true);
+    xTimerStart(retain_timer, 0);
+
+    esp_err_t ret = ESP_OK;
+    bool fresh = cached_jpeg != NULL && cached_zoom == zoom &&
+                 esp_timer_get_time() - cached_us <= (int64_t)preview_ttl_ms * 1000;
+    if (!fresh) {
+        frame_ref_t *frame = frame_pool_get(preview_ttl_ms);
+        if (frame == NULL) {
+            ret = ESP_FAIL;
+        } else if (cached_jpeg != NULL && frame->seq == cached_seq && cached_zoom == zoom) {
+            // Source unchanged since the last preview, just extend its life
+            cached_us = esp_timer_get_time();
+        } else {
+            uint8_t *jpeg = NULL;
+            size_t len = 0;
+            int64_t start_us = esp_timer_get_time();
+            TRACE_SPAN_BEGIN(encode_us);
+            ret = preview_build(&frame->fb, zoom, &jpeg, &len);
+            TRACE_SPAN_END(TRACE_ENCODE, trace_frame_id(&frame->fb), encode_us);
+            metrics_record(METRICS_STAGE_ENCODE, (uint32_t)(esp_timer_get_time() - start_us),
+                           len, ret != ESP_OK);
+            if (ret == ESP_OK) {
+                free(cached_jpeg);
+                cached_jpeg = jpeg;
+                cached_len = len;
+                cached_us = esp_timer_get_time();
+                cached_seq = frame->seq;
+                cached_zoom = zoom;
+                ESP_LOGD(TAG, "Preview from frame #%lu (%dx%d, %lu ms old, zoom %d), %d bytes",
+                         (unsigned long)frame->seq, frame->fb.width, frame->fb.height,
+                         (unsigned long)frame_ref_age_ms(frame), zoom, len);
+            }
+        }
+        frame_ref_release(frame);
+    }
+
+    if (ret == ESP_OK) {
+        *out = malloc(cached_len);
+        if (*out == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(*out, cached_jpeg, cached_len);
+            *out_len = cached_len;
+        }
+    }
+
+    xSemaphoreGive(preview_mutex);
+    return ret;
+}
@@ -0,0 +1,422 @@
+/**
+ * MJPEG AVI Export
+ * Wraps a session's stored JPEG frames into a RIFF AVI without re-encoding.
+ *
+ * The container is produced in two passes over the session directory; the
+ * only per-frame state is the frame's size (4 bytes, PSRAM when available):
+ *   1. scan  - record frame sizes, total size, largest frame, first frame name
+ *   2. movi  - header (all sizes now known) followed by the frame chunks;
+ *              every frame must still have its scanned size
+ * The idx1 index is then written from the recorded sizes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "sdcard.h"
+#include "export.h"
+
+static const char *TAG = "avi";
+
+#define AVI_HEADER_SIZE      224     // RIFF + hdrl LIST + movi LIST header
+#define AVI_HDRL_SIZE        192     // hdrl LIST payload
+#define AVI_STRL_SIZE        116     // strl LIST payload
+#define AVIF_HASINDEX        0x00000010
+#define AVIIF_KEYFRAME       0x00000010
+#define AVI_SIZES_INITIAL    256     // Size table entries before the first growth
+
+typedef enum {
+    AVI_PASS_SCAN,
+    AVI_PASS_MOVI
+} avi_pass_t;
+
+typedef struct {
+    avi_pass_t pass;
+    const char *session;
+    export_writer_t *w;
+    uint32_t limit;         // Frames found by the scan pass
+    uint32_t count;         // Frames visited in the current pass
+    uint32_t *sizes;        // Frame sizes recorded by the scan pass
+    uint32_t sizes_cap;     // Entries allocated in sizes
+    uint64_t movi_bytes;    // Sum of padded frame chunks
+    uint64_t movi_written;  // Chunk bytes written by the movi pass
+    uint32_t max_frame;     // Largest frame (dwSuggestedBufferSize)
+    char first[64];         // First frame, used for dimensions
+    esp_err_t err;
+} avi_ctx_t;
+
+static uint8_t *put_fourcc(uint8_t *p, const char *cc)
+{
+    memcpy(p, cc, 4);
+    return p + 4;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+    return p + 4;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    return p + 2;
+}
+
+/**
+ * Read frame dimensions from the SOFn segment of a stored JPEG
+ * Uses buf as scratch (must be at least EXPORT_BUF_SIZE bytes).
+ */
+static esp_err_t avi_read_dimensions(const char *name, uint8_t *buf,
+                                     uint16_t *width, uint16_t *height)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", EXPORT_SESSION_DIR, name);
+
+    FILE *f = sdcard_fopen(path, "rb");
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    size_t len = fread(buf, 1, EXPORT_BUF_SIZE, f);
+    fclose(f);
+
+    if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        ESP_LOGE(TAG, "Not a JPEG: %s", name);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    size_t i = 2;
+    while (i + 9 < len) {
+        if (buf[i] != 0xFF) {
+            break;
+        }
+        uint8_t marker = buf[i + 1];
+        uint16_t seg_len = (buf[i + 2] << 8) | buf[i + 3];
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            *height = (buf[i + 5] << 8) | buf[i + 6];
+            *width = (buf[i + 7] << 8) | buf[i + 8];
+            return ESP_OK;
+        }
+        if (marker == 0xDA) {
+            break;  // Start of scan without a frame header
+        }
+        i += 2 + seg_len;
+    }
+
+    ESP_LOGE(TAG, "No SOF marker in first %d bytes of %s", len, name);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * Append a frame size to the scan table, growing it as needed
+ */
+static esp_err_t avi_record_size(avi_ctx_t *ctx, uint32_t len)
+{
+    if (ctx->count == ctx->sizes_cap) {
+        uint32_t cap = ctx->sizes_cap ? ctx->sizes_cap * 2 : AVI_SIZES_INITIAL;
+        uint32_t *sizes = heap_caps_realloc(ctx->sizes, cap * sizeof(uint32_t),
+                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (sizes == NULL) {
+            sizes = realloc(ctx->sizes, cap * sizeof(uint32_t));
+        }
+        if (sizes == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate size table for %lu frames", (unsigned long)cap);
+            return ESP_ERR_NO_MEM;
+        }
+        ctx->sizes = sizes;
+        ctx->sizes_cap = cap;
+    }
+    ctx->sizes[ctx->count] = len;
+    return ESP_OK;
+}
+
+/**
+ * Per-frame callback for both passes
+ */
+static bool avi_frame_cb(const char *name, bool is_dir, void *arg)
+{
+    avi_ctx_t *ctx = (avi_ctx_t *)arg;
+
+    if (is_dir || !export_is_session_frame(name, ctx->session)) {
+        return true;
+    }
+    // Frames written after the scan are not part of this export
+    if (ctx->pass != AVI_PASS_SCAN && ctx->count >= ctx->limit) {
+        return false;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", EXPORT_SESSION_DIR, name);
+    int64_t size = sdcard_get_file_size(path);
+    if (size <= 0) {
+        return true;  // Failed or in-progress write, skipped in every pass
+    }
+    uint32_t len = (uint32_t)size;
+    uint32_t padded = len + (len & 1);
+
+    switch (ctx->pass) {
+        case AVI_PASS_SCAN:
+            ctx->err = avi_record_size(ctx, len);
+            if (ctx->err != ESP_OK) {
+                return false;
+            }
+            if (ctx->count == 0) {
+                strlcpy(ctx->first, name, sizeof(ctx->first));
+            }
+            ctx->movi_bytes += 8 + padded;
+            if (len > ctx->max_frame) {
+                ctx->max_frame = len;
+            }
+            break;
+
+        case AVI_PASS_MOVI: {
+            // Header sizes and the index were fixed by the scan pass
+            if (len != ctx->sizes[ctx->count] ||
+                ctx->movi_written + 8 + padded > ctx->movi_bytes) {
+                ESP_LOGE(TAG, "%s changed size during export (%lu, scanned %lu)", name,
+                         (unsigned long)len, (unsigned long)ctx->sizes[ctx->count]);
+                ctx->err = ESP_ERR_INVALID_STATE;
+                return false;
+            }
+            ctx->movi_written += 8 + padded;
+
+            uint8_t hdr[8];
+            put_u32(put_fourcc(hdr, "00dc"), len);
+            export_writer_put(ctx->w, hdr, sizeof(hdr));
+
+            FILE *f = sdcard_fopen(path, "rb");
+            if (f == NULL) {
+                ctx->err = ESP_FAIL;
+                return false;
+            }
+            export_writer_put_file(ctx->w, f, len, NULL);
+            fclose(f);
+
+            if (len & 1) {
+                uint8_t pad = 0;
+                export_writer_put(ctx->w, &pad, 1);
+            }
+            if (ctx->w->err != ESP_OK) {
+                ctx->err = ctx->w->err;
+                return false;
+            }
+            break;
+        }
+    }
+
+    ctx->count++;
+    return true;
+}
+
+/**
+ * Write the idx1 chunk from the recorded frame sizes
+ */
+static esp_err_t avi_write_index(const avi_ctx_t *ctx)
+{
+    uint8_t idx_hdr[8];
+    put_u32(put_fourcc(idx_hdr, "idx1"), 16 * ctx->limit);
+    export_writer_put(ctx->w, idx_hdr, sizeof(idx_hdr));
+
+    uint32_t offset = 4;    // Relative to the 'movi' fourcc
+    for (uint32_t i = 0; i < ctx->limit && ctx->w->err == ESP_OK; i++) {
+        uint8_t entry[16];
+        uint8_t *p = put_fourcc(entry, "00dc");
+        p = put_u32(p, AVIIF_KEYFRAME);
+        p = put_u32(p, offset);
+        put_u32(p, ctx->sizes[i]);
+        offset += 8 + ctx->sizes[i] + (ctx->sizes[i] & 1);
+        export_writer_put(ctx->w, entry, sizeof(entry));
+    }
+    return ctx->w->err;
+}
+
+/**
+ * Build RIFF/hdrl/movi headers
+ */
+static void avi_build_header(uint8_t *hdr, const avi_ctx_t *ctx, uint32_t fps,
+                             uint16_t width, uint16_t height)
+{
+    uint32_t frames = ctx->limit;
+    uint32_t movi_size = 4 + (uint32_t)ctx->movi_bytes;
+    uint32_t riff_size = 4 + (8 + AVI_HDRL_SIZE) + (8 + movi_size) + (8 + 16 * frames);
+    uint8_t *p = hdr;
+
+    p = put_fourcc(p, "RIFF");
+    p = put_u32(p, riff_size);
+    p = put_fourcc(p, "AVI ");
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, AVI_HDRL_SIZE);
+    p = put_fourcc(p, "hdrl");
+
+    // MainAVIHeader
+    p = put_fourcc(p, "avih");
+    p = put_u32(p, 56);
+    p = put_u32(p, 1000000 / fps);              // dwMicroSecPerFrame
+    p = put_u32(p, ctx->max_frame * fps);       // dwMaxBytesPerSec
+    p = put_u32(p, 0);                          // dwPaddingGranularity
+    p = put_u32(p, AVIF_HASINDEX);              // dwFlags
+    p = put_u32(p, frames);                     // dwTotalFrames
+    p = put_u32(p, 0);                          // dwInitialFrames
+    p = put_u32(p, 1);                          // dwStreams
+    p = put_u32(p, ctx->max_frame);             // dwSuggestedBufferSize
+    p = put_u32(p, width);
+    p = put_u32(p, height);
+    memset(p, 0, 16);                           // dwReserved[4]
+    p += 16;
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, AVI_STRL_SIZE);
+    p = put_fourcc(p, "strl");
+
+    // AVIStreamHeader
+    p = put_fourcc(p, "strh");
+    p = put_u32(p, 56);
+    p = put_fourcc(p, "vids");
+    p = put_fourcc(p, "MJPG");
+    p = put_u32(p, 0);                          // dwFlags
+    p = put_u16(p, 0);                          // wPriority
+    p = put_u16(p, 0);                          // wLanguage
+    p = put_u32(p, 0);                          // dwInitialFrames
+    p = put_u32(p, 1);                          // dwScale
+    p = put_u32(p, fps);                        // dwRate
+    p = put_u32(p, 0);                          // dwStart
+    p = put_u32(p, frames);                     // dwLength
+    p = put_u32(p, ctx->max_frame);             // dwSuggestedBufferSize
+    p = put_u32(p, 0xFFFFFFFF);                 // dwQuality (default)
+    p = put_u32(p, 0);                          // dwSampleSize
+    p = put_u16(p, 0);                          // rcFrame
+    p = put_u16(p, 0);
+    p = put_u16(p, width);
+    p = put_u16(p, height);
+
+    // BITMAPINFOHEADER
+    p = put_fourcc(p, "strf");
+    p = put_u32(p, 40);
+    p = put_u32(p, 40);                         // biSize
+    p = put_u32(p, width);
+    p = put_u32(p, height);
+    p = put_u16(p, 1);                          // biPlanes
+    p = put_u16(p, 24);                         // biBitCount
+    p = put_fourcc(p, "MJPG");                  // biCompression
+    p = put_u32(p, (uint32_t)width * height * 3);
+    memset(p, 0, 16);                           // resolution / palette
+    p += 16;
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, movi_size);
+    put_fourcc(p, "movi");
+}
+
+esp_err_t avi_export_stream(const char *session, uint32_t fps, const export_sink_t *sink)
+{
+    if (sink == NULL || sink->write == NULL) return ESP_ERR_INVALID_ARG;
+    if (!sdcard_is_ready()) return ESP_ERR_INVALID_STATE;
+    if (fps == 0 || fps > 120) fps = 30;
+
+    avi_ctx_t ctx = {
+        .pass = AVI_PASS_SCAN,
+        .session = session,
+    };
+
+    esp_err_t ret = sdcard_foreach_file(EXPORT_SESSION_DIR, avi_frame_cb, &ctx);
+    if (ret == ESP_OK) ret = ctx.err;
+    if (ret != ESP_OK) {
+        free(ctx.sizes);
+        return ret;
+    }
+    if (ctx.count == 0) {
+        ESP_LOGW(TAG, "No frames for session '%s'", session ? session : "");
+        return ESP_ERR_NOT_FOUND;
+    }
+    ctx.limit = ctx.count;
+
+    uint64_t riff_size = 4 + (8 + AVI_HDRL_SIZE) + (8 + 4 + ctx.movi_bytes) + (8 + 16ULL * ctx.limit);
+    if (riff_size > UINT32_MAX) {
+        ESP_LOGE(TAG, "Session too large for AVI 1.0 (%llu bytes)", riff_size);
+        free(ctx.sizes);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    export_writer_t w;
+    ret = export_writer_init(&w, sink);
+    if (ret != ESP_OK) {
+        free(ctx.sizes);
+        return ret;
+    }
+    ctx.w = &w;
+
+    uint16_t width = 0, height = 0;
+    ret = avi_read_dimensions(ctx.first, w.buf, &width, &height);
+    if (ret != ESP_OK) {
+        export_writer_finish(&w);
+        free(ctx.sizes);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Exporting %lu frames (%dx%d @ %lu fps, %llu bytes)",
+             (unsigned long)ctx.limit, width, height, (unsigned long)fps, riff_size + 8);
+
+    uint8_t hdr[AVI_HEADER_SIZE];
+    avi_build_header(hdr, &ctx, fps, width, height);
+    export_writer_put(&w, hdr, sizeof(hdr));
+
+    // movi chunks
+    ctx.pass = AVI_PASS_MOVI;
+    ctx.count = 0;
+    ctx.movi_written = 0;
+    ret = sdcard_foreach_file(EXPORT_SESSION_DIR, avi_frame_cb, &ctx);
+
+    if (ret == ESP_OK) ret = ctx.err;
+    if (ret == ESP_OK && (ctx.count != ctx.limit || ctx.movi_written != ctx.movi_bytes)) {
+        ESP_LOGE(TAG, "Session changed during export (%lu of %lu frames, %llu of %llu bytes)",
+                 (unsigned long)ctx.count, (unsigned long)ctx.limit,
+                 ctx.movi_written, ctx.movi_bytes);
+        ret = ESP_ERR_INVALID_STATE;
+    }
+
+    // idx1
+    if (ret == ESP_OK) {
+        ret = avi_write_index(&ctx);
+    }
+
+    esp_err_t flush_ret = export_writer_finish(&w);
+    if (ret == ESP_OK) ret = flush_ret;
+    free(ctx.sizes);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "AVI export complete (%llu bytes)", w.total);
+    }
+    return ret;
+}
+
+esp_err_t avi_export_to_file(const char *session, uint32_t fps, const char *path)
+{
+    sdcard_mkdir(EXPORT_OUTPUT_DIR);
+
+    FILE *f = sdcard_fopen(path, "wb");
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+
+    export_sink_t sink = {
+        .write = export_file_sink_write,
+        .ctx = f,
+    };
+    esp_err_t ret = avi_export_stream(session, fps, &sink);
+
+    if (fclose(f) != 0 && ret == ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        sdcard_delete_file(path);
+    }
+    return ret;
+}
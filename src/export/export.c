@@ -0,0 +1,110 @@
+/**
+ * Session Export - Common Helpers
+ * Buffered output writer and sinks shared by the container exporters
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_rom_crc.h"
+#include "export.h"
+
+static const char *TAG = "export";
+
+esp_err_t export_writer_init(export_writer_t *w, const export_sink_t *sink)
+{
+    memset(w, 0, sizeof(*w));
+    w->sink = sink;
+    w->buf = malloc(EXPORT_BUF_SIZE);
+    if (w->buf == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d byte staging buffer", EXPORT_BUF_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t writer_flush(export_writer_t *w)
+{
+    if (w->err == ESP_OK && w->used > 0) {
+        w->err = w->sink->write(w->sink->ctx, w->buf, w->used);
+    }
+    w->used = 0;
+    return w->err;
+}
+
+esp_err_t export_writer_put(export_writer_t *w, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len > 0 && w->err == ESP_OK) {
+        size_t n = EXPORT_BUF_SIZE - w->used;
+        if (n > len) n = len;
+        memcpy(w->buf + w->used, p, n);
+        w->used += n;
+        w->total += n;
+        p += n;
+        len -= n;
+        if (w->used == EXPORT_BUF_SIZE) {
+            writer_flush(w);
+        }
+    }
+    return w->err;
+}
+
+esp_err_t export_writer_put_file(export_writer_t *w, FILE *f, size_t len, uint32_t *crc)
+{
+    // Read straight into the staging buffer so no second copy is needed
+    while (len > 0 && w->err == ESP_OK) {
+        size_t n = EXPORT_BUF_SIZE - w->used;
+        if (n > len) n = len;
+        size_t got = fread(w->buf + w->used, 1, n, f);
+        if (got != n) {
+            ESP_LOGE(TAG, "Short read (%d of %d bytes)", got, n);
+            w->err = ESP_FAIL;
+            break;
+        }
+        if (crc != NULL) {
+            *crc = esp_rom_crc32_le(*crc, w->buf + w->used, n);
+        }
+        w->used += n;
+        w->total += n;
+        len -= n;
+        if (w->used == EXPORT_BUF_SIZE) {
+            writer_flush(w);
+        }
+    }
+    return w->err;
+}
+
+esp_err_t export_writer_finish(export_writer_t *w)
+{
+    esp_err_t ret = writer_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+    return ret;
+}
+
+esp_err_t export_file_sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    FILE *f = (FILE *)ctx;
+    if (fwrite(data, 1, len, f) != len) {
+        ESP_LOGE(TAG, "Failed to write %d bytes to export file", len);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool export_is_session_frame(const char *name, const char *session)
+{
+    size_t len = strlen(name);
+    if (len < 4 || strcasecmp(name + len - 4, ".jpg") != 0) {
+        return false;
+    }
+    if (session == NULL || session[0] == '\0') {
+        return true;
+    }
+    return strncmp(name, session, strlen(session)) == 0;
+}
@@ -0,0 +1,304 @@
+/**
+ * Streaming ZIP Export
+ * Produces a store-only ZIP of a session's frames over any export sink.
+ *
+ * Local headers carry the sizes (known from the directory entry) and a zero
+ * CRC; the CRC is computed while the data streams through and written in a
+ * data descriptor. The central directory is rebuilt by a second pass over
+ * the directory, so the only per-file state is the CRC table.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "sdcard.h"
+#include "export.h"
+
+static const char *TAG = "zip";
+
+#define ZIP_LOCAL_SIG        0x04034b50
+#define ZIP_DESCRIPTOR_SIG   0x08074b50
+#define ZIP_CENTRAL_SIG      0x02014b50
+#define ZIP_EOCD_SIG         0x06054b50
+#define ZIP64_EOCD_SIG       0x06064b50
+#define ZIP64_LOCATOR_SIG    0x07064b50
+
+#define ZIP_FLAG_DESCRIPTOR  0x0008      // CRC follows the data
+#define ZIP_VERSION          20          // 2.0: stored, data descriptors
+#define ZIP64_VERSION        45          // 4.5: ZIP64 extensions
+
+#define ZIP_LOCAL_SIZE       30
+#define ZIP_DESCRIPTOR_SIZE  16
+#define ZIP_CENTRAL_SIZE     46
+
+typedef enum {
+    ZIP_PASS_SCAN,
+    ZIP_PASS_DATA,
+    ZIP_PASS_CENTRAL
+} zip_pass_t;
+
+typedef struct {
+    zip_pass_t pass;
+    const char *session;
+    export_writer_t *w;
+    uint32_t *crcs;         // One CRC per entry, filled by the data pass
+    uint32_t limit;         // Entries found by the scan pass
+    uint32_t count;         // Entries visited in the current pass
+    uint64_t offset;        // Local header offset (central pass)
+    uint16_t dos_time;
+    uint16_t dos_date;
+    esp_err_t err;
+} zip_ctx_t;
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, v & 0xFFFF);
+    return put_u16(p, v >> 16);
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t v)
+{
+    p = put_u32(p, (uint32_t)v);
+    return put_u32(p, (uint32_t)(v >> 32));
+}
+
+/**
+ * Per-file callback for all three passes
+ */
+static bool zip_file_cb(const char *name, bool is_dir, void *arg)
+{
+    zip_ctx_t *ctx = (zip_ctx_t *)arg;
+
+    if (is_dir || !export_is_session_frame(name, ctx->session)) {
+        return true;
+    }
+    // Files written after the scan are not part of this archive
+    if (ctx->pass != ZIP_PASS_SCAN && ctx->count >= ctx->limit) {
+        return false;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", EXPORT_SESSION_DIR, name);
+    int64_t size = sdcard_get_file_size(path);
+    if (size <= 0) {
+        return true;  // Failed or in-progress write, skipped in every pass
+    }
+    uint32_t len = (uint32_t)size;
+    uint16_t name_len = strlen(name);
+
+    if (ctx->pass == ZIP_PASS_SCAN) {
+        ctx->count++;
+        return true;
+    }
+
+    if (ctx->pass == ZIP_PASS_DATA) {
+        uint8_t hdr[ZIP_LOCAL_SIZE];
+        uint8_t *p = put_u32(hdr, ZIP_LOCAL_SIG);
+        p = put_u16(p, ZIP_VERSION);
+        p = put_u16(p, ZIP_FLAG_DESCRIPTOR);
+        p = put_u16(p, 0);                      // Stored
+        p = put_u16(p, ctx->dos_time);
+        p = put_u16(p, ctx->dos_date);
+        p = put_u32(p, 0);                      // CRC in descriptor
+        p = put_u32(p, len);                    // Compressed size
+        p = put_u32(p, len);                    // Uncompressed size
+        p = put_u16(p, name_len);
+        put_u16(p, 0);                          // Extra length
+        export_writer_put(ctx->w, hdr, sizeof(hdr));
+        export_writer_put(ctx->w, name, name_len);
+
+        FILE *f = sdcard_fopen(path, "rb");
+        if (f == NULL) {
+            ctx->err = ESP_FAIL;
+            return false;
+        }
+        uint32_t crc = 0;
+        export_writer_put_file(ctx->w, f, len, &crc);
+        fclose(f);
+        ctx->crcs[ctx->count] = crc;
+
+        uint8_t desc[ZIP_DESCRIPTOR_SIZE];
+        p = put_u32(desc, ZIP_DESCRIPTOR_SIG);
+        p = put_u32(p, crc);
+        p = put_u32(p, len);
+        put_u32(p, len);
+        if (export_writer_put(ctx->w, desc, sizeof(desc)) != ESP_OK) {
+            ctx->err = ctx->w->err;
+            return false;
+        }
+    } else {
+        bool zip64 = ctx->offset >= 0xFFFFFFFF;
+        uint8_t hdr[ZIP_CENTRAL_SIZE];
+        uint8_t *p = put_u32(hdr, ZIP_CENTRAL_SIG);
+        p = put_u16(p, zip64 ? ZIP64_VERSION : ZIP_VERSION);   // Made by (MS-DOS)
+        p = put_u16(p, zip64 ? ZIP64_VERSION : ZIP_VERSION);   // Needed
+        p = put_u16(p, ZIP_FLAG_DESCRIPTOR);
+        p = put_u16(p, 0);
+        p = put_u16(p, ctx->dos_time);
+        p = put_u16(p, ctx->dos_date);
+        p = put_u32(p, ctx->crcs[ctx->count]);
+        p = put_u32(p, len);
+        p = put_u32(p, len);
+        p = put_u16(p, name_len);
+        p = put_u16(p, zip64 ? 12 : 0);         // Extra length
+        p = put_u16(p, 0);                      // Comment length
+        p = put_u16(p, 0);                      // Disk number
+        p = put_u16(p, 0);                      // Internal attributes
+        p = put_u32(p, 0);                      // External attributes
+        put_u32(p, zip64 ? 0xFFFFFFFF : (uint32_t)ctx->offset);
+        export_writer_put(ctx->w, hdr, sizeof(hdr));
+        export_writer_put(ctx->w, name, name_len);
+
+        if (zip64) {
+            uint8_t extra[12];
+            p = put_u16(extra, 0x0001);         // ZIP64 extended information
+            p = put_u16(p, 8);
+            put_u64(p, ctx->offset);
+            export_writer_put(ctx->w, extra, sizeof(extra));
+        }
+        if (ctx->w->err != ESP_OK) {
+            ctx->err = ctx->w->err;
+            return false;
+        }
+        ctx->offset += ZIP_LOCAL_SIZE + name_len + len + ZIP_DESCRIPTOR_SIZE;
+    }
+
+    ctx->count++;
+    return true;
+}
+
+/**
+ * Write end of central directory (plus ZIP64 records when needed)
+ */
+static void zip_write_end(export_writer_t *w, uint32_t entries,
+                          uint64_t cd_offset, uint64_t cd_size)
+{
+    uint8_t rec[56];
+    uint8_t *p;
+    bool zip64 = entries >= 0xFFFF || cd_offset >= 0xFFFFFFFF || cd_size >= 0xFFFFFFFF;
+
+    if (zip64) {
+        uint64_t eocd64_offset = w->total;
+
+        p = put_u32(rec, ZIP64_EOCD_SIG);
+        p = put_u64(p, 44);                     // Size of remaining record
+        p = put_u16(p, ZIP64_VERSION);
+        p = put_u16(p, ZIP64_VERSION);
+        p = put_u32(p, 0);                      // This disk
+        p = put_u32(p, 0);                      // Central directory disk
+        p = put_u64(p, entries);
+        p = put_u64(p, entries);
+        p = put_u64(p, cd_size);
+        put_u64(p, cd_offset);
+        export_writer_put(w, rec, 56);
+
+        p = put_u32(rec, ZIP64_LOCATOR_SIG);
+        p = put_u32(p, 0);
+        p = put_u64(p, eocd64_offset);
+        put_u32(p, 1);                          // Total disks
+        export_writer_put(w, rec, 20);
+    }
+
+    p = put_u32(rec, ZIP_EOCD_SIG);
+    p = put_u16(p, 0);
+    p = put_u16(p, 0);
+    p = put_u16(p, zip64 ? 0xFFFF : entries);
+    p = put_u16(p, zip64 ? 0xFFFF : entries);
+    p = put_u32(p, zip64 ? 0xFFFFFFFF : (uint32_t)cd_size);
+    p = put_u32(p, zip64 ? 0xFFFFFFFF : (uint32_t)cd_offset);
+    put_u16(p, 0);                              // Comment length
+    export_writer_put(w, rec, 22);
+}
+
+esp_err_t zip_export_stream(const char *session, const export_sink_t *sink)
+{
+    if (sink == NULL || sink->write == NULL) return ESP_ERR_INVALID_ARG;
+    if (!sdcard_is_ready()) return ESP_ERR_INVALID_STATE;
+
+    zip_ctx_t ctx = {
+        .pass = ZIP_PASS_SCAN,
+        .session = session,
+    };
+
+    esp_err_t ret = sdcard_foreach_file(EXPORT_SESSION_DIR, zip_file_cb, &ctx);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (ctx.count == 0) {
+        ESP_LOGW(TAG, "No files for session '%s'", session ? session : "");
+        return ESP_ERR_NOT_FOUND;
+    }
+    ctx.limit = ctx.count;
+
+    ctx.crcs = heap_caps_malloc(ctx.limit * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ctx.crcs == NULL) {
+        ctx.crcs = malloc(ctx.limit * sizeof(uint32_t));
+    }
+    if (ctx.crcs == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate CRC table for %lu files", (unsigned long)ctx.limit);
+        return ESP_ERR_NO_MEM;
+    }
+
+    export_writer_t w;
+    ret = export_writer_init(&w, sink);
+    if (ret != ESP_OK) {
+        free(ctx.crcs);
+        return ret;
+    }
+    ctx.w = &w;
+
+    // All entries share the export time; frame names already carry theirs
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    if (tm_info->tm_year >= 80) {
+        ctx.dos_time = (tm_info->tm_hour << 11) | (tm_info->tm_min << 5) | (tm_info->tm_sec / 2);
+        ctx.dos_date = ((tm_info->tm_year - 80) << 9) | ((tm_info->tm_mon + 1) << 5) | tm_info->tm_mday;
+    } else {
+        ctx.dos_time = 0;
+        ctx.dos_date = (1 << 5) | 1;            // 1980-01-01, clock not set
+    }
+
+    ESP_LOGI(TAG, "Streaming %lu files as ZIP", (unsigned long)ctx.limit);
+
+    ctx.pass = ZIP_PASS_DATA;
+    ctx.count = 0;
+    ret = sdcard_foreach_file(EXPORT_SESSION_DIR, zip_file_cb, &ctx);
+
+    uint64_t cd_offset = w.total;
+    if (ret == ESP_OK && ctx.err == ESP_OK && ctx.count == ctx.limit) {
+        ctx.pass = ZIP_PASS_CENTRAL;
+        ctx.count = 0;
+        ctx.offset = 0;
+        ret = sdcard_foreach_file(EXPORT_SESSION_DIR, zip_file_cb, &ctx);
+    }
+
+    if (ret == ESP_OK) ret = ctx.err;
+    if (ret == ESP_OK && ctx.count != ctx.limit) {
+        ESP_LOGE(TAG, "Session changed during export (%lu of %lu files)",
+                 (unsigned long)ctx.count, (unsigned long)ctx.limit);
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    if (ret == ESP_OK) {
+        zip_write_end(&w, ctx.limit, cd_offset, w.total - cd_offset);
+    }
+
+    esp_err_t flush_ret = export_writer_finish(&w);
+    if (ret == ESP_OK) ret = flush_ret;
+    free(ctx.crcs);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "ZIP export complete (%llu bytes)", w.total);
+    }
+    return ret;
+}
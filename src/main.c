@@ -28,7 +28,10 @@
 #include "esp_timer.h"
 
 #include "camera.h"
+#include "frame_pool.h"
+#include "preview.h"
 #include "sdcard.h"
+#include "trace.h"
 #include "timelapse.h"
 #include "config.h"
 #include "wifi.h"
@@ -71,6 +74,7 @@ static const char *menu_items[] = {
     "\xc9\xee\xb6\xc8\xcb\xaf\xc3\xdf",  // 深度睡眠
 };
 #define MENU_ITEM_COUNT 5
+#define SHOT_REVIEW_MS  2000   // Thumbnail of a single capture on the OLED
 
 /**
  * Button interrupt handler for BOOT button
@@ -230,20 +234,25 @@ static void execute_menu_action(int selection)
                 if (oled_init_success) {
                     oled_show_message("\xc5\xc4\xc9\xe3\xd6\xd0...", NULL, NULL);  // 拍摄中...
                 }
-                camera_fb_t *fb = esp_camera_fb_get();
-                if (fb) {
+                frame_ref_t *frame = frame_pool_capture_fresh(0, NULL);
+                if (frame) {
                     char filename[64];
                     snprintf(filename, sizeof(filename), "/sdcard/capture_%lu.jpg",
                              (unsigned long)(esp_timer_get_time() / 1000000));
-                    sdcard_write_file(filename, fb->buf, fb->len);
+                    esp_err_t save_ret = sdcard_write_frame(filename, frame->fb.buf, frame->fb.len,
+                                                            trace_frame_id(&frame->fb));
 
-                    esp_camera_fb_return(fb);
+                    frame_ref_release(frame);
                     ESP_LOGI(TAG, "Single capture saved: %s", filename);
 
                     if (oled_init_success) {
                         oled_show_message("\xc5\xc4\xc9\xe3\xcd\xea\xb3\xc9",
                                           "\xd2\xd1\xb4\xe6""SD""\xbf\xa8", NULL);  // 拍摄完成 已存SD卡
                         vTaskDelay(pdMS_TO_TICKS(1000));
+                        // Review the shot from the card, as it was stored
+                        if (save_ret == ESP_OK && oled_show_file(filename) == ESP_OK) {
+                            vTaskDelay(pdMS_TO_TICKS(SHOT_REVIEW_MS));
+                        }
                     }
                 }
             }
@@ -511,6 +520,7 @@ void app_main(void)
     } else {
         ESP_LOGI(TAG, "Camera initialized (Sensor ID: 0x%02X)",
                  camera_get_sensor()->id.PID);
+        preview_init();
     }
 
     // Initialize LCD (optional - won't fail if not present)
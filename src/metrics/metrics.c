@@ -0,0 +1,208 @@
+/**
+ * Runtime Metrics Implementation
+ *
+ * Every series owns one cell per core. Recording masks interrupts on the
+ * current core only, which pins the task to that core for the few
+ * instructions of the update; no cross-core lock is taken. Readers sum the
+ * cells without locking, so a render racing an update may be off by one
+ * observation, which is acceptable for monitoring.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "metrics.h"
+
+static const char *TAG = "metrics";
+
+// Histogram upper bounds in microseconds (+Inf bucket is implicit)
+static const uint32_t bucket_bounds_us[] = {
+    500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+#define METRICS_BUCKETS (sizeof(bucket_bounds_us) / sizeof(bucket_bounds_us[0]))
+
+typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t bytes;
+    uint64_t sum_us;
+    uint32_t buckets[METRICS_BUCKETS + 1];
+} metrics_cell_t;
+
+typedef struct {
+    metrics_family_t family;
+    const char *labels;
+    metrics_cell_t cells[portNUM_PROCESSORS];
+} metrics_series_t;
+
+typedef struct {
+    const char *prefix;
+    const char *help;
+} metrics_family_info_t;
+
+static const metrics_family_info_t families[METRICS_FAMILY_MAX] = {
+    [METRICS_FAMILY_HTTP]  = {"timelapse_http", "HTTP handler"},
+    [METRICS_FAMILY_STAGE] = {"timelapse_stage", "Pipeline stage"},
+};
+
+static metrics_series_t series[METRICS_MAX_SERIES] = {
+    [METRICS_STAGE_CAPTURE]  = {METRICS_FAMILY_STAGE, "stage=\"capture\""},
+    [METRICS_STAGE_SD_WRITE] = {METRICS_FAMILY_STAGE, "stage=\"sd_write\""},
+    [METRICS_STAGE_ENCODE]   = {METRICS_FAMILY_STAGE, "stage=\"encode\""},
+    [METRICS_STAGE_SETTLE]   = {METRICS_FAMILY_STAGE, "stage=\"settle\""},
+};
+static int series_count = METRICS_STAGE_MAX;
+
+metrics_id_t metrics_register(metrics_family_t family, const char *labels)
+{
+    if (series_count >= METRICS_MAX_SERIES) {
+        ESP_LOGW(TAG, "Series limit reached, not tracking {%s}", labels);
+        return -1;
+    }
+
+    metrics_series_t *s = &series[series_count];
+    memset(s, 0, sizeof(*s));
+    s->family = family;
+    s->labels = labels;
+    return series_count++;
+}
+
+void metrics_record(metrics_id_t id, uint32_t elapsed_us, uint32_t bytes, bool error)
+{
+    if (id < 0 || id >= series_count) return;
+
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS && elapsed_us > bucket_bounds_us[bucket]) {
+        bucket++;
+    }
+
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    metrics_cell_t *c = &series[id].cells[xPortGetCoreID()];
+    c->count++;
+    c->errors += error ? 1 : 0;
+    c->bytes += bytes;
+    c->sum_us += elapsed_us;
+    c->buckets[bucket]++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+/**
+ * Sum a series' per-core cells
+ */
+static void metrics_collect(const metrics_series_t *s, metrics_cell_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const metrics_cell_t *c = &s->cells[core];
+        out->count += c->count;
+        out->errors += c->errors;
+        out->bytes += c->bytes;
+        out->sum_us += c->sum_us;
+        for (int b = 0; b <= METRICS_BUCKETS; b++) {
+            out->buckets[b] += c->buckets[b];
+        }
+    }
+}
+
+typedef struct {
+    metrics_write_fn_t write;
+    void *ctx;
+    esp_err_t err;
+    size_t len;
+    char buf[1024];
+} render_buf_t;
+
+static void render_flush(render_buf_t *r)
+{
+    if (r->err == ESP_OK && r->len > 0) {
+        r->err = r->write(r->ctx, r->buf, r->len);
+    }
+    r->len = 0;
+}
+
+/**
+ * Append one formatted line, flushing the batch buffer when it fills up
+ */
+static void render_line(render_buf_t *r, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (n < 0) return;
+    if (n >= sizeof(line)) n = sizeof(line) - 1;
+    if (r->len + n > sizeof(r->buf)) {
+        render_flush(r);
+    }
+    memcpy(r->buf + r->len, line, n);
+    r->len += n;
+}
+
+static void render_family(render_buf_t *r, metrics_family_t family)
+{
+    const metrics_family_info_t *info = &families[family];
+    const char *p = info->prefix;
+
+    render_line(r, "# HELP %s_duration_seconds %s latency\n", p, info->help);
+    render_line(r, "# TYPE %s_duration_seconds histogram\n", p);
+
+    for (int i = 0; i < series_count; i++) {
+        const metrics_series_t *s = &series[i];
+        if (s->family != family) continue;
+
+        metrics_cell_t total;
+        metrics_collect(s, &total);
+
+        uint32_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += total.buckets[b];
+            render_line(r, "%s_duration_seconds_bucket{%s,le=\"%g\"} %lu\n",
+                        p, s->labels, bucket_bounds_us[b] / 1e6, (unsigned long)cumulative);
+        }
+        render_line(r, "%s_duration_seconds_bucket{%s,le=\"+Inf\"} %lu\n",
+                    p, s->labels, (unsigned long)total.count);
+        render_line(r, "%s_duration_seconds_sum{%s} %.6f\n", p, s->labels, total.sum_us / 1e6);
+        render_line(r, "%s_duration_seconds_count{%s} %lu\n", p, s->labels, (unsigned long)total.count);
+    }
+
+    render_line(r, "# HELP %s_errors_total %s errors\n", p, info->help);
+    render_line(r, "# TYPE %s_errors_total counter\n", p);
+    for (int i = 0; i < series_count; i++) {
+        if (series[i].family != family) continue;
+        metrics_cell_t total;
+        metrics_collect(&series[i], &total);
+        render_line(r, "%s_errors_total{%s} %lu\n", p, series[i].labels, (unsigned long)total.errors);
+    }
+
+    render_line(r, "# HELP %s_bytes_total %s payload bytes\n", p, info->help);
+    render_line(r, "# TYPE %s_bytes_total counter\n", p);
+    for (int i = 0; i < series_count; i++) {
+        if (series[i].family != family) continue;
+        metrics_cell_t total;
+        metrics_collect(&series[i], &total);
+        render_line(r, "%s_bytes_total{%s} %llu\n", p, series[i].labels, total.bytes);
+    }
+}
+
+esp_err_t metrics_render(metrics_write_fn_t write, void *ctx)
+{
+    render_buf_t r = {
+        .write = write,
+        .ctx = ctx,
+        .err = ESP_OK,
+        .len = 0,
+    };
+
+    for (int f = 0; f < METRICS_FAMILY_MAX && r.err == ESP_OK; f++) {
+        render_family(&r, f);
+    }
+    render_flush(&r);
+    return r.err;
+}
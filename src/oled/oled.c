@@ -13,11 +13,15 @@
 #include "driver/i2c.h"
 #include "jpeg_decoder.h"
 #include "oled.h"
+#include "sdcard.h"
 #include "font.h"
 #include "oled_chinese.h"
 
 static const char *TAG = "oled";
 
+// stdio buffer between FatFS and the decoder's 512 byte input buffer
+#define OLED_FILE_READ_BUF 4096
+
 // I2C configuration
 #define I2C_MASTER_NUM     I2C_NUM_0
 #define I2C_MASTER_FREQ_HZ 400000
@@ -812,15 +816,15 @@ void oled_draw_grayscale(const uint8_t *gray_data, int width, int height)
 {
     if (!gray_data || width <= 0 || height <= 0) return;
     
-    // Allocate error buffer for dithering
-    int16_t *errors = heap_caps_calloc((width + 2) * 2, sizeof(int16_t), MALLOC_CAP_DEFAULT);
+    // Allocate error buffer for dithering (indexed by OLED column, not source column)
+    int16_t *errors = heap_caps_calloc((OLED_WIDTH + 2) * 2, sizeof(int16_t), MALLOC_CAP_DEFAULT);
     if (!errors) {
         ESP_LOGE(TAG, "Failed to allocate dithering buffer");
         return;
     }
     
     int16_t *curr_row = errors;
-    int16_t *next_row = errors + width + 2;
+    int16_t *next_row = errors + OLED_WIDTH + 2;
     
     // Calculate scaling factors
     float scale_x = (float)width / OLED_WIDTH;
@@ -833,7 +837,7 @@ void oled_draw_grayscale(const uint8_t *gray_data, int width, int height)
         int16_t *temp = curr_row;
         curr_row = next_row;
         next_row = temp;
-        memset(next_row, 0, (width + 2) * sizeof(int16_t));
+        memset(next_row, 0, (OLED_WIDTH + 2) * sizeof(int16_t));
         
         int src_y = (int)(oy * scale_y);
         if (src_y >= height) src_y = height - 1;
@@ -871,83 +875,123 @@ esp_err_t oled_show_preview(const uint8_t *jpeg_data, size_t jpeg_len)
     
     ESP_LOGI(TAG, "Decoding JPEG for preview (%d bytes)", jpeg_len);
     
-    // Allocate grayscale buffer for OLED resolution
-    uint8_t *gray_buf = heap_caps_calloc(OLED_WIDTH * OLED_HEIGHT, 1, MALLOC_CAP_DEFAULT);
-    if (!gray_buf) {
-        ESP_LOGE(TAG, "Failed to allocate grayscale buffer");
-        return ESP_ERR_NO_MEM;
-    }
-    
-    // Get JPEG info first
+    // Decode luminance only at 1/8 scale: the decoder skips the chroma
+    // transform and color conversion, and the output needs 1 byte per pixel
     esp_jpeg_image_cfg_t jpeg_cfg = {
         .indata = (uint8_t *)jpeg_data,
         .indata_size = jpeg_len,
-        .outbuf = NULL,
-        .outbuf_size = 0,
-        .out_format = JPEG_IMAGE_FORMAT_RGB565,
-        .out_scale = JPEG_IMAGE_SCALE_1_8,  // Scale down to 1/8 for faster decode
-        .flags = {
-            .swap_color_bytes = 0,
-        }
+        .out_format = JPEG_IMAGE_FORMAT_GRAY8,
+        .out_scale = JPEG_IMAGE_SCALE_1_8,
     };
     
     esp_jpeg_image_output_t out_info;
-    
-    // Allocate decode buffer (at 1/8 scale, even 2048x1536 becomes 256x192)
-    // Max buffer needed: 256*192*2 = ~98KB for RGB565
-    size_t decode_buf_size = 320 * 240 * 2;  // Sufficient for 1/8 scaled images
-    uint8_t *decode_buf = heap_caps_malloc(decode_buf_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!decode_buf) {
-        decode_buf = heap_caps_malloc(decode_buf_size, MALLOC_CAP_DEFAULT);
+    esp_err_t ret = esp_jpeg_get_image_info(&jpeg_cfg, &out_info);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid JPEG header");
+        return ret;
     }
     
-    if (!decode_buf) {
+    // At 1/8 scale even 2048x1536 is only 256x192 = 48KB
+    uint8_t *gray_buf = heap_caps_malloc(out_info.output_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!gray_buf) {
+        gray_buf = heap_caps_malloc(out_info.output_len, MALLOC_CAP_DEFAULT);
+    }
+    if (!gray_buf) {
         ESP_LOGE(TAG, "Failed to allocate decode buffer");
-        free(gray_buf);
         return ESP_ERR_NO_MEM;
     }
     
-    jpeg_cfg.outbuf = decode_buf;
-    jpeg_cfg.outbuf_size = decode_buf_size;
+    jpeg_cfg.outbuf = gray_buf;
+    jpeg_cfg.outbuf_size = out_info.output_len;
     
-    // Decode JPEG
-    esp_err_t ret = esp_jpeg_decode(&jpeg_cfg, &out_info);
+    ret = esp_jpeg_decode(&jpeg_cfg, &out_info);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "JPEG decode failed: %s", esp_err_to_name(ret));
-        free(decode_buf);
         free(gray_buf);
         return ret;
     }
     
     ESP_LOGI(TAG, "Decoded image: %dx%d", out_info.width, out_info.height);
     
-    // Convert RGB565 to grayscale and scale to OLED size
-    uint16_t *rgb565 = (uint16_t *)decode_buf;
-    float scale_x = (float)out_info.width / OLED_WIDTH;
-    float scale_y = (float)out_info.height / OLED_HEIGHT;
+    // Nearest-neighbour resample to OLED size
+    uint8_t *oled_buf = heap_caps_malloc(OLED_WIDTH * OLED_HEIGHT, MALLOC_CAP_DEFAULT);
+    if (!oled_buf) {
+        ESP_LOGE(TAG, "Failed to allocate grayscale buffer");
+        free(gray_buf);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int oy = 0; oy < OLED_HEIGHT; oy++) {
+        const uint8_t *row = gray_buf + (oy * out_info.height / OLED_HEIGHT) * out_info.width;
+        for (int ox = 0; ox < OLED_WIDTH; ox++) {
+            oled_buf[oy * OLED_WIDTH + ox] = row[ox * out_info.width / OLED_WIDTH];
+        }
+    }
+    free(gray_buf);
+    
+    // Dither and display
+    oled_draw_grayscale(oled_buf, OLED_WIDTH, OLED_HEIGHT);
+    
+    free(oled_buf);
+    
+    return ESP_OK;
+}
+
+/**
+ * Nearest-neighbour sample one decoded band into the OLED-sized gray frame
+ */
+static bool oled_file_band(void *band_ctx, const esp_jpeg_band_t *band)
+{
+    uint8_t *gray = band_ctx;
     
     for (int oy = 0; oy < OLED_HEIGHT; oy++) {
+        int src_y = oy * band->image_height / OLED_HEIGHT;
+        if (src_y < band->top || src_y >= band->top + band->height) continue;
+        
+        const uint8_t *row = band->data + (src_y - band->top) * band->width;
         for (int ox = 0; ox < OLED_WIDTH; ox++) {
-            int src_x = (int)(ox * scale_x);
-            int src_y = (int)(oy * scale_y);
-            
-            if (src_x >= out_info.width) src_x = out_info.width - 1;
-            if (src_y >= out_info.height) src_y = out_info.height - 1;
-            
-            uint16_t pixel = rgb565[src_y * out_info.width + src_x];
-            
-            // Extract RGB and convert to grayscale
-            uint8_t r = ((pixel >> 11) & 0x1F) << 3;
-            uint8_t g = ((pixel >> 5) & 0x3F) << 2;
-            uint8_t b = (pixel & 0x1F) << 3;
-            
-            gray_buf[oy * OLED_WIDTH + ox] = (uint8_t)(0.299f * r + 0.587f * g + 0.114f * b);
+            gray[oy * OLED_WIDTH + ox] = row[ox * band->width / OLED_WIDTH];
         }
     }
+    return true;
+}
+
+esp_err_t oled_show_file(const char *path)
+{
+    if (!is_init) return ESP_ERR_INVALID_STATE;
+    if (!path) return ESP_ERR_INVALID_ARG;
+    
+    FILE *f = sdcard_fopen(path, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+    setvbuf(f, NULL, _IOFBF, OLED_FILE_READ_BUF);
+    
+    uint8_t *gray_buf = heap_caps_calloc(OLED_WIDTH * OLED_HEIGHT, 1, MALLOC_CAP_DEFAULT);
+    if (!gray_buf) {
+        ESP_LOGE(TAG, "Failed to allocate grayscale buffer");
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Decoded rows never exist as a whole frame: each band is sampled and dropped
+    esp_jpeg_stream_cfg_t jpeg_cfg = {
+        .read = esp_jpeg_file_read,
+        .read_ctx = f,
+        .on_band = oled_file_band,
+        .band_ctx = gray_buf,
+        .out_format = JPEG_IMAGE_FORMAT_GRAY8,
+        .out_scale = JPEG_IMAGE_SCALE_1_8,
+    };
+    esp_jpeg_image_output_t out_info;
+    esp_err_t ret = esp_jpeg_decode_stream(&jpeg_cfg, &out_info);
+    fclose(f);
+    
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "JPEG decode of %s failed: %s", path, esp_err_to_name(ret));
+        free(gray_buf);
+        return ret;
+    }
     
-    free(decode_buf);
+    ESP_LOGI(TAG, "Decoded %s: %dx%d", path, out_info.width, out_info.height);
     
-    // Apply dithering and display
     oled_draw_grayscale(gray_buf, OLED_WIDTH, OLED_HEIGHT);
     
     free(gray_buf);
@@ -17,7 +17,10 @@
 #include "sdmmc_cmd.h"
 #include "diskio.h"
 #include "ff.h"
+#include "esp_timer.h"
 #include "sdcard.h"
+#include "metrics.h"
+#include "trace.h"
 #include "camera_pins.h"
 
 static const char *TAG = "sdcard";
@@ -132,6 +135,12 @@ bool sdcard_is_ready(void)
 }
 
 esp_err_t sdcard_write_file(const char *path, const uint8_t *data, size_t len)
+{
+    return sdcard_write_frame(path, data, len, 0);
+}
+
+esp_err_t sdcard_write_frame(const char *path, const uint8_t *data, size_t len,
+                             uint32_t trace_frame)
 {
     if (!is_init) {
         ESP_LOGE(TAG, "SD card not initialized");
@@ -143,17 +152,29 @@ esp_err_t sdcard_write_file(const char *path, const uint8_t *data, size_t len)
 
     ESP_LOGI(TAG, "Writing %d bytes to: %s", len, full_path);
 
+    int64_t start_us = esp_timer_get_time();
+    TRACE_SPAN_BEGIN(open_us);
     FILE *f = fopen(full_path, "wb");
+    TRACE_SPAN_END(TRACE_SD_OPEN, trace_frame, open_us);
     if (f == NULL) {
         ESP_LOGE(TAG, "Failed to open file for writing: %s (errno=%d)", path, errno);
+        metrics_record(METRICS_STAGE_SD_WRITE, (uint32_t)(esp_timer_get_time() - start_us), 0, true);
         return ESP_FAIL;
     }
 
+    TRACE_SPAN_BEGIN(write_us);
     size_t written = fwrite(data, 1, len, f);
     int flush_ret = fflush(f);
+    TRACE_SPAN_END(TRACE_SD_WRITE, trace_frame, write_us);
+    TRACE_SPAN_BEGIN(close_us);
     fclose(f);
+    TRACE_SPAN_END(TRACE_SD_CLOSE, trace_frame, close_us);
 
-    if (written != len || flush_ret != 0) {
+    bool failed = written != len || flush_ret != 0;
+    metrics_record(METRICS_STAGE_SD_WRITE, (uint32_t)(esp_timer_get_time() - start_us),
+                   written, failed);
+
+    if (failed) {
         ESP_LOGE(TAG, "Failed to write all data (written=%d, expected=%d, flush=%d)", written, len, flush_ret);
         return ESP_FAIL;
     }
@@ -294,6 +315,48 @@ int sdcard_list_files(const char *path, char *buffer, size_t buffer_size)
     return count;
 }
 
+esp_err_t sdcard_foreach_file(const char *path, sdcard_dir_cb_t cb, void *ctx)
+{
+    if (!is_init) return ESP_ERR_INVALID_STATE;
+
+    char dir_path[128];
+    if (path == NULL || strlen(path) == 0) {
+        strcpy(dir_path, MOUNT_POINT);
+    } else {
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", MOUNT_POINT, path);
+    }
+
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        ESP_LOGE(TAG, "Failed to open directory: %s", dir_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!cb(entry->d_name, (entry->d_type & DT_DIR) != 0, ctx)) {
+            break;
+        }
+    }
+
+    closedir(dir);
+    return ESP_OK;
+}
+
+FILE *sdcard_fopen(const char *path, const char *mode)
+{
+    if (!is_init) return NULL;
+
+    char full_path[128];
+    snprintf(full_path, sizeof(full_path), "%s/%s", MOUNT_POINT, path);
+
+    FILE *f = fopen(full_path, mode);
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open file: %s (errno=%d)", path, errno);
+    }
+    return f;
+}
+
 int64_t sdcard_get_file_size(const char *path)
 {
     if (!is_init) return -1;
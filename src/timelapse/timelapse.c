@@ -17,7 +17,9 @@
 #include "nvs.h"
 #include "timelapse.h"
 #include "camera.h"
+#include "frame_pool.h"
 #include "sdcard.h"
+#include "trace.h"
 
 static const char *TAG = "timelapse";
 
@@ -40,6 +42,8 @@ static uint64_t last_shot_time = 0;
 static uint32_t sequence_number = 0;
 static uint64_t start_time_epoch = 0;
 static uint64_t end_time_epoch = 0;
+static uint32_t last_settle_ms = 0;
+static volatile uint32_t status_revision = 0;
 
 /**
  * Convert resolution enum to framesize_t
@@ -68,12 +72,19 @@ static esp_err_t save_photo(void)
     // Switch to high resolution for capture
     framesize_t capture_size = resolution_to_framesize(config.resolution);
     camera_set_framesize(capture_size);
-    
-    // Small delay to let sensor stabilize after resolution change
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    camera_fb_t *fb = camera_capture();
-    if (fb == NULL) {
+
+    // Let exposure and white balance settle after the resolution change
+    uint32_t settle_ms = 0;
+    if (camera_wait_settled(CAMERA_SETTLE_TIMEOUT_MS, &settle_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Exposure not settled after %lu ms, capturing anyway",
+                 (unsigned long)settle_ms);
+    }
+    last_settle_ms = settle_ms;
+
+    // Only a frame that started after settling shows the scene now
+    camera_capture_info_t info;
+    frame_ref_t *frame = frame_pool_capture_fresh(esp_timer_get_time(), &info);
+    if (frame == NULL) {
         ESP_LOGE(TAG, "Failed to capture photo");
         // Switch back to lower resolution for idle
         camera_set_framesize(FRAMESIZE_SVGA);
@@ -93,20 +104,26 @@ static esp_err_t save_photo(void)
              (unsigned long)sequence_number++);
 
     // Save to SD card
-    esp_err_t ret = sdcard_write_file(filename, fb->buf, fb->len);
+    const camera_fb_t *fb = &frame->fb;
+    esp_err_t ret = sdcard_write_frame(filename, fb->buf, fb->len, trace_frame_id(fb));
 
     if (ret == ESP_OK) {
         shot_count++;
         total_bytes += fb->len;
         status.saved_count = shot_count;
         status.saved_bytes = total_bytes;
+        TRACE_POINT(TRACE_COMMIT, trace_frame_id(fb));
+        camera_save_3a();
 
-        ESP_LOGI(TAG, "Photo saved: %s (%d bytes)", filename, fb->len);
+        ESP_LOGI(TAG, "Photo saved: %s (%d bytes, frame age %lu ms, %lu stale discarded)",
+                 filename, fb->len, (unsigned long)(info.age_us / 1000),
+                 (unsigned long)info.discarded);
     } else {
         ESP_LOGE(TAG, "Failed to save photo: %s", filename);
     }
 
-    camera_free_fb(fb);
+    frame_ref_release(frame);
+    status_revision++;
     
     // Switch back to lower resolution for idle (reduces FB-OVF)
     camera_set_framesize(FRAMESIZE_SVGA);
@@ -138,6 +155,7 @@ static void timelapse_task(void *pvParameters)
         if (bits & TIMELAPSE_START_BIT) {
             ESP_LOGI(TAG, "Starting timelapse...");
             current_state = TIMELAPSE_RUNNING;
+            status_revision++;
             shot_count = 0;
             last_shot_time = esp_timer_get_time() / 1000000;
             start_time_epoch = (uint64_t)time(NULL);
@@ -163,6 +181,7 @@ static void timelapse_task(void *pvParameters)
         if (bits & TIMELAPSE_STOP_BIT) {
             ESP_LOGI(TAG, "Stopping timelapse...");
             current_state = TIMELAPSE_IDLE;
+            status_revision++;
             xTimerStop(shoot_timer, 0);
             end_time_epoch = (uint64_t)time(NULL);
 
@@ -173,12 +192,14 @@ static void timelapse_task(void *pvParameters)
         if (bits & TIMELAPSE_PAUSE_BIT) {
             ESP_LOGI(TAG, "Pausing timelapse...");
             current_state = TIMELAPSE_PAUSED;
+            status_revision++;
             xTimerStop(shoot_timer, 0);
         }
 
         if (bits & TIMELAPSE_RESUME_BIT) {
             ESP_LOGI(TAG, "Resuming timelapse...");
             current_state = TIMELAPSE_RUNNING;
+            status_revision++;
             xTimerStart(shoot_timer, 0);
         }
 
@@ -188,6 +209,7 @@ static void timelapse_task(void *pvParameters)
                 if (config.total_shots > 0 && shot_count >= config.total_shots) {
                     ESP_LOGI(TAG, "Completed %lu shots", (unsigned long)shot_count);
                     current_state = TIMELAPSE_COMPLETED;
+                    status_revision++;
                     end_time_epoch = (uint64_t)time(NULL);
                     timelapse_save_config();
                     continue;
@@ -337,6 +359,7 @@ esp_err_t timelapse_set_config(timelapse_config_t *new_config)
     if (current_state == TIMELAPSE_PAUSED || current_state == TIMELAPSE_RUNNING) {
         xTimerChangePeriod(shoot_timer, pdMS_TO_TICKS(config.interval_sec * 1000), 0);
     }
+    status_revision++;
 
     return ESP_OK;
 }
@@ -372,6 +395,11 @@ void timelapse_get_status(timelapse_status_t *new_status)
     new_status->elapsed_sec = (esp_timer_get_time() / 1000000) - last_shot_time;
     new_status->start_time_sec = start_time_epoch;
     new_status->end_time_sec = end_time_epoch;
+    new_status->settle_ms = last_settle_ms;
+
+    camera_settle_stats_t settle;
+    camera_get_settle_stats(&settle);
+    new_status->wake_frames = settle.wake_frames;
 
     // Calculate time until next shot
     if (current_state == TIMELAPSE_RUNNING) {
@@ -391,6 +419,14 @@ void timelapse_get_status(timelapse_status_t *new_status)
     new_status->free_bytes = sd_info.free_space;
 }
 
+/**
+ * Get status revision counter
+ */
+uint32_t timelapse_get_revision(void)
+{
+    return status_revision;
+}
+
 /**
  * Save configuration to NVS
  */
@@ -0,0 +1,157 @@
+/**
+ * Frame Trace Implementation
+ *
+ * Writers claim a slot with one atomic increment and publish it by storing
+ * the slot's sequence number last; no lock is taken, so trace points are
+ * safe in the camera task. The reader checks the sequence number before and
+ * after copying a record and skips slots that were overwritten meanwhile.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+static const char *TAG = "trace";
+
+typedef struct {
+    _Atomic uint32_t seq;   // Claim index + 1 once published, 0 while written
+    uint32_t frame;
+    int64_t start_us;
+    uint32_t dur_us;
+    uint8_t point;
+    uint8_t core;
+} trace_rec_t;
+
+static trace_rec_t ring[TRACE_RING_SIZE];
+static _Atomic uint32_t ring_head = 0;
+
+static const struct {
+    const char *name;
+    bool span;
+} points[TRACE_POINT_MAX] = {
+    [TRACE_VSYNC]    = {"vsync", false},
+    [TRACE_QUEUED]   = {"queued", false},
+    [TRACE_TAKEN]    = {"taken", false},
+    [TRACE_COPY]     = {"copy", true},
+    [TRACE_ENCODE]   = {"encode", true},
+    [TRACE_SD_OPEN]  = {"sd_open", true},
+    [TRACE_SD_WRITE] = {"sd_write", true},
+    [TRACE_SD_CLOSE] = {"sd_close", true},
+    [TRACE_COMMIT]   = {"commit", false},
+};
+
+void trace_record(trace_point_t point, uint32_t frame, int64_t start_us, uint32_t dur_us)
+{
+    uint32_t idx = atomic_fetch_add_explicit(&ring_head, 1, memory_order_relaxed);
+    trace_rec_t *r = &ring[idx & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    r->frame = frame;
+    r->start_us = start_us;
+    r->dur_us = dur_us;
+    r->point = point;
+    r->core = xPortGetCoreID();
+    atomic_store_explicit(&r->seq, idx + 1, memory_order_release);
+}
+
+/**
+ * Driver callback (camera task / esp_camera_fb_get caller)
+ */
+static void trace_camera_cb(camera_trace_point_t point, const camera_fb_t *fb)
+{
+    static const trace_point_t map[] = {
+        [CAMERA_TRACE_VSYNC]  = TRACE_VSYNC,
+        [CAMERA_TRACE_QUEUED] = TRACE_QUEUED,
+        [CAMERA_TRACE_TAKEN]  = TRACE_TAKEN,
+    };
+    trace_record(map[point], trace_frame_id(fb), esp_timer_get_time(), 0);
+}
+
+void trace_init(void)
+{
+    esp_camera_set_trace_cb(trace_camera_cb);
+    ESP_LOGI(TAG, "Frame tracing enabled (%d records)", TRACE_RING_SIZE);
+}
+
+/**
+ * Copy a published record, false if it was overwritten while copying
+ */
+static bool trace_read(uint32_t idx, trace_rec_t *out)
+{
+    trace_rec_t *r = &ring[idx & (TRACE_RING_SIZE - 1)];
+    uint32_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    if (seq != idx + 1) {
+        return false;
+    }
+    out->frame = r->frame;
+    out->start_us = r->start_us;
+    out->dur_us = r->dur_us;
+    out->point = r->point;
+    out->core = r->core;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&r->seq, memory_order_relaxed) == seq;
+}
+
+esp_err_t trace_render_chrome(trace_write_fn_t write, void *ctx)
+{
+    static const char header[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char line[192];
+    esp_err_t ret = write(ctx, header, sizeof(header) - 1);
+
+    uint32_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    bool comma = false;
+
+    for (uint32_t idx = first; idx < head && ret == ESP_OK; idx++) {
+        trace_rec_t rec;
+        if (!trace_read(idx, &rec) || rec.point >= TRACE_POINT_MAX) {
+            continue;
+        }
+
+        int n;
+        if (points[rec.point].span) {
+            n = snprintf(line, sizeof(line),
+                         "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lu,"
+                         "\"pid\":1,\"tid\":%lu,\"args\":{\"core\":%u}}",
+                         comma ? "," : "", points[rec.point].name, (long long)rec.start_us,
+                         (unsigned long)rec.dur_us, (unsigned long)rec.frame, rec.core);
+        } else {
+            n = snprintf(line, sizeof(line),
+                         "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,"
+                         "\"pid\":1,\"tid\":%lu,\"args\":{\"core\":%u}}",
+                         comma ? "," : "", points[rec.point].name, (long long)rec.start_us,
+                         (unsigned long)rec.frame, rec.core);
+        }
+        ret = write(ctx, line, n);
+        comma = true;
+    }
+
+    if (ret == ESP_OK) {
+        ret = write(ctx, "]}", 2);
+    }
+    return ret;
+}
+
+#else // TRACE_ENABLED
+
+void trace_init(void)
+{
+}
+
+void trace_record(trace_point_t point, uint32_t frame, int64_t start_us, uint32_t dur_us)
+{
+}
+
+esp_err_t trace_render_chrome(trace_write_fn_t write, void *ctx)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // TRACE_ENABLED
@@ -9,20 +9,28 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_http_server.h"
 #include "esp_http_client.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 #include "cJSON.h"
 #include "webserver.h"
 #include "wifi.h"
 #include "camera.h"
+#include "preview.h"
 #include "sdcard.h"
 #include "timelapse.h"
 #include "power.h"
+#include "export.h"
+#include "metrics.h"
+#include "trace.h"
+#include "lwip/sockets.h"
 
 static const char *TAG = "webserver";
 
@@ -30,34 +38,199 @@ static httpd_handle_t server = NULL;
 static SemaphoreHandle_t api_mutex = NULL;
 static int server_port = 80;
 
+// Server-sent status events (/events)
+#define PUSH_MAX_SUBSCRIBERS     4       // Counted in the socket budget (webserver_start)
+#define PUSH_COALESCE_MS         500     // Minimum spacing between pushed events
+#define PUSH_BATTERY_POLL_MS     10000   // ADC sampling period while subscribers exist
+#define PUSH_BATTERY_DELTA_PCT   1.0f    // Battery change that triggers an event
+#define PUSH_KEEPALIVE_MS        15000   // Comment line to detect dead clients
+
+typedef struct {
+    timelapse_status_t tl;
+    battery_status_t battery;
+} status_snapshot_t;
+
+static int push_fds[PUSH_MAX_SUBSCRIBERS];
+static volatile int push_count = 0;     // Only modified on the httpd task
+static TaskHandle_t push_task = NULL;
+static TaskHandle_t push_waiter = NULL; // Notified when the producer has exited
+static volatile bool push_stop = false;
+
+// Async worker pool for slow handlers
+#define ASYNC_WORKER_STACK       8192
+
 /**
- * Get current status as JSON
+ * Async handler classes; handlers in one class share a concurrency limit
  */
-static esp_err_t get_status_handler(httpd_req_t *req)
-{
-    timelapse_status_t status;
-    timelapse_get_status(&status);
+typedef enum {
+    ASYNC_CLASS_CAMERA,     // Sensor access (preview, capture); never concurrent
+    ASYNC_CLASS_STORAGE,    // Bulk SD reads/writes (downloads, exports)
+    ASYNC_CLASS_MAX
+} async_class_t;
 
-    battery_status_t battery;
-    power_get_battery_status(&battery);
+typedef struct {
+    const char *name;
+    int max_running;        // Concurrency limit (one worker task each)
+    int max_queued;         // Extra requests allowed to wait
+    QueueHandle_t queue;    // Jobs of this class only, served in FIFO order
+    SemaphoreHandle_t tickets;  // max_running + max_queued admissions
+    int workers;            // Worker tasks started (kept across stop/start)
+} async_class_info_t;
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    async_class_t cls;
+    metrics_id_t metrics_id;    // Set when the route is registered
+} async_route_t;
+
+typedef struct {
+    httpd_req_t *req;
+    const async_route_t *route;
+    int64_t submit_us;          // Latency includes time spent queued
+} async_job_t;
+
+static async_class_info_t async_classes[ASYNC_CLASS_MAX] = {
+    [ASYNC_CLASS_CAMERA]  = {"camera", 1, 2},
+    [ASYNC_CLASS_STORAGE] = {"storage", 2, 2},
+};
+static bool async_ready = false;
+
+// Sockets for short API calls and idle browser keep-alive connections, on
+// top of the SSE subscribers and async admissions
+#define HTTPD_API_SOCKETS        4
+#define HTTPD_INTERNAL_SOCKETS   3       // Listener and control sockets of httpd
+static volatile bool async_accepting = false;  // Cleared while the server stops
+
+// Per-URI metrics; bytes are counted per socket by a send override
+typedef struct {
+    const httpd_uri_t *uri;
+    metrics_id_t id;
+    char labels[64];
+} uri_metrics_t;
+
+static uint32_t sock_bytes[CONFIG_LWIP_MAX_SOCKETS];
+
+/**
+ * Collect timelapse and battery status
+ */
+static void status_snapshot(status_snapshot_t *snap)
+{
+    timelapse_get_status(&snap->tl);
+    power_get_battery_status(&snap->battery);
+}
 
+/**
+ * Serialize status as JSON
+ * With prev == NULL every field is emitted; otherwise only fields that
+ * differ from prev (battery only beyond PUSH_BATTERY_DELTA_PCT).
+ */
+static cJSON *status_to_json(const status_snapshot_t *cur, const status_snapshot_t *prev)
+{
     cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "status", "ok");
-    cJSON_AddNumberToObject(root, "state", status.state);
-    cJSON_AddNumberToObject(root, "current_shot", status.current_shot);
-    cJSON_AddNumberToObject(root, "total_shots", status.total_shots);
-    cJSON_AddNumberToObject(root, "next_shot_sec", status.next_shot_sec);
-    cJSON_AddNumberToObject(root, "elapsed_sec", status.elapsed_sec);
-    cJSON_AddNumberToObject(root, "saved_count", status.saved_count);
-    cJSON_AddNumberToObject(root, "saved_bytes", status.saved_bytes);
-    cJSON_AddNumberToObject(root, "free_bytes", status.free_bytes);
-    cJSON_AddNumberToObject(root, "battery_voltage", battery.voltage);
-    cJSON_AddNumberToObject(root, "battery_percent", battery.percentage);
-    cJSON_AddBoolToObject(root, "usb_connected", battery.usb_connected);
-    cJSON_AddStringToObject(root, "ip", wifi_get_ip_address());
-    cJSON_AddNumberToObject(root, "start_time_sec", status.start_time_sec);
-    cJSON_AddNumberToObject(root, "end_time_sec", status.end_time_sec);
+    if (prev == NULL) {
+        cJSON_AddStringToObject(root, "status", "ok");
+    }
+
+#define STATUS_FIELD(field, name) \
+    if (prev == NULL || prev->tl.field != cur->tl.field) \
+        cJSON_AddNumberToObject(root, name, cur->tl.field)
+
+    STATUS_FIELD(state, "state");
+    STATUS_FIELD(current_shot, "current_shot");
+    STATUS_FIELD(total_shots, "total_shots");
+    STATUS_FIELD(saved_count, "saved_count");
+    STATUS_FIELD(saved_bytes, "saved_bytes");
+    STATUS_FIELD(free_bytes, "free_bytes");
+    STATUS_FIELD(start_time_sec, "start_time_sec");
+    STATUS_FIELD(end_time_sec, "end_time_sec");
+    STATUS_FIELD(settle_ms, "settle_ms");
+    STATUS_FIELD(wake_frames, "wake_frames");
+#undef STATUS_FIELD
+
+    // Countdown fields tick every second; they never trigger an event on
+    // their own but are re-anchored whenever anything else is sent.
+    if (prev == NULL || cJSON_GetArraySize(root) > 0) {
+        cJSON_AddNumberToObject(root, "next_shot_sec", cur->tl.next_shot_sec);
+        cJSON_AddNumberToObject(root, "elapsed_sec", cur->tl.elapsed_sec);
+    }
+
+    float battery_diff = prev ? cur->battery.percentage - prev->battery.percentage : 0;
+    if (prev == NULL || battery_diff >= PUSH_BATTERY_DELTA_PCT ||
+        battery_diff <= -PUSH_BATTERY_DELTA_PCT) {
+        cJSON_AddNumberToObject(root, "battery_voltage", cur->battery.voltage);
+        cJSON_AddNumberToObject(root, "battery_percent", cur->battery.percentage);
+    }
+    if (prev == NULL || prev->battery.usb_connected != cur->battery.usb_connected) {
+        cJSON_AddBoolToObject(root, "usb_connected", cur->battery.usb_connected);
+    }
+    if (prev == NULL) {
+        cJSON_AddStringToObject(root, "ip", wifi_get_ip_address());
+    }
+
+    return root;
+}
+
+static uint32_t *sock_bytes_slot(int sockfd)
+{
+    int idx = sockfd - LWIP_SOCKET_OFFSET;
+    if (idx < 0 || idx >= CONFIG_LWIP_MAX_SOCKETS) return NULL;
+    return &sock_bytes[idx];
+}
 
+/**
+ * Socket send override that counts bytes written per session
+ */
+static int metrics_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+
+    uint32_t *slot = sock_bytes_slot(sockfd);
+    if (slot) *slot += ret;
+    return ret;
+}
+
+/**
+ * Session open hook - installs the counting send function
+ */
+static esp_err_t metrics_open_fn(httpd_handle_t hd, int sockfd)
+{
+    uint32_t *slot = sock_bytes_slot(sockfd);
+    if (slot) *slot = 0;
+    return httpd_sess_set_send_override(hd, sockfd, metrics_send);
+}
+
+/**
+ * Run a handler and record latency, bytes sent and errors
+ * @param start_us Start of the measured interval (submit time for async jobs)
+ */
+static esp_err_t metrics_run(esp_err_t (*handler)(httpd_req_t *), httpd_req_t *req,
+                             metrics_id_t id, int64_t start_us)
+{
+    uint32_t *slot = sock_bytes_slot(httpd_req_to_sockfd(req));
+    uint32_t bytes_before = slot ? *slot : 0;
+
+    esp_err_t ret = handler(req);
+
+    uint32_t bytes = slot ? *slot - bytes_before : 0;
+    metrics_record(id, (uint32_t)(esp_timer_get_time() - start_us), bytes, ret != ESP_OK);
+    return ret;
+}
+
+/**
+ * Get current status as JSON
+ */
+static esp_err_t get_status_handler(httpd_req_t *req)
+{
+    status_snapshot_t snap;
+    status_snapshot(&snap);
+
+    cJSON *root = status_to_json(&snap, NULL);
     char *json = cJSON_Print(root);
     cJSON_Delete(root);
 
@@ -189,19 +362,34 @@ static esp_err_t post_time_handler(httpd_req_t *req)
 }
 
 /**
- * Get preview image
+ * Get preview image (optional ?zoom=1..PREVIEW_MAX_ZOOM crops the center)
  */
 static esp_err_t get_preview_handler(httpd_req_t *req)
 {
-    camera_fb_t *fb = camera_get_preview();
-    if (fb == NULL) {
+    uint8_t *jpeg = NULL;
+    size_t len = 0;
+    int zoom = 1;
+
+    char query[32];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char param[8];
+        if (httpd_query_key_value(query, "zoom", param, sizeof(param)) == ESP_OK) {
+            zoom = atoi(param);
+        }
+    }
+    if (zoom < 1 || zoom > PREVIEW_MAX_ZOOM) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "zoom out of range");
+        return ESP_FAIL;
+    }
+
+    if (preview_get_jpeg(zoom, &jpeg, &len) != ESP_OK) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
     httpd_resp_set_type(req, "image/jpeg");
-    httpd_resp_send(req, (const char *)fb->buf, fb->len);
-    camera_free_fb(fb);
+    httpd_resp_send(req, (const char *)jpeg, len);
+    free(jpeg);
 
     return ESP_OK;
 }
@@ -267,6 +455,378 @@ static esp_err_t get_file_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/**
+ * Export sink state: total says whether the response has started
+ */
+typedef struct {
+    httpd_req_t *req;
+    size_t total;       // Bytes handed to httpd_resp_send_chunk so far
+} http_sink_t;
+
+/**
+ * Export sink writing HTTP chunks (ctx is an http_sink_t)
+ */
+static esp_err_t http_sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    http_sink_t *w = ctx;
+    // The first chunk sends the status line and headers, even if it fails
+    w->total += len;
+    return httpd_resp_send_chunk(w->req, (const char *)data, len);
+}
+
+/**
+ * Parse the session/fps query shared by the export endpoints
+ * Exporting every frame on the card must be asked for with all=1: a missing
+ * or truncated session would otherwise silently widen the export. Session
+ * names become file names, so path separators are rejected.
+ * Sends a 400 response on error.
+ * @param session Session prefix, "" when all=1
+ * @return ESP_OK, or ESP_FAIL after the error response was sent
+ */
+static esp_err_t parse_export_query(httpd_req_t *req, char *session, size_t session_len,
+                                    uint32_t *fps)
+{
+    session[0] = '\0';
+    *fps = 30;
+    bool all = false;
+
+    char query[96];
+    esp_err_t ret = httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (ret == ESP_OK) {
+        char param[16];
+        ret = httpd_query_key_value(query, "session", session, session_len);
+        if (httpd_query_key_value(query, "fps", param, sizeof(param)) == ESP_OK) {
+            *fps = atoi(param);
+        }
+        if (httpd_query_key_value(query, "all", param, sizeof(param)) == ESP_OK) {
+            all = strcmp(param, "1") == 0;
+        }
+    }
+
+    const char *error = NULL;
+    if (ret == ESP_ERR_HTTPD_RESULT_TRUNC) {
+        error = "Query or session name too long";
+    } else if (session[0] == '\0' && !all) {
+        error = "Specify session=<prefix> or all=1";
+    } else if (session[0] != '\0' && all) {
+        error = "session and all=1 are exclusive";
+    } else if (strchr(session, '/') != NULL || strstr(session, "..") != NULL) {
+        error = "Invalid session";
+    }
+    if (error != NULL) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Stream a session as MJPEG AVI
+ */
+static esp_err_t get_export_avi_handler(httpd_req_t *req)
+{
+    char session[32];
+    uint32_t fps;
+    if (parse_export_query(req, session, sizeof(session), &fps) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s.avi\"",
+             session[0] ? session : "timelapse");
+    httpd_resp_set_type(req, "video/x-msvideo");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+
+    http_sink_t w = { .req = req };
+    export_sink_t sink = {
+        .write = http_sink_write,
+        .ctx = &w,
+    };
+    esp_err_t ret = avi_export_stream(session, fps, &sink);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "AVI export failed: %s", esp_err_to_name(ret));
+        if (w.total == 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "AVI export failed");
+        }
+        // Once streaming has started, dropping the connection is the only
+        // way to signal a truncated body
+        return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * Export a session as MJPEG AVI onto the SD card
+ */
+static esp_err_t post_export_avi_handler(httpd_req_t *req)
+{
+    char session[32];
+    uint32_t fps;
+    if (parse_export_query(req, session, sizeof(session), &fps) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s.avi", EXPORT_OUTPUT_DIR,
+             session[0] ? session : "timelapse");
+
+    esp_err_t ret = avi_export_to_file(session, fps, path);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "status", ret == ESP_OK ? "exported" : "failed");
+    cJSON_AddStringToObject(root, "file", path);
+
+    char *json = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    free(json);
+
+    return ESP_OK;
+}
+
+/**
+ * Stream a whole session as a store-only ZIP
+ */
+static esp_err_t get_download_session_handler(httpd_req_t *req)
+{
+    char session[32];
+    uint32_t fps;
+    if (parse_export_query(req, session, sizeof(session), &fps) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s.zip\"",
+             session[0] ? session : "timelapse");
+    httpd_resp_set_type(req, "application/zip");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+
+    http_sink_t w = { .req = req };
+    export_sink_t sink = {
+        .write = http_sink_write,
+        .ctx = &w,
+    };
+    esp_err_t ret = zip_export_stream(session, &sink);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "ZIP export failed: %s", esp_err_to_name(ret));
+        if (w.total == 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "ZIP export failed");
+        }
+        return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * Frame an SSE event as one HTTP chunk
+ * @return malloc'd buffer (caller frees), NULL on allocation failure
+ */
+static char *push_format_chunk(const char *event, size_t *out_len)
+{
+    size_t body_len = strlen(event);
+    size_t cap = body_len + 32;
+    char *chunk = malloc(cap);
+    if (chunk == NULL) return NULL;
+
+    *out_len = snprintf(chunk, cap, "%x\r\n%s\r\n", (unsigned)body_len, event);
+    return chunk;
+}
+
+static void push_remove_subscriber(int fd)
+{
+    for (int i = 0; i < push_count; i++) {
+        if (push_fds[i] == fd) {
+            push_fds[i] = push_fds[--push_count];
+            ESP_LOGI(TAG, "Event subscriber %d left (%d active)", fd, push_count);
+            return;
+        }
+    }
+}
+
+/**
+ * Broadcast a pre-framed chunk to all subscribers (runs on the httpd task)
+ */
+static void push_broadcast_work(void *arg)
+{
+    char *chunk = (char *)arg;
+    size_t len = strlen(chunk);
+
+    for (int i = push_count - 1; i >= 0; i--) {
+        int fd = push_fds[i];
+        if (httpd_socket_send(server, fd, chunk, len, 0) < 0) {
+            push_remove_subscriber(fd);
+            httpd_sess_trigger_close(server, fd);
+        }
+    }
+    free(chunk);
+}
+
+/**
+ * Session close hook - drops SSE subscribers and closes the socket
+ */
+static void push_close_fn(httpd_handle_t hd, int sockfd)
+{
+    push_remove_subscriber(sockfd);
+    close(sockfd);
+}
+
+/**
+ * Queue an event for every subscriber
+ */
+static void push_send(const char *event)
+{
+    size_t len;
+    char *chunk = push_format_chunk(event, &len);
+    if (chunk == NULL) return;
+
+    xSemaphoreTake(api_mutex, portMAX_DELAY);
+    if (server == NULL || httpd_queue_work(server, push_broadcast_work, chunk) != ESP_OK) {
+        free(chunk);
+    }
+    xSemaphoreGive(api_mutex);
+}
+
+/**
+ * Status producer task
+ * Single producer for all /events subscribers: polls the cheap timelapse
+ * revision counter, samples the battery at a slow cadence, and pushes a
+ * delta only when something changed, at most once per PUSH_COALESCE_MS.
+ * Exits on its own when push_stop is set and the task is notified, so it is
+ * never killed while holding the FatFS lock or cJSON allocations.
+ */
+static void status_push_task(void *pvParameters)
+{
+    status_snapshot_t last = {0};
+    bool have_last = false;
+    uint32_t last_revision = 0;
+    int64_t last_battery_ms = 0;
+    int64_t last_send_ms = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PUSH_COALESCE_MS));
+        if (push_stop) {
+            break;
+        }
+
+        if (push_count == 0) {
+            have_last = false;
+            continue;
+        }
+
+        int64_t now_ms = esp_timer_get_time() / 1000;
+        uint32_t revision = timelapse_get_revision();
+        bool battery_due = (now_ms - last_battery_ms) >= PUSH_BATTERY_POLL_MS;
+
+        if (have_last && revision == last_revision && !battery_due) {
+            if (now_ms - last_send_ms >= PUSH_KEEPALIVE_MS) {
+                push_send(": keepalive\n\n");
+                last_send_ms = now_ms;
+            }
+            continue;
+        }
+
+        status_snapshot_t cur = last;
+        if (!have_last || revision != last_revision) {
+            // Includes the SD free-space query, so only on actual changes
+            timelapse_get_status(&cur.tl);
+        }
+        if (!have_last || battery_due) {
+            power_get_battery_status(&cur.battery);
+            last_battery_ms = now_ms;
+        }
+        last_revision = revision;
+
+        cJSON *delta = status_to_json(&cur, have_last ? &last : NULL);
+        if (cJSON_GetArraySize(delta) > 0) {
+            char *json = cJSON_PrintUnformatted(delta);
+            if (json != NULL) {
+                size_t ev_len = strlen(json) + 16;
+                char *event = malloc(ev_len);
+                if (event != NULL) {
+                    snprintf(event, ev_len, "data: %s\n\n", json);
+                    push_send(event);
+                    free(event);
+                    last_send_ms = now_ms;
+                }
+                free(json);
+            }
+        }
+
+        // Battery baseline only moves when a battery change was emitted,
+        // so slow drift still crosses the threshold eventually
+        if (have_last && cJSON_GetObjectItem(delta, "battery_percent") == NULL) {
+            cur.battery.percentage = last.battery.percentage;
+            cur.battery.voltage = last.battery.voltage;
+        }
+        cJSON_Delete(delta);
+
+        last = cur;
+        have_last = true;
+    }
+
+    xTaskNotifyGive(push_waiter);
+    vTaskDelete(NULL);
+}
+
+/**
+ * Subscribe to status events (Server-Sent Events)
+ * Sends a full snapshot, then keeps the socket for pushed deltas.
+ */
+static esp_err_t get_events_handler(httpd_req_t *req)
+{
+    if (push_count >= PUSH_MAX_SUBSCRIBERS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    status_snapshot_t snap;
+    status_snapshot(&snap);
+
+    cJSON *root = status_to_json(&snap, NULL);
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (json == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    // retry: tells EventSource how long to wait before reconnecting
+    httpd_resp_send_chunk(req, "retry: 3000\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "data: ", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, json, HTTPD_RESP_USE_STRLEN);
+    esp_err_t ret = httpd_resp_send_chunk(req, "\n\n", HTTPD_RESP_USE_STRLEN);
+    free(json);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Response is deliberately left unterminated; further chunks are
+    // written straight to the socket by push_broadcast_work
+    int fd = httpd_req_to_sockfd(req);
+    push_fds[push_count++] = fd;
+    ESP_LOGI(TAG, "Event subscriber %d joined (%d active)", fd, push_count);
+
+    return ESP_OK;
+}
+
 /**
  * Serve main HTML page
  */
@@ -304,7 +864,7 @@ static const char *html_template =
     "<header><h1>Timelapse Controller</h1></header>"
     "<div class=\"status-grid\" id=\"status\"></div>"
     "<div class=\"preview\">"
-    "<img id=\"preview\" src=\"/preview\" onload=\"this.style.display='block'\" onerror=\"this.style.display='none'\">"
+    "<img id=\"preview\" src=\"/preview\" title=\"Click to zoom\" onclick=\"zoomPreview()\" onload=\"this.style.display='block'\" onerror=\"this.style.display='none'\">"
     "</div>"
     "<div class=\"controls\">"
     "<button class=\"btn-start\" onclick=\"api('start')\">Start</button>"
@@ -320,7 +880,7 @@ static const char *html_template =
     "<div class=\"input-row\"><span class=\"input-label\">Time</span><button class=\"btn-capture\" style=\"width:100%\" onclick=\"syncTime()\">Sync from Device</button></div>"
     "<button class=\"btn-update\" onclick=\"updateConfig()\">Apply Settings</button>"
     "</div>"
-    "<div class=\"footer\">%s &bull; <a href=\"/files\">Gallery</a></div>"
+    "<div class=\"footer\">%s &bull; <a href=\"/files\">Gallery</a> &bull; <a href=\"/export_avi?all=1\">Video (all)</a> &bull; <a href=\"/download_session?all=1\">ZIP (all)</a></div>"
     "</div>"
     "<script>"
     "const $=id=>document.getElementById(id);"
@@ -330,7 +890,9 @@ static const char *html_template =
     "$('resolution').innerHTML=resOpts.map(o=>`<option value=\"${o.v}\">${o.t}</option>`).join('');"
     "$('quality').innerHTML=qOpts.map(v=>`<option value=\"${v}\">${v}</option>`).join('');"
     "}"
+    "let st={};"
     "function renderStatus(d){"
+    "if(d.state===undefined)return;"
     "const s=['Idle','Running','Paused','Done','Error'];"
     "const h=`"
     "<div class='stat-item'>State<div class='stat-val'>${s[d.state]}</div></div>"
@@ -345,17 +907,26 @@ static const char *html_template =
     "`;"
     "$('status').innerHTML=h;"
     "}"
-    "function update(){fetch('/status').then(r=>r.json()).then(renderStatus).catch(console.error);setTimeout(update,2000);}" 
+    "function update(){fetch('/status').then(r=>r.json()).then(d=>{st=d;renderStatus(st);}).catch(console.error);}"
+    "function poll(){update();setTimeout(poll,2000);}"
+    "function listen(){"
+    "if(!window.EventSource){poll();return;}"
+    "const es=new EventSource('/events');"
+    "es.onmessage=e=>{Object.assign(st,JSON.parse(e.data));renderStatus(st);};"
+    "setInterval(()=>{if(st.state===1&&st.next_shot_sec>0){st.next_shot_sec--;renderStatus(st);}},1000);"
+    "}"
     "function api(act){fetch('/'+act,{method:'POST'}).then(r=>r.json()).then(d=>{alert(d.status||'OK');update();});}"
     "function updateConfig(){"
     "const i=$('interval').value,s=$('shots').value,r=$('resolution').value,q=$('quality').value;"
     "fetch(`/config?interval=${i}&shots=${s}&resolution=${r}&quality=${q}`,{method:'POST'}).then(r=>r.json()).then(()=>{alert('Config Updated');update();});"
     "}"
+    "let zoom=1;"
+    "function zoomPreview(){zoom=zoom>=8?1:zoom*2;$('preview').src=`/preview?zoom=${zoom}&t=${Date.now()}`;}"
     "function syncTime(){const epoch=Math.floor(Date.now()/1000);fetch(`/time?epoch=${epoch}`,{method:'POST'}).then(r=>r.json()).then(()=>{alert('Time synced');update();});}"
     "function hydrateConfig(){fetch('/config').then(r=>r.json()).then(d=>{$('interval').value=d.interval_sec;$('shots').value=d.total_shots;$('resolution').value=d.resolution;$('quality').value=d.quality;});}"
     "hydrateSelects();"
     "hydrateConfig();"
-    "update();"
+    "listen();"
     "</script></body></html>";
 
 static esp_err_t get_index_handler(httpd_req_t *req)
@@ -373,6 +944,208 @@ static esp_err_t get_index_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/**
+ * Async worker task (pvParameters is its async_class_info_t)
+ * Runs queued slow handlers so the httpd task keeps serving short API calls.
+ * Each class has its own queue and max_running workers, so the worker count
+ * is the concurrency limit and idle workers block instead of polling.
+ */
+static void async_worker_task(void *pvParameters)
+{
+    async_class_info_t *cls = (async_class_info_t *)pvParameters;
+    async_job_t job;
+
+    while (1) {
+        if (xQueueReceive(cls->queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        metrics_run(job.route->handler, job.req, job.route->metrics_id, job.submit_us);
+        httpd_req_async_handler_complete(job.req);
+
+        xSemaphoreGive(cls->tickets);
+    }
+}
+
+/**
+ * Hand a request to the worker pool (user_ctx is its async_route_t)
+ */
+static esp_err_t async_submit_handler(httpd_req_t *req)
+{
+    const async_route_t *route = (const async_route_t *)req->user_ctx;
+    async_class_info_t *cls = &async_classes[route->cls];
+
+    int64_t submit_us = esp_timer_get_time();
+
+    if (!async_ready) {
+        return metrics_run(route->handler, req, route->metrics_id, submit_us);
+    }
+
+    if (!async_accepting || xSemaphoreTake(cls->tickets, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "%s handlers busy, rejecting %s", cls->name, req->uri);
+        metrics_record(route->metrics_id, 0, 0, true);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, "{\"status\":\"busy\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    async_job_t job = {
+        .route = route,
+        .submit_us = submit_us,
+    };
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        xSemaphoreGive(cls->tickets);
+        return metrics_run(route->handler, req, route->metrics_id, submit_us);
+    }
+
+    // Tickets bound the queue, so this cannot block
+    if (xQueueSend(cls->queue, &job, 0) != pdTRUE) {
+        httpd_resp_send_500(job.req);
+        httpd_req_async_handler_complete(job.req);
+        metrics_record(route->metrics_id, 0, 0, true);
+        xSemaphoreGive(cls->tickets);
+    }
+    return ESP_OK;
+}
+
+static async_route_t async_preview = {get_preview_handler, ASYNC_CLASS_CAMERA, -1};
+static async_route_t async_capture = {post_capture_handler, ASYNC_CLASS_CAMERA, -1};
+static async_route_t async_download = {get_file_handler, ASYNC_CLASS_STORAGE, -1};
+static async_route_t async_download_session = {get_download_session_handler, ASYNC_CLASS_STORAGE, -1};
+static async_route_t async_export_avi = {get_export_avi_handler, ASYNC_CLASS_STORAGE, -1};
+static async_route_t async_export_avi_file = {post_export_avi_handler, ASYNC_CLASS_STORAGE, -1};
+
+/**
+ * Instrumented entry point for every registered URI (user_ctx is its
+ * uri_metrics_t). Async routes record from the worker instead.
+ */
+static esp_err_t metrics_uri_handler(httpd_req_t *req)
+{
+    uri_metrics_t *m = (uri_metrics_t *)req->user_ctx;
+    req->user_ctx = m->uri->user_ctx;
+
+    if (m->uri->handler == async_submit_handler) {
+        return async_submit_handler(req);
+    }
+    return metrics_run(m->uri->handler, req, m->id, esp_timer_get_time());
+}
+
+/**
+ * Metrics in Prometheus text format
+ */
+static esp_err_t metrics_http_write(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+static esp_err_t get_metrics_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t ret = metrics_render(metrics_http_write, req);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/**
+ * Frame trace as Chrome trace-event JSON (load in chrome://tracing or Perfetto)
+ */
+static esp_err_t get_trace_handler(httpd_req_t *req)
+{
+#if TRACE_ENABLED
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"trace.json\"");
+    esp_err_t ret = trace_render_chrome(metrics_http_write, req);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+#else
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Tracing disabled (CONFIG_CAMERA_TRACE)");
+    return ESP_OK;
+#endif
+}
+
+/**
+ * Start the async worker pool
+ */
+static esp_err_t async_pool_init(void)
+{
+    int workers = 0;
+    for (int i = 0; i < ASYNC_CLASS_MAX; i++) {
+        async_class_info_t *cls = &async_classes[i];
+        int admissions = cls->max_running + cls->max_queued;
+        if (cls->queue == NULL) {
+            cls->queue = xQueueCreate(admissions, sizeof(async_job_t));
+        }
+        if (cls->tickets == NULL) {
+            cls->tickets = xSemaphoreCreateCounting(admissions, admissions);
+        }
+        if (cls->queue == NULL || cls->tickets == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    for (int i = 0; i < ASYNC_CLASS_MAX; i++) {
+        async_class_info_t *cls = &async_classes[i];
+        while (cls->workers < cls->max_running) {
+            if (xTaskCreate(async_worker_task, "http_async", ASYNC_WORKER_STACK,
+                            cls, 5, NULL) != pdPASS) {
+                ESP_LOGW(TAG, "Async %s worker %d not started", cls->name, cls->workers);
+                break;
+            }
+            cls->workers++;
+        }
+        if (cls->workers == 0) {
+            // A class without a worker would never drain its queue
+            return ESP_ERR_NO_MEM;
+        }
+        workers += cls->workers;
+    }
+
+    async_ready = true;
+    ESP_LOGI(TAG, "Async pool started (%d workers)", workers);
+    return ESP_OK;
+}
+
+/**
+ * Quiesce the async pool before httpd_stop frees the server
+ * Queued jobs are answered with 503, then every admission ticket is
+ * collected, which waits for the jobs still running on workers.
+ */
+static void async_pool_quiesce(void)
+{
+    if (!async_ready) {
+        return;
+    }
+    async_accepting = false;
+
+    for (int i = 0; i < ASYNC_CLASS_MAX; i++) {
+        async_class_info_t *cls = &async_classes[i];
+        async_job_t job;
+        while (xQueueReceive(cls->queue, &job, 0) == pdTRUE) {
+            metrics_record(job.route->metrics_id, 0, 0, true);
+            httpd_resp_set_status(job.req, "503 Service Unavailable");
+            httpd_resp_send(job.req, "{\"status\":\"stopping\"}", HTTPD_RESP_USE_STRLEN);
+            httpd_req_async_handler_complete(job.req);
+            xSemaphoreGive(cls->tickets);
+        }
+    }
+
+    for (int i = 0; i < ASYNC_CLASS_MAX; i++) {
+        async_class_info_t *cls = &async_classes[i];
+        int admissions = cls->max_running + cls->max_queued;
+        for (int t = 0; t < admissions; t++) {
+            xSemaphoreTake(cls->tickets, portMAX_DELAY);
+        }
+        for (int t = 0; t < admissions; t++) {
+            xSemaphoreGive(cls->tickets);
+        }
+    }
+}
+
 /**
  * URI handlers
  */
@@ -380,17 +1153,28 @@ static const httpd_uri_t uris[] = {
     {"/", HTTP_GET, get_index_handler, NULL},
     {"/index.html", HTTP_GET, get_index_handler, NULL},
     {"/status", HTTP_GET, get_status_handler, NULL},
+    {"/events", HTTP_GET, get_events_handler, NULL},
     {"/start", HTTP_POST, post_start_handler, NULL},
     {"/stop", HTTP_POST, post_stop_handler, NULL},
-    {"/capture", HTTP_POST, post_capture_handler, NULL},
+    {"/capture", HTTP_POST, async_submit_handler, (void *)&async_capture},
     {"/config", HTTP_GET, get_config_handler, NULL},
     {"/config", HTTP_POST, post_config_handler, NULL},
     {"/time", HTTP_POST, post_time_handler, NULL},
-    {"/preview", HTTP_GET, get_preview_handler, NULL},
+    {"/preview", HTTP_GET, async_submit_handler, (void *)&async_preview},
     {"/files", HTTP_GET, get_files_handler, NULL},
-    {"/download", HTTP_GET, get_file_handler, NULL}
+    {"/download", HTTP_GET, async_submit_handler, (void *)&async_download},
+    {"/download_session", HTTP_GET, async_submit_handler, (void *)&async_download_session},
+    {"/export_avi", HTTP_GET, async_submit_handler, (void *)&async_export_avi},
+    {"/export_avi", HTTP_POST, async_submit_handler, (void *)&async_export_avi_file},
+    {"/metrics", HTTP_GET, get_metrics_handler, NULL},
+    {"/trace", HTTP_GET, get_trace_handler, NULL}
 };
 
+#define URI_COUNT (sizeof(uris) / sizeof(uris[0]))
+
+static uri_metrics_t uri_metrics[URI_COUNT];
+static bool uri_metrics_registered = false;
+
 /**
  * Initialize web server
  */
@@ -403,6 +1187,13 @@ esp_err_t webserver_init(int port)
     server_port = port;
     api_mutex = xSemaphoreCreateMutex();
 
+    if (push_task == NULL) {
+        xTaskCreate(status_push_task, "status_push", 4096, NULL, 4, &push_task);
+    }
+    if (!async_ready && async_pool_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Async pool unavailable, slow handlers run inline");
+    }
+
     ESP_LOGI(TAG, "Web server initialized on port %d", port);
     return ESP_OK;
 }
@@ -412,10 +1203,16 @@ esp_err_t webserver_init(int port)
  */
 void webserver_deinit(void)
 {
-    if (server != NULL) {
-        httpd_stop(server);
-        server = NULL;
+    if (push_task != NULL) {
+        // Ask the producer to exit and wait until it has
+        push_waiter = xTaskGetCurrentTaskHandle();
+        push_stop = true;
+        xTaskNotifyGive(push_task);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        push_task = NULL;
+        push_stop = false;
     }
+    webserver_stop();
     if (api_mutex != NULL) {
         vSemaphoreDelete(api_mutex);
         api_mutex = NULL;
@@ -433,9 +1230,24 @@ esp_err_t webserver_start(void)
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = server_port;
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = 24;
     config.stack_size = 16384;
-    config.lru_purge_enable = true;
+
+    // Every socket the handlers can hold at once gets a slot: LRU purge is
+    // off because SSE pushes do not refresh a session's LRU stamp, so it
+    // would evict idle-looking subscribers first
+    int sockets = PUSH_MAX_SUBSCRIBERS + HTTPD_API_SOCKETS;
+    for (int i = 0; i < ASYNC_CLASS_MAX; i++) {
+        sockets += async_classes[i].max_running + async_classes[i].max_queued;
+    }
+    if (sockets > CONFIG_LWIP_MAX_SOCKETS - HTTPD_INTERNAL_SOCKETS) {
+        ESP_LOGW(TAG, "Socket budget %d exceeds CONFIG_LWIP_MAX_SOCKETS, clamped", sockets);
+        sockets = CONFIG_LWIP_MAX_SOCKETS - HTTPD_INTERNAL_SOCKETS;
+    }
+    config.max_open_sockets = sockets;
+    config.lru_purge_enable = false;
+    config.close_fn = push_close_fn;
+    config.open_fn = metrics_open_fn;
 
     esp_err_t ret = httpd_start(&server, &config);
     if (ret != ESP_OK) {
@@ -443,10 +1255,26 @@ esp_err_t webserver_start(void)
         return ret;
     }
 
-    // Register URI handlers
-    for (int i = 0; i < sizeof(uris) / sizeof(httpd_uri_t); i++) {
-        httpd_register_uri_handler(server, &uris[i]);
+    // Register URI handlers, each wrapped for metrics
+    for (int i = 0; i < URI_COUNT; i++) {
+        uri_metrics_t *m = &uri_metrics[i];
+        if (!uri_metrics_registered) {
+            m->uri = &uris[i];
+            snprintf(m->labels, sizeof(m->labels), "uri=\"%s\",method=\"%s\"",
+                     uris[i].uri, uris[i].method == HTTP_POST ? "POST" : "GET");
+            m->id = metrics_register(METRICS_FAMILY_HTTP, m->labels);
+            if (uris[i].handler == async_submit_handler) {
+                ((async_route_t *)uris[i].user_ctx)->metrics_id = m->id;
+            }
+        }
+
+        httpd_uri_t wrapped = uris[i];
+        wrapped.handler = metrics_uri_handler;
+        wrapped.user_ctx = m;
+        httpd_register_uri_handler(server, &wrapped);
     }
+    uri_metrics_registered = true;
+    async_accepting = true;
 
     ESP_LOGI(TAG, "Web server started");
     return ESP_OK;
@@ -461,8 +1289,14 @@ esp_err_t webserver_stop(void)
         return ESP_OK;
     }
 
+    // Async jobs hold request copies that point into the server
+    async_pool_quiesce();
+
+    xSemaphoreTake(api_mutex, portMAX_DELAY);
     httpd_stop(server);
     server = NULL;
+    push_count = 0;
+    xSemaphoreGive(api_mutex);
     ESP_LOGI(TAG, "Web server stopped");
     return ESP_OK;
 }
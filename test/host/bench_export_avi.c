@@ -0,0 +1,310 @@
+/*
+ * Host check and benchmark for the MJPEG AVI exporter (src/export/avi.c).
+ *
+ * Build and run from the repository root:
+ *   cc -O2 -Itest/host/include -Iinclude -include host_compat.h \
+ *      test/host/bench_export_avi.c test/host/sdcard_host.c src/export/avi.c src/export/export.c \
+ *      -o bench_export_avi
+ *   ./bench_export_avi managed_components/espressif__esp32-camera/test/pictures
+ *
+ * Builds a session from the pictures in a temporary SD root (one frame with
+ * an odd length, plus files that must be left out) and walks the exported
+ * RIFF: header sizes, avih/strh frame counts and dimensions, every movi
+ * chunk against its source file including the pad byte, and every idx1
+ * entry against the chunk it points to. Checks that frames resized between
+ * the scan and the copy fail the export. Then times the export of a larger
+ * session to a counting sink and to a file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "export.h"
+#include "sdcard_host.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                    \
+    do {                                    \
+        if (!(cond)) {                      \
+            printf("FAIL: " __VA_ARGS__);   \
+            printf("\n");                   \
+            failures++;                     \
+        }                                   \
+    } while (0)
+
+#define MAX_FRAMES  512
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} blob_t;
+
+static char root[64];
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool load_file(const char *path, blob_t *b)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    b->len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    b->data = malloc(b->len + 1);
+    bool ok = b->data && fread(b->data, 1, b->len, f) == b->len;
+    fclose(f);
+    return ok;
+}
+
+static void write_frame(const char *name, const uint8_t *data, size_t len)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, EXPORT_SESSION_DIR, name);
+    FILE *f = fopen(path, "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+/* Frame dimensions from the first SOF0-2 segment */
+static void jpeg_size(const blob_t *b, uint32_t *w, uint32_t *h)
+{
+    for (size_t i = 2; i + 9 < b->len && b->data[i] == 0xFF; i += 2 + ((b->data[i + 2] << 8) | b->data[i + 3])) {
+        if (b->data[i + 1] >= 0xC0 && b->data[i + 1] <= 0xC2) {
+            *h = (b->data[i + 5] << 8) | b->data[i + 6];
+            *w = (b->data[i + 7] << 8) | b->data[i + 8];
+            return;
+        }
+    }
+    *w = *h = 0;
+}
+
+/**
+ * Walk an exported AVI and compare it with the frames it was built from
+ */
+static void check_avi(const char *name, const blob_t *frames, int count, uint32_t fps)
+{
+    char path[256];
+    blob_t avi;
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    if (!load_file(path, &avi)) {
+        CHECK(false, "%s not written", name);
+        return;
+    }
+    const uint8_t *d = avi.data;
+    uint32_t w, h;
+    jpeg_size(&frames[0], &w, &h);
+
+    CHECK(memcmp(d, "RIFF", 4) == 0 && memcmp(d + 8, "AVI ", 4) == 0, "no RIFF/AVI header");
+    CHECK(get_u32(d + 4) == avi.len - 8, "RIFF size %u, file has %zu bytes", get_u32(d + 4), avi.len - 8);
+    CHECK(memcmp(d + 12, "LIST", 4) == 0 && memcmp(d + 20, "hdrl", 4) == 0, "no hdrl LIST");
+    size_t movi_list = 20 + get_u32(d + 16);
+
+    // avih, strh and strf sit at fixed offsets inside hdrl
+    CHECK(memcmp(d + 24, "avih", 4) == 0, "no avih");
+    CHECK(get_u32(d + 32) == 1000000 / fps, "dwMicroSecPerFrame %u", get_u32(d + 32));
+    CHECK(get_u32(d + 44) & 0x10, "AVIF_HASINDEX not set");
+    CHECK(get_u32(d + 48) == (uint32_t)count, "dwTotalFrames %u, expected %d", get_u32(d + 48), count);
+    CHECK(get_u32(d + 64) == w && get_u32(d + 68) == h, "avih size %ux%u, expected %ux%u",
+          get_u32(d + 64), get_u32(d + 68), w, h);
+    CHECK(memcmp(d + 100, "strh", 4) == 0 && memcmp(d + 108, "vids", 4) == 0 &&
+          memcmp(d + 112, "MJPG", 4) == 0, "no MJPG video strh");
+    CHECK(get_u32(d + 132) == fps && get_u32(d + 140) == (uint32_t)count, "strh rate %u length %u",
+          get_u32(d + 132), get_u32(d + 140));
+    CHECK(memcmp(d + 164, "strf", 4) == 0 && get_u32(d + 176) == w && get_u32(d + 180) == h, "strf size");
+
+    CHECK(memcmp(d + movi_list, "LIST", 4) == 0 && memcmp(d + movi_list + 8, "movi", 4) == 0, "no movi LIST");
+    size_t movi = movi_list + 8;
+    size_t idx1 = movi + get_u32(d + movi_list + 4);
+    if (idx1 + 8 > avi.len) {
+        CHECK(false, "movi LIST runs past the end of the file");
+        free(avi.data);
+        return;
+    }
+
+    // movi chunks, in order, byte-identical to the source files
+    size_t pos = movi + 4;
+    for (int i = 0; i < count && pos + 8 <= idx1; i++) {
+        uint32_t len = get_u32(d + pos + 4);
+        CHECK(memcmp(d + pos, "00dc", 4) == 0, "frame %d: chunk id", i);
+        CHECK(len == frames[i].len && memcmp(d + pos + 8, frames[i].data, len) == 0,
+              "frame %d: %u bytes differ from the %zu byte source", i, len, frames[i].len);
+        if (len & 1) {
+            CHECK(d[pos + 8 + len] == 0, "frame %d: pad byte", i);
+        }
+        pos += 8 + len + (len & 1);
+    }
+    CHECK(pos == idx1, "movi chunks end at %zu, LIST size says %zu", pos, idx1);
+
+    // idx1 entries point at the chunks they describe
+    CHECK(memcmp(d + idx1, "idx1", 4) == 0, "no idx1");
+    CHECK(get_u32(d + idx1 + 4) == 16u * count, "idx1 size %u", get_u32(d + idx1 + 4));
+    CHECK(idx1 + 8 + 16u * count == avi.len, "trailing bytes after idx1");
+    for (int i = 0; i < count && idx1 + 8 + 16 * (i + 1) <= avi.len; i++) {
+        const uint8_t *e = d + idx1 + 8 + 16 * i;
+        uint32_t off = get_u32(e + 8);
+        CHECK(memcmp(e, "00dc", 4) == 0 && (get_u32(e + 4) & 0x10), "idx1 %d: id/flags", i);
+        CHECK(movi + off + 8 <= idx1 && memcmp(d + movi + off, "00dc", 4) == 0 &&
+              get_u32(d + movi + off + 4) == get_u32(e + 12) && get_u32(e + 12) == frames[i].len,
+              "idx1 %d: offset %u / size %u do not match the chunk", i, off, get_u32(e + 12));
+    }
+    free(avi.data);
+}
+
+static esp_err_t count_sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    *(uint64_t *)ctx += len;
+    return ESP_OK;
+}
+
+/* Sink that grows every frame of session A by one byte on its first write */
+static esp_err_t growing_sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    bool *grown = (bool *)ctx;
+    if (!*grown) {
+        *grown = true;
+        for (int i = 0; i < 30; i++) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s/TL_A_%04d.jpg", root, EXPORT_SESSION_DIR, i);
+            FILE *f = fopen(path, "ab");
+            fputc(0, f);
+            fclose(f);
+        }
+    }
+    (void)data;
+    (void)len;
+    return ESP_OK;
+}
+
+/* Frame order as the exporter sees it (directory order, not name order) */
+typedef struct {
+    const char *session;
+    blob_t *frames;
+    int count;
+} order_ctx_t;
+
+static bool order_cb(const char *name, bool is_dir, void *arg)
+{
+    order_ctx_t *o = (order_ctx_t *)arg;
+    if (!is_dir && export_is_session_frame(name, o->session) && o->count < MAX_FRAMES) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s/%s", root, EXPORT_SESSION_DIR, name);
+        load_file(path, &o->frames[o->count++]);
+    }
+    return true;
+}
+
+static int session_frames(const char *session, blob_t *frames)
+{
+    order_ctx_t o = { session, frames, 0 };
+    sdcard_foreach_file(EXPORT_SESSION_DIR, order_cb, &o);
+    return o.count;
+}
+
+static void free_frames(blob_t *frames, int count)
+{
+    for (int i = 0; i < count; i++) {
+        free(frames[i].data);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *pic_dir = argc > 1 ? argv[1] : "managed_components/espressif__esp32-camera/test/pictures";
+    static const char *pic_names[] = { "test_inside.jpeg", "test_outside.jpeg", "testimg.jpeg" };
+    blob_t pics[3];
+    for (int i = 0; i < 3; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", pic_dir, pic_names[i]);
+        if (!load_file(path, &pics[i])) {
+            printf("cannot read %s\n", path);
+            return 1;
+        }
+    }
+
+    strcpy(root, "/tmp/avi_host_XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        return 1;
+    }
+    sdcard_host_set_root(root);
+    sdcard_mkdir(EXPORT_SESSION_DIR);
+    sdcard_mkdir(EXPORT_SESSION_DIR "/sub.jpg");
+
+    // Session A: 30 frames, frame 7 with an odd length; other files are not frames of it
+    char name[64];
+    for (int i = 0; i < 30; i++) {
+        const blob_t *p = &pics[i % 3];
+        snprintf(name, sizeof(name), "TL_A_%04d.jpg", i);
+        write_frame(name, p->data, p->len + (i == 7));
+    }
+    write_frame("TL_B_0000.jpg", pics[0].data, pics[0].len);
+    write_frame("TL_A_notes.txt", pics[0].data, 16);
+
+    static blob_t frames[MAX_FRAMES];
+    int count = session_frames("TL_A", frames);
+    CHECK(count == 30, "session A has %d frames", count);
+    CHECK(avi_export_to_file("TL_A", 12, EXPORT_OUTPUT_DIR "/a.avi") == ESP_OK, "export of session A");
+    check_avi(EXPORT_OUTPUT_DIR "/a.avi", frames, count, 12);
+    free_frames(frames, count);
+
+    uint64_t total = 0;
+    export_sink_t count_sink = { count_sink_write, &total };
+    CHECK(avi_export_stream("TL_NONE", 10, &count_sink) == ESP_ERR_NOT_FOUND, "empty session not rejected");
+    CHECK(avi_export_to_file("TL_NONE", 10, EXPORT_OUTPUT_DIR "/none.avi") != ESP_OK &&
+          sdcard_get_file_size(EXPORT_OUTPUT_DIR "/none.avi") < 0, "failed export left a file");
+    printf("structure: RIFF/hdrl/movi/idx1 checked for %d frames\n", count);
+
+    // Frames that change size after the scan must fail the export, not corrupt it
+    bool grown = false;
+    export_sink_t growing_sink = { growing_sink_write, &grown };
+    CHECK(avi_export_stream("TL_A", 12, &growing_sink) == ESP_ERR_INVALID_STATE,
+          "frames resized during export not detected");
+    printf("consistency: frames resized after the scan fail with ESP_ERR_INVALID_STATE\n");
+
+    // Throughput: 300 frames (about 10 MB), best of 3
+    for (int i = 0; i < 300; i++) {
+        snprintf(name, sizeof(name), "TL_C_%04d.jpg", i);
+        write_frame(name, pics[i % 3].data, pics[i % 3].len);
+    }
+    double best_sink = 1e9, best_file = 1e9;
+    for (int n = 0; n < 3; n++) {
+        total = 0;
+        double t0 = now_s();
+        CHECK(avi_export_stream("TL_C", 10, &count_sink) == ESP_OK, "stream export of session C");
+        double t1 = now_s();
+        CHECK(avi_export_to_file("TL_C", 10, EXPORT_OUTPUT_DIR "/c.avi") == ESP_OK, "file export of session C");
+        double t2 = now_s();
+        best_sink = t1 - t0 < best_sink ? t1 - t0 : best_sink;
+        best_file = t2 - t1 < best_file ? t2 - t1 : best_file;
+    }
+    count = session_frames("TL_C", frames);
+    check_avi(EXPORT_OUTPUT_DIR "/c.avi", frames, count, 10);
+    free_frames(frames, count);
+    printf("throughput: %d frames, %.1f MB: sink %.1f MB/s (%.0f frames/s), file %.1f MB/s\n",
+           count, total / 1e6, total / 1e6 / best_sink, count / best_sink, total / 1e6 / best_file);
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    system(cmd);
+    for (int i = 0; i < 3; i++) {
+        free(pics[i].data);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
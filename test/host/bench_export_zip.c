@@ -0,0 +1,299 @@
+/*
+ * Host check and benchmark for the streaming ZIP exporter (src/export/zip.c).
+ *
+ * Build and run from the repository root (needs Info-ZIP unzip on the PATH):
+ *   cc -O2 -Itest/host/include -Iinclude -include host_compat.h \
+ *      test/host/bench_export_zip.c test/host/sdcard_host.c src/export/zip.c src/export/export.c \
+ *      -o bench_export_zip
+ *   ./bench_export_zip managed_components/espressif__esp32-camera/test/pictures [--large]
+ *
+ * Every archive is written through zip_export_stream into a temporary SD
+ * root, verified with `unzip -t` and its entry count compared with
+ * `unzip -Zt`. Covered paths:
+ *   - the data-descriptor layout (zero CRC in the local header, CRC and
+ *     sizes after the data), checked byte-wise on the first entry
+ *   - ZIP64 end records for more than 65534 entries
+ *   - with --large, ZIP64 central directory offsets past 4 GB (three
+ *     1.5 GB sparse frames; needs about 4.5 GB of free space)
+ * Then times the export of a 300-frame session.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "export.h"
+#include "sdcard_host.h"
+#include "esp_rom_crc.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                    \
+    do {                                    \
+        if (!(cond)) {                      \
+            printf("FAIL: " __VA_ARGS__);   \
+            printf("\n");                   \
+            failures++;                     \
+        }                                   \
+    } while (0)
+
+#define MANY_ENTRIES    70000   // Past the 0xFFFF entry limit of the classic EOCD
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} blob_t;
+
+static char root[64];
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool load_file(const char *path, blob_t *b)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    b->len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    b->data = malloc(b->len + 1);  // Room for the odd-length test frame
+    bool ok = b->data && fread(b->data, 1, b->len, f) == b->len;
+    fclose(f);
+    return ok;
+}
+
+static void write_frame(const char *name, const uint8_t *data, size_t len)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, EXPORT_SESSION_DIR, name);
+    FILE *f = fopen(path, "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+/* Sparse frame of the given size (zeros, no disk blocks until read) */
+static void write_sparse_frame(const char *name, off_t len)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, EXPORT_SESSION_DIR, name);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    CHECK(fd >= 0 && ftruncate(fd, len) == 0, "sparse frame %s", name);
+    close(fd);
+}
+
+/**
+ * Export a session to a file under the SD root
+ * @return Archive size, 0 on failure
+ */
+static uint64_t export_zip(const char *session, const char *name, double *seconds)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *f = fopen(path, "wb");
+    export_sink_t sink = { export_file_sink_write, f };
+
+    double t0 = now_s();
+    esp_err_t ret = zip_export_stream(session, &sink);
+    fclose(f);
+    if (seconds) {
+        *seconds = now_s() - t0;
+    }
+    CHECK(ret == ESP_OK, "zip_export_stream(%s) returned %d", session, ret);
+    return ret == ESP_OK ? sdcard_get_file_size(name) : 0;
+}
+
+/**
+ * Run unzip -t on an archive
+ * @return true if unzip reports no errors for the expected entry count
+ */
+static bool unzip_test(const char *name, int entries)
+{
+    char cmd[320], line[512];
+    snprintf(cmd, sizeof(cmd), "unzip -tqq %s/%s 2>&1; echo \"exit $?\"", root, name);
+    FILE *p = popen(cmd, "r");
+    bool ok = false;
+    while (fgets(line, sizeof(line), p)) {
+        if (strcmp(line, "exit 0\n") == 0) {
+            ok = true;
+        } else if (strncmp(line, "exit", 4) != 0) {
+            printf("  unzip: %s", line);
+        }
+    }
+    pclose(p);
+
+    // Listing: "<N> files, ..." trailer from zipinfo
+    snprintf(cmd, sizeof(cmd), "unzip -Zt %s/%s 2>&1", root, name);
+    p = popen(cmd, "r");
+    int listed = -1;
+    if (fgets(line, sizeof(line), p)) {
+        sscanf(line, "%d files", &listed);
+    }
+    pclose(p);
+    CHECK(listed == entries, "%s: zipinfo lists %d entries, expected %d", name, listed, entries);
+    return ok;
+}
+
+/**
+ * Check the first entry's local header and data descriptor against its source
+ */
+static void check_descriptor(const char *name, const char *frame, const blob_t *src)
+{
+    char path[256];
+    blob_t zip;
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    if (!load_file(path, &zip)) {
+        CHECK(false, "%s not written", name);
+        return;
+    }
+    const uint8_t *d = zip.data;
+    uint32_t name_len = get_u16(d + 26);
+    const uint8_t *desc = d + 30 + name_len + src->len;
+    uint32_t crc = esp_rom_crc32_le(0, src->data, src->len);
+
+    CHECK(get_u32(d) == 0x04034b50, "no local header");
+    CHECK(get_u16(d + 6) & 0x0008, "data descriptor flag not set");
+    CHECK(get_u16(d + 8) == 0, "entry not stored");
+    CHECK(get_u32(d + 14) == 0, "local header CRC should be deferred to the descriptor");
+    CHECK(get_u32(d + 18) == src->len && get_u32(d + 22) == src->len, "local header sizes");
+    CHECK(name_len == strlen(frame) && memcmp(d + 30, frame, name_len) == 0, "local header name");
+    CHECK(memcmp(d + 30 + name_len, src->data, src->len) == 0, "stored data differs from the frame");
+    CHECK(get_u32(desc) == 0x08074b50 && get_u32(desc + 4) == crc &&
+          get_u32(desc + 8) == src->len && get_u32(desc + 12) == src->len,
+          "data descriptor: crc %08x, expected %08x", get_u32(desc + 4), crc);
+    free(zip.data);
+}
+
+int main(int argc, char **argv)
+{
+    const char *pic_dir = "managed_components/espressif__esp32-camera/test/pictures";
+    bool large = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--large") == 0) {
+            large = true;
+        } else {
+            pic_dir = argv[i];
+        }
+    }
+    static const char *pic_names[] = { "test_inside.jpeg", "test_outside.jpeg", "testimg.jpeg" };
+    blob_t pics[3];
+    for (int i = 0; i < 3; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", pic_dir, pic_names[i]);
+        if (!load_file(path, &pics[i])) {
+            printf("cannot read %s\n", path);
+            return 1;
+        }
+    }
+
+    strcpy(root, "/tmp/zip_host_XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        return 1;
+    }
+    sdcard_host_set_root(root);
+    sdcard_mkdir(EXPORT_SESSION_DIR);
+    sdcard_mkdir(EXPORT_SESSION_DIR "/sub.jpg");
+
+    // Small session with data descriptors; other sessions and non-frames are left out
+    char name[64];
+    for (int i = 0; i < 30; i++) {
+        snprintf(name, sizeof(name), "TL_A_%04d.jpg", i);
+        write_frame(name, pics[i % 3].data, pics[i % 3].len + (i == 7));
+    }
+    write_frame("TL_B_0000.jpg", pics[0].data, pics[0].len);
+    write_frame("TL_A_notes.txt", pics[0].data, 16);
+    write_frame("TL_A_empty.jpg", pics[0].data, 0);
+
+    CHECK(export_zip("TL_A", "a.zip", NULL) > 0, "session A");
+    CHECK(unzip_test("a.zip", 30), "unzip -t a.zip");
+
+    // The first entry is whichever frame the directory listing returns first
+    char cmd[320], first[64] = "";
+    snprintf(cmd, sizeof(cmd), "unzip -Z1 %s/a.zip | head -1", root);
+    FILE *p = popen(cmd, "r");
+    if (fgets(first, sizeof(first), p)) {
+        first[strcspn(first, "\n")] = '\0';
+    }
+    pclose(p);
+    blob_t src;
+    snprintf(cmd, sizeof(cmd), "%s/%s/%s", root, EXPORT_SESSION_DIR, first);
+    if (first[0] != '\0' && load_file(cmd, &src)) {
+        check_descriptor("a.zip", first, &src);
+        free(src.data);
+    } else {
+        CHECK(false, "first entry '%s' is not a session frame", first);
+    }
+
+    export_sink_t null_sink = { export_file_sink_write, NULL };
+    CHECK(zip_export_stream("TL_NONE", &null_sink) == ESP_ERR_NOT_FOUND, "empty session not rejected");
+    printf("descriptors: 30 entries pass unzip -t, local header/descriptor checked on %s\n", first);
+
+    // ZIP64 end records: more entries than the classic EOCD can count
+    for (int i = 0; i < MANY_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "TL_M_%05d.jpg", i);
+        write_frame(name, pics[2].data, 64 + i % 64);
+    }
+    uint64_t many = export_zip("TL_M", "many.zip", NULL);
+    CHECK(many > 0 && unzip_test("many.zip", MANY_ENTRIES), "unzip -t many.zip");
+    printf("zip64 entries: %d entries, %.1f MB pass unzip -t\n", MANY_ENTRIES, many / 1e6);
+    snprintf(cmd, sizeof(cmd), "find %s/%s -name 'TL_M_*' -delete", root, EXPORT_SESSION_DIR);
+    system(cmd);
+
+    // ZIP64 offsets: central directory entries past 4 GB
+    if (large) {
+        for (int i = 0; i < 3; i++) {
+            snprintf(name, sizeof(name), "TL_L_%d.jpg", i);
+            write_sparse_frame(name, 1536LL << 20);
+        }
+        write_frame("TL_L_3.jpg", pics[2].data, pics[2].len);
+        double dt;
+        uint64_t size = export_zip("TL_L", "large.zip", &dt);
+        CHECK(size > 0xFFFFFFFFULL, "large archive is only %llu bytes", (unsigned long long)size);
+        CHECK(unzip_test("large.zip", 4), "unzip -t large.zip");
+        printf("zip64 offsets: %.2f GB archive in %.1f s passes unzip -t\n", size / 1e9, dt);
+        snprintf(cmd, sizeof(cmd), "rm -f %s/large.zip %s/%s/TL_L_*", root, root, EXPORT_SESSION_DIR);
+        system(cmd);
+    }
+
+    // Throughput: 300 frames (about 10 MB), best of 3
+    for (int i = 0; i < 300; i++) {
+        snprintf(name, sizeof(name), "TL_C_%04d.jpg", i);
+        write_frame(name, pics[i % 3].data, pics[i % 3].len);
+    }
+    double best = 1e9;
+    uint64_t size = 0;
+    for (int n = 0; n < 3; n++) {
+        double dt;
+        size = export_zip("TL_C", "c.zip", &dt);
+        best = dt < best ? dt : best;
+    }
+    CHECK(unzip_test("c.zip", 300), "unzip -t c.zip");
+    printf("throughput: 300 frames, %.1f MB in %.1f ms (%.1f MB/s, CRC included)\n",
+           size / 1e6, best * 1e3, size / 1e6 / best);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    system(cmd);
+    for (int i = 0; i < 3; i++) {
+        free(pics[i].data);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * Host stand-in for the FreeRTOS primitives the application modules use:
+ * tasks, counting semaphores, event groups and software timers on top of
+ * pthreads. Ticks are milliseconds on CLOCK_MONOTONIC. There is no
+ * scheduler, so priorities and stack sizes are ignored.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+struct host_timer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    int64_t expiry_ms;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+} host_task_t;
+
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static int64_t host_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void host_abs_time(struct timespec *ts, int64_t ms)
+{
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (long)(ms % 1000) * 1000000;
+}
+
+/* Condition variables wait on CLOCK_MONOTONIC, like the tick count */
+static void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Wait on cond until woken or the tick deadline passes (lock held)
+ * @return false on timeout
+ */
+static bool host_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline_ms)
+{
+    if (deadline_ms < 0) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    struct timespec ts;
+    host_abs_time(&ts, deadline_ms);
+    return pthread_cond_timedwait(cond, lock, &ts) != ETIMEDOUT;
+}
+
+static int64_t host_deadline(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? -1 : host_now_ms() + ticks * portTICK_PERIOD_MS;
+}
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+UBaseType_t host_critical_enter(void)
+{
+    pthread_once(&critical_once, critical_init);
+    pthread_mutex_lock(&critical_lock);
+    return 0;
+}
+
+void host_critical_exit(UBaseType_t state)
+{
+    (void)state;
+    pthread_mutex_unlock(&critical_lock);
+}
+
+/* Tasks */
+
+static void *task_entry(void *arg)
+{
+    host_task_t task = *(host_task_t *)arg;
+    free(arg);
+    task.fn(task.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+    host_task_t *task = malloc(sizeof(*task));
+    pthread_t thread;
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&thread, NULL, task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle != NULL) {
+        fprintf(stderr, "E (freertos_host) vTaskDelete of another task is not supported\n");
+        abort();
+    }
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts;
+    host_abs_time(&ts, host_now_ms() + ticks * portTICK_PERIOD_MS);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_now_ms() / portTICK_PERIOD_MS);
+}
+
+/* Semaphores */
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    host_cond_init(&sem->cond);
+    sem->count = initial_count;
+    sem->max = max_count;
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    int64_t deadline = host_deadline(ticks);
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (!host_cond_wait(&sem->cond, &sem->lock, deadline) && sem->count == 0) {
+            pthread_mutex_unlock(&sem->lock);
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count >= sem->max) {
+        pthread_mutex_unlock(&sem->lock);
+        return pdFALSE;
+    }
+    sem->count++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+/* Event groups */
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    EventGroupHandle_t group = calloc(1, sizeof(*group));
+    if (group == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    host_cond_init(&group->cond);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t bits = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    int64_t deadline = host_deadline(ticks);
+    pthread_mutex_lock(&group->lock);
+    for (;;) {
+        EventBits_t set = group->bits & bits;
+        if (wait_for_all ? set == bits : set != 0) {
+            break;
+        }
+        if (!host_cond_wait(&group->cond, &group->lock, deadline)) {
+            break;
+        }
+    }
+    EventBits_t result = group->bits;
+    if (clear_on_exit && (wait_for_all ? (result & bits) == bits : (result & bits) != 0)) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
+
+/* Software timers */
+
+static void *timer_thread(void *arg)
+{
+    TimerHandle_t timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    for (;;) {
+        if (!timer->active) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        if (host_cond_wait(&timer->cond, &timer->lock, timer->expiry_ms) ||
+            !timer->active || host_now_ms() < timer->expiry_ms) {
+            continue;   // Restarted, stopped or woken early
+        }
+        if (timer->auto_reload) {
+            timer->expiry_ms += timer->period * portTICK_PERIOD_MS;
+        } else {
+            timer->active = false;
+        }
+        // The timer service task runs callbacks without holding timer state
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer);
+        pthread_mutex_lock(&timer->lock);
+    }
+    return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback)
+{
+    (void)name;
+    TimerHandle_t timer = calloc(1, sizeof(*timer));
+    if (timer == NULL || period == 0) {
+        free(timer);
+        return NULL;
+    }
+    pthread_mutex_init(&timer->lock, NULL);
+    host_cond_init(&timer->cond);
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0) {
+        free(timer);
+        return NULL;
+    }
+    pthread_detach(timer->thread);
+    return timer;
+}
+
+static void timer_arm(TimerHandle_t timer, bool active)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->active = active;
+    timer->expiry_ms = host_now_ms() + timer->period * portTICK_PERIOD_MS;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    timer_arm(timer, true);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    timer_arm(timer, false);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks)
+{
+    (void)ticks;
+    if (period == 0) {
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&timer->lock);
+    timer->period = period;
+    pthread_mutex_unlock(&timer->lock);
+    timer_arm(timer, true);
+    return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,26 @@
+/* Minimal esp_heap_caps.h for building the application modules with a plain host compiler */
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+static inline void *heap_caps_malloc(size_t size, unsigned int caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void *heap_caps_realloc(void *ptr, size_t size, unsigned int caps)
+{
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
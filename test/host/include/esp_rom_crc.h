@@ -0,0 +1,25 @@
+/* Minimal esp_rom_crc.h for building the exporters with a plain host compiler */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC-32 (IEEE 802.3, reflected), same convention as the ROM function */
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (len--) {
+        crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,32 @@
+/* Minimal FreeRTOS.h for running the application modules on pthreads with a plain host compiler */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFF)
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define portNUM_PROCESSORS      1
+
+/* Interrupt masking maps to one process-wide recursive lock */
+UBaseType_t host_critical_enter(void);
+void host_critical_exit(UBaseType_t state);
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()       host_critical_enter()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)    host_critical_exit(x)
+
+static inline BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
@@ -0,0 +1,15 @@
+/* Minimal FreeRTOS semphr.h: counting semaphores on a pthread mutex and condition */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_sem *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+/* No priority inheritance or owner checks; a mutex is a binary semaphore given once */
+#define xSemaphoreCreateMutex()     xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreCreateBinary()    xSemaphoreCreateCounting(1, 0)
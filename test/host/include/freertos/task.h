@@ -0,0 +1,18 @@
+/* Minimal FreeRTOS task.h: tasks are detached pthreads, ticks are milliseconds */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/* Stack depth and priority are ignored */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle);
+
+/* Only the calling task can delete itself (handle NULL) */
+void vTaskDelete(TaskHandle_t handle);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
@@ -0,0 +1,15 @@
+/* Minimal FreeRTOS timers.h: each software timer runs its callbacks on its own pthread */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks);
+/* Like FreeRTOS, also starts a dormant timer */
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks);
+void *pvTimerGetTimerID(TimerHandle_t timer);
@@ -0,0 +1,9 @@
+/* Minimal nvs_flash.h; see nvs.h */
+#pragma once
+
+#include "nvs.h"
+
+static inline esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,10 @@
+/* Host stand-in for the SD card driver: sdcard.h paths resolve under a directory */
+#pragma once
+
+#include "sdcard.h"
+
+/**
+ * Set the directory that plays the SD card root
+ * @param root Existing directory; the path is not copied
+ */
+void sdcard_host_set_root(const char *root);
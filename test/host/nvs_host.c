@@ -0,0 +1,155 @@
+/*
+ * Host stand-in for NVS: blobs in a fixed table in process memory. Writes
+ * are visible at once (nvs_commit has nothing to flush), so a module that
+ * is re-initialized within a run reads back what it saved, as after a
+ * reboot on the chip.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nvs.h"
+
+#define NVS_HOST_ENTRIES    32
+#define NVS_HOST_HANDLES    8
+#define NVS_HOST_NAME_LEN   16      // Same limit as NVS keys and namespaces
+#define NVS_HOST_BLOB_SIZE  512
+
+typedef struct {
+    bool used;
+    char name_space[NVS_HOST_NAME_LEN];
+    char key[NVS_HOST_NAME_LEN];
+    size_t len;
+    uint8_t data[NVS_HOST_BLOB_SIZE];
+} nvs_entry_t;
+
+typedef struct {
+    bool open;
+    bool writable;
+    char name_space[NVS_HOST_NAME_LEN];
+} nvs_open_handle_t;
+
+static nvs_entry_t entries[NVS_HOST_ENTRIES];
+static nvs_open_handle_t handles[NVS_HOST_HANDLES];
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static nvs_entry_t *find_entry(const char *name_space, const char *key)
+{
+    for (int i = 0; i < NVS_HOST_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].name_space, name_space) == 0 &&
+            (key == NULL || strcmp(entries[i].key, key) == 0)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Open handle for a handle value (nvs_lock held), NULL if invalid */
+static nvs_open_handle_t *get_handle(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > NVS_HOST_HANDLES || !handles[handle - 1].open) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    if (name_space == NULL || strlen(name_space) >= NVS_HOST_NAME_LEN || handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    if (mode == NVS_READONLY && find_entry(name_space, NULL) == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (int i = 0; i < NVS_HOST_HANDLES; i++) {
+        if (!handles[i].open) {
+            handles[i].open = true;
+            handles[i].writable = mode == NVS_READWRITE;
+            strcpy(handles[i].name_space, name_space);
+            *handle = i + 1;
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    nvs_entry_t *e = h ? find_entry(h->name_space, key) : NULL;
+    if (h == NULL) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (e == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out == NULL) {
+        *length = e->len;
+    } else if (*length < e->len) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        memcpy(out, e->data, e->len);
+        *length = e->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (key == NULL || strlen(key) >= NVS_HOST_NAME_LEN || length > NVS_HOST_BLOB_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h == NULL || !h->writable) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_entry_t *e = find_entry(h->name_space, key);
+    for (int i = 0; e == NULL && i < NVS_HOST_ENTRIES; i++) {
+        if (!entries[i].used) {
+            e = &entries[i];
+            e->used = true;
+            strcpy(e->name_space, h->name_space);
+            strcpy(e->key, key);
+        }
+    }
+    if (e == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(e->data, value, length);
+    e->len = length;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = get_handle(handle) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h) {
+        h->open = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void nvs_host_erase_all(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    memset(entries, 0, sizeof(entries));
+    pthread_mutex_unlock(&nvs_lock);
+}
@@ -0,0 +1,124 @@
+/*
+ * Host stand-in for src/sdcard/sdcard.c, used by the host checks in this
+ * directory. Implements the subset of sdcard.h the export and timelapse
+ * modules use on top of POSIX; like FatFS, directory iteration does not
+ * report "." and "..".
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include "sdcard_host.h"
+
+static const char *host_root = NULL;
+
+void sdcard_host_set_root(const char *root)
+{
+    host_root = root;
+}
+
+static void host_path(char *buf, size_t size, const char *path)
+{
+    if (path == NULL || path[0] == '\0') {
+        snprintf(buf, size, "%s", host_root);
+    } else {
+        snprintf(buf, size, "%s/%s", host_root, path);
+    }
+}
+
+void sdcard_get_info(sdcard_info_t *info)
+{
+    struct statvfs vfs;
+    if (info == NULL) {
+        return;
+    }
+    memset(info, 0, sizeof(*info));
+    if (host_root == NULL || statvfs(host_root, &vfs) != 0) {
+        return;
+    }
+    snprintf(info->card_name, sizeof(info->card_name), "HOST");
+    info->card_size = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+    info->free_space = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    info->used_space = info->card_size - (uint64_t)vfs.f_bfree * vfs.f_frsize;
+    info->initialized = true;
+}
+
+bool sdcard_is_ready(void)
+{
+    return host_root != NULL;
+}
+
+esp_err_t sdcard_write_file(const char *path, const uint8_t *data, size_t len)
+{
+    return sdcard_write_frame(path, data, len, 0);
+}
+
+esp_err_t sdcard_write_frame(const char *path, const uint8_t *data, size_t len,
+                             uint32_t trace_frame)
+{
+    (void)trace_frame;
+    FILE *f = sdcard_fopen(path, "wb");
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    size_t written = fwrite(data, 1, len, f);
+    return fclose(f) == 0 && written == len ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sdcard_foreach_file(const char *path, sdcard_dir_cb_t cb, void *ctx)
+{
+    char dir_path[512];
+    host_path(dir_path, sizeof(dir_path), path);
+
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (!cb(entry->d_name, entry->d_type == DT_DIR, ctx)) {
+            break;
+        }
+    }
+    closedir(dir);
+    return ESP_OK;
+}
+
+FILE *sdcard_fopen(const char *path, const char *mode)
+{
+    char full[512];
+    host_path(full, sizeof(full), path);
+    return fopen(full, mode);
+}
+
+int64_t sdcard_get_file_size(const char *path)
+{
+    char full[512];
+    struct stat st;
+    host_path(full, sizeof(full), path);
+    return stat(full, &st) == 0 ? (int64_t)st.st_size : -1;
+}
+
+esp_err_t sdcard_mkdir(const char *path)
+{
+    char full[512];
+    struct stat st;
+    host_path(full, sizeof(full), path);
+    if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) {
+        return ESP_OK;
+    }
+    return mkdir(full, 0755) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sdcard_delete_file(const char *path)
+{
+    char full[512];
+    host_path(full, sizeof(full), path);
+    return unlink(full) == 0 ? ESP_OK : ESP_FAIL;
+}